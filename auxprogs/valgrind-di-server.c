@@ -88,9 +88,10 @@
                                     // pub_core_libcfile.h
 #include "pub_core_libcfile.h"      // For VG_CLO_DEFAULT_LOGPORT
 
-/* Needed to get a definition for pread() from unistd.h */
+/* Needed to get a definition for pread() from unistd.h, and
+   st_mtim in struct stat */
 #ifndef _XOPEN_SOURCE
-#define _XOPEN_SOURCE 600
+#define _XOPEN_SOURCE 700
 #endif
 
 #include <stdio.h>
@@ -121,6 +122,14 @@ unsigned M_CONNECTIONS = 0;
 
 static const char* clo_serverpath = ".";
 
+/* The default size of the compressed block cache, in MB. */
+#define  CACHE_SIZE_MB_DEFAULT 256
+/* The maximum allowable size of the compressed block cache, in MB. */
+#define  CACHE_SIZE_MB_MAX     65536
+
+/* The size of the compressed block cache, in MB. */
+static unsigned clo_cache_size_mb = CACHE_SIZE_MB_DEFAULT;
+
 
 /*---------------------------------------------------------------*/
 
@@ -183,8 +192,21 @@ typedef
       // currently connected to any file.
       int   file_fd;
       ULong file_size;
+      // Identity of that file, for the block cache.  A file rewritten
+      // in place keeps its dev and ino, and may keep its mtime in
+      // seconds, so its size and the mtime nanoseconds are part of it.
+      ULong file_dev;
+      ULong file_ino;
+      ULong file_mtime;
+      ULong file_mtime_ns;
       // Session ID
       ULong session_id;
+      // Readahead: the next |ra_pending| blocks of |ra_len| bytes,
+      // starting at |ra_next|, are to be put in the block cache when
+      // there is nothing else to do.
+      ULong ra_next;
+      ULong ra_len;
+      UInt  ra_pending;
       // How many bytes and chunks sent?
       ULong stats_n_rdok_frames;
       ULong stats_n_read_unz_bytes; // bytes via READ (uncompressed)
@@ -499,6 +521,24 @@ static Bool parse_Frame_le64_le64_le64 ( Frame* fr, const HChar* tag,
    return True;
 }
 
+static Bool parse_Frame_le64_le64_le64_le64 ( Frame* fr, const HChar* tag,
+                                              /*OUT*/ULong* n1,
+                                              /*OUT*/ULong* n2,
+                                              /*OUT*/ULong* n3,
+                                              /*OUT*/ULong* n4 )
+{
+   assert(strlen(tag) == 4);
+   if (!fr || !fr->data) return False;
+   if (fr->n_data < 4) return False;
+   if (memcmp(&fr->data[0], tag, 4) != 0) return False;
+   if (fr->n_data != 4 + 4*8) return False;
+   *n1 = read_ULong_le(&fr->data[4 + 0*8]);
+   *n2 = read_ULong_le(&fr->data[4 + 1*8]);
+   *n3 = read_ULong_le(&fr->data[4 + 2*8]);
+   *n4 = read_ULong_le(&fr->data[4 + 3*8]);
+   return True;
+}
+
 static Frame* mk_Frame_le64_le64_le64_bytes ( 
                  const HChar* tag,
                  ULong n1, ULong n2, ULong n3, ULong n_data,
@@ -676,6 +716,254 @@ static UInt calc_gnu_debuglink_crc32(/*OUT*/Bool* ok, int fd, ULong size)
    }
 
 
+/*---------------------------------------------------------------*/
+
+/* The compressed block cache.  It is shared by all connections, so
+   that when many clients read the same large debuginfo files -- as
+   happens when lots of Valgrind runs start at once on a build
+   machine -- each block is read and compressed only once.  Blocks
+   are identified by the device, inode and modification time of their
+   file, and by their offset and length in it.  When the cache grows
+   beyond --cache-size, the least recently used blocks are evicted. */
+
+#define CACHE_HASH_SIZE 65536
+
+typedef
+   struct _CBlock {
+      struct _CBlock* hash_next;
+      struct _CBlock* lru_prev;  // towards the most recently used
+      struct _CBlock* lru_next;  // towards the least recently used
+      ULong  file_dev;
+      ULong  file_ino;
+      ULong  file_mtime;
+      ULong  file_mtime_ns;
+      ULong  file_size;
+      ULong  offset;
+      ULong  len;    // uncompressed length
+      ULong  zlen;   // compressed length
+      UChar* zdata;
+   }
+   CBlock;
+
+static CBlock* cache_hash[CACHE_HASH_SIZE];
+static CBlock* cache_lru_first = NULL;  // most recently used
+static CBlock* cache_lru_last  = NULL;  // least recently used
+static ULong   cache_szB = 0;
+
+static ULong stats_cache_hits   = 0;
+static ULong stats_cache_misses = 0;
+
+static UInt cache_hash_of ( ULong file_dev, ULong file_ino, ULong offset )
+{
+   ULong h = file_ino * 0x9E3779B97F4A7C15ULL;
+   h ^= file_dev + (offset >> 13) * 0xC2B2AE3D27D4EB4FULL;
+   return (UInt)(h ^ (h >> 32)) % CACHE_HASH_SIZE;
+}
+
+static Bool cache_block_matches ( const CBlock* b, const ConnState* cs,
+                                  ULong offset, ULong len )
+{
+   return b->offset == offset && b->len == len
+          && b->file_ino == cs->file_ino && b->file_dev == cs->file_dev
+          && b->file_mtime == cs->file_mtime
+          && b->file_mtime_ns == cs->file_mtime_ns
+          && b->file_size == cs->file_size;
+}
+
+static void cache_lru_unlink ( CBlock* b )
+{
+   if (b->lru_prev) b->lru_prev->lru_next = b->lru_next;
+   else             cache_lru_first       = b->lru_next;
+   if (b->lru_next) b->lru_next->lru_prev = b->lru_prev;
+   else             cache_lru_last        = b->lru_prev;
+   b->lru_prev = b->lru_next = NULL;
+}
+
+static void cache_lru_push_first ( CBlock* b )
+{
+   b->lru_prev = NULL;
+   b->lru_next = cache_lru_first;
+   if (cache_lru_first) cache_lru_first->lru_prev = b;
+   else                 cache_lru_last            = b;
+   cache_lru_first = b;
+}
+
+/* Evict the least recently used block. */
+static void cache_evict_one ( void )
+{
+   CBlock*  b = cache_lru_last;
+   CBlock** pp;
+   assert(b != NULL);
+   cache_lru_unlink(b);
+   pp = &cache_hash[cache_hash_of(b->file_dev, b->file_ino, b->offset)];
+   while (*pp != b) {
+      assert(*pp != NULL);
+      pp = &(*pp)->hash_next;
+   }
+   *pp = b->hash_next;
+   assert(cache_szB >= b->zlen);
+   cache_szB -= b->zlen;
+   free(b->zdata);
+   free(b);
+}
+
+static CBlock* cache_lookup ( const ConnState* cs, ULong offset, ULong len )
+{
+   CBlock* b = cache_hash[cache_hash_of(cs->file_dev, cs->file_ino, offset)];
+   for (; b != NULL; b = b->hash_next) {
+      if (cache_block_matches(b, cs, offset, len)) {
+         cache_lru_unlink(b);
+         cache_lru_push_first(b);
+         return b;
+      }
+   }
+   return NULL;
+}
+
+/* Add a block to the cache, evicting others as necessary to keep
+   within --cache-size.  Takes ownership of |zdata|.  The new block
+   itself is never evicted here, so it remains valid until the next
+   call. */
+static CBlock* cache_add ( const ConnState* cs, ULong offset, ULong len,
+                           UChar* zdata, ULong zlen )
+{
+   UInt    h = cache_hash_of(cs->file_dev, cs->file_ino, offset);
+   CBlock* b = my_malloc(sizeof(CBlock));
+   while (cache_lru_last != NULL
+          && cache_szB + zlen > (ULong)clo_cache_size_mb * 1024 * 1024)
+      cache_evict_one();
+   b->file_dev      = cs->file_dev;
+   b->file_ino      = cs->file_ino;
+   b->file_mtime    = cs->file_mtime;
+   b->file_mtime_ns = cs->file_mtime_ns;
+   b->file_size     = cs->file_size;
+   b->offset        = offset;
+   b->len           = len;
+   b->zlen          = zlen;
+   b->zdata         = zdata;
+   b->hash_next     = cache_hash[h];
+   cache_hash[h]    = b;
+   cache_lru_push_first(b);
+   cache_szB += zlen;
+   return b;
+}
+
+/* Read [offset, +len) of conn_state[conn_no]'s file and compress it
+   with LZO.  Returns the compressed data in malloc'd space, and its
+   length in |*zlen|, or NULL and a reason in |*reason|. */
+static UChar* read_and_compress ( int conn_no, ULong offset, ULong len,
+                                  /*OUT*/ULong* zlen,
+                                  /*OUT*/const char** reason )
+{
+   /* First, allocate a temp buf and read from the file into it. */
+   /* FIXME: what if pread reads short and we have to redo it? */
+   UChar* unzBuf = my_malloc(len);
+   size_t nRead = pread(conn_state[conn_no].file_fd, unzBuf, len, offset);
+   if (nRead != len) {
+      free(unzBuf);
+      *reason = "I/O error reading file";
+      return NULL;
+   }
+   // Now compress it with LZO.  LZO appears to recommend
+   // the worst-case output size as (in_len + in_len / 16 + 67).
+   // Be more conservative here.
+#  define STACK_ALLOC(var,size) \
+      lzo_align_t __LZO_MMODEL \
+         var [ ((size) \
+               + (sizeof(lzo_align_t) - 1)) / sizeof(lzo_align_t) ]
+   STACK_ALLOC(wrkmem, LZO1X_1_MEM_COMPRESS);
+#  undef STACK_ALLOC
+   UInt zLenMax = len + len / 4 + 1024;
+   UChar* zBuf = my_malloc(zLenMax);
+   lzo_uint zLen = zLenMax;
+   Int lzo_rc = lzo1x_1_compress(unzBuf, len, zBuf, &zLen, wrkmem);
+   free(unzBuf);
+   if (lzo_rc != LZO_E_OK) {
+      free(zBuf);
+      *reason = "LZO failed";
+      return NULL;
+   }
+   assert(zLen <= zLenMax);
+   *zlen = zLen;
+   return zBuf;
+}
+
+/* Get the compressed block [offset, +len) of conn_state[conn_no]'s
+   file, from the cache if possible.  Returns NULL and a reason in
+   |*reason| if it can't be read. */
+static CBlock* get_block ( int conn_no, ULong offset, ULong len,
+                           /*OUT*/const char** reason )
+{
+   ConnState* cs = &conn_state[conn_no];
+   CBlock*    b  = cache_lookup(cs, offset, len);
+   if (b) {
+      stats_cache_hits++;
+      return b;
+   }
+   stats_cache_misses++;
+   ULong  zlen  = 0;
+   UChar* zdata = read_and_compress(conn_no, offset, len, &zlen, reason);
+   if (zdata == NULL)
+      return NULL;
+   return cache_add(cs, offset, len, zdata, zlen);
+}
+
+
+/*---------------------------------------------------------------*/
+
+/* Readahead.  Debuginfo files are mostly read sequentially, so after
+   a READ or RDMB request, the blocks which follow are likely to be
+   asked for next.  When there are no requests to service, the main
+   loop calls do_readahead to put them in the block cache. */
+
+/* How many blocks to read ahead after each request. */
+#define READAHEAD_BLOCKS 16
+
+static void note_read ( int conn_no, ULong end, ULong len )
+{
+   if (clo_cache_size_mb == 0)
+      return;
+   conn_state[conn_no].ra_next    = end;
+   conn_state[conn_no].ra_len     = len;
+   conn_state[conn_no].ra_pending = READAHEAD_BLOCKS;
+}
+
+static Bool readahead_pending ( void )
+{
+   int i;
+   for (i = 0; i < M_CONNECTIONS; i++) {
+      if (conn_state[i].in_use && conn_state[i].ra_pending > 0)
+         return True;
+   }
+   return False;
+}
+
+/* Read ahead one block for each connection which has some pending. */
+static void do_readahead ( void )
+{
+   int i;
+   for (i = 0; i < M_CONNECTIONS; i++) {
+      ConnState*  cs = &conn_state[i];
+      const char* reason;
+      if (!cs->in_use || cs->ra_pending == 0)
+         continue;
+      if (cs->file_fd == 0 || cs->ra_next >= cs->file_size) {
+         cs->ra_pending = 0;
+         continue;
+      }
+      ULong len = cs->file_size - cs->ra_next;
+      if (len > cs->ra_len)
+         len = cs->ra_len;
+      if (get_block(i, cs->ra_next, len, &reason) == NULL) {
+         cs->ra_pending = 0;
+         continue;
+      }
+      cs->ra_next += len;
+      cs->ra_pending--;
+   }
+}
+
+
 /*---------------------------------------------------------------*/
 
 /* Handle a transaction for conn_state[conn_no].  There is incoming
@@ -729,12 +1017,18 @@ static Bool handle_transaction ( int conn_no )
    assert(res == NULL);
 
    UChar* filename = NULL;
-   ULong req_session_id = 0, req_offset = 0, req_len = 0;
+   ULong req_session_id = 0, req_offset = 0, req_len = 0, req_n_blocks = 0;
 
    if (parse_Frame_noargs(req, "VERS")) {
       res = mk_Frame_asciiz("VEOK", "Valgrind Debuginfo Server, Version 1");
    }
    else
+   if (parse_Frame_noargs(req, "VER2")) {
+      /* Version 2 adds RDMB.  Clients ask for it first, and fall back
+         to VERS if the server doesn't know it. */
+      res = mk_Frame_asciiz("VEOK", "Valgrind Debuginfo Server, Version 2");
+   }
+   else
    if (parse_Frame_noargs(req, "CRC3")) {
       /* FIXME: add a session ID to this request, and check it */
       if (conn_state[conn_no].file_fd == 0) {
@@ -783,8 +1077,16 @@ static Bool handle_transaction ( int conn_no )
             ok = False;
          }
          if (ok) {
-            conn_state[conn_no].file_fd   = fd;
-            conn_state[conn_no].file_size = stat_buf.st_size;
+            conn_state[conn_no].file_fd    = fd;
+            conn_state[conn_no].file_size  = stat_buf.st_size;
+            conn_state[conn_no].file_dev   = stat_buf.st_dev;
+            conn_state[conn_no].file_ino   = stat_buf.st_ino;
+            conn_state[conn_no].file_mtime = stat_buf.st_mtime;
+#           if defined(VGO_darwin)
+            conn_state[conn_no].file_mtime_ns = stat_buf.st_mtimensec;
+#           else
+            conn_state[conn_no].file_mtime_ns = stat_buf.st_mtim.tv_nsec;
+#           endif
             assert(res == NULL);
             res = mk_Frame_le64_le64("OPOK", conn_state[conn_no].session_id,
                                              conn_state[conn_no].file_size);
@@ -820,57 +1122,103 @@ static Bool handle_transaction ( int conn_no )
          res = mk_Frame_asciiz("FAIL", "READ: request exceeds file size");
          ok = False;
       }
-      /* Try to read the file. */
+      /* Get the block, compressed with LZO. */
       if (ok) {
-         /* First, allocate a temp buf and read from the file into it. */
-         /* FIXME: what if pread reads short and we have to redo it? */
-         UChar* unzBuf = my_malloc(req_len);
-         size_t nRead = pread(conn_state[conn_no].file_fd,
-                              unzBuf, req_len, req_offset);
-         if (nRead != req_len) {
-            free_Frame(res);
-            res = mk_Frame_asciiz("FAIL", "READ: I/O error reading file");
-            ok = False;
-         }         
-         if (ok) {
-            // Now compress it with LZO.  LZO appears to recommend
-            // the worst-case output size as (in_len + in_len / 16 + 67).
-            // Be more conservative here.
-#           define STACK_ALLOC(var,size) \
-               lzo_align_t __LZO_MMODEL \
-                  var [ ((size) \
-                        + (sizeof(lzo_align_t) - 1)) / sizeof(lzo_align_t) ]
-            STACK_ALLOC(wrkmem, LZO1X_1_MEM_COMPRESS);
-#           undef STACK_ALLOC
-            UInt zLenMax = req_len + req_len / 4 + 1024;
-            UChar* zBuf = my_malloc(zLenMax);
-            lzo_uint zLen = zLenMax;
-            Int lzo_rc = lzo1x_1_compress(unzBuf, req_len,
-                                          zBuf, &zLen, wrkmem); 
-            if (lzo_rc == LZO_E_OK) {
-              //printf("XXXXX req_len %u  zLen %u\n", (UInt)req_len, (UInt)zLen);
-               assert(zLen <= zLenMax);
-               /* Make a frame to put the results in.  Bytes 24 and
-                  onwards need to be filled from the compressed data,
-                  and 'buf' is set to point to the right bit. */
-               UChar* buf = NULL;
-               res = mk_Frame_le64_le64_le64_bytes
-                 ("RDOK", req_session_id, req_offset, req_len, zLen, &buf);
-               assert(res);
-               assert(buf);
-               memcpy(buf, zBuf, zLen);
-               // Update stats
-               conn_state[conn_no].stats_n_rdok_frames++;
-               conn_state[conn_no].stats_n_read_unz_bytes += req_len;
-               conn_state[conn_no].stats_n_read_z_bytes   += zLen;
-            } else {
+         const char* reason = NULL;
+         CBlock* b = get_block(conn_no, req_offset, req_len, &reason);
+         if (b) {
+            /* Make a frame to put the results in.  Bytes 24 and
+               onwards need to be filled from the compressed data,
+               and 'buf' is set to point to the right bit. */
+            UChar* buf = NULL;
+            res = mk_Frame_le64_le64_le64_bytes
+              ("RDOK", req_session_id, req_offset, req_len, b->zlen, &buf);
+            assert(res);
+            assert(buf);
+            memcpy(buf, b->zdata, b->zlen);
+            // Update stats
+            conn_state[conn_no].stats_n_rdok_frames++;
+            conn_state[conn_no].stats_n_read_unz_bytes += req_len;
+            conn_state[conn_no].stats_n_read_z_bytes   += b->zlen;
+            note_read(conn_no, req_offset + req_len, req_len);
+         } else {
+            char msg[100];
+            snprintf(msg, sizeof(msg), "READ: %s", reason);
+            res = mk_Frame_asciiz("FAIL", msg);
+         }
+      }
+   }
+   else
+   if (parse_Frame_le64_le64_le64_le64(req, "RDMB", &req_session_id,
+                                       &req_offset, &req_len,
+                                       &req_n_blocks)) {
+      /* Read multiple blocks: the |req_n_blocks| blocks of |req_len|
+         bytes starting at |req_offset|, stopping at the end of the
+         file, so the last one may be shorter.  The response is
+            RMOK session_id offset len n_blocks
+         (all le64) followed, for each block, by its compressed
+         length (le64) and its LZO compressed data. */
+      Bool ok = True;
+      if (req_session_id != conn_state[conn_no].session_id) {
+         res = mk_Frame_asciiz("FAIL", "RDMB: invalid session ID");
+         ok = False;
+      }
+      if (ok && conn_state[conn_no].file_fd == 0) {
+         res = mk_Frame_asciiz("FAIL", "RDMB: no associated file");
+         ok = False;
+      }
+      if (ok && (req_len == 0 || req_n_blocks == 0
+                 || req_len > 1024*1024 || req_n_blocks > 1024*1024
+                 || req_len * req_n_blocks > 1024*1024)) {
+         res = mk_Frame_asciiz("FAIL", "RDMB: invalid request size");
+         ok = False;
+      }
+      if (ok && req_offset >= conn_state[conn_no].file_size) {
+         res = mk_Frame_asciiz("FAIL", "RDMB: request exceeds file size");
+         ok = False;
+      }
+      if (ok) {
+         ULong file_size = conn_state[conn_no].file_size;
+         ULong max_n_data
+            = 4 + 4*8 + req_n_blocks * (8 + req_len + req_len / 4 + 1024);
+         ULong n_data = 4 + 4*8, n_blocks = 0, off = req_offset;
+         UChar* data = my_malloc(max_n_data);
+         while (n_blocks < req_n_blocks && off < file_size) {
+            const char* reason = NULL;
+            ULong len = file_size - off;
+            if (len > req_len)
+               len = req_len;
+            CBlock* b = get_block(conn_no, off, len, &reason);
+            if (b == NULL) {
+               char msg[100];
+               snprintf(msg, sizeof(msg), "RDMB: %s", reason);
+               res = mk_Frame_asciiz("FAIL", msg);
                ok = False;
-               free_Frame(res);
-               res = mk_Frame_asciiz("FAIL", "READ: LZO failed");
+               break;
             }
-            free(zBuf);
+            assert(n_data + 8 + b->zlen <= max_n_data);
+            write_ULong_le(&data[n_data], b->zlen);
+            memcpy(&data[n_data + 8], b->zdata, b->zlen);
+            n_data += 8 + b->zlen;
+            conn_state[conn_no].stats_n_read_unz_bytes += len;
+            conn_state[conn_no].stats_n_read_z_bytes   += b->zlen;
+            n_blocks++;
+            off += len;
+         }
+         if (ok) {
+            memcpy(&data[0], "RMOK", 4);
+            write_ULong_le(&data[4 + 0*8], req_session_id);
+            write_ULong_le(&data[4 + 1*8], req_offset);
+            write_ULong_le(&data[4 + 2*8], req_len);
+            write_ULong_le(&data[4 + 3*8], n_blocks);
+            res = calloc(sizeof(Frame), 1);
+            res->data   = data;
+            res->n_data = n_data;
+            conn_state[conn_no].stats_n_rdok_frames++;
+            note_read(conn_no, off, req_len);
+         } else {
+            free(data);
          }
-         free(unzBuf);
       }
    }
    else {
@@ -1021,7 +1369,8 @@ static void usage ( void )
       "\n"
       "usage is:\n"
       "\n"
-      "   valgrind-di-server [--exit-at-zero|-e] [port-number]\n"
+      "   valgrind-di-server [--exit-at-zero|-e] [--max-connect=INT]\n"
+      "                      [--cache-size=MB] [port-number]\n"
       "\n"
       "   where   --exit-at-zero or -e causes the listener to exit\n"
       "           when the number of connections falls back to zero\n"
@@ -1031,12 +1380,17 @@ static void usage ( void )
       "           number of connected processes (default = %d).\n"
       "           INT must be positive and less than %d.\n"
       "\n"
+      "           --cache-size=MB sets the size of the cache of compressed\n"
+      "           blocks shared by all connections (default = %d).\n"
+      "           MB must be less than %d.  0 disables the cache.\n"
+      "\n"
       "           port-number is the default port on which to listen for\n"
       "           connections.  It must be between 1024 and 65535.\n"
       "           Current default is %d.\n"
       "\n"
       ,
-      M_CONNECTIONS_DEFAULT, M_CONNECTIONS_MAX, VG_CLO_DEFAULT_LOGPORT
+      M_CONNECTIONS_DEFAULT, M_CONNECTIONS_MAX,
+      CACHE_SIZE_MB_DEFAULT, CACHE_SIZE_MB_MAX, VG_CLO_DEFAULT_LOGPORT
    );
    exit(1);
 }
@@ -1053,6 +1407,10 @@ static void banner ( const char* str )
 
 static void exit_routine ( void )
 {
+   if (stats_cache_hits + stats_cache_misses > 0) {
+      printf("block cache: %llu hits, %llu misses, %llu MB in use\n",
+             stats_cache_hits, stats_cache_misses, cache_szB / 1000000);
+   }
    banner("exited");
    exit(0);
 }
@@ -1084,6 +1442,15 @@ int main (int argc, char** argv)
          if (M_CONNECTIONS <= 0 || M_CONNECTIONS > M_CONNECTIONS_MAX)
             usage();
       }
+      else if (0 == strncmp(argv[i], "--cache-size=", 13)) {
+         const char* str = strchr(argv[i], '=') + 1;
+         if (0 == strcmp(str, "0"))
+            clo_cache_size_mb = 0;
+         else if (atoi_with_bound(str, CACHE_SIZE_MB_MAX) > 0)
+            clo_cache_size_mb = atoi_with_bound(str, CACHE_SIZE_MB_MAX);
+         else
+            usage();
+      }
       else
       if (atoi_portno(argv[i]) > 0) {
          port = atoi_portno(argv[i]);
@@ -1220,14 +1587,19 @@ assert(ret != -1);
          j++;
       }
 
-      res = poll(tmp_pollfd, j, 20/*ms*/ /* 0=return immediately. */ );
+      /* If there is readahead to do, don't wait: do it while no
+         requests are coming in. */
+      res = poll(tmp_pollfd, j,
+                 readahead_pending() ? 0 : 20/*ms*/
+                 /* 0=return immediately. */ );
       if (res < 0) {
          perror("poll(main) failed");
          panic("poll(main) failed");
       }
     
-      /* nothing happened. go round again. */
+      /* nothing happened.  do some readahead, and go round again. */
       if (res == 0) {
+         do_readahead();
          continue;
       }
 
@@ -1323,7 +1323,7 @@ static VgFile *new_dumpfile(int tid, const HChar* trigger)
       */
      int t;
      thread_info** thr = CLG_(get_threads)();
-     for(t=1;t<VG_N_THREADS;t++) {
+     for(t=1;t<CLG_(get_n_threads)();t++) {
        if (!thr[t]) continue;
        CLG_(add_diff_cost)(CLG_(sets).full, sum,
 			  thr[t]->lastdump_cost,
@@ -1370,6 +1370,40 @@ static void close_dumpfile(VgFile *fp)
 
 static const HChar* print_trigger;
 
+/* Look up the debug info of all the addresses get_debug_pos will be
+ * asked about when dumping the BBCCs in array, in one go.
+ */
+static void resolve_debug_pos(BBCC** array)
+{
+    BBCC **p;
+    jCC* jcc;
+    Addr* addrs;
+    UWord n = 0;
+    UInt i;
+
+    for(p = array; *p; p++) {
+	n += (*p)->bb->instr_count + 1;
+	for(i = 0; i <= (*p)->bb->cjmp_count; i++)
+	    for(jcc = (*p)->jmp[i].jcc_list; jcc; jcc = jcc->next_from)
+		n++;
+    }
+    if (n == 0) return;
+
+    addrs = (Addr*) CLG_MALLOC("cl.dump.rdp.1", n * sizeof(Addr));
+    n = 0;
+    for(p = array; *p; p++) {
+	BB* bb = (*p)->bb;
+	for(i = 0; i < bb->instr_count; i++)
+	    addrs[n++] = bb_addr(bb) + bb->instr[i].instr_offset;
+	addrs[n++] = bb_jmpaddr(bb);
+	for(i = 0; i <= bb->cjmp_count; i++)
+	    for(jcc = (*p)->jmp[i].jcc_list; jcc; jcc = jcc->next_from)
+		addrs[n++] = bb_addr(jcc->to->bb);
+    }
+    VG_(resolve_IPs)(VG_(current_DiEpoch)(), addrs, n);
+    CLG_FREE(addrs);
+}
+
 static void print_bbccs_of_thread(thread_info* ti)
 {
   BBCC **p, **array;
@@ -1385,6 +1419,7 @@ static void print_bbccs_of_thread(thread_info* ti)
   }
 
   p = array = prepare_dump();
+  resolve_debug_pos(array);
   init_fpos(&lastFnPos);
   init_apos(&lastAPos, 0, 0, 0);
 
@@ -1441,6 +1476,7 @@ static void print_bbccs_of_thread(thread_info* ti)
   }
 
   close_dumpfile(print_fp);
+  VG_(forget_resolved_IPs)();
   VG_(free)(array);
   
   /* set counters of last dump */
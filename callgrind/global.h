@@ -757,6 +757,7 @@ void CLG_(push_cxt)(fn_node* fn);
 /* from threads.c */
 void CLG_(init_threads)(void);
 thread_info** CLG_(get_threads)(void);
+UInt CLG_(get_n_threads)(void);
 thread_info* CLG_(get_current_thread)(void);
 void CLG_(switch_thread)(ThreadId tid);
 void CLG_(forall_threads)(void (*func)(thread_info*));
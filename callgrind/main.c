@@ -1547,7 +1547,7 @@ static void dump_state_togdb(void)
     /* threads */
     th = CLG_(get_threads)();
     VG_(gdb_printf)("threads:");
-    for(t=1;t<VG_N_THREADS;t++) {
+    for(t=1;t<CLG_(get_n_threads)();t++) {
 	if (!th[t]) continue;
 	VG_(gdb_printf)(" %d", t);
     }
@@ -1614,7 +1614,7 @@ static Bool handle_gdb_monitor_command (ThreadId tid, const HChar *req)
        // Status information to be improved ...
        thread_info** th = CLG_(get_threads)();
        Int t, tcount = 0;
-       for(t=1;t<VG_N_THREADS;t++)
+       for(t=1;t<CLG_(get_n_threads)();t++)
 	 if (th[t]) tcount++;
        VG_(gdb_printf)("%d thread(s) running.\n", tcount);
      }
@@ -1707,12 +1707,16 @@ ULong *syscalltime;
 #else
 UInt *syscalltime;
 #endif
+static UInt n_syscalltime;
 
 static
 void CLG_(pre_syscalltime)(ThreadId tid, UInt syscallno,
                            UWord* args, UInt nArgs)
 {
   if (CLG_(clo).collect_systime) {
+    VG_(grow_thread_array)("cl.main.pci.1", (void**)&syscalltime,
+                           &n_syscalltime, sizeof syscalltime[0],
+                           VG_N_THREADS);
 #if CLG_MICROSYSTIME
     struct vki_timeval tv_now;
     VG_(gettimeofday)(&tv_now, NULL);
@@ -1978,11 +1982,9 @@ void CLG_(post_clo_init)(void)
    if (CLG_(clo).collect_systime) {
       VG_(needs_syscall_wrapper)(CLG_(pre_syscalltime),
                                  CLG_(post_syscalltime));
-      syscalltime = CLG_MALLOC("cl.main.pci.1",
-                               VG_N_THREADS * sizeof syscalltime[0]);
-      for (UInt i = 0; i < VG_N_THREADS; ++i) {
-         syscalltime[i] = 0;
-      }
+      VG_(grow_thread_array)("cl.main.pci.1", (void**)&syscalltime,
+                             &n_syscalltime, sizeof syscalltime[0],
+                             VG_N_THREADS);
    }
 
    if (VG_(clo_px_file_backed) != VexRegUpdSpAtMemAccess) {
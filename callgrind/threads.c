@@ -62,12 +62,18 @@ static exec_stack current_states;
 ThreadId CLG_(current_tid);
 
 static thread_info** thread;
+static UInt n_thread;  /* follows VG_N_THREADS as it grows */
 
 thread_info** CLG_(get_threads)()
 {
   return thread;
 }
 
+UInt CLG_(get_n_threads)()
+{
+  return n_thread;
+}
+
 thread_info* CLG_(get_current_thread)()
 {
   return thread[CLG_(current_tid)];
@@ -75,12 +81,8 @@ thread_info* CLG_(get_current_thread)()
 
 void CLG_(init_threads)()
 {
-    UInt i;
-
-    thread = CLG_MALLOC("cl.threads.it.1", VG_N_THREADS * sizeof thread[0]);
-
-    for(i=0;i<VG_N_THREADS;i++)
-	thread[i] = 0;
+    VG_(grow_thread_array)("cl.threads.it.1", (void**)&thread, &n_thread,
+                           sizeof thread[0], VG_N_THREADS);
     CLG_(current_tid) = VG_INVALID_THREADID;
 }
 
@@ -89,7 +91,7 @@ void CLG_(forall_threads)(void (*func)(thread_info*))
 {
   Int t, orig_tid = CLG_(current_tid);
 
-  for(t=1;t<VG_N_THREADS;t++) {
+  for(t=1;t<n_thread;t++) {
     if (!thread[t]) continue;
     CLG_(switch_thread)(t);
     (*func)(thread[t]);
@@ -154,6 +156,9 @@ void CLG_(switch_thread)(ThreadId tid)
 
   CLG_(current_tid) = tid;
   CLG_ASSERT(tid < VG_N_THREADS);
+  /* The core grows its thread table on demand */
+  VG_(grow_thread_array)("cl.threads.it.1", (void**)&thread, &n_thread,
+                         sizeof thread[0], VG_N_THREADS);
 
   if (tid != VG_INVALID_THREADID) {
     thread_info* t;
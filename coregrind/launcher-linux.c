@@ -42,16 +42,21 @@
                                 // pub_core_libcfile.h
 #include "pub_core_libcproc.h"  // For VALGRIND_LIB, VALGRIND_LAUNCHER
 #include "pub_core_ume.h"
+#include "pub_core_zygote.h"    // For the --connect protocol
 
 #include <assert.h>
 #include <ctype.h>
 #include <elf.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 
 #ifndef EM_X86_64
 #define EM_X86_64 62    // elf.h doesn't define this on some older systems
@@ -325,6 +330,149 @@ static const char *select_platform(const char *clientname)
    return platform;
 }
 
+/* --connect=<path>: rather than starting a Valgrind, ask the
+   --server=<path> Valgrind to fork one that runs the client with our
+   stdin/stdout/stderr, working directory and environment (see
+   pub_core_zygote.h), and exit the way it does. */
+
+static pid_t server_child_pid = 0;
+
+static void forward_signal ( int signo )
+{
+   if (server_child_pid > 0)
+      kill(server_child_pid, signo);
+}
+
+static void write_fully ( int sd, const void *buf, size_t count )
+{
+   const char *p = buf;
+   while (count > 0) {
+      ssize_t n = write(sd, p, count);
+      if (n < 0 && errno == EINTR)
+         continue;
+      if (n <= 0)
+         barf("lost connection to the Valgrind server: %s", strerror(errno));
+      p += n;
+      count -= n;
+   }
+}
+
+static int read_Int ( int sd )
+{
+   int    v;
+   char   *p = (char *)&v;
+   size_t count = sizeof(v);
+   while (count > 0) {
+      ssize_t n = read(sd, p, count);
+      if (n < 0 && errno == EINTR)
+         continue;
+      if (n <= 0)
+         barf("lost connection to the Valgrind server");
+      p += n;
+      count -= n;
+   }
+   return v;
+}
+
+static void run_on_server ( const char *sockpath, char **client_argv,
+                            char **envp )
+{
+   struct sockaddr_un addr;
+   struct msghdr      msg;
+   struct iovec       iov;
+   struct sigaction   sa;
+   union {
+      struct cmsghdr h;
+      char           buf[CMSG_SPACE(3 * sizeof(int))];
+   } cbuf;
+   ZygoteRequest hdr;
+   char   cwd[4096];
+   char   *payload, *p;
+   size_t szB;
+   int    n_args, n_env, i, sd, status;
+   int    fds[3] = { 0, 1, 2 };
+
+   if (getcwd(cwd, sizeof(cwd)) == NULL)
+      barf("cannot get the current working directory: %s", strerror(errno));
+
+   szB = strlen(cwd) + 1;
+   for (n_args = 0; client_argv[n_args]; n_args++)
+      szB += strlen(client_argv[n_args]) + 1;
+   for (n_env = 0; envp[n_env]; n_env++)
+      szB += strlen(envp[n_env]) + 1;
+   if (szB > VG_ZYGOTE_MAX_PAYLOAD)
+      barf("arguments and environment are too big for --connect");
+
+   payload = malloc(szB);
+   if (payload == NULL)
+      barf("malloc of payload failed.");
+   strcpy(payload, cwd);
+   p = payload + strlen(cwd) + 1;
+   for (i = 0; i < n_args; i++) {
+      strcpy(p, client_argv[i]);
+      p += strlen(p) + 1;
+   }
+   for (i = 0; i < n_env; i++) {
+      strcpy(p, envp[i]);
+      p += strlen(p) + 1;
+   }
+   assert(p == payload + szB);
+
+   if (strlen(sockpath) >= sizeof(addr.sun_path))
+      barf("--connect socket path '%s' is too long", sockpath);
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strcpy(addr.sun_path, sockpath);
+   sd = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (sd < 0 || connect(sd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+      barf("cannot connect to the Valgrind server on '%s': %s",
+           sockpath, strerror(errno));
+
+   hdr.magic       = VG_ZYGOTE_MAGIC;
+   hdr.n_args      = n_args;
+   hdr.n_env       = n_env;
+   hdr.payload_szB = szB;
+   iov.iov_base = &hdr;
+   iov.iov_len  = sizeof(hdr);
+   memset(&msg, 0, sizeof(msg));
+   memset(&cbuf, 0, sizeof(cbuf));
+   msg.msg_iov        = &iov;
+   msg.msg_iovlen     = 1;
+   msg.msg_control    = cbuf.buf;
+   msg.msg_controllen = sizeof(cbuf.buf);
+   CMSG_FIRSTHDR(&msg)->cmsg_level = SOL_SOCKET;
+   CMSG_FIRSTHDR(&msg)->cmsg_type  = SCM_RIGHTS;
+   CMSG_FIRSTHDR(&msg)->cmsg_len   = CMSG_LEN(sizeof(fds));
+   memcpy(CMSG_DATA(CMSG_FIRSTHDR(&msg)), fds, sizeof(fds));
+   if (sendmsg(sd, &msg, 0) != sizeof(hdr))
+      barf("cannot send request to the Valgrind server: %s", strerror(errno));
+   write_fully(sd, payload, szB);
+   free(payload);
+
+   server_child_pid = read_Int(sd);
+   if (server_child_pid < 0)
+      barf("the Valgrind server could not start '%s'", client_argv[0]);
+   VG_(debugLog)(1, "launcher", "server started pid %d\n",
+                 (int)server_child_pid);
+
+   /* Pass on the signals that would terminate us to the child. */
+   memset(&sa, 0, sizeof(sa));
+   sa.sa_handler = forward_signal;
+   sa.sa_flags   = SA_RESTART;
+   sigaction(SIGHUP,  &sa, NULL);
+   sigaction(SIGINT,  &sa, NULL);
+   sigaction(SIGQUIT, &sa, NULL);
+   sigaction(SIGTERM, &sa, NULL);
+
+   status = read_Int(sd);
+   if (WIFSIGNALED(status)) {
+      signal(WTERMSIG(status), SIG_DFL);
+      raise(WTERMSIG(status));
+      exit(128 + WTERMSIG(status));
+   }
+   exit(WEXITSTATUS(status));
+}
+
 /* Where we expect to find all our aux files */
 static const char *valgrind_lib = VG_LIBDIR;
 
@@ -333,6 +481,8 @@ int main(int argc, char** argv, char** envp)
    int i, j, loglevel, r;
    const char *toolname = NULL;
    const char *clientname = NULL;
+   const char *connect_path = NULL;
+   int n_other_opts = 0;
    const char *platform;
    const char *default_platform;
    const char *cp;
@@ -358,6 +508,10 @@ int main(int argc, char** argv, char** envp)
       }
       if (0 == strcmp(argv[i], "-d")) 
          loglevel++;
+      else if (0 == strncmp(argv[i], "--connect=", 10))
+         connect_path = argv[i] + 10;
+      else
+         n_other_opts++;
       if (0 == strncmp(argv[i], "--tool=", 7)) 
          toolname = argv[i] + 7;
    }
@@ -366,6 +520,18 @@ int main(int argc, char** argv, char** envp)
       messages all through startup. */
    VG_(debugLog_startup)(loglevel, "Stage 1");
 
+   if (connect_path) {
+      if (n_other_opts > 0)
+         barf("--connect cannot be combined with other options; "
+              "the server's options are used");
+      if (clientname == NULL)
+         barf("no program specified");
+      if (0 == strcmp(argv[i], "--"))
+         i++;
+      run_on_server(connect_path, &argv[i], envp);
+      /*NOTREACHED*/
+   }
+
    /* Make sure we know which tool we're using */
    if (toolname) {
       VG_(debugLog)(1, "launcher", "tool '%s' requested\n", toolname);
@@ -202,6 +202,21 @@ SysRes ML_(am_do_munmap_NO_NOTIFY)(Addr start, SizeT length)
    return VG_(do_syscall2)(__NR_munmap, (UWord)start, length );
 }
 
+#if defined(VGO_linux)
+/* madvise does not change the mapping structure, so there is nothing
+   to notify. */
+SysRes ML_(am_do_madvise)(Addr start, SizeT length, Int advice)
+{
+   return VG_(do_syscall3)(__NR_madvise, (UWord)start, length, advice );
+}
+
+/* Likewise for mincore, which only reads the mapping state. */
+SysRes ML_(am_do_mincore)(Addr start, SizeT length, UChar* vec)
+{
+   return VG_(do_syscall3)(__NR_mincore, (UWord)start, length, (UWord)vec );
+}
+#endif
+
 #if HAVE_MREMAP
 /* The following are used only to implement mremap(). */
 
@@ -277,16 +277,16 @@
 
 /* ------ start of STATE for the address-space manager ------ */
 
-/* Max number of segments we can track.  On Android, virtual address
-   space is limited, so keep a low limit -- 5000 x sizef(NSegment) is
-   360KB. */
+/* Number of segments we can track before the segment array has to be
+   grown.  On Android, virtual address space is limited, so keep a low
+   initial size -- 5000 x sizeof(NSegment) is 360KB. */
 #if defined(VGPV_arm_linux_android) \
     || defined(VGPV_x86_linux_android) \
     || defined(VGPV_mips32_linux_android) \
     || defined(VGPV_arm64_linux_android)
-# define VG_N_SEGMENTS 5000
+# define VG_N_SEGMENTS_INITIAL 5000
 #else
-# define VG_N_SEGMENTS 30000
+# define VG_N_SEGMENTS_INITIAL 30000
 #endif
 
 /* Array [0 .. nsegments_used-1] of all mappings. */
@@ -296,8 +296,31 @@
 /* I: the segments cover the entire address space precisely. */
 /* Each segment can optionally hold an index into the filename table. */
 
-static NSegment nsegments[VG_N_SEGMENTS];
-static Int      nsegments_used = 0;
+/* The array is kept as a gap buffer, so that adding and removing
+   segments does not require shifting all the segments above the
+   change point.  Physically, nsegments has room for nsegments_size
+   entries.  Segments [0 .. nsegments_gap-1] are at the bottom of it,
+   segments [nsegments_gap .. nsegments_used-1] at the top, and the
+   unused entries in between form the gap.  Segments are always
+   inserted and removed at the gap, which is moved to the change point
+   first (move_nsegments_gap).  Changes to the address space tend to
+   be close to each other, so moving the gap is usually cheap.  Always
+   access segments by their index using SEG(); a pointer to a segment
+   is only valid until the next change to the array.
+
+   The array starts out as nsegments_initial and is grown, by mapping
+   a bigger one, when full (grow_nsegments).  So there is no limit on
+   the number of segments. */
+
+static NSegment  nsegments_initial[VG_N_SEGMENTS_INITIAL];
+static NSegment* nsegments      = nsegments_initial;
+static Int       nsegments_size = VG_N_SEGMENTS_INITIAL;
+static Int       nsegments_used = 0;
+static Int       nsegments_gap  = 0;
+
+#define SEG(_i) \
+   (nsegments[(_i) < nsegments_gap \
+              ? (_i) : (_i) + (nsegments_size - nsegments_used)])
 
 #define Addr_MIN ((Addr)0)
 #define Addr_MAX ((Addr)(-1ULL))
@@ -332,6 +355,14 @@ static Addr aspacem_cStart = 0;
 // Where aspacem will start looking for Valgrind space
 static Addr aspacem_vStart = 0;
 
+// Search hints for VG_(am_get_advisory): no segment overlapping
+// [aspacem_cStart, aspacem_cFreeHint) is SkFree, and likewise for
+// aspacem_vStart.  So the search for a free hole can start at the
+// hint rather than walking over all the mappings in between.
+// add_segment lowers a hint when it frees space below it.
+static Addr aspacem_cFreeHint = 0;
+static Addr aspacem_vFreeHint = 0;
+
 
 #define AM_SANITY_CHECK                                      \
    do {                                                      \
@@ -346,6 +377,9 @@ static Addr aspacem_vStart = 0;
 inline
 static Int  find_nsegment_idx ( Addr a );
 
+static void add_segment ( const NSegment* seg );
+static void init_nsegment ( /*OUT*/NSegment* seg );
+
 static void parse_procselfmaps (
       void (*record_mapping)( Addr addr, SizeT len, UInt prot,
                               ULong dev, ULong ino, Off64T offset, 
@@ -534,7 +568,7 @@ void VG_(am_show_nsegments) ( Int logLevel, const HChar* who )
                  who, nsegments_used);
    ML_(am_show_segnames)( logLevel, who);
    for (i = 0; i < nsegments_used; i++)
-     show_nsegment( logLevel, i, &nsegments[i] );
+     show_nsegment( logLevel, i, &SEG(i) );
    VG_(debugLog)(logLevel, "aspacem",
                  ">>>\n");
 }
@@ -572,7 +606,7 @@ Int VG_(am_get_segment_starts)( UInt kind_mask, Addr* starts, Int nStarts )
 
    nSegs = 0;
    for (i = 0; i < nsegments_used; i++) {
-      if ((nsegments[i].kind & kind_mask) != 0)
+      if ((SEG(i).kind & kind_mask) != 0)
          nSegs++;
    }
 
@@ -587,8 +621,8 @@ Int VG_(am_get_segment_starts)( UInt kind_mask, Addr* starts, Int nStarts )
 
    j = 0;
    for (i = 0; i < nsegments_used; i++) {
-      if ((nsegments[i].kind & kind_mask) != 0)
-         starts[j++] = nsegments[i].start;
+      if ((SEG(i).kind & kind_mask) != 0)
+         starts[j++] = SEG(i).start;
    }
 
    aspacem_assert(j == nSegs); /* this should not fail */
@@ -710,42 +744,110 @@ static Bool maybe_merge_nsegments ( NSegment* s1, const NSegment* s2 )
 }
 
 
-/* Sanity-check and canonicalise the segment array (merge mergable
-   segments).  Returns True if any segments were merged. */
+/* Move the gap in the segment array so that it starts just before
+   segment i, that is, segments [0 .. i-1] end up below it. */
+
+static void move_nsegments_gap ( Int i )
+{
+   Int gapLen = nsegments_size - nsegments_used;
+
+   aspacem_assert(i >= 0 && i <= nsegments_used);
+
+   if (i < nsegments_gap) {
+      VG_(memmove)( &nsegments[i + gapLen], &nsegments[i],
+                    (nsegments_gap - i) * sizeof(NSegment) );
+   } else if (i > nsegments_gap) {
+      VG_(memmove)( &nsegments[nsegments_gap],
+                    &nsegments[nsegments_gap + gapLen],
+                    (i - nsegments_gap) * sizeof(NSegment) );
+   }
+   nsegments_gap = i;
+}
+
+/* Make room for a new segment at index i, moving segments [i ..]
+   up by one.  The caller must fill in SEG(i). */
 
-static Bool preen_nsegments ( void )
+static void insert_nsegment_at ( Int i )
 {
-   Int i, r, w, nsegments_used_old = nsegments_used;
+   aspacem_assert(nsegments_used < nsegments_size);
+   move_nsegments_gap(i);
+   nsegments_gap++;
+   nsegments_used++;
+}
+
+/* Remove segments [i .. i+n-1], moving the ones above down. */
+
+static void delete_nsegments_at ( Int i, Int n )
+{
+   aspacem_assert(n >= 0 && i >= 0 && i + n <= nsegments_used);
+   move_nsegments_gap(i + n);
+   nsegments_gap  -= n;
+   nsegments_used -= n;
+}
+
+
+/* Check the segment array covers the entire address space exactly
+   once, and also that each segment is sane.  This looks at every
+   segment, so is only done at --sanity-level=3 and above. */
+
+static void check_nsegments ( void )
+{
+   Int i;
 
-   /* Pass 1: check the segment array covers the entire address space
-      exactly once, and also that each segment is sane. */
    aspacem_assert(nsegments_used > 0);
-   aspacem_assert(nsegments[0].start == Addr_MIN);
-   aspacem_assert(nsegments[nsegments_used-1].end == Addr_MAX);
+   aspacem_assert(SEG(0).start == Addr_MIN);
+   aspacem_assert(SEG(nsegments_used-1).end == Addr_MAX);
 
-   aspacem_assert(sane_NSegment(&nsegments[0]));
+   aspacem_assert(sane_NSegment(&SEG(0)));
    for (i = 1; i < nsegments_used; i++) {
-      aspacem_assert(sane_NSegment(&nsegments[i]));
-      aspacem_assert(nsegments[i-1].end+1 == nsegments[i].start);
+      aspacem_assert(sane_NSegment(&SEG(i)));
+      aspacem_assert(SEG(i-1).end+1 == SEG(i).start);
    }
+}
+
+
+/* Canonicalise the segment array (merge mergable segments) after
+   segments iLo .. iHi inclusive have been changed.  The rest of the
+   array is already in canonical form, so only the changed segments
+   and their immediate neighbours need to be considered.  Returns True
+   if any segments were merged. */
+
+static Bool preen_nsegments ( Int iLo, Int iHi )
+{
+   Int r, w;
+
+   aspacem_assert(0 <= iLo && iLo <= iHi && iHi < nsegments_used);
+
+   if (VG_(clo_sanity_level) >= 3)
+      check_nsegments();
 
-   /* Pass 2: merge as much as possible, using
-      maybe_merge_segments. */
-   w = 0;
-   for (r = 1; r < nsegments_used; r++) {
-      if (maybe_merge_nsegments(&nsegments[w], &nsegments[r])) {
+   if (iLo > 0)
+      iLo--;
+   if (iHi < nsegments_used-1)
+      iHi++;
+
+   for (r = iLo; r <= iHi; r++) {
+      aspacem_assert(sane_NSegment(&SEG(r)));
+      if (r > iLo)
+         aspacem_assert(SEG(r-1).end+1 == SEG(r).start);
+   }
+
+   /* Merge as much as possible, using maybe_merge_segments, then
+      remove the segments that have been merged away. */
+   w = iLo;
+   for (r = iLo+1; r <= iHi; r++) {
+      if (maybe_merge_nsegments(&SEG(w), &SEG(r))) {
          /* nothing */
       } else {
          w++;
          if (w != r) 
-            nsegments[w] = nsegments[r];
+            SEG(w) = SEG(r);
       }
    }
-   w++;
-   aspacem_assert(w > 0 && w <= nsegments_used);
-   nsegments_used = w;
+   aspacem_assert(w >= iLo && w <= iHi);
+   delete_nsegments_at(w+1, iHi-w);
 
-   return nsegments_used != nsegments_used_old;
+   return w != iHi;
 }
 
 
@@ -805,8 +907,8 @@ static void sync_check_mapping_callback ( Addr addr, SizeT len, UInt prot,
    aspacem_assert(0 <= iLo && iLo < nsegments_used);
    aspacem_assert(0 <= iHi && iHi < nsegments_used);
    aspacem_assert(iLo <= iHi);
-   aspacem_assert(nsegments[iLo].start <= addr );
-   aspacem_assert(nsegments[iHi].end   >= addr + len - 1 );
+   aspacem_assert(SEG(iLo).start <= addr );
+   aspacem_assert(SEG(iHi).end   >= addr + len - 1 );
 
    /* x86 doesn't differentiate 'x' and 'r' (at least, all except the
       most recent NX-bit enabled CPUs) and so recent kernels attempt
@@ -843,22 +945,22 @@ static void sync_check_mapping_callback ( Addr addr, SizeT len, UInt prot,
       UInt seg_prot;
    
       /* compare the kernel's offering against ours. */
-      same = nsegments[i].kind == SkAnonC
-             || nsegments[i].kind == SkAnonV
-             || nsegments[i].kind == SkFileC
-             || nsegments[i].kind == SkFileV
-             || nsegments[i].kind == SkShmC;
+      same = SEG(i).kind == SkAnonC
+             || SEG(i).kind == SkAnonV
+             || SEG(i).kind == SkFileC
+             || SEG(i).kind == SkFileV
+             || SEG(i).kind == SkShmC;
 
       seg_prot = 0;
-      if (nsegments[i].hasR) seg_prot |= VKI_PROT_READ;
-      if (nsegments[i].hasW) seg_prot |= VKI_PROT_WRITE;
-      if (nsegments[i].hasX) seg_prot |= VKI_PROT_EXEC;
+      if (SEG(i).hasR) seg_prot |= VKI_PROT_READ;
+      if (SEG(i).hasW) seg_prot |= VKI_PROT_WRITE;
+      if (SEG(i).hasX) seg_prot |= VKI_PROT_EXEC;
 
       cmp_offsets
-         = nsegments[i].kind == SkFileC || nsegments[i].kind == SkFileV;
+         = SEG(i).kind == SkFileC || SEG(i).kind == SkFileV;
 
       cmp_devino
-         = nsegments[i].dev != 0 || nsegments[i].ino != 0;
+         = SEG(i).dev != 0 || SEG(i).ino != 0;
 
       /* Consider other reasons to not compare dev/inode */
 #if defined(VGO_linux)
@@ -897,10 +999,10 @@ static void sync_check_mapping_callback ( Addr addr, SizeT len, UInt prot,
       same = same
              && seg_prot == prot
              && (cmp_devino
-                   ? (nsegments[i].dev == dev && nsegments[i].ino == ino)
+                   ? (SEG(i).dev == dev && SEG(i).ino == ino)
                    : True)
              && (cmp_offsets 
-                   ? nsegments[i].start-nsegments[i].offset == addr-offset
+                   ? SEG(i).start-SEG(i).offset == addr-offset
                    : True);
       if (!same) {
          Addr start = addr;
@@ -913,7 +1015,7 @@ static void sync_check_mapping_callback ( Addr addr, SizeT len, UInt prot,
          VG_(debugLog)(
             0,"aspacem",
               "segment mismatch: V's seg 1st, kernel's 2nd:\n");
-         show_nsegment_full( 0, i, &nsegments[i] );
+         show_nsegment_full( 0, i, &SEG(i) );
          VG_(debugLog)(0,"aspacem", 
             "...: .... %010lx-%010lx %s %c%c%c.. ....... "
             "d=0x%03llx i=%-7llu o=%-7lld (.) m=. %s\n",
@@ -956,8 +1058,8 @@ static void sync_check_gap_callback ( Addr addr, SizeT len )
    aspacem_assert(0 <= iLo && iLo < nsegments_used);
    aspacem_assert(0 <= iHi && iHi < nsegments_used);
    aspacem_assert(iLo <= iHi);
-   aspacem_assert(nsegments[iLo].start <= addr );
-   aspacem_assert(nsegments[iHi].end   >= addr + len - 1 );
+   aspacem_assert(SEG(iLo).start <= addr );
+   aspacem_assert(SEG(iHi).end   >= addr + len - 1 );
 
    /* NSegments iLo .. iHi inclusive should agree with the presented
       data. */
@@ -966,8 +1068,8 @@ static void sync_check_gap_callback ( Addr addr, SizeT len )
       Bool same;
    
       /* compare the kernel's offering against ours. */
-      same = nsegments[i].kind == SkFree
-             || nsegments[i].kind == SkResvn;
+      same = SEG(i).kind == SkFree
+             || SEG(i).kind == SkResvn;
 
       if (!same) {
          Addr start = addr;
@@ -980,7 +1082,7 @@ static void sync_check_gap_callback ( Addr addr, SizeT len )
          VG_(debugLog)(
             0,"aspacem",
               "segment mismatch: V's gap 1st, kernel's 2nd:\n");
-         show_nsegment_full( 0, i, &nsegments[i] );
+         show_nsegment_full( 0, i, &SEG(i) );
          VG_(debugLog)(0,"aspacem", 
             "   : .... %010lx-%010lx %s\n",
             start, end, len_buf);
@@ -1064,8 +1166,8 @@ static Int find_nsegment_idx_WRK ( Addr a )
          ML_(am_barf)("find_nsegment_idx: not found");
       }
       mid      = (lo + hi) / 2;
-      a_mid_lo = nsegments[mid].start;
-      a_mid_hi = nsegments[mid].end;
+      a_mid_lo = SEG(mid).start;
+      a_mid_hi = SEG(mid).end;
 
       if (a < a_mid_lo) { hi = mid-1; continue; }
       if (a > a_mid_hi) { lo = mid+1; continue; }
@@ -1107,8 +1209,8 @@ inline static Int find_nsegment_idx ( Addr a )
    if ((a >> 12) == cache_pageno[ix]
        && cache_segidx[ix] >= 0
        && cache_segidx[ix] < nsegments_used
-       && nsegments[cache_segidx[ix]].start <= a
-       && a <= nsegments[cache_segidx[ix]].end) {
+       && SEG(cache_segidx[ix]).start <= a
+       && a <= SEG(cache_segidx[ix]).end) {
       /* hit */
       /* aspacem_assert( cache_segidx[ix] == find_nsegment_idx_WRK(a) ); */
       return cache_segidx[ix];
@@ -1129,12 +1231,12 @@ NSegment const * VG_(am_find_nsegment) ( Addr a )
 {
    Int i = find_nsegment_idx(a);
    aspacem_assert(i >= 0 && i < nsegments_used);
-   aspacem_assert(nsegments[i].start <= a);
-   aspacem_assert(a <= nsegments[i].end);
-   if (nsegments[i].kind == SkFree) 
+   aspacem_assert(SEG(i).start <= a);
+   aspacem_assert(a <= SEG(i).end);
+   if (SEG(i).kind == SkFree) 
       return NULL;
    else
-      return &nsegments[i];
+      return &SEG(i);
 }
 
 /* Finds an anonymous segment containing 'a'. Returned pointer is read only. */
@@ -1142,10 +1244,10 @@ NSegment const *VG_(am_find_anon_segment) ( Addr a )
 {
    Int i = find_nsegment_idx(a);
    aspacem_assert(i >= 0 && i < nsegments_used);
-   aspacem_assert(nsegments[i].start <= a);
-   aspacem_assert(a <= nsegments[i].end);
-   if (nsegments[i].kind == SkAnonC || nsegments[i].kind == SkAnonV)
-      return &nsegments[i];
+   aspacem_assert(SEG(i).start <= a);
+   aspacem_assert(a <= SEG(i).end);
+   if (SEG(i).kind == SkAnonC || SEG(i).kind == SkAnonV)
+      return &SEG(i);
    else
       return NULL;
 }
@@ -1153,9 +1255,13 @@ NSegment const *VG_(am_find_anon_segment) ( Addr a )
 /* Map segment pointer to segment index. */
 static Int segAddr_to_index ( const NSegment* seg )
 {
-   aspacem_assert(seg >= &nsegments[0] && seg < &nsegments[nsegments_used]);
+   Int i = seg - &nsegments[0];
+   Int gapLen = nsegments_size - nsegments_used;
+
+   aspacem_assert(i >= 0 && i < nsegments_size);
+   aspacem_assert(i < nsegments_gap || i >= nsegments_gap + gapLen);
 
-   return seg - &nsegments[0];
+   return i < nsegments_gap ? i : i - gapLen;
 }
 
 
@@ -1173,10 +1279,10 @@ NSegment const * VG_(am_next_nsegment) ( const NSegment* here, Bool fwds )
       if (i < 0)
          return NULL;
    }
-   if (nsegments[i].kind == SkFree) 
+   if (SEG(i).kind == SkFree) 
       return NULL;
    else
-      return &nsegments[i];
+      return &SEG(i);
 }
 
 
@@ -1188,9 +1294,57 @@ ULong VG_(am_get_anonsize_total)( void )
    Int   i;
    ULong total = 0;
    for (i = 0; i < nsegments_used; i++) {
-      if (nsegments[i].kind == SkAnonC || nsegments[i].kind == SkAnonV) {
-         total += (ULong)nsegments[i].end 
-                  - (ULong)nsegments[i].start + 1ULL;
+      if (SEG(i).kind == SkAnonC || SEG(i).kind == SkAnonV) {
+         total += (ULong)SEG(i).end 
+                  - (ULong)SEG(i).start + 1ULL;
+      }
+   }
+   return total;
+}
+
+/* Count the resident pages of [start, start+len), in chunks of
+   N_MINCORE_PAGES pages.  A chunk whose residency cannot be obtained is
+   counted as fully resident. */
+#define N_MINCORE_PAGES 4096
+static ULong resident_size ( Addr start, SizeT len )
+{
+#  if defined(VGO_linux)
+   static UChar vec[N_MINCORE_PAGES];
+   ULong total = 0;
+   while (len > 0) {
+      SizeT chunk = len < N_MINCORE_PAGES * VKI_PAGE_SIZE
+                       ? len : N_MINCORE_PAGES * VKI_PAGE_SIZE;
+      SysRes sres = ML_(am_do_mincore)( start, chunk, vec );
+      if (sr_isError(sres)) {
+         total += chunk;
+      } else {
+         SizeT i;
+         for (i = 0; i < chunk / VKI_PAGE_SIZE; i++)
+            if (vec[i] & 1)
+               total += VKI_PAGE_SIZE;
+      }
+      start += chunk;
+      len   -= chunk;
+   }
+   return total;
+#  else
+   return len;
+#  endif
+}
+
+/* Likewise, but only for the anonymous mappings belonging to V.  If
+   RESIDENT, only count the pages the kernel has actually backed, so
+   that space which is merely reserved (e.g. for the thread table) does
+   not count.  Where that cannot be found out, this is the same as the
+   mapped size. */
+ULong VG_(am_get_anonsize_valgrind)( Bool resident )
+{
+   Int   i;
+   ULong total = 0;
+   for (i = 0; i < nsegments_used; i++) {
+      if (SEG(i).kind == SkAnonV) {
+         SizeT len = SEG(i).end - SEG(i).start + 1;
+         total += resident ? resident_size( SEG(i).start, len ) : len;
       }
    }
    return total;
@@ -1218,9 +1372,9 @@ Bool is_valid_for( UInt kinds, Addr start, SizeT len, UInt prot )
    needX = toBool(prot & VKI_PROT_EXEC);
 
    iLo = find_nsegment_idx(start);
-   aspacem_assert(start >= nsegments[iLo].start);
+   aspacem_assert(start >= SEG(iLo).start);
 
-   if (start+len-1 <= nsegments[iLo].end) {
+   if (start+len-1 <= SEG(iLo).end) {
       /* This is a speedup hack which avoids calling find_nsegment_idx
          a second time when possible.  It is always correct to just
          use the "else" clause below, but is_valid_for_client is
@@ -1232,10 +1386,10 @@ Bool is_valid_for( UInt kinds, Addr start, SizeT len, UInt prot )
    }
 
    for (i = iLo; i <= iHi; i++) {
-      if ( (nsegments[i].kind & kinds) != 0
-           && (needR ? nsegments[i].hasR : True)
-           && (needW ? nsegments[i].hasW : True)
-           && (needX ? nsegments[i].hasX : True) ) {
+      if ( (SEG(i).kind & kinds) != 0
+           && (needR ? SEG(i).hasR : True)
+           && (needW ? SEG(i).hasW : True)
+           && (needX ? SEG(i).hasX : True) ) {
          /* ok */
       } else {
          return False;
@@ -1298,7 +1452,7 @@ static Bool any_Ts_in_range ( Addr start, SizeT len )
    iLo = find_nsegment_idx(start);
    iHi = find_nsegment_idx(start + len - 1);
    for (i = iLo; i <= iHi; i++) {
-      if (nsegments[i].hasT)
+      if (SEG(i).hasT)
          return True;
    }
    return False;
@@ -1312,7 +1466,7 @@ static Bool any_Ts_in_range ( Addr start, SizeT len )
        segment can be extended. */
 Bool VG_(am_addr_is_in_extensible_client_stack)( Addr addr )
 {
-   const NSegment *seg = nsegments + find_nsegment_idx(addr);
+   const NSegment *seg = &SEG(find_nsegment_idx(addr));
 
    switch (seg->kind) {
    case SkFree:
@@ -1361,7 +1515,7 @@ Bool VG_(am_addr_is_in_extensible_client_stack)( Addr addr )
 
 static void split_nsegment_at ( Addr a )
 {
-   Int i, j;
+   Int i;
 
    aspacem_assert(a > 0);
    aspacem_assert(VG_IS_PAGE_ALIGNED(a));
@@ -1369,30 +1523,177 @@ static void split_nsegment_at ( Addr a )
    i = find_nsegment_idx(a);
    aspacem_assert(i >= 0 && i < nsegments_used);
 
-   if (nsegments[i].start == a)
+   if (SEG(i).start == a)
       /* 'a' is already the start point of a segment, so nothing to be
          done. */
       return;
 
-   /* else we have to slide the segments upwards to make a hole */
-   if (nsegments_used >= VG_N_SEGMENTS)
-      ML_(am_barf_toolow)("VG_N_SEGMENTS");
-   for (j = nsegments_used-1; j > i; j--)
-      nsegments[j+1] = nsegments[j];
-   nsegments_used++;
+   /* else we have to make a hole above segment i */
+   insert_nsegment_at(i+1);
+
+   SEG(i+1)       = SEG(i);
+   SEG(i+1).start = a;
+   SEG(i).end     = a-1;
 
-   nsegments[i+1]       = nsegments[i];
-   nsegments[i+1].start = a;
-   nsegments[i].end     = a-1;
+   if (SEG(i).kind == SkFileV || SEG(i).kind == SkFileC)
+      SEG(i+1).offset 
+         += ((ULong)SEG(i+1).start) - ((ULong)SEG(i).start);
 
-   if (nsegments[i].kind == SkFileV || nsegments[i].kind == SkFileC)
-      nsegments[i+1].offset 
-         += ((ULong)nsegments[i+1].start) - ((ULong)nsegments[i].start);
+   ML_(am_inc_refcount)(SEG(i).fnIdx);
 
-   ML_(am_inc_refcount)(nsegments[i].fnIdx);
+   aspacem_assert(sane_NSegment(&SEG(i)));
+   aspacem_assert(sane_NSegment(&SEG(i+1)));
+}
+
+
+/* Map, and record, bytes of anonymous memory for aspacem's own use.
+   The advisory is used as a hint only, so the kernel cannot place the
+   memory over a mapping we don't know about. */
+
+static void* map_aspacem_buf ( SizeT bytes, const HChar* what )
+{
+   MapRequest req;
+   Addr       advised;
+   Bool       ok;
+   SysRes     sres;
+   NSegment   seg;
+
+   req.rkind = MAny;
+   req.start = 0;
+   req.len   = bytes;
+   advised = VG_(am_get_advisory)( &req, False/*forClient*/, &ok );
+   sres = VG_(am_do_mmap_NO_NOTIFY)( 
+             ok ? advised : 0, bytes, 
+             VKI_PROT_READ|VKI_PROT_WRITE, 
+             VKI_MAP_PRIVATE|VKI_MAP_ANONYMOUS, 
+             0, 0
+          );
+   if (sr_isError(sres)) {
+      HChar message[100];
+      ML_(am_sprintf)(message, "out of memory growing the %s", what);
+      ML_(am_barf)(message);
+   }
+
+   init_nsegment( &seg );
+   seg.kind  = SkAnonV;
+   seg.start = sr_Res(sres);
+   seg.end   = seg.start + bytes - 1;
+   seg.hasR  = True;
+   seg.hasW  = True;
+   add_segment( &seg );
+   return (void*)(Addr)sr_Res(sres);
+}
+
+/* Unmap, and record, memory mapped by map_aspacem_buf. */
+
+static void unmap_aspacem_buf ( void* p, SizeT bytes )
+{
+   SysRes   sres;
+   NSegment seg;
+
+   sres = ML_(am_do_munmap_NO_NOTIFY)( (Addr)p, bytes );
+   aspacem_assert(!sr_isError(sres));
+   init_nsegment( &seg );
+   seg.kind  = SkFree;
+   seg.start = (Addr)p;
+   seg.end   = seg.start + bytes - 1;
+   add_segment( &seg );
+}
+
+#if defined(VGO_solaris)
+/* Buffers into which parse_procselfmaps reads /proc/self/xmap and
+   /proc/self/rmap.  There are never more mappings than segments, so
+   each has room for as many entries as the segment array, and they
+   are grown with it. */
+static vki_prxmap_t  proc_xmap_initial[VG_N_SEGMENTS_INITIAL];
+static vki_prmap_t   proc_rmap_initial[VG_N_SEGMENTS_INITIAL];
+static vki_prxmap_t* proc_xmap      = proc_xmap_initial;
+static vki_prmap_t*  proc_rmap      = proc_rmap_initial;
+static Int           proc_maps_size = VG_N_SEGMENTS_INITIAL;
+
+/* Both new buffers are put in a single mapping, xmap first. */
+static SizeT proc_maps_bytes ( Int size )
+{
+   return VG_PGROUNDUP(size * (sizeof(vki_prxmap_t) + sizeof(vki_prmap_t)));
+}
+
+static void grow_proc_maps ( Int new_size )
+{
+   vki_prxmap_t* old = proc_xmap;
+   Int old_size      = proc_maps_size;
+
+   proc_xmap = map_aspacem_buf( proc_maps_bytes(new_size),
+                                "/proc/self/xmap buffers" );
+   proc_rmap = (vki_prmap_t*)(proc_xmap + new_size);
+   proc_maps_size = new_size;
+
+   if (old != proc_xmap_initial)
+      unmap_aspacem_buf( old, proc_maps_bytes(old_size) );
+}
+#endif
+
+/* Replace the segment array by one twice the size.  This maps memory
+   and so must only be done when the segment array agrees with the
+   kernel, i.e. not while a mapping change is being notified; see
+   ensure_nsegments_room.  The new array, and the freed old one, are
+   recorded like any other change of V's mappings.  On Solaris, the
+   buffers for reading the kernel's mappings are grown too. */
+
+static Bool growing_nsegments = False;
+
+static void grow_nsegments ( void )
+{
+   NSegment* old       = nsegments;
+   Int       old_size  = nsegments_size;
+   Int       new_size  = 2 * old_size;
+   SizeT     old_bytes = VG_PGROUNDUP(old_size * sizeof(NSegment));
+   SizeT     new_bytes = VG_PGROUNDUP(new_size * sizeof(NSegment));
+   Int       nAbove;
+   NSegment* new;
+
+   aspacem_assert(!growing_nsegments);
+   growing_nsegments = True;
+
+   /* This records the new array in the old one, which has room for it
+      (see NSEGMENTS_SLACK). */
+   new = map_aspacem_buf( new_bytes, "segment array" );
+
+   /* Copy the segments over, keeping the gap where it was. */
+   nAbove = nsegments_used - nsegments_gap;
+   VG_(memcpy)( &new[0], &old[0], nsegments_gap * sizeof(NSegment) );
+   VG_(memcpy)( &new[new_size - nAbove], &old[old_size - nAbove],
+                nAbove * sizeof(NSegment) );
+   nsegments      = new;
+   nsegments_size = new_size;
+
+   VG_(debugLog)(1, "aspacem",
+                 "grew segment array to %d entries at 0x%lx\n",
+                 new_size, (Addr)new);
+
+   if (old != nsegments_initial)
+      unmap_aspacem_buf( old, old_bytes );
+
+#  if defined(VGO_solaris)
+   grow_proc_maps( new_size );
+#  endif
 
-   aspacem_assert(sane_NSegment(&nsegments[i]));
-   aspacem_assert(sane_NSegment(&nsegments[i+1]));
+   growing_nsegments = False;
+}
+
+/* No operation adds more than this many segments (two splits for each
+   of at most two add_segment calls). */
+#define NSEGMENTS_SLACK 4
+
+/* Make sure the next operation on the segment array has room.  This
+   is called at the end of each operation which can add segments,
+   where the segment array is known to agree with the kernel, so that
+   no growing is ever needed in the middle of one. */
+
+static void ensure_nsegments_room ( void )
+{
+   if (nsegments_used + NSEGMENTS_SLACK > nsegments_size
+       && !growing_nsegments)
+      grow_nsegments();
 }
 
 
@@ -1420,8 +1721,8 @@ void split_nsegments_lo_and_hi ( Addr sLo, Addr sHi,
    aspacem_assert(0 <= *iLo && *iLo < nsegments_used);
    aspacem_assert(0 <= *iHi && *iHi < nsegments_used);
    aspacem_assert(*iLo <= *iHi);
-   aspacem_assert(nsegments[*iLo].start == sLo);
-   aspacem_assert(nsegments[*iHi].end == sHi);
+   aspacem_assert(SEG(*iLo).start == sLo);
+   aspacem_assert(SEG(*iHi).end == sHi);
    /* Not that I'm overly paranoid or anything, definitely not :-) */
 }
 
@@ -1463,18 +1764,23 @@ static void add_segment ( const NSegment* seg )
       that decrement the reference counters for the segments names of
       the replaced segments. */
    for (i = iLo; i <= iHi; ++i)
-      ML_(am_dec_refcount)(nsegments[i].fnIdx);
+      ML_(am_dec_refcount)(SEG(i).fnIdx);
    delta = iHi - iLo;
    aspacem_assert(delta >= 0);
-   if (delta > 0) {
-      for (i = iLo; i < nsegments_used-delta; i++)
-         nsegments[i] = nsegments[i+delta];
-      nsegments_used -= delta;
-   }
+   if (delta > 0)
+      delete_nsegments_at(iLo+1, delta);
 
-   nsegments[iLo] = *seg;
+   SEG(iLo) = *seg;
 
-   (void)preen_nsegments();
+   /* Freeing space invalidates the search hints below it. */
+   if (seg->kind == SkFree) {
+      if (sStart < aspacem_cFreeHint)
+         aspacem_cFreeHint = sStart;
+      if (sStart < aspacem_vFreeHint)
+         aspacem_vFreeHint = sStart;
+   }
+
+   (void)preen_nsegments(iLo, iLo);
    if (0) VG_(am_show_nsegments)(0,"AFTER preen (add_segment)");
 }
 
@@ -1615,8 +1921,9 @@ Addr VG_(am_startup) ( Addr sp_at_startup )
    seg.kind        = SkFree;
    seg.start       = Addr_MIN;
    seg.end         = Addr_MAX;
-   nsegments[0]    = seg;
    nsegments_used  = 1;
+   nsegments_gap   = 1;
+   SEG(0)          = seg;
 
    aspacem_minAddr = VG_(clo_aspacem_minAddr);
 
@@ -1818,6 +2125,7 @@ Addr VG_(am_startup) ( Addr sp_at_startup )
 
    VG_(am_show_nsegments)(2, "With contents of /proc/self/maps");
 
+   ensure_nsegments_room();
    AM_SANITY_CHECK;
    return suggested_clstack_end;
 }
@@ -1882,9 +2190,12 @@ Addr VG_(am_get_advisory) ( const MapRequest*  req,
         it does not trash either any of its own mappings or any of 
         valgrind's mappings.
    */
-   Int  i, j;
+   Int  i, j, startIdx;
    Addr holeStart, holeEnd, holeLen;
    Bool fixed_not_required;
+#if !defined(VGO_solaris)
+   Addr* freeHint;
+#endif
 
 #if defined(VGO_solaris)
    Addr startPoint = forClient ? aspacem_vStart - 1 : aspacem_maxAddr - 1;
@@ -1900,6 +2211,7 @@ Addr VG_(am_get_advisory) ( const MapRequest*  req,
       found. */
    Int floatIdx = -1;
    Int fixedIdx = -1;
+   Int firstFreeIdx = -1;
 
    aspacem_assert(nsegments_used > 0);
 
@@ -1928,11 +2240,11 @@ Addr VG_(am_get_advisory) ( const MapRequest*  req,
       Int  iHi   = find_nsegment_idx(reqEnd);
       Bool allow = True;
       for (i = iLo; i <= iHi; i++) {
-         if (nsegments[i].kind == SkFree
-             || nsegments[i].kind == SkFileC
-             || nsegments[i].kind == SkAnonC
-             || nsegments[i].kind == SkShmC
-             || nsegments[i].kind == SkResvn) {
+         if (SEG(i).kind == SkFree
+             || SEG(i).kind == SkFileC
+             || SEG(i).kind == SkAnonC
+             || SEG(i).kind == SkShmC
+             || SEG(i).kind == SkResvn) {
             /* ok */
          } else {
             allow = False;
@@ -1956,8 +2268,8 @@ Addr VG_(am_get_advisory) ( const MapRequest*  req,
       Int  iHi   = find_nsegment_idx(reqEnd);
       Bool allow = True;
       for (i = iLo; i <= iHi; i++) {
-         if (nsegments[i].kind == SkFree
-             || nsegments[i].kind == SkResvn) {
+         if (SEG(i).kind == SkFree
+             || SEG(i).kind == SkResvn) {
             /* ok */
          } else {
             allow = False;
@@ -1974,10 +2286,26 @@ Addr VG_(am_get_advisory) ( const MapRequest*  req,
 
    /* ------ Implement the Default Policy ------ */
 
-   /* Don't waste time looking for a fixed match if not requested to. */
+   /* Don't waste time looking for a fixed match if not requested to.
+      Otherwise, the only hole which can satisfy it is the one
+      containing the requested start. */
    fixed_not_required = req->rkind == MAny || req->rkind == MAlign;
 
-   i = find_nsegment_idx(startPoint);
+   if (!fixed_not_required) {
+      i = find_nsegment_idx(reqStart);
+      if (SEG(i).kind == SkFree && reqEnd <= SEG(i).end)
+         fixedIdx = i;
+   }
+
+#if !defined(VGO_solaris)
+   /* Skip the mappings which are known to come before the first free
+      hole. */
+   freeHint = forClient ? &aspacem_cFreeHint : &aspacem_vFreeHint;
+   if (*freeHint > startPoint)
+      startPoint = *freeHint;
+#endif
+
+   i = startIdx = find_nsegment_idx(startPoint);
 
 #if defined(VGO_solaris)
 #  define UPDATE_INDEX(index)                               \
@@ -2002,17 +2330,20 @@ Addr VG_(am_get_advisory) ( const MapRequest*  req,
 #endif /* VGO_solaris */
 
    /* Examine holes from index i back round to i-1.  Record the
-      index first fixed hole and the first floating hole which would
-      satisfy the request. */
+      index of the first floating hole which would satisfy the
+      request. */
    for (j = 0; j < nsegments_used; j++) {
 
-      if (nsegments[i].kind != SkFree) {
+      if (SEG(i).kind != SkFree) {
          UPDATE_INDEX(i);
          continue;
       }
 
-      holeStart = nsegments[i].start;
-      holeEnd   = nsegments[i].end;
+      if (firstFreeIdx == -1)
+         firstFreeIdx = i;
+
+      holeStart = SEG(i).start;
+      holeEnd   = SEG(i).end;
 
       /* Stay sane .. */
       aspacem_assert(holeStart <= holeEnd);
@@ -2031,26 +2362,28 @@ Addr VG_(am_get_advisory) ( const MapRequest*  req,
       /* See if it's any use to us. */
       holeLen = holeEnd - holeStart + 1;
 
-      if (fixedIdx == -1 && holeStart <= reqStart && reqEnd <= holeEnd)
-         fixedIdx = i;
-
-      if (floatIdx == -1 && holeLen >= reqLen)
+      if (holeLen >= reqLen) {
          floatIdx = i;
-  
-      /* Don't waste time searching once we've found what we wanted. */
-      if ((fixed_not_required || fixedIdx >= 0) && floatIdx >= 0)
          break;
+      }
 
       UPDATE_INDEX(i);
    }
 
+#if !defined(VGO_solaris)
+   /* If the search did not wrap around, everything between the hint
+      and the first free hole it found is mapped. */
+   if (firstFreeIdx >= startIdx)
+      *freeHint = SEG(firstFreeIdx).start;
+#endif
+
    aspacem_assert(fixedIdx >= -1 && fixedIdx < nsegments_used);
    if (fixedIdx >= 0) 
-      aspacem_assert(nsegments[fixedIdx].kind == SkFree);
+      aspacem_assert(SEG(fixedIdx).kind == SkFree);
 
    aspacem_assert(floatIdx >= -1 && floatIdx < nsegments_used);
    if (floatIdx >= 0) 
-      aspacem_assert(nsegments[floatIdx].kind == SkFree);
+      aspacem_assert(SEG(floatIdx).kind == SkFree);
 
    AM_SANITY_CHECK;
 
@@ -2072,21 +2405,21 @@ Addr VG_(am_get_advisory) ( const MapRequest*  req,
          }
          if (floatIdx >= 0) {
             *ok = True;
-            return ADVISE_ADDRESS(&nsegments[floatIdx]);
+            return ADVISE_ADDRESS(&SEG(floatIdx));
          }
          *ok = False;
          return 0;
       case MAny:
          if (floatIdx >= 0) {
             *ok = True;
-            return ADVISE_ADDRESS(&nsegments[floatIdx]);
+            return ADVISE_ADDRESS(&SEG(floatIdx));
          }
          *ok = False;
          return 0;
       case MAlign:
          if (floatIdx >= 0) {
             *ok = True;
-            return ADVISE_ADDRESS_ALIGNED(&nsegments[floatIdx]);
+            return ADVISE_ADDRESS_ALIGNED(&SEG(floatIdx));
          }
          *ok = False;
          return 0;
@@ -2124,10 +2457,10 @@ static NSegment const * VG_(am_find_free_nsegment) ( Addr a )
 {
    Int i = find_nsegment_idx(a);
    aspacem_assert(i >= 0 && i < nsegments_used);
-   aspacem_assert(nsegments[i].start <= a);
-   aspacem_assert(a <= nsegments[i].end);
-   if (nsegments[i].kind == SkFree) 
-      return &nsegments[i];
+   aspacem_assert(SEG(i).start <= a);
+   aspacem_assert(a <= SEG(i).end);
+   if (SEG(i).kind == SkFree) 
+      return &SEG(i);
    else
       return NULL;
 }
@@ -2185,6 +2518,7 @@ VG_(am_notify_client_mmap)( Addr a, SizeT len, UInt prot, UInt flags,
       }
    }
    add_segment( &seg );
+   ensure_nsegments_room();
    AM_SANITY_CHECK;
    return needDiscard;
 }
@@ -2216,6 +2550,7 @@ VG_(am_notify_client_shmat)( Addr a, SizeT len, UInt prot )
    seg.hasW   = toBool(prot & VKI_PROT_WRITE);
    seg.hasX   = toBool(prot & VKI_PROT_EXEC);
    add_segment( &seg );
+   ensure_nsegments_room();
    AM_SANITY_CHECK;
    return needDiscard;
 }
@@ -2255,12 +2590,12 @@ Bool VG_(am_notify_mprotect)( Addr start, SizeT len, UInt prot )
 
    for (i = iLo; i <= iHi; i++) {
       /* Apply the permissions to all relevant segments. */
-      switch (nsegments[i].kind) {
+      switch (SEG(i).kind) {
          case SkAnonC: case SkAnonV: case SkFileC: case SkFileV: case SkShmC:
-            nsegments[i].hasR = newR;
-            nsegments[i].hasW = newW;
-            nsegments[i].hasX = newX;
-            aspacem_assert(sane_NSegment(&nsegments[i]));
+            SEG(i).hasR = newR;
+            SEG(i).hasW = newW;
+            SEG(i).hasX = newX;
+            aspacem_assert(sane_NSegment(&SEG(i)));
             break;
          default:
             break;
@@ -2269,7 +2604,8 @@ Bool VG_(am_notify_mprotect)( Addr start, SizeT len, UInt prot )
 
    /* Changing permissions could have made previously un-mergable
       segments mergeable.  Therefore have to re-preen them. */
-   (void)preen_nsegments();
+   (void)preen_nsegments(iLo, iHi);
+   ensure_nsegments_room();
    AM_SANITY_CHECK;
    return needDiscard;
 }
@@ -2319,6 +2655,7 @@ Bool VG_(am_notify_munmap)( Addr start, SizeT len )
 
    /* Unmapping could create two adjacent free segments, so a preen is
       needed.  add_segment() will do that, so no need to here. */
+   ensure_nsegments_room();
    AM_SANITY_CHECK;
    return needDiscard;
 }
@@ -2426,6 +2763,7 @@ SysRes VG_(am_mmap_named_file_fixed_client_flags)
    }
    add_segment( &seg );
 
+   ensure_nsegments_room();
    AM_SANITY_CHECK;
    return sres;
 }
@@ -2484,6 +2822,7 @@ SysRes VG_(am_mmap_anon_fixed_client) ( Addr start, SizeT length, UInt prot )
    seg.hasX  = toBool(prot & VKI_PROT_EXEC);
    add_segment( &seg );
 
+   ensure_nsegments_room();
    AM_SANITY_CHECK;
    return sres;
 }
@@ -2543,6 +2882,7 @@ static SysRes am_mmap_anon_float_client ( SizeT length, Int prot, Bool isCH )
    seg.isCH  = isCH;
    add_segment( &seg );
 
+   ensure_nsegments_room();
    AM_SANITY_CHECK;
    return sres;
 }
@@ -2645,16 +2985,210 @@ SysRes VG_(am_mmap_anon_float_valgrind)( SizeT length )
    seg.hasX  = True;
    add_segment( &seg );
 
+   ensure_nsegments_room();
+   AM_SANITY_CHECK;
+   return sres;
+}
+
+/* Transparent huge page support for V's big, long-lived mappings
+   (tool shadow memory and the translation cache).  Such mappings are
+   placed at HUGEPAGE_SZB-aligned addresses and madvise'd with
+   MADV_HUGEPAGE, so that the kernel can back them with huge pages and
+   reduce TLB pressure on large-footprint programs.  Whether this is
+   done is decided by --huge-pages, once, on first use. */
+
+#define HUGEPAGE_SZB (2 * 1024 * 1024)
+
+static Int huge_pages_state = -1; /* -1: undecided, 0: off, 1: on */
+
+#if defined(VGO_linux)
+/* Does the kernel's THP setting file contain "[always]" or
+   "[madvise]", i.e. is THP usable through madvise? */
+static Bool thp_kernel_enabled ( void )
+{
+   HChar  buf[100];
+   Int    n, i;
+   SysRes fd = ML_(am_open)( "/sys/kernel/mm/transparent_hugepage/enabled",
+                             VKI_O_RDONLY, 0 );
+   if (sr_isError(fd))
+      return False;
+   n = ML_(am_read)( sr_Res(fd), buf, sizeof(buf) - 1 );
+   ML_(am_close)( sr_Res(fd) );
+   if (n <= 0)
+      return False;
+   buf[n] = 0;
+   for (i = 0; i < n; i++) {
+      if (buf[i] != '[')
+         continue;
+      if ((i + 8 <= n && buf[i+1] == 'a' && buf[i+2] == 'l'
+           && buf[i+7] == ']')
+          || (i + 9 <= n && buf[i+1] == 'm' && buf[i+2] == 'a'
+              && buf[i+8] == ']'))
+         return True;
+   }
+   return False;
+}
+#endif
+
+static Bool huge_pages_enabled ( void )
+{
+   if (LIKELY(huge_pages_state >= 0))
+      return huge_pages_state == 1;
+#  if defined(VGO_linux)
+   switch (VG_(clo_huge_pages)) {
+      case Vg_HugePagesNo:   huge_pages_state = 0; break;
+      case Vg_HugePagesYes:  huge_pages_state = 1; break;
+      case Vg_HugePagesAuto: huge_pages_state = thp_kernel_enabled() ? 1 : 0;
+                             break;
+      default:               aspacem_assert(0);
+   }
+#  else
+   huge_pages_state = 0;
+#  endif
+   VG_(debugLog)(1, "aspacem", "huge pages for V's large mappings: %s\n",
+                 huge_pages_state == 1 ? "enabled" : "disabled");
+   return huge_pages_state == 1;
+}
+
+/* Like VG_(am_mmap_anon_float_valgrind), but if huge pages are enabled,
+   the mapping starts on a HUGEPAGE_SZB boundary and is advised to be
+   backed by huge pages. */
+
+SysRes VG_(am_mmap_anon_float_valgrind_huge)( SizeT length )
+{
+   SysRes     sres;
+   NSegment   seg;
+   Addr       advised, aligned;
+   Bool       ok;
+   MapRequest req;
+
+   if (!huge_pages_enabled() || length < HUGEPAGE_SZB)
+      return VG_(am_mmap_anon_float_valgrind)( length );
+
+   length = VG_PGROUNDUP(length);
+
+   /* Ask for enough room to be able to align the start. */
+   req.rkind = MAny;
+   req.start = 0;
+   req.len   = length + HUGEPAGE_SZB;
+   advised = VG_(am_get_advisory)( &req, False/*forClient*/, &ok );
+   if (!ok)
+      return VG_(am_mmap_anon_float_valgrind)( length );
+   aligned = VG_ROUNDUP(advised, HUGEPAGE_SZB);
+
+   sres = VG_(am_do_mmap_NO_NOTIFY)( 
+             aligned, length, 
+             VKI_PROT_READ|VKI_PROT_WRITE|VKI_PROT_EXEC, 
+             VKI_MAP_FIXED|VKI_MAP_PRIVATE|VKI_MAP_ANONYMOUS, 
+             VM_TAG_VALGRIND, 0
+          );
+   if (sr_isError(sres))
+      /* See the inner kludge in VG_(am_mmap_anon_float_valgrind). */
+      return VG_(am_mmap_anon_float_valgrind)( length );
+   if (sr_Res(sres) != aligned) {
+      (void)ML_(am_do_munmap_NO_NOTIFY)( sr_Res(sres), length );
+      return VG_(mk_SysRes_Error)( VKI_EINVAL );
+   }
+
+#  if defined(VGO_linux)
+   /* A failure only means that the kernel has no THP support; the
+      mapping itself is fine. */
+   (void)ML_(am_do_madvise)( aligned, length, VKI_MADV_HUGEPAGE );
+#  endif
+   VG_(debugLog)(2, "aspacem", "huge mapping %#lx-%#lx\n",
+                 aligned, aligned + length - 1);
+
+   init_nsegment( &seg );
+   seg.kind  = SkAnonV;
+   seg.start = aligned;
+   seg.end   = seg.start + length - 1;
+   seg.hasR  = True;
+   seg.hasW  = True;
+   seg.hasX  = True;
+   add_segment( &seg );
+
+   ensure_nsegments_room();
    AM_SANITY_CHECK;
    return sres;
 }
 
-/* Really just a wrapper around VG_(am_mmap_anon_float_valgrind). */
+/* Shadow memory allocation.  With huge pages, small requests are
+   carved out of HUGEPAGE_SZB chunks, so that e.g. memcheck's SecMaps
+   share huge pages rather than each being a separate small mapping.
+   Carved blocks are never unmapped, as that would punch holes in the
+   huge pages: VG_(am_shadow_free) puts them on a free list instead,
+   for VG_(am_shadow_alloc) to reuse.  Otherwise, these are just
+   wrappers around VG_(am_mmap_anon_float_valgrind) and
+   VG_(am_munmap_valgrind). */
+
+static Addr shadow_chunk_next = 0;
+static Addr shadow_chunk_end1 = 0;
+
+/* Freed carved blocks, linked through their first word. */
+typedef
+   struct _ShadowFree {
+      struct _ShadowFree* next;
+      SizeT size;
+   }
+   ShadowFree;
+
+static ShadowFree* shadow_free_list = NULL;
 
 void* VG_(am_shadow_alloc)(SizeT size)
 {
-   SysRes sres = VG_(am_mmap_anon_float_valgrind)( size );
-   return sr_isError(sres) ? NULL : (void*)(Addr)sr_Res(sres);
+   SysRes       sres;
+   Addr         res;
+   ShadowFree** prev;
+
+   if (!huge_pages_enabled()) {
+      sres = VG_(am_mmap_anon_float_valgrind)( size );
+      return sr_isError(sres) ? NULL : (void*)(Addr)sr_Res(sres);
+   }
+
+   if (size == 0)
+      return NULL;
+   size = VG_PGROUNDUP(size);
+   if (size >= HUGEPAGE_SZB / 2) {
+      sres = VG_(am_mmap_anon_float_valgrind_huge)( size );
+      return sr_isError(sres) ? NULL : (void*)(Addr)sr_Res(sres);
+   }
+
+   for (prev = &shadow_free_list; *prev != NULL; prev = &(*prev)->next) {
+      if ((*prev)->size == size) {
+         res = (Addr)*prev;
+         *prev = (*prev)->next;
+         return (void*)res;
+      }
+   }
+
+   if (shadow_chunk_next + size > shadow_chunk_end1) {
+      /* Abandon what is left of the current chunk. */
+      sres = VG_(am_mmap_anon_float_valgrind_huge)( HUGEPAGE_SZB );
+      if (sr_isError(sres))
+         return NULL;
+      shadow_chunk_next = sr_Res(sres);
+      shadow_chunk_end1 = shadow_chunk_next + HUGEPAGE_SZB;
+   }
+   res = shadow_chunk_next;
+   shadow_chunk_next += size;
+   return (void*)res;
+}
+
+void VG_(am_shadow_free)(void* p, SizeT size)
+{
+   SysRes      sres;
+   ShadowFree* sf;
+
+   if (!huge_pages_enabled() || VG_PGROUNDUP(size) >= HUGEPAGE_SZB / 2) {
+      sres = VG_(am_munmap_valgrind)( (Addr)p, size );
+      aspacem_assert(!sr_isError(sres));
+      return;
+   }
+
+   sf = p;
+   sf->size = VG_PGROUNDUP(size);
+   sf->next = shadow_free_list;
+   shadow_free_list = sf;
 }
 
 /* Map a file at an unconstrained address for V, and update the
@@ -2736,6 +3270,7 @@ static SysRes VG_(am_mmap_file_float_valgrind_flags) ( SizeT length, UInt prot,
    }
    add_segment( &seg );
 
+   ensure_nsegments_room();
    AM_SANITY_CHECK;
    return sres;
 }
@@ -2864,26 +3399,27 @@ Bool VG_(am_change_ownership_v_to_c)( Addr start, SizeT len )
       return False;
 
    i = find_nsegment_idx(start);
-   if (nsegments[i].kind != SkFileV && nsegments[i].kind != SkAnonV)
+   if (SEG(i).kind != SkFileV && SEG(i).kind != SkAnonV)
       return False;
-   if (start+len-1 > nsegments[i].end)
+   if (start+len-1 > SEG(i).end)
       return False;
 
-   aspacem_assert(start >= nsegments[i].start);
-   aspacem_assert(start+len-1 <= nsegments[i].end);
+   aspacem_assert(start >= SEG(i).start);
+   aspacem_assert(start+len-1 <= SEG(i).end);
 
    /* This scheme is like how mprotect works: split the to-be-changed
       range into its own segment(s), then mess with them (it).  There
       should be only one. */
    split_nsegments_lo_and_hi( start, start+len-1, &iLo, &iHi );
    aspacem_assert(iLo == iHi);
-   switch (nsegments[iLo].kind) {
-      case SkFileV: nsegments[iLo].kind = SkFileC; break;
-      case SkAnonV: nsegments[iLo].kind = SkAnonC; break;
+   switch (SEG(iLo).kind) {
+      case SkFileV: SEG(iLo).kind = SkFileC; break;
+      case SkAnonV: SEG(iLo).kind = SkAnonC; break;
       default: aspacem_assert(0); /* can't happen - guarded above */
    }
 
-   preen_nsegments();
+   preen_nsegments(iLo, iHi);
+   ensure_nsegments_room();
    return True;
 }
 
@@ -2893,9 +3429,9 @@ Bool VG_(am_change_ownership_v_to_c)( Addr start, SizeT len )
 void VG_(am_set_segment_hasT)( Addr addr )
 {
    Int i = find_nsegment_idx(addr);
-   SegKind kind = nsegments[i].kind;
+   SegKind kind = SEG(i).kind;
    aspacem_assert(kind == SkAnonC || kind == SkFileC || kind == SkShmC);
-   nsegments[i].hasT = True;
+   SEG(i).hasT = True;
 }
 
 
@@ -2942,12 +3478,12 @@ Bool VG_(am_create_reservation) ( Addr start, SizeT length,
    if (startI != endI)
       return False;
 
-   if (nsegments[startI].kind != SkFree)
+   if (SEG(startI).kind != SkFree)
       return False;
 
    /* Looks good - make the reservation. */
-   aspacem_assert(nsegments[startI].start <= start2);
-   aspacem_assert(end2 <= nsegments[startI].end);
+   aspacem_assert(SEG(startI).start <= start2);
+   aspacem_assert(end2 <= SEG(startI).end);
 
    init_nsegment( &seg );
    seg.kind  = SkResvn;
@@ -2957,6 +3493,7 @@ Bool VG_(am_create_reservation) ( Addr start, SizeT length,
    seg.smode = smode;
    add_segment( &seg );
 
+   ensure_nsegments_room();
    AM_SANITY_CHECK;
    return True;
 }
@@ -2984,14 +3521,14 @@ const NSegment *VG_(am_extend_into_adjacent_reservation_client)( Addr addr,
    *overflow = False;
 
    segA = find_nsegment_idx(addr);
-   aspacem_assert(nsegments[segA].kind == SkAnonC);
+   aspacem_assert(SEG(segA).kind == SkAnonC);
 
    if (delta == 0)
-      return nsegments + segA;
+      return &SEG(segA);
 
-   prot =   (nsegments[segA].hasR ? VKI_PROT_READ : 0)
-          | (nsegments[segA].hasW ? VKI_PROT_WRITE : 0)
-          | (nsegments[segA].hasX ? VKI_PROT_EXEC : 0);
+   prot =   (SEG(segA).hasR ? VKI_PROT_READ : 0)
+          | (SEG(segA).hasW ? VKI_PROT_WRITE : 0)
+          | (SEG(segA).hasX ? VKI_PROT_EXEC : 0);
 
    aspacem_assert(VG_IS_PAGE_ALIGNED(delta<0 ? -delta : delta));
 
@@ -3000,12 +3537,12 @@ const NSegment *VG_(am_extend_into_adjacent_reservation_client)( Addr addr,
       /* Extending the segment forwards. */
       segR = segA+1;
       if (segR >= nsegments_used
-          || nsegments[segR].kind != SkResvn
-          || nsegments[segR].smode != SmLower)
+          || SEG(segR).kind != SkResvn
+          || SEG(segR).smode != SmLower)
          return NULL;
 
       if (delta + VKI_PAGE_SIZE 
-                > (nsegments[segR].end - nsegments[segR].start + 1)) {
+                > (SEG(segR).end - SEG(segR).start + 1)) {
          *overflow = True;
          return NULL;
       }
@@ -3013,23 +3550,23 @@ const NSegment *VG_(am_extend_into_adjacent_reservation_client)( Addr addr,
       /* Extend the kernel's mapping. */
       // DDD: #warning GrP fixme MAP_FIXED can clobber memory!
       sres = VG_(am_do_mmap_NO_NOTIFY)( 
-                nsegments[segR].start, delta,
+                SEG(segR).start, delta,
                 prot,
                 VKI_MAP_FIXED|VKI_MAP_PRIVATE|VKI_MAP_ANONYMOUS, 
                 0, 0 
              );
       if (sr_isError(sres))
          return NULL; /* kernel bug if this happens? */
-      if (sr_Res(sres) != nsegments[segR].start) {
+      if (sr_Res(sres) != SEG(segR).start) {
          /* kernel bug if this happens? */
         (void)ML_(am_do_munmap_NO_NOTIFY)( sr_Res(sres), delta );
         return NULL;
       }
 
       /* Ok, success with the kernel.  Update our structures. */
-      nsegments[segR].start += delta;
-      nsegments[segA].end += delta;
-      aspacem_assert(nsegments[segR].start <= nsegments[segR].end);
+      SEG(segR).start += delta;
+      SEG(segA).end += delta;
+      aspacem_assert(SEG(segR).start <= SEG(segR).end);
 
    } else {
 
@@ -3039,12 +3576,12 @@ const NSegment *VG_(am_extend_into_adjacent_reservation_client)( Addr addr,
 
       segR = segA-1;
       if (segR < 0
-          || nsegments[segR].kind != SkResvn
-          || nsegments[segR].smode != SmUpper)
+          || SEG(segR).kind != SkResvn
+          || SEG(segR).smode != SmUpper)
          return NULL;
 
       if (delta + VKI_PAGE_SIZE 
-                > (nsegments[segR].end - nsegments[segR].start + 1)) {
+                > (SEG(segR).end - SEG(segR).start + 1)) {
          *overflow = True;
          return NULL;
       }
@@ -3052,27 +3589,27 @@ const NSegment *VG_(am_extend_into_adjacent_reservation_client)( Addr addr,
       /* Extend the kernel's mapping. */
       // DDD: #warning GrP fixme MAP_FIXED can clobber memory!
       sres = VG_(am_do_mmap_NO_NOTIFY)( 
-                nsegments[segA].start-delta, delta,
+                SEG(segA).start-delta, delta,
                 prot,
                 VKI_MAP_FIXED|VKI_MAP_PRIVATE|VKI_MAP_ANONYMOUS, 
                 0, 0 
              );
       if (sr_isError(sres))
          return NULL; /* kernel bug if this happens? */
-      if (sr_Res(sres) != nsegments[segA].start-delta) {
+      if (sr_Res(sres) != SEG(segA).start-delta) {
          /* kernel bug if this happens? */
         (void)ML_(am_do_munmap_NO_NOTIFY)( sr_Res(sres), delta );
         return NULL;
       }
 
       /* Ok, success with the kernel.  Update our structures. */
-      nsegments[segR].end -= delta;
-      nsegments[segA].start -= delta;
-      aspacem_assert(nsegments[segR].start <= nsegments[segR].end);
+      SEG(segR).end -= delta;
+      SEG(segA).start -= delta;
+      aspacem_assert(SEG(segR).start <= SEG(segR).end);
    }
 
    AM_SANITY_CHECK;
-   return nsegments + segA;
+   return &SEG(segA);
 }
 
 
@@ -3096,7 +3633,7 @@ const NSegment *VG_(am_extend_map_client)( Addr addr, SizeT delta )
    Int ix = find_nsegment_idx(addr);
    aspacem_assert(ix >= 0 && ix < nsegments_used);
 
-   NSegment *seg = nsegments + ix;
+   NSegment *seg = &SEG(ix);
 
    aspacem_assert(seg->kind == SkFileC || seg->kind == SkAnonC ||
                   seg->kind == SkShmC);
@@ -3133,8 +3670,9 @@ const NSegment *VG_(am_extend_map_client)( Addr addr, SizeT delta )
    if (0)
       VG_(am_show_nsegments)(0, "VG_(am_extend_map_client) AFTER");
 
+   ensure_nsegments_room();
    AM_SANITY_CHECK;
-   return nsegments + find_nsegment_idx(addr);
+   return &SEG(find_nsegment_idx(addr));
 }
 
 
@@ -3177,8 +3715,8 @@ Bool VG_(am_relocate_nooverlap_client)( /*OUT*/Bool* need_discard,
    if (iLo != iHi)
       return False;
 
-   if (nsegments[iLo].kind != SkFileC && nsegments[iLo].kind != SkAnonC &&
-       nsegments[iLo].kind != SkShmC)
+   if (SEG(iLo).kind != SkFileC && SEG(iLo).kind != SkAnonC &&
+       SEG(iLo).kind != SkShmC)
       return False;
 
    sres = ML_(am_do_relocate_nooverlap_mapping_NO_NOTIFY)
@@ -3193,7 +3731,7 @@ Bool VG_(am_relocate_nooverlap_client)( /*OUT*/Bool* need_discard,
    *need_discard = any_Ts_in_range( old_addr, old_len )
                    || any_Ts_in_range( new_addr, new_len );
 
-   seg = nsegments[iLo];
+   seg = SEG(iLo);
 
    /* Mark the new area based on the old seg. */
    if (seg.kind == SkFileC) {
@@ -3218,6 +3756,7 @@ Bool VG_(am_relocate_nooverlap_client)( /*OUT*/Bool* need_discard,
 
    add_segment( &seg );
 
+   ensure_nsegments_room();
    AM_SANITY_CHECK;
    return True;
 }
@@ -3658,11 +4197,11 @@ static void add_mapping_callback(Addr addr, SizeT len, UInt prot,
 
       UInt seg_prot;
 
-      if (nsegments[i].kind == SkAnonV  ||  nsegments[i].kind == SkFileV) {
+      if (SEG(i).kind == SkAnonV  ||  SEG(i).kind == SkFileV) {
          /* Ignore V regions */
          continue;
       } 
-      else if (nsegments[i].kind == SkFree || nsegments[i].kind == SkResvn) {
+      else if (SEG(i).kind == SkFree || SEG(i).kind == SkResvn) {
          /* Add mapping for SkResvn regions */
          ChangedSeg* cs = &css_local[css_used_local];
          if (css_used_local < css_size_local) {
@@ -3678,28 +4217,28 @@ static void add_mapping_callback(Addr addr, SizeT len, UInt prot,
          return;
 
       }
-      else if (nsegments[i].kind == SkAnonC ||
-               nsegments[i].kind == SkFileC ||
-               nsegments[i].kind == SkShmC)
+      else if (SEG(i).kind == SkAnonC ||
+               SEG(i).kind == SkFileC ||
+               SEG(i).kind == SkShmC)
       {
          /* Check permissions on client regions */
          // GrP fixme
          seg_prot = 0;
-         if (nsegments[i].hasR) seg_prot |= VKI_PROT_READ;
-         if (nsegments[i].hasW) seg_prot |= VKI_PROT_WRITE;
+         if (SEG(i).hasR) seg_prot |= VKI_PROT_READ;
+         if (SEG(i).hasW) seg_prot |= VKI_PROT_WRITE;
 #        if defined(VGA_x86)
          // GrP fixme sloppyXcheck 
          // darwin: kernel X ignored and spuriously changes? (vm_copy)
          seg_prot |= (prot & VKI_PROT_EXEC);
 #        else
-         if (nsegments[i].hasX) seg_prot |= VKI_PROT_EXEC;
+         if (SEG(i).hasX) seg_prot |= VKI_PROT_EXEC;
 #        endif
          if (seg_prot != prot) {
              if (VG_(clo_trace_syscalls)) 
                  VG_(debugLog)(0,"aspacem","region %p..%p permission "
                                  "mismatch (kernel %x, V %x)\n", 
-                                 (void*)nsegments[i].start,
-                                 (void*)(nsegments[i].end+1), prot, seg_prot);
+                                 (void*)SEG(i).start,
+                                 (void*)(SEG(i).end+1), prot, seg_prot);
             /* Add mapping for regions with protection changes */
             ChangedSeg* cs = &css_local[css_used_local];
             if (css_used_local < css_size_local) {
@@ -3739,7 +4278,7 @@ static void remove_mapping_callback(Addr addr, SizeT len)
 
    /* NSegments iLo .. iHi inclusive should agree with the presented data. */
    for (i = iLo; i <= iHi; i++) {
-      if (nsegments[i].kind != SkFree && nsegments[i].kind != SkResvn) {
+      if (SEG(i).kind != SkFree && SEG(i).kind != SkResvn) {
          /* V has a mapping, kernel doesn't.  Add to css_local[],
             directives to chop off the part of the V mapping that
             falls within the gap that the kernel tells us is
@@ -3747,8 +4286,8 @@ static void remove_mapping_callback(Addr addr, SizeT len)
          ChangedSeg* cs = &css_local[css_used_local];
          if (css_used_local < css_size_local) {
             cs->is_added = False;
-            cs->start    = Addr__max(nsegments[i].start, addr);
-            cs->end      = Addr__min(nsegments[i].end,   addr + len - 1);
+            cs->start    = Addr__max(SEG(i).start, addr);
+            cs->end      = Addr__min(SEG(i).end,   addr + len - 1);
             aspacem_assert(VG_IS_PAGE_ALIGNED(cs->start));
             aspacem_assert(VG_IS_PAGE_ALIGNED(cs->end+1));
             /* I don't think the following should fail.  But if it
@@ -3824,9 +4363,8 @@ typedef struct
    HChar  filename[VKI_PATH_MAX];
 } Mapping;
 
-static SizeT read_proc_file(const HChar *filename, HChar *buf,
-                            SizeT buf_size, const HChar *buf_size_name,
-                            SizeT entry_size)
+static SizeT read_proc_file(const HChar *filename, void *buf,
+                            SizeT buf_size, SizeT entry_size)
 {
    SysRes res = ML_(am_open)(filename, VKI_O_RDONLY, 0);
    if (sr_isError(res)) {
@@ -3844,8 +4382,13 @@ static SizeT read_proc_file(const HChar *filename, HChar *buf,
       ML_(am_barf)(message);
    }
 
-   if (r >= buf_size)
-      ML_(am_barf_toolow)(buf_size_name);
+   /* The buffer has room for one entry per segment, so this can only
+      happen if the kernel has many more mappings than we know about. */
+   if (r >= buf_size) {
+      HChar message[100];
+      ML_(am_sprintf)(message, "Too many mappings in %s.", filename);
+      ML_(am_barf)(message);
+   }
 
    if (r % entry_size != 0) {
       HChar message[100];
@@ -3971,29 +4514,29 @@ static void parse_procselfmaps (
    Addr start = Addr_MIN;
    Addr gap_start = Addr_MIN;
 
-#define M_XMAP_BUF (VG_N_SEGMENTS * sizeof(vki_prxmap_t))
-   /* Static to keep it out of stack frame... */
-   static HChar xmap_buf[M_XMAP_BUF];
    const Mapping *xmap = NULL;
    SizeT xmap_index = 0; /* Current entry */
    SizeT xmap_entries;
    Mapping xmap_mapping;
    Bool advance_xmap;
 
-#define M_RMAP_BUF (VG_N_SEGMENTS * sizeof(vki_prmap_t))
-   static HChar rmap_buf[M_RMAP_BUF];
    const Mapping *rmap = NULL;
    SizeT rmap_index = 0; /* Current entry */
    SizeT rmap_entries;
    Mapping rmap_mapping;
    Bool advance_rmap;
 
+   const HChar *xmap_buf = (const HChar *)proc_xmap;
+   const HChar *rmap_buf = (const HChar *)proc_rmap;
+
    /* Read fully /proc/self/xmap and /proc/self/rmap. */
-   xmap_entries = read_proc_file("/proc/self/xmap", xmap_buf, M_XMAP_BUF,
-                                 "M_XMAP_BUF", sizeof(vki_prxmap_t));
+   xmap_entries = read_proc_file("/proc/self/xmap", proc_xmap,
+                                 proc_maps_size * sizeof(vki_prxmap_t),
+                                 sizeof(vki_prxmap_t));
 
-   rmap_entries = read_proc_file("/proc/self/rmap", rmap_buf, M_RMAP_BUF,
-                                 "M_RMAP_BUF", sizeof(vki_prmap_t));
+   rmap_entries = read_proc_file("/proc/self/rmap", proc_rmap,
+                                 proc_maps_size * sizeof(vki_prmap_t),
+                                 sizeof(vki_prmap_t));
 
    /* Get the first xmap and rmap. */
    advance_xmap = True;
@@ -4078,13 +4621,13 @@ static void new_segment_found_callback(Addr addr, SizeT len, UInt prot,
    Int iLo = find_nsegment_idx(addr);
    Int iHi = find_nsegment_idx(addr + len - 1);
    aspacem_assert(iLo <= iHi);
-   aspacem_assert(nsegments[iLo].start <= addr);
-   aspacem_assert(nsegments[iHi].end   >= addr + len - 1);
+   aspacem_assert(SEG(iLo).start <= addr);
+   aspacem_assert(SEG(iHi).end   >= addr + len - 1);
 
    /* Do not perform any sanity checks. That is done in other places.
       Just find if a reported mapping is found in aspacemgr's book keeping. */
    for (Int i = iLo; i <= iHi; i++) {
-      if ((nsegments[i].kind == SkFree) || (nsegments[i].kind == SkResvn)) {
+      if ((SEG(i).kind == SkFree) || (SEG(i).kind == SkResvn)) {
          found_addr = addr;
          found_size = len;
          found_prot = prot;
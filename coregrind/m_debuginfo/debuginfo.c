@@ -59,6 +59,7 @@
 #include "priv_tytypes.h"
 #include "priv_storage.h"
 #include "priv_readdwarf.h"
+#include "priv_diskcache.h"
 #if defined(VGO_linux) || defined(VGO_solaris)
 # include "priv_readelf.h"
 # include "priv_readdwarf3.h"
@@ -109,6 +110,11 @@
 /*------------------------------------------------------------*/
 
 static void caches__invalidate (void);
+static void load_deferred_tables ( DebugInfo* di, UInt tables );
+
+/* Number of archived DebugInfos whose line tables were freed by
+   VG_(discard_archived_line_tables). */
+static ULong stats__archived_line_tables_freed = 0;
 
 
 /*------------------------------------------------------------*/
@@ -341,6 +347,8 @@ static void free_DebugInfo ( DebugInfo* di )
    if (di->fsm.filename) ML_(dinfo_free)(di->fsm.filename);
    if (di->fsm.dbgname)  ML_(dinfo_free)(di->fsm.dbgname);
    if (di->soname)       ML_(dinfo_free)(di->soname);
+   if (di->cache_buildid) ML_(dinfo_free)(di->cache_buildid);
+   if (di->cache_debug_buildid) ML_(dinfo_free)(di->cache_debug_buildid);
    if (di->loctab)       ML_(dinfo_free)(di->loctab);
    if (di->loctab_fndn_ix) ML_(dinfo_free)(di->loctab_fndn_ix);
    if (di->inltab)       ML_(dinfo_free)(di->inltab);
@@ -473,6 +481,10 @@ static void discard_or_archive_DebugInfo ( DebugInfo* di )
             VG_(redir_notify_delete_DebugInfo)( curr );
          }
          if (archive) {
+            /* The object file may not be around any more by the time
+               an archived stack trace is printed, so read now what is
+               needed for that.  Call frame info won't be needed. */
+            load_deferred_tables(di, DiTab_Loc | DiTab_Dwarf3);
             /* Adjust the epoch markers appropriately. */
             di->last_epoch = VG_(current_DiEpoch)();
             VG_(archive_ExeContext_in_range) (di->last_epoch,
@@ -491,6 +503,42 @@ static void discard_or_archive_DebugInfo ( DebugInfo* di )
 }
 
 
+/* Free the line number and inlined call tables of the archived
+   DebugInfos.  These are only kept to give file/line info in the stack
+   traces of code that has been unloaded; once they are gone, such
+   traces just show the function names.  Returns the number of
+   DebugInfos whose tables were freed. */
+UInt VG_(discard_archived_line_tables) ( void )
+{
+   DebugInfo* di;
+   UInt       n_freed = 0;
+
+   for (di = debugInfo_list; di; di = di->next) {
+      if (!is_DebugInfo_archived(di)
+          || (di->loctab == NULL && di->inltab == NULL))
+         continue;
+      if (VG_(clo_verbosity) > 1)
+         VG_(dmsg)("Discarding line info of archived %s\n",
+                   di->fsm.filename ? di->fsm.filename : "???");
+      if (di->loctab)         ML_(dinfo_free)(di->loctab);
+      if (di->loctab_fndn_ix) ML_(dinfo_free)(di->loctab_fndn_ix);
+      if (di->inltab)         ML_(dinfo_free)(di->inltab);
+      di->loctab         = NULL;
+      di->loctab_fndn_ix = NULL;
+      di->loctab_used    = di->loctab_size = 0;
+      di->inltab         = NULL;
+      di->inltab_used    = di->inltab_size = 0;
+      n_freed++;
+   }
+
+   /* The caches can hold indexes into the tables just freed. */
+   if (n_freed > 0)
+      caches__invalidate();
+   stats__archived_line_tables_freed += n_freed;
+   return n_freed;
+}
+
+
 /* Repeatedly scan debugInfo_list, looking for DebugInfos with text
    AVMAs intersecting [start,start+length), and call discard_DebugInfo
    to get rid of them.  This modifies the list, hence the multiple
@@ -791,6 +839,37 @@ static void check_CFSI_related_invariants ( const DebugInfo* di )
 }
 
 
+/* Read those of the TABLES of 'di' that were deferred when its
+   symbols were read (--lazy-debuginfo=yes).  This is tried only once
+   per table: if reading fails, the table stays empty.
+
+   No cache needs invalidating: a query touching a deferred table of
+   'di' always reads it first, so nothing about these tables can have
+   been cached. */
+static void load_deferred_tables ( DebugInfo* di, UInt tables )
+{
+   tables &= di->deferred;
+   if (LIKELY(tables == 0))
+      return;
+   vg_assert(di->have_dinfo);
+
+#  if defined(VGO_linux) || defined(VGO_solaris)
+   (void)ML_(read_elf_deferred_debug_info)( di, tables );
+#  else
+   vg_assert(0); // only the ELF reader defers tables
+#  endif
+
+   /* Canonicalise whatever was read, even if reading failed part of
+      the way through. */
+   di->deferred &= ~tables;
+   ML_(canonicaliseDeferredTables)( di, tables );
+   if (tables & DiTab_CFI) {
+      check_CFSI_related_invariants(di);
+      ML_(finish_CFSI_arrays)(di);
+   }
+}
+
+
 /*--------------------------------------------------------------*/
 /*---                                                        ---*/
 /*--- TOP LEVEL: INITIALISE THE DEBUGINFO SYSTEM             ---*/
@@ -981,13 +1060,19 @@ static ULong di_notify_ACHIEVE_ACCEPT_STATE ( struct _DebugInfo* di )
                    "acquired info ------\n");
       /* invalidate the debug info caches. */
       caches__invalidate();
-      /* prepare read data for use */
-      ML_(canonicaliseTables)( di );
-      /* Check invariants listed in
-         Comment_on_IMPORTANT_REPRESENTATIONAL_INVARIANTS in
-         priv_storage.h. */
-      check_CFSI_related_invariants(di);
-      ML_(finish_CFSI_arrays)(di);
+      /* prepare read data for use, unless it was loaded from the
+         --debuginfo-cache-dir, in which case it is ready already,
+         and was checked before being saved */
+      if (!di->cache_loaded) {
+         ML_(canonicaliseTables)( di );
+         /* Check invariants listed in
+            Comment_on_IMPORTANT_REPRESENTATIONAL_INVARIANTS in
+            priv_storage.h. */
+         check_CFSI_related_invariants(di);
+         ML_(finish_CFSI_arrays)(di);
+         if (di->cache_buildid && di->deferred == 0)
+            ML_(diskcache_save)(di);
+      }
 
       // Mark di's first epoch point as a valid epoch.  Because its
       // last_epoch value is still invalid, this changes di's state from
@@ -1854,8 +1939,11 @@ InlIPCursor* VG_(new_IIPC)(DiEpoch ep, Addr eip)
 
    /* Search the DebugInfo for (ep, eip) */
    search_all_loctabs ( ep, eip, &di, &locno );
-   if (di == NULL || di->inltab_used == 0)
-      return NULL; // No di (with inltab) containing eip.
+   if (di == NULL)
+      return NULL; // No di containing eip.
+   load_deferred_tables(di, DiTab_Dwarf3);
+   if (di->inltab_used == 0)
+      return NULL; // No inltab in di.
 
    /* Search the entry in di->inltab with the highest addr_lo that
       contains eip. */
@@ -1911,6 +1999,201 @@ void VG_(delete_IIPC)(InlIPCursor *iipc)
 /*--- plausible-looking stack dumps.                       ---*/
 /*------------------------------------------------------------*/
 
+/* Results of VG_(resolve_IPs).  For each resolved (ip, epoch) pair,
+   this records what search_all_symtabs (for text symbols) and
+   search_all_loctabs would find, and the DebugInfo whose text contains
+   ip, which gives its object name.  The array is sorted by ip then
+   epoch, and looked up by binary search.  As it holds DebugInfo
+   pointers, it is discarded by caches__invalidate. */
+typedef
+   struct {
+      Addr       ip;
+      DiEpoch    ep;
+      DebugInfo* sym_di;  /* first DebugInfo with an r-x mapping holding
+                             ip, NULL if none */
+      Word       sno;     /* symtab entry of ip in sym_di, or -1 */
+      DebugInfo* text_di; /* first DebugInfo whose text holds ip,
+                             NULL if none */
+      Word       locno;   /* loctab entry of ip in text_di, or -1 */
+   }
+   ResolvedIP;
+
+static ResolvedIP* resolved_IPs      = NULL;
+static UWord       resolved_IPs_used = 0;
+
+static ULong stats__resolve_batches    = 0;
+static ULong stats__resolved_IPs       = 0;
+static ULong stats__resolved_IPs_found = 0;
+
+static Word cmp_ResolvedIP ( const ResolvedIP* r, Addr ip, DiEpoch ep )
+{
+   if (r->ip < ip) return -1;
+   if (r->ip > ip) return 1;
+   if (r->ep.n < ep.n) return -1;
+   if (r->ep.n > ep.n) return 1;
+   return 0;
+}
+
+/* Return the results of VG_(resolve_IPs) for (ep, ip), or NULL if
+   ip was not resolved at that epoch. */
+static const ResolvedIP* find_resolved_IP ( DiEpoch ep, Addr ip )
+{
+   Word lo = 0, hi = (Word)resolved_IPs_used - 1, mid, c;
+
+   while (lo <= hi) {
+      mid = (lo + hi) / 2;
+      c = cmp_ResolvedIP(&resolved_IPs[mid], ip, ep);
+      if (c < 0) { lo = mid + 1; continue; }
+      if (c > 0) { hi = mid - 1; continue; }
+      return &resolved_IPs[mid];
+   }
+   return NULL;
+}
+
+/* Index of the first of the n sorted entries of r whose ip is >= a. */
+static UWord first_ResolvedIP_from ( const ResolvedIP* r, UWord n, Addr a )
+{
+   UWord lo = 0, hi = n, mid;
+
+   while (lo < hi) {
+      mid = (lo + hi) / 2;
+      if (r[mid].ip < a)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+   return lo;
+}
+
+static Int cmp_Addr ( const void* v1, const void* v2 )
+{
+   Addr a1 = *(const Addr*)v1;
+   Addr a2 = *(const Addr*)v2;
+   if (a1 < a2) return -1;
+   if (a1 > a2) return 1;
+   return 0;
+}
+
+void VG_(resolve_IPs) ( DiEpoch ep, const Addr* ips, UWord n_ips )
+{
+   Addr*       sorted;
+   ResolvedIP* new;
+   ResolvedIP* merged;
+   UWord       n_new, i, j, k;
+   Word        lo;
+   DebugInfo*  di;
+
+   vg_assert(!is_DiEpoch_INVALID(ep));
+   if (n_ips == 0)
+      return;
+   stats__resolve_batches++;
+
+   /* Sort the IPs, dropping the duplicates and those already
+      resolved. */
+   sorted = ML_(dinfo_zalloc)("di.resolve_IPs.1", n_ips * sizeof(Addr));
+   VG_(memcpy)(sorted, ips, n_ips * sizeof(Addr));
+   VG_(ssort)(sorted, n_ips, sizeof(Addr), cmp_Addr);
+   n_new = 0;
+   for (i = 0; i < n_ips; i++) {
+      if (n_new > 0 && sorted[n_new - 1] == sorted[i])
+         continue;
+      if (find_resolved_IP(ep, sorted[i]) != NULL)
+         continue;
+      sorted[n_new++] = sorted[i];
+   }
+   if (n_new == 0) {
+      ML_(dinfo_free)(sorted);
+      return;
+   }
+   stats__resolved_IPs += n_new;
+
+   new = ML_(dinfo_zalloc)("di.resolve_IPs.2", n_new * sizeof(ResolvedIP));
+   for (i = 0; i < n_new; i++) {
+      new[i].ip      = sorted[i];
+      new[i].ep      = ep;
+      new[i].sym_di  = NULL;
+      new[i].sno     = -1;
+      new[i].text_di = NULL;
+      new[i].locno   = -1;
+   }
+   ML_(dinfo_free)(sorted);
+
+   /* Walk the DebugInfos in the order search_all_symtabs and
+      search_all_loctabs do, so that an IP is attributed to the same
+      DebugInfo.  Within a DebugInfo, the IPs are looked up in
+      increasing order, so that each search starts where the previous
+      one ended. */
+   for (di = debugInfo_list; di != NULL; di = di->next) {
+      if (!is_DI_valid_for_epoch(di, ep))
+         continue;
+
+      if (di->fsm.have_rx_map) {
+         for (j = 0; j < VG_(sizeXA)(di->fsm.maps); j++) {
+            const DebugInfoMapping* map = VG_(indexXA)(di->fsm.maps, j);
+            if (!map->rx)
+               continue;
+            lo = 0;
+            for (k = first_ResolvedIP_from(new, n_new, map->avma);
+                 k < n_new && new[k].ip < map->avma + map->size; k++) {
+               if (new[k].sym_di != NULL)
+                  continue;
+               new[k].sym_di = di;
+               new[k].sno = ML_(search_one_symtab_from)(di, new[k].ip,
+                                                        True, lo);
+               if (new[k].sno >= 0)
+                  lo = new[k].sno;
+            }
+         }
+      }
+
+      if (di->text_present && di->text_size > 0) {
+         Bool loaded = False;
+         lo = 0;
+         for (k = first_ResolvedIP_from(new, n_new, di->text_avma);
+              k < n_new && new[k].ip < di->text_avma + di->text_size; k++) {
+            if (new[k].text_di != NULL)
+               continue;
+            if (!loaded) {
+               load_deferred_tables(di, DiTab_Loc);
+               loaded = True;
+            }
+            new[k].text_di = di;
+            new[k].locno = ML_(search_one_loctab_from)(di, new[k].ip, lo);
+            if (new[k].locno >= 0)
+               lo = new[k].locno;
+         }
+      }
+   }
+
+   /* Merge the new results into resolved_IPs. */
+   merged = ML_(dinfo_zalloc)("di.resolve_IPs.3",
+                              (resolved_IPs_used + n_new)
+                              * sizeof(ResolvedIP));
+   i = j = k = 0;
+   while (i < resolved_IPs_used || j < n_new) {
+      if (j == n_new
+          || (i < resolved_IPs_used
+              && cmp_ResolvedIP(&resolved_IPs[i],
+                                new[j].ip, new[j].ep) < 0))
+         merged[k++] = resolved_IPs[i++];
+      else
+         merged[k++] = new[j++];
+   }
+   if (resolved_IPs)
+      ML_(dinfo_free)(resolved_IPs);
+   ML_(dinfo_free)(new);
+   resolved_IPs = merged;
+   resolved_IPs_used = k;
+}
+
+void VG_(forget_resolved_IPs) ( void )
+{
+   if (resolved_IPs)
+      ML_(dinfo_free)(resolved_IPs);
+   resolved_IPs = NULL;
+   resolved_IPs_used = 0;
+}
+
 /* Search all symtabs that we know about to locate ptr.  If found, set
    *pdi to the relevant DebugInfo, and *symno to the symtab entry
    *number within that.  If not found, *psi is set to NULL.
@@ -1925,6 +2208,18 @@ static void search_all_symtabs ( DiEpoch ep, Addr ptr,
    DebugInfo* di;
    Bool       inRange;
 
+   if (findText && resolved_IPs_used > 0) {
+      const ResolvedIP* r = find_resolved_IP(ep, ptr);
+      if (r != NULL) {
+         stats__resolved_IPs_found++;
+         if (r->sno == -1)
+            goto not_found;
+         *symno = r->sno;
+         *pdi = r->sym_di;
+         return;
+      }
+   }
+
    for (di = debugInfo_list; di != NULL; di = di->next) {
 
       if (!is_DI_valid_for_epoch(di, ep))
@@ -1985,6 +2280,19 @@ static void search_all_loctabs ( DiEpoch ep, Addr ptr,
 {
    Word       lno;
    DebugInfo* di;
+
+   if (resolved_IPs_used > 0) {
+      const ResolvedIP* r = find_resolved_IP(ep, ptr);
+      if (r != NULL) {
+         stats__resolved_IPs_found++;
+         if (r->locno == -1)
+            goto not_found;
+         *locno = r->locno;
+         *pdi = r->text_di;
+         return;
+      }
+   }
+
    for (di = debugInfo_list; di != NULL; di = di->next) {
       if (!is_DI_valid_for_epoch(di, ep))
          continue;
@@ -1992,6 +2300,7 @@ static void search_all_loctabs ( DiEpoch ep, Addr ptr,
           && di->text_size > 0
           && di->text_avma <= ptr 
           && ptr < di->text_avma + di->text_size) {
+         load_deferred_tables(di, DiTab_Loc);
          lno = ML_(search_one_loctab) ( di, ptr );
          if (lno == -1) goto not_found;
          *locno = lno;
@@ -2352,6 +2661,15 @@ Bool VG_(get_objname) ( DiEpoch ep, Addr a, const HChar** objname )
    const NSegment *seg;
    const HChar* filename;
 
+   if (resolved_IPs_used > 0) {
+      const ResolvedIP* r = find_resolved_IP(ep, a);
+      if (r != NULL && r->text_di != NULL) {
+         stats__resolved_IPs_found++;
+         *objname = r->text_di->fsm.filename;
+         return True;
+      }
+   }
+
    /* Look in the debugInfo_list to find the name.  In most cases we
       expect this to produce a result. */
    for (di = debugInfo_list; di != NULL; di = di->next) {
@@ -2909,6 +3227,90 @@ UWord evalCfiExpr ( const XArray* exprs, Int ix,
 }
 
 
+/* An index of the r-x mappings of the DebugInfos valid for the current
+   epoch, sorted by address, so that find_DiCfSI does not have to walk
+   the whole of debugInfo_list.  Since ML_(addDiCfSI) drops any CFI
+   which is not inside an r-x mapping, the mappings are all that is
+   needed to find the DebugInfo which may hold CFI for an address, and
+   they are known even for DebugInfos whose CFI has not been read yet
+   (--lazy-debuginfo=yes).
+
+   Mappings of different DebugInfos should not overlap, but nothing
+   relies on it: max_hi is the highest hi of this and all the previous
+   entries, so that a search knows when no earlier entry can cover an
+   address.
+
+   The index is rebuilt on the first search after caches__invalidate,
+   which happens whenever a DebugInfo is activated or discarded, and so
+   whenever the epoch changes. */
+typedef
+   struct {
+      Addr       lo;      /* first byte of the mapping */
+      Addr       hi;      /* last byte of the mapping */
+      Addr       max_hi;  /* max of hi over this and previous entries */
+      DebugInfo* di;
+   }
+   CfsiIndexEnt;
+
+static CfsiIndexEnt* cfsi_index       = NULL;
+static UWord         cfsi_index_used  = 0;
+static UWord         cfsi_index_size  = 0;
+static Bool          cfsi_index_valid = False;
+
+/* Stats, shown by VG_(print_debuginfo_stats). */
+static ULong stats__cfsi_cache_queries  = 0;
+static ULong stats__cfsi_cache_misses   = 0;
+static ULong stats__cfsi_index_rebuilds = 0;
+static ULong stats__cfsi_index_steps    = 0;
+
+static Int cmp_CfsiIndexEnt ( const void* v1, const void* v2 )
+{
+   const CfsiIndexEnt* e1 = v1;
+   const CfsiIndexEnt* e2 = v2;
+   if (e1->lo < e2->lo) return -1;
+   if (e1->lo > e2->lo) return 1;
+   return 0;
+}
+
+static void cfsi_index__rebuild ( void )
+{
+   DebugInfo* di;
+   Word       i;
+   DiEpoch    curr_epoch = VG_(current_DiEpoch)();
+
+   stats__cfsi_index_rebuilds++;
+   cfsi_index_used = 0;
+   for (di = debugInfo_list; di != NULL; di = di->next) {
+      if (!is_DI_valid_for_epoch(di, curr_epoch))
+         continue;
+      for (i = 0; i < VG_(sizeXA)(di->fsm.maps); i++) {
+         const DebugInfoMapping* map = VG_(indexXA)(di->fsm.maps, i);
+         if (!map->rx || map->size == 0)
+            continue;
+         if (cfsi_index_used == cfsi_index_size) {
+            cfsi_index_size = cfsi_index_size == 0 ? 64 : 2 * cfsi_index_size;
+            cfsi_index = ML_(dinfo_realloc)("di.debuginfo.cir.1", cfsi_index,
+                                            cfsi_index_size
+                                            * sizeof cfsi_index[0]);
+         }
+         cfsi_index[cfsi_index_used].lo = map->avma;
+         cfsi_index[cfsi_index_used].hi = map->avma + map->size - 1;
+         cfsi_index[cfsi_index_used].di = di;
+         cfsi_index_used++;
+      }
+   }
+
+   if (cfsi_index_used > 0)
+      VG_(ssort)(cfsi_index, cfsi_index_used, sizeof cfsi_index[0],
+                 cmp_CfsiIndexEnt);
+   for (i = 0; i < cfsi_index_used; i++) {
+      cfsi_index[i].max_hi = cfsi_index[i].hi;
+      if (i > 0 && cfsi_index[i-1].max_hi > cfsi_index[i].max_hi)
+         cfsi_index[i].max_hi = cfsi_index[i-1].max_hi;
+   }
+   cfsi_index_valid = True;
+}
+
 /* Search all the DebugInfos in the entire system, to find the DiCfSI_m
    that pertains to 'ip'. 
 
@@ -2925,23 +3327,42 @@ static void find_DiCfSI ( /*OUT*/DebugInfo** diP,
                           /*OUT*/DiCfSI_m** cfsi_mP,
                           Addr ip )
 {
-   DebugInfo* di;
+   DebugInfo* di = NULL;
    Word       i = -1;
-
-   static UWord n_search = 0;
-   static UWord n_steps = 0;
-   n_search++;
+   Word       k, lo, hi;
 
    if (0) VG_(printf)("search for %#lx\n", ip);
 
-   DiEpoch curr_epoch = VG_(current_DiEpoch)();
+   if (UNLIKELY(!cfsi_index_valid))
+      cfsi_index__rebuild();
 
-   for (di = debugInfo_list; di != NULL; di = di->next) {
+   /* Find the last entry starting at or below ip ... */
+   lo = 0;
+   hi = cfsi_index_used - 1;
+   k  = -1;
+   while (lo <= hi) {
+      Word mid = (lo + hi) / 2;
+      if (cfsi_index[mid].lo <= ip) {
+         k  = mid;
+         lo = mid + 1;
+      } else {
+         hi = mid - 1;
+      }
+   }
+
+   /* ... and look at it and those before it which may cover ip. */
+   for (; k >= 0 && cfsi_index[k].max_hi >= ip; k--) {
       Word j;
-      n_steps++;
+      stats__cfsi_index_steps++;
 
-      if (!is_DI_valid_for_epoch(di, curr_epoch))
+      if (ip > cfsi_index[k].hi)
          continue;
+      di = cfsi_index[k].di;
+
+      /* The summary address ranges below are only known once the
+         call frame info has been read. */
+      if (UNLIKELY(di->deferred & DiTab_CFI))
+         load_deferred_tables(di, DiTab_CFI);
 
       /* Use the per-DebugInfo summary address ranges to skip
          inapplicable DebugInfos quickly. */
@@ -2981,29 +3402,10 @@ static void find_DiCfSI ( /*OUT*/DebugInfo** diP,
       if (*cfsi_mP == NULL) {
          // This is a cfsi hole. Report no cfi information found.
          *diP = (DebugInfo*)1;
-         // But we will still perform the hack below.
       } else {
          *diP = di;
       }
 
-      /* Start of performance-enhancing hack: once every 64 (chosen
-         hackily after profiling) successful searches, move the found
-         DebugInfo one step closer to the start of the list.  This
-         makes future searches cheaper.  For starting konqueror on
-         amd64, this in fact reduces the total amount of searching
-         done by the above find-the-right-DebugInfo loop by more than
-         a factor of 20. */
-      if ((n_search & 0xF) == 0) {
-         /* Move di one step closer to the start of the list. */
-         move_DebugInfo_one_step_forward( di );
-      }
-      /* End of performance-enhancing hack. */
-
-      if (0 && ((n_search & 0x7FFFF) == 0))
-         VG_(printf)("find_DiCfSI: %lu searches, "
-                     "%lu DebugInfos looked at\n", 
-                     n_search, n_steps);
-
    }
 
 }
@@ -3026,53 +3428,98 @@ static void find_DiCfSI ( /*OUT*/DebugInfo** diP,
    once a DebugInfo is read, adding new DiCfSI_m* is not possible
    anymore, as the cfsi_m_pool is frozen once the reading is terminated.
    Also, the cache is invalidated when new debuginfo is read due to
-   an mmap or some debuginfo is discarded due to an munmap. */
+   an mmap or some debuginfo is discarded due to an munmap.
 
-// Prime number, giving about 6Kbytes cache on 32 bits,
-//                           12Kbytes cache on 64 bits.
-#define N_CFSI_M_CACHE 509
+   The cache is set-associative: an ip can be in any of the
+   N_CFSI_M_CACHE_WAYS entries of set ip % N_CFSI_M_CACHE_SETS.  The
+   entries of a set are kept in most-recently-used-first order, so a
+   miss replaces the least recently used one.  Call stacks deep in big
+   programs visit many more return addresses than a direct-mapped
+   cache of a few hundred entries can hold without conflicts. */
+
+// Prime number of sets, giving about 192Kbytes cache on 32 bits,
+//                                  384Kbytes cache on 64 bits.
+#define N_CFSI_M_CACHE_SETS 4093
+#define N_CFSI_M_CACHE_WAYS 4
 
 typedef
    struct { Addr ip; DebugInfo* di; DiCfSI_m* cfsi_m; }
    CFSI_m_CacheEnt;
 
-static CFSI_m_CacheEnt cfsi_m_cache[N_CFSI_M_CACHE];
+static CFSI_m_CacheEnt cfsi_m_cache[N_CFSI_M_CACHE_SETS][N_CFSI_M_CACHE_WAYS];
 
 static void cfsi_m_cache__invalidate ( void ) {
    VG_(memset)(&cfsi_m_cache, 0, sizeof(cfsi_m_cache));
+   cfsi_index_valid = False;
 }
 
 static inline CFSI_m_CacheEnt* cfsi_m_cache__find ( Addr ip )
 {
-   UWord         hash = ip % N_CFSI_M_CACHE;
-   CFSI_m_CacheEnt* ce = &cfsi_m_cache[hash];
-#  ifdef N_Q_M_STATS
-   static UWord  n_q = 0, n_m = 0;
-   n_q++;
-   if (0 == (n_q & 0x1FFFFF))
-      VG_(printf)("QQQ %lu %lu\n", n_q, n_m);
-#  endif
+   CFSI_m_CacheEnt* set = cfsi_m_cache[ip % N_CFSI_M_CACHE_SETS];
+   CFSI_m_CacheEnt  tmp;
+   DebugInfo*       di;
+   DiCfSI_m*        cfsi_m;
+   UInt             w;
 
-   if (LIKELY(ce->ip == ip) && LIKELY(ce->di != NULL)) {
-      /* found an entry in the cache .. */
+   stats__cfsi_cache_queries++;
+
+   if (LIKELY(set[0].ip == ip) && LIKELY(set[0].di != NULL)) {
+      /* found it in the most recently used entry of the set .. */
    } else {
-      /* not found in cache.  Search and update. */
-#     ifdef N_Q_M_STATS
-      n_m++;
-#     endif
-      ce->ip = ip;
-      find_DiCfSI( &ce->di, &ce->cfsi_m, ip );
+      for (w = 1; w < N_CFSI_M_CACHE_WAYS; w++) {
+         if (set[w].ip == ip && set[w].di != NULL)
+            break;
+      }
+      if (w < N_CFSI_M_CACHE_WAYS) {
+         /* found it further down the set; move it to the front. */
+         tmp = set[w];
+      } else {
+         /* not found in cache.  Search, and evict the least recently
+            used entry. */
+         stats__cfsi_cache_misses++;
+         find_DiCfSI( &di, &cfsi_m, ip );
+         tmp.ip     = ip;
+         tmp.di     = di;
+         tmp.cfsi_m = cfsi_m;
+         w = N_CFSI_M_CACHE_WAYS - 1;
+      }
+      for (; w > 0; w--)
+         set[w] = set[w-1];
+      set[0] = tmp;
    }
 
-   if (UNLIKELY(ce->di == (DebugInfo*)1)) {
+   if (UNLIKELY(set[0].di == (DebugInfo*)1)) {
       /* no DiCfSI for this address */
       return NULL;
    } else {
       /* found a DiCfSI for this address */
-      return ce;
+      return &set[0];
    }
 }
 
+void VG_(print_debuginfo_stats) ( void )
+{
+   VG_(message)(Vg_DebugMsg,
+                "debuginfo: cfsi cache: %'llu queries, %'llu misses "
+                "(1 in %llu)\n",
+                stats__cfsi_cache_queries, stats__cfsi_cache_misses,
+                stats__cfsi_cache_queries / (stats__cfsi_cache_misses
+                                             ? stats__cfsi_cache_misses : 1));
+   VG_(message)(Vg_DebugMsg,
+                "debuginfo: cfsi index: %'lu entries, %'llu rebuilds, "
+                "%'llu entries looked at\n",
+                cfsi_index_used, stats__cfsi_index_rebuilds,
+                stats__cfsi_index_steps);
+   VG_(message)(Vg_DebugMsg,
+                "debuginfo: resolved IPs: %'llu batches, %'llu IPs, "
+                "%'llu lookups answered\n",
+                stats__resolve_batches, stats__resolved_IPs,
+                stats__resolved_IPs_found);
+   VG_(message)(Vg_DebugMsg,
+                "debuginfo: archived line tables freed: %'llu\n",
+                stats__archived_line_tables_freed);
+}
+
 Bool VG_(has_CF_info)(Addr a)
 {
    return cfsi_m_cache__find (a) != NULL;
@@ -3967,6 +4414,8 @@ Bool consider_vars_in_frame ( /*MOD*/XArray* /* of HChar */ dname1,
    }
    /* End of performance-enhancing hack. */
 
+   load_deferred_tables(di, DiTab_Dwarf3);
+
    /* any var info at all? */
    if (!di->varinfo)
       return False;
@@ -4085,6 +4534,7 @@ Bool VG_(get_data_description)(
       /* text segment missing? unlikely, but handle it .. */
       if (!di->text_present || di->text_size == 0)
          continue;
+      load_deferred_tables(di, DiTab_Dwarf3);
       /* any var info at all? */
       if (!di->varinfo)
          continue;
@@ -4411,6 +4861,8 @@ VG_(di_get_stack_blocks_at_ip)( Addr ip, Bool arrays_only )
    }
    /* End of performance-enhancing hack. */
 
+   load_deferred_tables(di, DiTab_Dwarf3);
+
    /* any var info at all? */
    if (!di->varinfo)
       return res; /* currently empty */
@@ -4503,6 +4955,8 @@ VG_(di_get_global_blocks_from_dihandle) ( ULong di_handle, Bool  arrays_only )
    gvars = VG_(newXA)( ML_(dinfo_zalloc), "di.debuginfo.dggbfd.1",
                        ML_(dinfo_free), sizeof(GlobalBlock) );
 
+   load_deferred_tables(di, DiTab_Dwarf3);
+
    /* any var info at all? */
    if (!di->varinfo)
       return gvars;
@@ -4833,6 +5287,7 @@ UInt VG_(debuginfo_generation) (void)
 static void caches__invalidate ( void ) {
    cfsi_m_cache__invalidate();
    sym_name_cache__invalidate();
+   VG_(forget_resolved_IPs)();
    debuginfo_generation++;
 }
 
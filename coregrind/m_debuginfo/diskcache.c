@@ -0,0 +1,741 @@
+
+/*--------------------------------------------------------------------*/
+/*--- On-disk cache of canonicalised debug info tables.            ---*/
+/*---                                                  diskcache.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   Copyright (C) 2019-2019 The Valgrind Developers
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#include "pub_core_basics.h"
+#include "pub_core_vki.h"
+#include "pub_core_debuginfo.h"
+#include "pub_core_libcassert.h"
+#include "pub_core_libcbase.h"
+#include "pub_core_libcfile.h"
+#include "pub_core_libcprint.h"
+#include "pub_core_libcproc.h"      /* VG_(getpid) */
+#include "pub_core_options.h"
+#include "pub_core_xarray.h"
+#include "pub_core_wordfm.h"
+#include "pub_core_deduppoolalloc.h"
+
+#include "priv_misc.h"              /* dinfo_zalloc/free/strdup */
+#include "priv_image.h"
+#include "priv_tytypes.h"
+#include "priv_storage.h"
+#include "priv_diskcache.h"         /* self */
+
+/* See priv_diskcache.h for the overall story. */
+
+#define DISKCACHE_MAGIC    0x43444756  /* "VGDC" */
+#define DISKCACHE_VERSION  2
+
+#define NO_STR  0xFFFFFFFFFFFFFFFFULL
+
+typedef
+   struct {
+      UInt  magic;
+      UInt  version;
+      /* The layout of the tables.  An entry saved by a Valgrind
+         with different ones is ignored. */
+      UInt  sizeof_DiSym;
+      UInt  sizeof_DiLoc;
+      UInt  sizeof_DiInlLoc;
+      UInt  sizeof_FnDn;
+      UInt  sizeof_DiCfSI_m;
+      UInt  sizeof_CfiExpr;
+      /* Were the inlined calls read ? */
+      UInt  inline_info;
+      UInt  sizeof_fndn_ix;
+      UInt  sizeof_cfsi_m_ix;
+      UInt  unused;
+      /* Where the object was when the entry was saved. */
+      Addr  text_avma;
+      Addr  text_bias;
+      Addr  data_bias;
+      /* The sizes of the tables following the header, in order. */
+      ULong n_strs;          /* strings, NUL-terminated, in str order */
+      ULong strs_szB;
+      ULong debug_buildid;   /* str number of the build-id of the
+                                separate debug file the tables were
+                                read from, NO_STR if there was none */
+      ULong symtab_used;     /* DiSym; the pri_name is a str number,
+                                the sec_names 0 or 1 + the index in
+                                the following table */
+      ULong n_sec_names;     /* ULong str numbers; NO_STR ends a list */
+      ULong loctab_used;     /* DiLoc, then the loctab_fndn_ix */
+      ULong inltab_used;     /* DiInlLoc; the inlinedfn is a str number */
+      ULong maxinl_codesz;
+      ULong n_fndn;          /* FnDn, as str numbers (dirname: NO_STR
+                                if NULL), in fndnpool order */
+      ULong cfsi_used;       /* Addr cfsi_base, then the cfsi_m_ix */
+      ULong n_cfsi_m;        /* DiCfSI_m, in cfsi_m_pool order */
+      ULong n_cfsi_exprs;    /* CfiExpr */
+      Addr  cfsi_minavma;
+      Addr  cfsi_maxavma;
+   }
+   DiskCacheHeader;
+
+Bool ML_(diskcache_wanted) ( const DebugInfo* di )
+{
+   /* Variable info is not cached: its types and location expressions
+      are a graph rather than tables.  When tracing, the point is to
+      see the debug info being read. */
+   return VG_(clo_debuginfo_cache_dir) != NULL
+          && !VG_(clo_read_var_info)
+          && !di->trace_symtab && !di->trace_cfi
+          && !di->ddump_syms && !di->ddump_line && !di->ddump_frames;
+}
+
+static HChar* entry_name ( const HChar* buildid, const HChar* suffix )
+{
+   HChar* name = ML_(dinfo_zalloc)( "di.diskcache.entry_name.1",
+                                    VG_(strlen)(VG_(clo_debuginfo_cache_dir))
+                                    + VG_(strlen)(buildid)
+                                    + VG_(strlen)(suffix) + 2 );
+   VG_(sprintf)( name, "%s/%s%s", VG_(clo_debuginfo_cache_dir),
+                 buildid, suffix );
+   return name;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Saving                                               ---*/
+/*------------------------------------------------------------*/
+
+typedef
+   struct {
+      WordFM* str_nos;  /* string address -> str number */
+      XArray* strs;     /* of HChar: the strings, in str order */
+      ULong   n_strs;
+   }
+   StrTab;
+
+static ULong str_no ( StrTab* st, const HChar* str )
+{
+   UWord no;
+   if (str == NULL)
+      return NO_STR;
+   if (!VG_(lookupFM)( st->str_nos, NULL, &no, (UWord)str )) {
+      no = st->n_strs++;
+      VG_(addToFM)( st->str_nos, (UWord)str, no );
+      VG_(addBytesToXA)( st->strs, str, VG_(strlen)(str) + 1 );
+   }
+   return no;
+}
+
+/* Writes 'szB' bytes, then pads to a multiple of 8 bytes. */
+static Bool write_padded ( Int fd, const void* p, ULong szB )
+{
+   static const UChar zeroes[8] = { 0 };
+   const UChar* q = p;
+   ULong left = szB;
+   while (left > 0) {
+      Int w = VG_(write)( fd, q, left > 1024*1024 ? 1024*1024 : (Int)left );
+      if (w <= 0)
+         return False;
+      q    += w;
+      left -= w;
+   }
+   if (szB % 8 != 0
+       && VG_(write)( fd, zeroes, 8 - szB % 8 ) != 8 - szB % 8)
+      return False;
+   return True;
+}
+
+#define XA_PAYLOAD(_xa) \
+   (VG_(sizeXA)(_xa) > 0 ? VG_(indexXA)((_xa), 0) : NULL)
+
+void ML_(diskcache_save) ( const DebugInfo* di )
+{
+   DiskCacheHeader h;
+   StrTab  st;
+   XArray* syms;       /* of DiSym */
+   XArray* sec_names;  /* of ULong */
+   XArray* inls;       /* of DiInlLoc */
+   XArray* fndns;      /* of FnDn */
+   HChar*  tmpname;
+   HChar*  name;
+   SysRes  sres;
+   Int     fd;
+   Bool    ok;
+   UWord   i;
+
+   vg_assert(di->cache_buildid != NULL);
+   vg_assert(di->deferred == 0);
+
+   st.str_nos = VG_(newFM)( ML_(dinfo_zalloc), "di.diskcache.save.1",
+                            ML_(dinfo_free), NULL );
+   st.strs    = VG_(newXA)( ML_(dinfo_zalloc), "di.diskcache.save.2",
+                            ML_(dinfo_free), sizeof(HChar) );
+   st.n_strs  = 0;
+
+   /* Convert the tables which point to strings. */
+   syms = VG_(newXA)( ML_(dinfo_zalloc), "di.diskcache.save.3",
+                      ML_(dinfo_free), sizeof(DiSym) );
+   sec_names = VG_(newXA)( ML_(dinfo_zalloc), "di.diskcache.save.4",
+                           ML_(dinfo_free), sizeof(ULong) );
+   for (i = 0; i < di->symtab_used; i++) {
+      DiSym sym = di->symtab[i];
+      sym.pri_name = (const HChar*)(UWord)str_no( &st, sym.pri_name );
+      if (sym.sec_names != NULL) {
+         const HChar** sec;
+         ULong no, end = NO_STR;
+         UWord start = VG_(sizeXA)(sec_names);
+         for (sec = di->symtab[i].sec_names; *sec != NULL; sec++) {
+            no = str_no( &st, *sec );
+            VG_(addToXA)( sec_names, &no );
+         }
+         VG_(addToXA)( sec_names, &end );
+         sym.sec_names = (const HChar**)(start + 1);
+      }
+      VG_(addToXA)( syms, &sym );
+   }
+
+   inls = VG_(newXA)( ML_(dinfo_zalloc), "di.diskcache.save.5",
+                      ML_(dinfo_free), sizeof(DiInlLoc) );
+   for (i = 0; i < di->inltab_used; i++) {
+      DiInlLoc inl = di->inltab[i];
+      inl.inlinedfn = (const HChar*)(UWord)str_no( &st, inl.inlinedfn );
+      VG_(addToXA)( inls, &inl );
+   }
+
+   fndns = VG_(newXA)( ML_(dinfo_zalloc), "di.diskcache.save.6",
+                       ML_(dinfo_free), sizeof(FnDn) );
+   h.n_fndn = di->fndnpool ? VG_(sizeDedupPA)( di->fndnpool ) : 0;
+   for (i = 1; i <= h.n_fndn; i++) {
+      FnDn fndn = *(FnDn*)VG_(indexEltNumber)( di->fndnpool, i );
+      fndn.filename = (const HChar*)(UWord)str_no( &st, fndn.filename );
+      fndn.dirname  = (const HChar*)(UWord)str_no( &st, fndn.dirname );
+      VG_(addToXA)( fndns, &fndn );
+   }
+   h.debug_buildid = str_no( &st, di->cache_debug_buildid );
+
+   h.magic            = DISKCACHE_MAGIC;
+   h.version          = DISKCACHE_VERSION;
+   h.sizeof_DiSym     = sizeof(DiSym);
+   h.sizeof_DiLoc     = sizeof(DiLoc);
+   h.sizeof_DiInlLoc  = sizeof(DiInlLoc);
+   h.sizeof_FnDn      = sizeof(FnDn);
+   h.sizeof_DiCfSI_m  = sizeof(DiCfSI_m);
+   h.sizeof_CfiExpr   = sizeof(CfiExpr);
+   h.inline_info      = VG_(clo_read_inline_info);
+   h.sizeof_fndn_ix   = di->loctab_used > 0 ? di->sizeof_fndn_ix : 0;
+   h.sizeof_cfsi_m_ix = di->cfsi_used > 0 ? di->sizeof_cfsi_m_ix : 0;
+   h.unused           = 0;
+   h.text_avma        = di->text_avma;
+   h.text_bias        = di->text_bias;
+   h.data_bias        = di->data_bias;
+   h.n_strs           = st.n_strs;
+   h.strs_szB         = VG_(sizeXA)( st.strs );
+   h.symtab_used      = di->symtab_used;
+   h.n_sec_names      = VG_(sizeXA)( sec_names );
+   h.loctab_used      = di->loctab_used;
+   h.inltab_used      = di->inltab_used;
+   h.maxinl_codesz    = di->maxinl_codesz;
+   h.cfsi_used        = di->cfsi_used;
+   h.n_cfsi_m         = di->cfsi_m_pool ? VG_(sizeDedupPA)( di->cfsi_m_pool )
+                                        : 0;
+   h.n_cfsi_exprs     = di->cfsi_exprs ? VG_(sizeXA)( di->cfsi_exprs ) : 0;
+   h.cfsi_minavma     = di->cfsi_minavma;
+   h.cfsi_maxavma     = di->cfsi_maxavma;
+
+   /* Write to a temporary file, which is then renamed, so that
+      concurrent runs never see a partial entry. */
+   name    = entry_name( di->cache_buildid, ".vgdi" );
+   tmpname = ML_(dinfo_zalloc)( "di.diskcache.save.7",
+                                VG_(strlen)(name) + 20 );
+   VG_(sprintf)( tmpname, "%s.%d", name, VG_(getpid)() );
+   sres = VG_(open)( tmpname, VKI_O_CREAT|VKI_O_WRONLY|VKI_O_TRUNC,
+                     VKI_S_IRUSR|VKI_S_IWUSR|VKI_S_IRGRP|VKI_S_IROTH );
+   ok = !sr_isError(sres);
+   if (ok) {
+      fd = sr_Res(sres);
+      ok = write_padded( fd, &h, sizeof(h) )
+           && write_padded( fd, XA_PAYLOAD(st.strs), h.strs_szB )
+           && write_padded( fd, XA_PAYLOAD(syms),
+                            h.symtab_used * sizeof(DiSym) )
+           && write_padded( fd, XA_PAYLOAD(sec_names),
+                            h.n_sec_names * sizeof(ULong) )
+           && write_padded( fd, di->loctab, h.loctab_used * sizeof(DiLoc) )
+           && write_padded( fd, di->loctab_fndn_ix,
+                            h.loctab_used * h.sizeof_fndn_ix )
+           && write_padded( fd, XA_PAYLOAD(inls),
+                            h.inltab_used * sizeof(DiInlLoc) )
+           && write_padded( fd, XA_PAYLOAD(fndns), h.n_fndn * sizeof(FnDn) )
+           && write_padded( fd, di->cfsi_base, h.cfsi_used * sizeof(Addr) )
+           && write_padded( fd, di->cfsi_m_ix,
+                            h.cfsi_used * h.sizeof_cfsi_m_ix )
+           && write_padded( fd, h.n_cfsi_m > 0
+                                   ? VG_(indexEltNumber)( di->cfsi_m_pool, 1 )
+                                   : NULL,
+                            h.n_cfsi_m * sizeof(DiCfSI_m) )
+           && write_padded( fd, h.n_cfsi_exprs > 0
+                                   ? VG_(indexXA)( di->cfsi_exprs, 0 )
+                                   : NULL,
+                            h.n_cfsi_exprs * sizeof(CfiExpr) );
+      VG_(close)( fd );
+      if (ok)
+         ok = VG_(rename)( tmpname, name ) == 0;
+      if (!ok)
+         VG_(unlink)( tmpname );
+   }
+
+   if (VG_(clo_verbosity) > 1)
+      VG_(message)(Vg_DebugMsg, "%s debug info of %s to %s\n",
+                   ok ? "Saved" : "Failed to save",
+                   di->fsm.filename, name);
+
+   ML_(dinfo_free)( tmpname );
+   ML_(dinfo_free)( name );
+   VG_(deleteXA)( fndns );
+   VG_(deleteXA)( inls );
+   VG_(deleteXA)( sec_names );
+   VG_(deleteXA)( syms );
+   VG_(deleteXA)( st.strs );
+   VG_(deleteFM)( st.str_nos, NULL, NULL );
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Loading                                              ---*/
+/*------------------------------------------------------------*/
+
+/* The tables of an entry, in the file image. */
+typedef
+   struct {
+      const HChar*    strs;
+      const DiSym*    symtab;
+      const ULong*    sec_names;
+      const DiLoc*    loctab;
+      const void*     loctab_fndn_ix;
+      const DiInlLoc* inltab;
+      const FnDn*     fndns;
+      const Addr*     cfsi_base;
+      const void*     cfsi_m_ix;
+      const DiCfSI_m* cfsi_m;
+      const CfiExpr*  cfsi_exprs;
+   }
+   Tables;
+
+/* Finds the tables in the 'szB' bytes of 'img', which start with
+   header 'h'.  Returns False if they don't fit. */
+static Bool find_tables ( const DiskCacheHeader* h,
+                          const UChar* img, ULong szB, /*OUT*/Tables* t )
+{
+   ULong off = VG_ROUNDUP(sizeof(*h), 8);
+
+#  define TAKE(_field, _szB) \
+      do { ULong _sz = (_szB); \
+           if (_sz > szB || off > szB - _sz) return False; \
+           t->_field = (const void*)(img + off); \
+           off += VG_ROUNDUP(_sz, 8); } while (0)
+
+   /* Guard against absurd counts overflowing the size computations. */
+   if (h->n_strs > szB || h->symtab_used > szB || h->n_sec_names > szB
+       || h->loctab_used > szB || h->inltab_used > szB || h->n_fndn > szB
+       || h->cfsi_used > szB || h->n_cfsi_m > szB || h->n_cfsi_exprs > szB)
+      return False;
+   TAKE(strs,           h->strs_szB);
+   TAKE(symtab,         h->symtab_used * sizeof(DiSym));
+   TAKE(sec_names,      h->n_sec_names * sizeof(ULong));
+   TAKE(loctab,         h->loctab_used * sizeof(DiLoc));
+   TAKE(loctab_fndn_ix, h->loctab_used * h->sizeof_fndn_ix);
+   TAKE(inltab,         h->inltab_used * sizeof(DiInlLoc));
+   TAKE(fndns,          h->n_fndn * sizeof(FnDn));
+   TAKE(cfsi_base,      h->cfsi_used * sizeof(Addr));
+   TAKE(cfsi_m_ix,      h->cfsi_used * h->sizeof_cfsi_m_ix);
+   TAKE(cfsi_m,         h->n_cfsi_m * sizeof(DiCfSI_m));
+   TAKE(cfsi_exprs,     h->n_cfsi_exprs * sizeof(CfiExpr));
+#  undef TAKE
+   return off == szB;
+}
+
+static UInt get_ix ( const void* ixs, UInt sizeof_ix, UWord i )
+{
+   switch (sizeof_ix) {
+      case 1: return ((const UChar*) ixs)[i];
+      case 2: return ((const UShort*)ixs)[i];
+      case 4: return ((const UInt*)  ixs)[i];
+      default: vg_assert(0);
+   }
+}
+
+static Int cmp_FnDn_strs ( const void* v1, const void* v2 )
+{
+   const HChar* const* p1 = v1;
+   const HChar* const* p2 = v2;
+   Int r = VG_(strcmp)( p1[0], p2[0] );
+   if (r != 0)
+      return r;
+   if (p1[1] == NULL || p2[1] == NULL)
+      return (p1[1] != NULL) - (p2[1] != NULL);
+   return VG_(strcmp)( p1[1], p2[1] );
+}
+
+static Int cmp_DiCfSI_m_ptrs ( const void* v1, const void* v2 )
+{
+   return VG_(memcmp)( *(const DiCfSI_m* const*)v1,
+                       *(const DiCfSI_m* const*)v2, sizeof(DiCfSI_m) );
+}
+
+/* Do the FnDn of the entry, once their strings are looked up, or its
+   DiCfSI_m contain duplicates ?  When loaded in their dedup pools,
+   these would not get the numbers the other tables refer to. */
+static Bool has_duplicates ( const DiskCacheHeader* h, const Tables* t,
+                             const HChar** strs )
+{
+   const HChar**    fndns;  /* filename, dirname pairs */
+   const DiCfSI_m** cfsi_ms;
+   Bool  dup = False;
+   ULong i;
+
+   if (h->n_fndn > 1) {
+      fndns = ML_(dinfo_zalloc)( "di.diskcache.has_duplicates.1",
+                                 h->n_fndn * 2 * sizeof(HChar*) );
+      for (i = 0; i < h->n_fndn; i++) {
+         UWord dn = (UWord)t->fndns[i].dirname;
+         fndns[2 * i]     = strs[(UWord)t->fndns[i].filename];
+         fndns[2 * i + 1] = (ULong)dn == NO_STR ? NULL : strs[dn];
+      }
+      VG_(ssort)( fndns, h->n_fndn, 2 * sizeof(HChar*), cmp_FnDn_strs );
+      for (i = 1; i < h->n_fndn && !dup; i++)
+         dup = cmp_FnDn_strs( &fndns[2 * (i - 1)], &fndns[2 * i] ) == 0;
+      ML_(dinfo_free)( fndns );
+   }
+
+   if (h->n_cfsi_m > 1 && !dup) {
+      cfsi_ms = ML_(dinfo_zalloc)( "di.diskcache.has_duplicates.2",
+                                   h->n_cfsi_m * sizeof(DiCfSI_m*) );
+      for (i = 0; i < h->n_cfsi_m; i++)
+         cfsi_ms[i] = &t->cfsi_m[i];
+      VG_(ssort)( cfsi_ms, h->n_cfsi_m, sizeof(DiCfSI_m*),
+                  cmp_DiCfSI_m_ptrs );
+      for (i = 1; i < h->n_cfsi_m && !dup; i++)
+         dup = cmp_DiCfSI_m_ptrs( &cfsi_ms[i - 1], &cfsi_ms[i] ) == 0;
+      ML_(dinfo_free)( cfsi_ms );
+   }
+   return dup;
+}
+
+/* Checks that all the references between the tables are in range, and
+   that the tables load as they were saved, so that a corrupted entry
+   is rejected before 'di' is modified.  Also checks that the entry
+   was made with the same separate debug file, 'debug_buildid' (NULL
+   if none), as was found now. */
+static Bool check_tables ( const DiskCacheHeader* h, const Tables* t,
+                           const HChar* debug_buildid )
+{
+   ULong i, n;
+   const HChar*  s;
+   const HChar** strs;
+   Bool ok;
+
+   /* There are exactly n_strs strings in the blob. */
+   for (n = 0, s = t->strs; s < t->strs + h->strs_szB; n++) {
+      const HChar* e = s;
+      while (e < t->strs + h->strs_szB && *e != 0)
+         e++;
+      if (e == t->strs + h->strs_szB)
+         return False;
+      s = e + 1;
+   }
+   if (n != h->n_strs)
+      return False;
+
+#  define CHECK_STR(_no, _null_ok) \
+      if (!((_no) < h->n_strs || ((_null_ok) && (_no) == NO_STR))) \
+         return False
+
+   for (i = 0; i < h->symtab_used; i++) {
+      UWord sec = (UWord)t->symtab[i].sec_names;
+      CHECK_STR((UWord)t->symtab[i].pri_name, False);
+      if (sec != 0) {
+         if (sec > h->n_sec_names)
+            return False;
+         for (n = sec - 1; n < h->n_sec_names && t->sec_names[n] != NO_STR;
+              n++)
+            CHECK_STR(t->sec_names[n], False);
+         if (n == h->n_sec_names)
+            return False;
+      }
+   }
+   for (i = 0; i < h->n_fndn; i++) {
+      CHECK_STR((UWord)t->fndns[i].filename, False);
+      CHECK_STR((UWord)t->fndns[i].dirname, True);
+   }
+   for (i = 0; i < h->inltab_used; i++) {
+      CHECK_STR((UWord)t->inltab[i].inlinedfn, False);
+      if (t->inltab[i].fndn_ix > h->n_fndn)
+         return False;
+   }
+   CHECK_STR(h->debug_buildid, True);
+#  undef CHECK_STR
+
+   if (h->loctab_used > 0) {
+      if (h->sizeof_fndn_ix != 1 && h->sizeof_fndn_ix != 2
+          && h->sizeof_fndn_ix != 4)
+         return False;
+      for (i = 0; i < h->loctab_used; i++)
+         if (get_ix( t->loctab_fndn_ix, h->sizeof_fndn_ix, i ) > h->n_fndn)
+            return False;
+   }
+   if (h->cfsi_used > 0) {
+      if (h->sizeof_cfsi_m_ix != 1 && h->sizeof_cfsi_m_ix != 2
+          && h->sizeof_cfsi_m_ix != 4)
+         return False;
+      if (h->n_cfsi_m == 0)
+         return False;
+      for (i = 0; i < h->cfsi_used; i++)
+         if (get_ix( t->cfsi_m_ix, h->sizeof_cfsi_m_ix, i ) > h->n_cfsi_m)
+            return False;
+   }
+
+   strs = ML_(dinfo_zalloc)( "di.diskcache.check_tables.1",
+                             (h->n_strs + 1) * sizeof(HChar*) );
+   for (i = 0, s = t->strs; i < h->n_strs; i++) {
+      strs[i] = s;
+      s += VG_(strlen)(s) + 1;
+   }
+   if (h->debug_buildid == NO_STR)
+      ok = debug_buildid == NULL;
+   else
+      ok = debug_buildid != NULL
+           && VG_(strcmp)( strs[h->debug_buildid], debug_buildid ) == 0;
+   ok = ok && !has_duplicates( h, t, strs );
+   ML_(dinfo_free)( strs );
+   return ok;
+}
+
+/* Reads the whole of file 'name'.  Returns NULL if it can't. */
+static UChar* read_entry ( const HChar* name, /*OUT*/ULong* szB )
+{
+   SysRes sres = VG_(open)( name, VKI_O_RDONLY, 0 );
+   UChar* img;
+   Long   size, done;
+   Int    fd;
+
+   if (sr_isError(sres))
+      return NULL;
+   fd   = sr_Res(sres);
+   size = VG_(fsize)( fd );
+   if (size < (Long)sizeof(DiskCacheHeader)) {
+      VG_(close)( fd );
+      return NULL;
+   }
+   img = ML_(dinfo_zalloc)( "di.diskcache.read_entry.1", size );
+   for (done = 0; done < size; ) {
+      Long left = size - done;
+      Int  r = VG_(read)( fd, img + done,
+                          left > 1024*1024 ? 1024*1024 : (Int)left );
+      if (r <= 0)
+         break;
+      done += r;
+   }
+   VG_(close)( fd );
+   if (done != size) {
+      ML_(dinfo_free)( img );
+      return NULL;
+   }
+   *szB = size;
+   return img;
+}
+
+Bool ML_(diskcache_load) ( DebugInfo* di, const HChar* buildid,
+                           const HChar* debug_buildid )
+{
+   HChar*  name = entry_name( buildid, ".vgdi" );
+   UChar*  img;
+   ULong   szB = 0;
+   const DiskCacheHeader* h;
+   Tables  t;
+   const HChar** strs;
+   const HChar*  s;
+   Addr    delta;
+   UWord   i;
+
+   vg_assert(!di->have_dinfo);
+   vg_assert(di->symtab == NULL && di->loctab == NULL);
+   vg_assert(di->inltab == NULL && di->cfsi_rd == NULL);
+
+   img = read_entry( name, &szB );
+   if (img == NULL) {
+      ML_(dinfo_free)( name );
+      return False;
+   }
+   h = (const DiskCacheHeader*)img;
+
+   /* The object may be mapped elsewhere than when the entry was saved,
+      but all of it must have moved by the same amount. */
+   delta = di->text_bias - h->text_bias;
+   if (h->magic != DISKCACHE_MAGIC
+       || h->version != DISKCACHE_VERSION
+       || h->sizeof_DiSym != sizeof(DiSym)
+       || h->sizeof_DiLoc != sizeof(DiLoc)
+       || h->sizeof_DiInlLoc != sizeof(DiInlLoc)
+       || h->sizeof_FnDn != sizeof(FnDn)
+       || h->sizeof_DiCfSI_m != sizeof(DiCfSI_m)
+       || h->sizeof_CfiExpr != sizeof(CfiExpr)
+       || h->inline_info != VG_(clo_read_inline_info)
+       || di->text_avma - h->text_avma != delta
+       || di->data_bias - h->data_bias != delta
+       || !find_tables( h, img, szB, &t )
+       || !check_tables( h, &t, debug_buildid )) {
+      if (VG_(clo_verbosity) > 1)
+         VG_(message)(Vg_DebugMsg, "Ignoring unusable debug info cache "
+                      "file %s\n", name);
+      ML_(dinfo_free)( img );
+      ML_(dinfo_free)( name );
+      return False;
+   }
+
+   /* Strings */
+   strs = ML_(dinfo_zalloc)( "di.diskcache.load.1",
+                             (h->n_strs + 1) * sizeof(HChar*) );
+   for (i = 0, s = t.strs; i < h->n_strs; i++) {
+      Int len = VG_(strlen)(s);
+      strs[i] = ML_(addStr)( di, s, len );
+      s += len + 1;
+   }
+#  define STR(_no) ((ULong)(_no) == NO_STR ? NULL : strs[(UWord)(_no)])
+
+   /* Symbols */
+   if (h->symtab_used > 0) {
+      di->symtab = ML_(dinfo_memdup)( "di.diskcache.load.2", t.symtab,
+                                      h->symtab_used * sizeof(DiSym) );
+      di->symtab_used = di->symtab_size = h->symtab_used;
+      for (i = 0; i < h->symtab_used; i++) {
+         DiSym* sym = &di->symtab[i];
+         UWord  sec = (UWord)sym->sec_names;
+         sym->pri_name = STR((UWord)sym->pri_name);
+         sym->sec_names = NULL;
+         if (sec != 0) {
+            UWord n = 0, j;
+            while (t.sec_names[sec - 1 + n] != NO_STR)
+               n++;
+            sym->sec_names = ML_(dinfo_zalloc)( "di.diskcache.load.3",
+                                                (n + 1) * sizeof(HChar*) );
+            for (j = 0; j < n; j++)
+               sym->sec_names[j] = STR(t.sec_names[sec - 1 + j]);
+         }
+         sym->avmas.main += delta;
+         if (GET_TOCPTR_AVMA(sym->avmas) != 0) {
+            SET_TOCPTR_AVMA(sym->avmas, GET_TOCPTR_AVMA(sym->avmas) + delta);
+         }
+         if (GET_LOCAL_EP_AVMA(sym->avmas) != 0) {
+            SET_LOCAL_EP_AVMA(sym->avmas,
+                              GET_LOCAL_EP_AVMA(sym->avmas) + delta);
+         }
+      }
+   }
+
+   /* File and dir names: adding them in order gives them the same
+      numbers as when saved, as check_tables made sure there are no
+      duplicates. */
+   for (i = 0; i < h->n_fndn; i++) {
+      UInt fndn_ix = ML_(addFnDn)( di, STR((UWord)t.fndns[i].filename),
+                                       STR((UWord)t.fndns[i].dirname) );
+      vg_assert(fndn_ix == i + 1);
+   }
+
+   /* Lines */
+   if (h->loctab_used > 0) {
+      di->loctab = ML_(dinfo_memdup)( "di.diskcache.load.4", t.loctab,
+                                      h->loctab_used * sizeof(DiLoc) );
+      di->loctab_fndn_ix
+         = ML_(dinfo_memdup)( "di.diskcache.load.5", t.loctab_fndn_ix,
+                              h->loctab_used * h->sizeof_fndn_ix );
+      di->sizeof_fndn_ix = h->sizeof_fndn_ix;
+      di->loctab_used = di->loctab_size = h->loctab_used;
+      for (i = 0; i < h->loctab_used; i++)
+         di->loctab[i].addr += delta;
+   }
+
+   /* Inlined calls */
+   if (h->inltab_used > 0) {
+      di->inltab = ML_(dinfo_memdup)( "di.diskcache.load.6", t.inltab,
+                                      h->inltab_used * sizeof(DiInlLoc) );
+      di->inltab_used = di->inltab_size = h->inltab_used;
+      for (i = 0; i < h->inltab_used; i++) {
+         di->inltab[i].inlinedfn = STR((UWord)di->inltab[i].inlinedfn);
+         di->inltab[i].addr_lo += delta;
+         di->inltab[i].addr_hi += delta;
+      }
+   }
+   di->maxinl_codesz = h->maxinl_codesz;
+
+   /* Call frame info.  The CfiExprs are not rebased: they hold no
+      code addresses. */
+   if (h->cfsi_used > 0) {
+      di->cfsi_m_pool = VG_(newDedupPA)(1000 * sizeof(DiCfSI_m),
+                                        vg_alignof(DiCfSI_m),
+                                        ML_(dinfo_zalloc),
+                                        "di.storage.DiCfSI_m_pool",
+                                        ML_(dinfo_free));
+      for (i = 0; i < h->n_cfsi_m; i++) {
+         UInt cfsi_m_ix = VG_(allocFixedEltDedupPA)( di->cfsi_m_pool,
+                                                     sizeof(DiCfSI_m),
+                                                     &t.cfsi_m[i] );
+         vg_assert(cfsi_m_ix == i + 1);
+      }
+      VG_(freezeDedupPA)( di->cfsi_m_pool, ML_(dinfo_shrink_block) );
+      di->cfsi_base = ML_(dinfo_memdup)( "di.diskcache.load.7", t.cfsi_base,
+                                         h->cfsi_used * sizeof(Addr) );
+      di->cfsi_m_ix = ML_(dinfo_memdup)( "di.diskcache.load.8", t.cfsi_m_ix,
+                                         h->cfsi_used * h->sizeof_cfsi_m_ix );
+      di->sizeof_cfsi_m_ix = h->sizeof_cfsi_m_ix;
+      di->cfsi_used = di->cfsi_size = h->cfsi_used;
+      for (i = 0; i < h->cfsi_used; i++)
+         di->cfsi_base[i] += delta;
+      di->cfsi_minavma = h->cfsi_minavma + delta;
+      di->cfsi_maxavma = h->cfsi_maxavma + delta;
+   }
+   if (h->n_cfsi_exprs > 0) {
+      di->cfsi_exprs = VG_(newXA)( ML_(dinfo_zalloc), "di.diskcache.load.9",
+                                   ML_(dinfo_free), sizeof(CfiExpr) );
+      for (i = 0; i < h->n_cfsi_exprs; i++)
+         VG_(addToXA)( di->cfsi_exprs, &t.cfsi_exprs[i] );
+   }
+#  undef STR
+
+   if (di->strpool)
+      VG_(freezeDedupPA) (di->strpool, ML_(dinfo_shrink_block));
+   if (di->fndnpool)
+      VG_(freezeDedupPA) (di->fndnpool, ML_(dinfo_shrink_block));
+   di->cache_loaded = True;
+
+   if (VG_(clo_verbosity) > 1)
+      VG_(message)(Vg_DebugMsg, "Loaded debug info of %s from %s\n",
+                   di->fsm.filename, name);
+
+   ML_(dinfo_free)( strs );
+   ML_(dinfo_free)( img );
+   ML_(dinfo_free)( name );
+   return True;
+}
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
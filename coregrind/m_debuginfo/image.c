@@ -41,12 +41,15 @@
 #include "pub_core_libcprint.h"
 #include "pub_core_libcproc.h"     /* VG_(read_millisecond_timer) */
 #include "pub_core_libcfile.h"
+#include "pub_core_aspacemgr.h"    /* for mmaping local files */
 #include "priv_misc.h"             /* dinfo_zalloc/free/strdup */
 #include "priv_image.h"            /* self */
 
 #include "minilzo.h"
 #define TINFL_HEADER_FILE_ONLY
 #include "tinfl.c"
+#define TZSTD_HEADER_FILE_ONLY
+#include "tzstd.c"
 
 /* These values (1024 entries of 8192 bytes each) gives a cache
    size of 8MB. */
@@ -57,6 +60,17 @@
 
 #define COMPRESSED_SLICE_ARRAY_GROW_SIZE 64
 
+/* The maximum number of cache-entry sized blocks to ask a debuginfo
+   server for at once, if it can send several per request.  Much of
+   the debuginfo is read sequentially, and for such runs of reads
+   this saves most of the round trips. */
+#define DI_SERVER_BLOCKS_PER_READ 16
+
+/* The number of sequential runs of reads from a debuginfo server
+   which are tracked at once.  Readers of different sections are
+   usually interleaved. */
+#define DI_SERVER_RA_STREAMS 4
+
 /* An entry in the cache. */
 typedef
    struct {
@@ -75,9 +89,21 @@ typedef
       SizeT  szD;   // size of decompressed data
       DiOffT offC;  // offset of compressed data
       SizeT  szC;   // size of compressed data
+      DiCompression comp; // how it is compressed
    }
    CSlc;
 
+/* A readahead stream, for reading from a debuginfo server. */
+typedef
+   struct {
+      UChar* buf;       // DI_SERVER_BLOCKS_PER_READ * CACHE_ENTRY_SIZE
+      DiOffT off;       // buf holds [off, +szB) of the file
+      SizeT  szB;
+      UInt   n_blocks;  // how many blocks that is
+      UInt   last_use;  // for choosing which stream to replace
+   }
+   RaStream;
+
 /* Source for files */
 typedef
    struct {
@@ -92,10 +118,21 @@ typedef
       // (that is, using a debuginfo server; hence when is_local==False)
       // Session ID allocated to us by the server.  Cannot be zero.
       ULong session_id;
+      // Does the server understand RDMB (read multiple blocks)?  If
+      // so, the data is read via the readahead streams in ra[].
+      Bool     multi_block;
+      RaStream ra[DI_SERVER_RA_STREAMS];
+      UInt     ra_clock;
    }
    Source;
 
 struct _DiImage {
+   // For a local file, the whole file mapped read-only, in which case
+   // mapping.map_szB == real_size, and reads of [0, real_size) are
+   // plain loads from it.  Otherwise NULL and 0, and all reads go via
+   // the cache.  The cache is still used for the decompressed slices,
+   // which lie above real_size.  Must be first: see priv_image.h.
+   DiImageMapping mapping;
    // The source -- how to get hold of the file we are reading
    Source source;
    // Virtual size of the image = real size + size of uncompressed data
@@ -363,6 +400,22 @@ static Frame* mk_Frame_le64_le64_le64 ( const HChar* tag,
    return f;
 }
 
+static Frame* mk_Frame_le64_le64_le64_le64 ( const HChar* tag,
+                                             ULong n1, ULong n2, ULong n3,
+                                             ULong n4 )
+{
+   vg_assert(VG_(strlen)(tag) == 4);
+   Frame* f = ML_(dinfo_zalloc)("di.mFllll.1", sizeof(Frame));
+   f->n_data = 4 + 4*8;
+   f->data = ML_(dinfo_zalloc)("di.mFllll.2", f->n_data);
+   VG_(memcpy)(&f->data[0], tag, 4);
+   write_ULong_le(&f->data[4 + 0*8], n1);
+   write_ULong_le(&f->data[4 + 1*8], n2);
+   write_ULong_le(&f->data[4 + 2*8], n3);
+   write_ULong_le(&f->data[4 + 3*8], n4);
+   return f;
+}
+
 static Frame* mk_Frame_asciiz ( const HChar* tag, const HChar* str )
 {
    vg_assert(VG_(strlen)(tag) == 4);
@@ -447,6 +500,26 @@ static Bool parse_Frame_le64_le64_le64_bytes (
    return True;
 }
 
+static Bool parse_Frame_le64_le64_le64_le64_bytes (
+               const Frame* fr, const HChar* tag,
+               /*OUT*/ULong* n1, /*OUT*/ULong* n2, /*OUT*/ULong* n3,
+               /*OUT*/ULong* n4, /*OUT*/UChar** data, /*OUT*/ULong* n_data
+            )
+{
+   vg_assert(VG_(strlen)(tag) == 4);
+   if (!fr || !fr->data) return False;
+   if (fr->n_data < 4) return False;
+   if (VG_(memcmp)(&fr->data[0], tag, 4) != 0) return False;
+   if (fr->n_data < 4 + 4*8) return False;
+   *n1 = read_ULong_le(&fr->data[4 + 0*8]);
+   *n2 = read_ULong_le(&fr->data[4 + 1*8]);
+   *n3 = read_ULong_le(&fr->data[4 + 2*8]);
+   *n4 = read_ULong_le(&fr->data[4 + 3*8]);
+   *data   = &fr->data[4 + 4*8];
+   *n_data = fr->n_data - (4 + 4*8);
+   return True;
+}
+
 static DiOffT block_round_down ( DiOffT i )
 {
    return i & ((DiOffT)~(CACHE_ENTRY_SIZE-1));
@@ -478,6 +551,25 @@ static inline Bool is_in_CEnt ( const CEnt* cent, DiOffT off )
    return off - cent->off < cent->used;
 }
 
+/* Decompresses the compressed data of |cslc|, which is in |cbuf|, into
+   |dst|, which has space for cslc->szD bytes.  Returns the number of
+   bytes written. */
+static SizeT decompress_CSlc ( UChar* dst, const CSlc* cslc,
+                               const UChar* cbuf )
+{
+   switch (cslc->comp) {
+      case DiCompZlib:
+         return tinfl_decompress_mem_to_mem(
+                   dst, cslc->szD, cbuf, cslc->szC,
+                   TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF
+                   | TINFL_FLAG_PARSE_ZLIB_HEADER);
+      case DiCompZstd:
+         return tzstd_decompress_mem_to_mem(dst, cslc->szD, cbuf, cslc->szC);
+      default:
+         vg_assert(0);
+   }
+}
+
 /* Returns pointer to CSlc or NULL */
 static inline CSlc* find_cslc ( DiImage* img, DiOffT off )
 {
@@ -535,11 +627,141 @@ static void move_CEnt_to_top ( DiImage* img, UInt entNo )
    img->ces[0] = tmp;
 }
 
+/* Get |n_blocks| blocks of CACHE_ENTRY_SIZE bytes from the server,
+   starting at |off|, or as many as there are before the end of the
+   file, into |ra|. */
+static void read_blocks_from_server ( DiImage* img, RaStream* ra,
+                                      DiOffT off, UInt n_blocks )
+{
+   vg_assert(!img->source.is_local && img->source.multi_block);
+   vg_assert(img->source.session_id > 0);
+   vg_assert(off < img->real_size);
+   vg_assert(n_blocks >= 1 && n_blocks <= DI_SERVER_BLOCKS_PER_READ);
+   ra->off = 0;
+   ra->szB = 0;
+   ra->n_blocks = 0;
+
+   Frame* req = mk_Frame_le64_le64_le64_le64("RDMB", img->source.session_id,
+                                             off, CACHE_ENTRY_SIZE,
+                                             n_blocks);
+   Frame* res = do_transaction(img->source.fd, req);
+   free_Frame(req); req = NULL;
+   if (!res) goto server_fail;
+   ULong  rx_session_id = 0, rx_off = 0, rx_len = 0, rx_n_blocks = 0;
+   UChar* rx_data = NULL;
+   ULong  rx_data_len = 0;
+   /* As with READ, the session ID, offset and block size are copies
+      of the ones requested.  rx_n_blocks is the number of blocks
+      which follow, each being its compressed length (le64) and then
+      the LZO compressed data.  All but the last are CACHE_ENTRY_SIZE
+      bytes long uncompressed. */
+   if (!parse_Frame_le64_le64_le64_le64_bytes
+       (res, "RMOK", &rx_session_id, &rx_off, &rx_len, &rx_n_blocks,
+                     &rx_data, &rx_data_len))
+      goto server_fail;
+   if (rx_session_id != img->source.session_id
+       || rx_off != off || rx_len != CACHE_ENTRY_SIZE
+       || rx_n_blocks == 0 || rx_n_blocks > n_blocks)
+      goto server_fail;
+
+   ULong  i;
+   DiOffT boff = off;
+   SizeT  szB  = 0;
+   for (i = 0; i < rx_n_blocks; i++) {
+      SizeT blen = img->real_size - boff;
+      if (blen > CACHE_ENTRY_SIZE)
+         blen = CACHE_ENTRY_SIZE;
+      if (boff >= img->real_size || rx_data_len < 8)
+         goto server_fail;
+      ULong zlen = read_ULong_le(rx_data);
+      if (zlen > rx_data_len - 8)
+         goto server_fail;
+      lzo_uint out_len = blen;
+      Int lzo_rc = lzo1x_decompress_safe(rx_data + 8, zlen,
+                                         &ra->buf[szB], &out_len,
+                                         NULL);
+      if (lzo_rc != LZO_E_OK || out_len != blen)
+         goto server_fail;
+      rx_data     += 8 + zlen;
+      rx_data_len -= 8 + zlen;
+      boff        += blen;
+      szB         += blen;
+   }
+   free_Frame(res); res = NULL;
+   ra->off = off;
+   ra->szB = szB;
+   ra->n_blocks = rx_n_blocks;
+   return;
+
+  server_fail:
+   /* The server screwed up somehow.  Now what? */
+   if (res) {
+      UChar* reason = NULL;
+      if (parse_Frame_asciiz(res, "FAIL", &reason)) {
+         VG_(umsg)("set_CEnt (reading data from DI server): fail: "
+                   "%s\n", reason);
+      } else {
+         VG_(umsg)("set_CEnt (reading data from DI server): fail: "
+                   "unknown reason\n");
+      }
+      free_Frame(res); res = NULL;
+   } else {
+      VG_(umsg)("set_CEnt (reading data from DI server): fail: "
+                "server unexpectedly closed the connection\n");
+   }
+   give_up__comms_lost();
+   /* NOTREACHED */
+   vg_assert(0);
+}
+
+/* Returns the readahead stream holding [off, +len), which is within
+   one block, getting it from the server if need be.  Like the
+   kernel's file readahead, a read which carries on from where a
+   stream ended gets twice as many blocks as that stream did last
+   time, up to DI_SERVER_BLOCKS_PER_READ.  Any other read gets just
+   one block, in place of the least recently used stream. */
+static RaStream* get_ra_stream ( DiImage* img, DiOffT off, SizeT len )
+{
+   RaStream* ra;
+   UInt      i, n_blocks = 1;
+   vg_assert(img->source.multi_block);
+   img->source.ra_clock++;
+   for (i = 0; i < DI_SERVER_RA_STREAMS; i++) {
+      ra = &img->source.ra[i];
+      if (off >= ra->off && off + len <= ra->off + ra->szB) {
+         ra->last_use = img->source.ra_clock;
+         return ra;
+      }
+   }
+   ra = NULL;
+   for (i = 0; i < DI_SERVER_RA_STREAMS; i++) {
+      if (img->source.ra[i].szB > 0
+          && off == img->source.ra[i].off + img->source.ra[i].szB) {
+         ra = &img->source.ra[i];
+         n_blocks = 2 * ra->n_blocks;
+         if (n_blocks > DI_SERVER_BLOCKS_PER_READ)
+            n_blocks = DI_SERVER_BLOCKS_PER_READ;
+         break;
+      }
+   }
+   if (ra == NULL) {
+      ra = &img->source.ra[0];
+      for (i = 1; i < DI_SERVER_RA_STREAMS; i++) {
+         if (img->source.ra[i].last_use < ra->last_use)
+            ra = &img->source.ra[i];
+      }
+   }
+   read_blocks_from_server(img, ra, off, n_blocks);
+   vg_assert(off >= ra->off && off + len <= ra->off + ra->szB);
+   ra->last_use = img->source.ra_clock;
+   return ra;
+}
+
 /* Set the given entry so that it has a chunk of the file containing
    the given offset.  It is this function that brings data into the
    cache, either by reading the local file or pulling it from the
    remote server. */
-static void set_CEnt ( const DiImage* img, UInt entNo, DiOffT off )
+static void set_CEnt ( DiImage* img, UInt entNo, DiOffT off )
 {
    SizeT len;
    DiOffT off_orig = off;
@@ -577,6 +799,11 @@ static void set_CEnt ( const DiImage* img, UInt entNo, DiOffT off )
       // Simple: just read it
       SysRes sr = VG_(pread)(img->source.fd, &ce->data[0], (Int)len, off);
       vg_assert(!sr_isError(sr));
+   } else if (img->source.multi_block) {
+      // Copy it from the blocks read ahead, getting them first if
+      // need be.
+      RaStream* ra = get_ra_stream(img, off, len);
+      VG_(memcpy)(&ce->data[0], &ra->buf[off - ra->off], len);
    } else {
       // Not so simple: poke the server
       vg_assert(img->source.session_id > 0);
@@ -728,11 +955,7 @@ static UChar get_slowcase ( DiImage* img, DiOffT off )
          vg_assert(is_sane_CEnt("get_slowcase-case-1", img, i));
          vg_assert(img->ces_used == ces_used_at_entry + 1);
       } else {
-         SizeT len = tinfl_decompress_mem_to_mem(
-                        img->ces[i]->data, cslc->szD,
-                        cbuf, cslc->szC,
-                        TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF
-                        | TINFL_FLAG_PARSE_ZLIB_HEADER);
+         SizeT len = decompress_CSlc(img->ces[i]->data, cslc, cbuf);
          vg_assert(len == cslc->szD); // sanity check on data, FIXME
          vg_assert(cslc->szD == size);
          img->ces[i]->used = cslc->szD;
@@ -778,11 +1001,7 @@ static UChar get_slowcase ( DiImage* img, DiOffT off )
       img->ces[i]->fromC = False;
       vg_assert(is_sane_CEnt("get_slowcase-case-2", img, i));
    } else {
-      SizeT len = tinfl_decompress_mem_to_mem(
-                     img->ces[i]->data, cslc->szD,
-                     cbuf, cslc->szC,
-                     TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF
-                     | TINFL_FLAG_PARSE_ZLIB_HEADER);
+      SizeT len = decompress_CSlc(img->ces[i]->data, cslc, cbuf);
       vg_assert(len == size);
       img->ces[i]->used = size;
       img->ces[i]->off = cslc->offD;
@@ -804,6 +1023,9 @@ static UChar get_slowcase ( DiImage* img, DiOffT off )
 // This is called a lot, so do the usual fast/slow split stuff on it. */
 static inline UChar get ( DiImage* img, DiOffT off )
 {
+   /* For mapped local files, it's a plain load. */
+   if (LIKELY(off < img->mapping.map_szB))
+      return img->mapping.map[off];
    /* Most likely case is, it's in the ces[0] position. */
    /* ML_(img_from_local_file) requests a read for ces[0] when
       creating the image.  Hence slot zero is always non-NULL, so we
@@ -854,6 +1076,16 @@ DiImage* ML_(img_from_local_file)(const HChar* fullpath)
    /* img->ces is already zeroed out */
    vg_assert(img->source.fd >= 0);
 
+   /* Map the whole file, so that reading it costs no more than reading
+      memory.  If that fails (e.g. on a 32 bit host, for a file too big
+      to fit in the address space), read it via the cache instead. */
+   SysRes sres = VG_(am_mmap_file_float_valgrind)( size, VKI_PROT_READ,
+                                                   img->source.fd, 0 );
+   if (!sr_isError(sres)) {
+      img->mapping.map     = (const UChar*)sr_Res(sres);
+      img->mapping.map_szB = size;
+   }
+
    /* Force the zeroth entry to be the first chunk of the file.
       That's likely to be the first part that's requested anyway, and
       loading it at this point forcing img->cent[0] to always be
@@ -899,17 +1131,33 @@ DiImage* ML_(img_from_di_server)(const HChar* filename,
       reasonably sure we're talking to an instance of
       auxprogs/valgrind-di-server and not to some other random program
       that happens to be listening on that port. */
-   Frame* req = mk_Frame_noargs("VERS");
+   Bool multi_block = False;
+   Frame* req = mk_Frame_noargs("VER2");
    Frame* res = do_transaction(sd, req);
    if (res == NULL)
       goto fail; // do_transaction failed?!
    UChar* vstr = NULL;
-   if (!parse_Frame_asciiz(res, "VEOK", &vstr))
-      goto fail; // unexpected response kind, or invalid ID string
-   vg_assert(vstr);
-   if (VG_(strcmp)("Valgrind Debuginfo Server, Version 1",
-                   (const HChar*)vstr) != 0)
-      goto fail; // wrong version string
+   if (parse_Frame_asciiz(res, "VEOK", &vstr)
+       && VG_(strcmp)("Valgrind Debuginfo Server, Version 2",
+                      (const HChar*)vstr) == 0) {
+      multi_block = True;
+   } else {
+      /* An older server, which only knows VERS, and sends us a FAIL
+         frame for VER2. */
+      free_Frame(req);
+      free_Frame(res);
+      req = mk_Frame_noargs("VERS");
+      res = do_transaction(sd, req);
+      if (res == NULL)
+         goto fail; // do_transaction failed?!
+      vstr = NULL;
+      if (!parse_Frame_asciiz(res, "VEOK", &vstr))
+         goto fail; // unexpected response kind, or invalid ID string
+      vg_assert(vstr);
+      if (VG_(strcmp)("Valgrind Debuginfo Server, Version 1",
+                      (const HChar*)vstr) != 0)
+         goto fail; // wrong version string
+   }
    free_Frame(req);
    free_Frame(res);
    req = NULL;
@@ -934,6 +1182,14 @@ DiImage* ML_(img_from_di_server)(const HChar* filename,
    img->source.is_local   = False;
    img->source.fd         = sd;
    img->source.session_id = session_id;
+   img->source.multi_block = multi_block;
+   if (multi_block) {
+      UInt i;
+      for (i = 0; i < DI_SERVER_RA_STREAMS; i++)
+         img->source.ra[i].buf
+            = ML_(dinfo_zalloc)("di.image.ML_ifds.3",
+                                DI_SERVER_BLOCKS_PER_READ * CACHE_ENTRY_SIZE);
+   }
    img->size              = size;
    img->real_size         = size;
    img->ces_used          = 0;
@@ -977,7 +1233,7 @@ DiImage* ML_(img_from_di_server)(const HChar* filename,
 }
 
 DiOffT ML_(img_mark_compressed_part)(DiImage* img, DiOffT offset, SizeT szC,
-                                     SizeT szD)
+                                     SizeT szD, DiCompression comp)
 {
    DiOffT ret;
    vg_assert(img != NULL);
@@ -994,6 +1250,7 @@ DiOffT ML_(img_mark_compressed_part)(DiImage* img, DiOffT offset, SizeT szC,
    img->cslc[img->cslc_used].szC = szC;
    img->cslc[img->cslc_used].offD = img->size;
    img->cslc[img->cslc_used].szD = szD;
+   img->cslc[img->cslc_used].comp = comp;
    img->size += szD;
    img->cslc_used++;
    return ret;
@@ -1001,10 +1258,13 @@ DiOffT ML_(img_mark_compressed_part)(DiImage* img, DiOffT offset, SizeT szC,
 
 void ML_(img_done)(DiImage* img)
 {
+   UInt i;
    vg_assert(img != NULL);
    if (img->source.is_local) {
-      /* Close the file; nothing else to do. */
+      /* Unmap and close the file; nothing else to do. */
       vg_assert(img->source.session_id == 0);
+      if (img->mapping.map != NULL)
+         VG_(am_munmap_valgrind)((Addr)img->mapping.map, img->mapping.map_szB);
       VG_(close)(img->source.fd);
    } else {
       /* Close the socket.  The server can detect this and will scrub
@@ -1012,10 +1272,13 @@ void ML_(img_done)(DiImage* img)
          explicitly by sending it a "CLOSE" message, or any such. */
       vg_assert(img->source.session_id != 0);
       VG_(close)(img->source.fd);
+      if (img->source.multi_block) {
+         for (i = 0; i < DI_SERVER_RA_STREAMS; i++)
+            ML_(dinfo_free)(img->source.ra[i].buf);
+      }
    }
 
    /* Free up the cache entries, ultimately |img| itself. */
-   UInt i;
    vg_assert(img->ces_used <= CACHE_N_ENTRIES);
    for (i = 0; i < img->ces_used; i++) {
       ML_(dinfo_free)(img->ces[i]);
@@ -1029,6 +1292,12 @@ void ML_(img_done)(DiImage* img)
    ML_(dinfo_free)(img);
 }
 
+Bool ML_(img_is_local)(const DiImage* img)
+{
+   vg_assert(img != NULL);
+   return img->source.is_local;
+}
+
 DiOffT ML_(img_size)(const DiImage* img)
 {
    vg_assert(img != NULL);
@@ -1083,6 +1352,10 @@ void ML_(img_get)(/*OUT*/void* dst,
    vg_assert(img != NULL);
    vg_assert(size > 0);
    ensure_valid(img, offset, size, "ML_(img_get)");
+   if (LIKELY(offset + size <= img->mapping.map_szB)) {
+      VG_(memcpy)(dst, img->mapping.map + offset, size);
+      return;
+   }
    SizeT i;
    for (i = 0; i < size; i++) {
       ((UChar*)dst)[i] = get(img, offset + i);
@@ -1095,6 +1368,12 @@ SizeT ML_(img_get_some)(/*OUT*/void* dst,
    vg_assert(img != NULL);
    vg_assert(size > 0);
    ensure_valid(img, offset, size, "ML_(img_get_some)");
+   if (LIKELY(offset < img->mapping.map_szB)) {
+      SizeT nToCopy = img->mapping.map_szB - offset;
+      if (size < nToCopy) nToCopy = size;
+      VG_(memcpy)(dst, img->mapping.map + offset, nToCopy);
+      return nToCopy;
+   }
    UChar* dstU = (UChar*)dst;
    /* Use |get| in the normal way to get the first byte of the range.
       This guarantees to put the cache entry containing |offset| in
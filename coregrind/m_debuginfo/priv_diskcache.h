@@ -0,0 +1,76 @@
+
+/*--------------------------------------------------------------------*/
+/*--- On-disk cache of canonicalised debug info tables.            ---*/
+/*---                                             priv_diskcache.h ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   Copyright (C) 2019-2019 The Valgrind Developers
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#ifndef __PRIV_DISKCACHE_H
+#define __PRIV_DISKCACHE_H
+
+#include "pub_core_basics.h"    // Bool
+
+/* With --debuginfo-cache-dir=<dir>, the canonicalised symbol, line,
+   inlined call and call frame tables of an object with a build-id are
+   saved in <dir>/<build-id>.vgdi once read, and are loaded from there
+   instead of being read from the object's debug info by later runs.
+
+   The file is a header followed by the tables, each at an 8-aligned
+   offset, in the layout they have in memory, except that pointers to
+   strings are replaced by string numbers.  Addresses are those of the
+   run which saved the file, and are rebased when loading if the
+   object is mapped elsewhere.
+
+   The tables depend on the separate debug file found for the object,
+   if any, e.g. an entry saved before the debug files of a library
+   were installed has its symbols only.  So the header records the
+   build-id of the debug file, and an entry is only used if the same
+   debug file is found.  Objects whose debug file has no build-id are
+   not cached. */
+
+/* Should the tables of 'di' be looked for in, or saved to, the
+   cache ? */
+extern Bool ML_(diskcache_wanted) ( const DebugInfo* di );
+
+/* Loads the tables of 'di', whose layout (text_avma, biases, ...) is
+   known, from the cache entry for 'buildid', if it was saved with
+   the tables read from the separate debug file with build-id
+   'debug_buildid' (NULL if none).  Returns False, with 'di'
+   unchanged, if there is no usable entry.  On success, the tables are
+   canonical already and di->cache_loaded is set. */
+extern Bool ML_(diskcache_load) ( DebugInfo* di, const HChar* buildid,
+                                  const HChar* debug_buildid );
+
+/* Saves the canonicalised tables of 'di' as the cache entry for
+   di->cache_buildid, read from the debug file di->cache_debug_buildid.
+   Failures are silent, except at -v. */
+extern void ML_(diskcache_save) ( const DebugInfo* di );
+
+#endif /* ndef __PRIV_DISKCACHE_H */
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
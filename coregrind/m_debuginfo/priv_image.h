@@ -57,6 +57,24 @@ typedef  ULong  DiOffT;
    expected part of the image is missing. */
 #define DiOffT_INVALID ((DiOffT)(0xFFFFFFFFFFFFFFFFULL))
 
+/* Every DiImage starts with one of these.  For a local file, which is
+   mapped in full, |map| points at the mapping and |map_szB| is the
+   file size, so that the cursor functions below can read it with
+   plain loads.  For anything else, they are NULL and 0. */
+typedef
+   struct { const UChar* map; DiOffT map_szB; }
+   DiImageMapping;
+
+/* If [offset, +size) of |img| is mapped, returns its address, else
+   NULL. */
+static inline const UChar* ML_(img_mapped)( const DiImage* img,
+                                            DiOffT offset, SizeT size ) {
+   const DiImageMapping* m = (const DiImageMapping*)img;
+   if (LIKELY(offset < m->map_szB && size <= m->map_szB - offset))
+      return m->map + offset;
+   return NULL;
+}
+
 /* Create an image from a file in the local filesysem.  Returns NULL
    if it fails, for whatever reason. */
 DiImage* ML_(img_from_local_file)(const HChar* fullpath);
@@ -74,6 +92,10 @@ DiImage* ML_(img_from_di_server)(const HChar* filename,
 /* Destroy an existing image. */
 void ML_(img_done)(DiImage*);
 
+/* Is the image read from a local file, rather than from a debuginfo
+   server ? */
+Bool ML_(img_is_local)(const DiImage* img);
+
 /* Virtual size of the image. */
 DiOffT ML_(img_size)(const DiImage* img);
 
@@ -130,12 +152,21 @@ ULong  ML_(img_get_ULong) (DiImage* img, DiOffT offset);
    connection, making the client/server split pointless. */
 UInt ML_(img_calc_gnu_debuglink_crc32)(DiImage* img);
 
+/* Compression formats of compressed parts of images. */
+typedef
+   enum {
+      DiCompZlib,  // zlib stream, decompressed by tinfl.c
+      DiCompZstd   // zstd frames, decompressed by tzstd.c
+   }
+   DiCompression;
+
 /* Mark compressed part of image defined with (offset, szC).
    szD is length of uncompressed data (should be known before decompression).
+   comp says how it is compressed.
    Returns (virtual) position in image from which decompressed data can be
-   read. */
+   read.  The data is decompressed on first access. */
 DiOffT ML_(img_mark_compressed_part)(DiImage* img, DiOffT offset, SizeT szC,
-                                     SizeT szD);
+                                     SizeT szD, DiCompression comp);
 
 
 /*------------------------------------------------------------*/
@@ -295,22 +326,35 @@ static inline UChar* ML_(cur_read_memdup)( DiCursor c, SizeT size,
    return dst;
 }
 
+/* The primitive types below are read straight from the mapping when
+   the image has one, else via the out-of-line ML_(img_get_*).  Their
+   offsets need not be aligned, hence these. */
+typedef struct { UShort v; } __attribute__((packed)) DiUnalignedUShort;
+typedef struct { UInt   v; } __attribute__((packed)) DiUnalignedUInt;
+typedef struct { ULong  v; } __attribute__((packed)) DiUnalignedULong;
+
 static inline UChar ML_(cur_read_UChar) ( DiCursor c ) {
+   const UChar* p = ML_(img_mapped)( c.img, c.ioff, sizeof(UChar) );
+   if (LIKELY(p != NULL))
+      return *p;
    UChar r = ML_(img_get_UChar)( c.img, c.ioff );
    return r;
 }
 static inline UChar ML_(cur_step_UChar)( DiCursor* c ) {
-   UChar r = ML_(img_get_UChar)( c->img, c->ioff );
+   UChar r = ML_(cur_read_UChar)( *c );
    c->ioff += sizeof(UChar);
    return r;
 }
 
 static inline UShort ML_(cur_read_UShort) ( DiCursor c ) {
+   const UChar* p = ML_(img_mapped)( c.img, c.ioff, sizeof(UShort) );
+   if (LIKELY(p != NULL))
+      return ((const DiUnalignedUShort*)p)->v;
    UShort r = ML_(img_get_UShort)( c.img, c.ioff );
    return r;
 }
 static inline UShort ML_(cur_step_UShort) ( DiCursor* c ) {
-   UShort r = ML_(img_get_UShort)( c->img, c->ioff );
+   UShort r = ML_(cur_read_UShort)( *c );
    c->ioff += sizeof(UShort);
    return r;
 }
@@ -319,11 +363,14 @@ static inline Short ML_(cur_step_Short) ( DiCursor* c ) {
 }
 
 static inline UInt ML_(cur_read_UInt) ( DiCursor c ) {
+   const UChar* p = ML_(img_mapped)( c.img, c.ioff, sizeof(UInt) );
+   if (LIKELY(p != NULL))
+      return ((const DiUnalignedUInt*)p)->v;
    UInt r = ML_(img_get_UInt)( c.img, c.ioff );
    return r;
 }
 static inline UInt ML_(cur_step_UInt) ( DiCursor* c ) {
-   UInt r = ML_(img_get_UInt)( c->img, c->ioff );
+   UInt r = ML_(cur_read_UInt)( *c );
    c->ioff += sizeof(UInt);
    return r;
 }
@@ -332,11 +379,14 @@ static inline Int ML_(cur_step_Int) ( DiCursor* c ) {
 }
 
 static inline ULong ML_(cur_read_ULong) ( DiCursor c ) {
+   const UChar* p = ML_(img_mapped)( c.img, c.ioff, sizeof(ULong) );
+   if (LIKELY(p != NULL))
+      return ((const DiUnalignedULong*)p)->v;
    ULong r = ML_(img_get_ULong)( c.img, c.ioff );
    return r;
 }
 static inline ULong ML_(cur_step_ULong) ( DiCursor* c ) {
-   ULong r = ML_(img_get_ULong)( c->img, c->ioff );
+   ULong r = ML_(cur_read_ULong)( *c );
    c->ioff += sizeof(ULong);
    return r;
 }
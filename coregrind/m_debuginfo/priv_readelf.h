@@ -54,6 +54,12 @@ extern Bool ML_(is_elf_object_file)( const void* image, SizeT n_image,
 */
 extern Bool ML_(read_elf_debug_info) ( DebugInfo* di );
 
+/* With --lazy-debuginfo=yes, ML_(read_elf_debug_info) only reads the
+   symbols, and records in di->deferred the other tables it could
+   read.  This reads those of them that are in TABLES (DiTab_ bits).
+   The caller must canonicalise them afterwards. */
+extern Bool ML_(read_elf_deferred_debug_info) ( DebugInfo* di, UInt tables );
+
 
 #endif /* ndef __PRIV_READELF_H */
 
@@ -569,6 +569,16 @@ struct _DebugInfoFSM
 #define N_EHFRAME_SECTS 2
 
 
+/* The tables of a DebugInfo which, with --lazy-debuginfo=yes, are
+   only read the first time a query needs them (see
+   DebugInfo::deferred).  The symbol table is always read straight
+   away, as m_redir needs it as soon as the object is mapped. */
+#define DiTab_CFI    (1 << 0)  /* call frame info (cfsi_*) */
+#define DiTab_Loc    (1 << 1)  /* line number info (loctab) */
+#define DiTab_Dwarf3 (1 << 2)  /* inlined calls and variables (inltab,
+                                  varinfo), which are read together */
+
+
 /* So, the main structure for holding debug info for one object. */
 
 struct _DebugInfo {
@@ -646,6 +656,23 @@ struct _DebugInfo {
       invalid and should not be consulted. */
    Bool  have_dinfo; /* initially False */
 
+   /* The DiTab_ tables which have not been read yet.  They are read
+      by ML_(read_elf_deferred_debug_info), provided the object file
+      still has the size and modification time it had when the
+      symbols were read. */
+   UInt  deferred;
+   Long  deferred_size;
+   ULong deferred_mtime;
+
+   /* With --debuginfo-cache-dir, the build-id under which the tables
+      are to be saved once canonicalised (NULL if they are not to be
+      saved), the build-id of the separate debug file they are read
+      from (NULL if none), and whether they were loaded from the cache
+      instead of being read.  See priv_diskcache.h. */
+   HChar* cache_buildid;
+   HChar* cache_debug_buildid;
+   Bool   cache_loaded;
+
    /* All the rest of the fields in this structure are filled in once
       we have committed to reading the symbols and debug info (that
       is, at the point where .have_dinfo is set to True). */
@@ -1110,6 +1137,11 @@ extern void ML_(addVar)( struct _DebugInfo* di,
    this after finishing adding entries to these tables. */
 extern void ML_(canonicaliseTables) ( struct _DebugInfo* di );
 
+/* Canonicalise the DiTab_ TABLES held by 'di', which have just been
+   read after being deferred. */
+extern void ML_(canonicaliseDeferredTables) ( struct _DebugInfo* di,
+                                              UInt tables );
+
 /* Canonicalise the call-frame-info table held by 'di', in preparation
    for use. This is called by ML_(canonicaliseTables) but can also be
    called on it's own to sort just this table. */
@@ -1130,6 +1162,14 @@ extern Word ML_(search_one_symtab) ( const DebugInfo* di, Addr ptr,
    if not found.  Binary search.  */
 extern Word ML_(search_one_loctab) ( const DebugInfo* di, Addr ptr );
 
+/* As above, but only search the entries from index lo onwards.  When
+   looking up increasing addresses, passing the index found for the
+   previous one walks the table only once. */
+extern Word ML_(search_one_symtab_from) ( const DebugInfo* di, Addr ptr,
+                                          Bool findText, Word lo );
+extern Word ML_(search_one_loctab_from) ( const DebugInfo* di, Addr ptr,
+                                          Word lo );
+
 /* Find a CFI-table index containing the specified pointer, or -1 if
    not found.  Binary search.  */
 extern Word ML_(search_one_cfitab) ( const DebugInfo* di, Addr ptr );
@@ -1145,6 +1185,53 @@ extern Word ML_(search_one_fpotab) ( const DebugInfo* di, Addr ptr );
 extern DebugInfoMapping* ML_(find_rx_mapping) ( DebugInfo* di,
                                                 Addr lo, Addr hi );
 
+/* ------ Helper processes ------ */
+
+/* With --debuginfo-helpers=N, the DWARF readers split the compilation
+   units of a large section into up to N+1 contiguous parts.  Part 0
+   is read by the calling process, the others by forked helper
+   processes.  A helper does not store the line and inlined call
+   entries it reads: ML_(addLineInfo), ML_(addInlInfo) and
+   ML_(addFnDn) record them instead, and the records are sent back to
+   the parent, which adds them in part order.  The resulting tables
+   are thus exactly those of a sequential read. */
+
+/* Is section 'sec' of 'di' worth reading with helpers ? */
+extern Bool ML_(want_helpers) ( const DebugInfo* di, DiSlice sec );
+
+/* Forks the helpers for reading a section made of 'n_units' units.
+   Returns the part that the calling process must read: 0 in the
+   parent, 1 .. *n_parts-1 in a helper.  *n_parts is set to 1 + the
+   number of helpers started, which can be 0. */
+extern Int ML_(fork_helpers) ( DebugInfo* di, Word n_units,
+                               /*OUT*/Int* n_parts );
+
+/* Are we a helper process ? */
+extern Bool ML_(in_helper) ( void );
+
+/* Sends the records of this helper to the parent, and exits.
+   'failure' is NULL if the part was read successfully, otherwise the
+   reason why reading stopped. */
+extern void ML_(finish_helper) ( const HChar* failure )
+   __attribute__((noreturn));
+
+/* Adds the records of all helpers to 'di', in part order, and reaps
+   the helpers.  If a helper failed, the records of the following
+   parts are discarded and the failure reason is returned, otherwise
+   NULL is returned. */
+extern const HChar* ML_(collect_helpers) ( DebugInfo* di );
+
+/* Kills and reaps all helpers, discarding their records. */
+extern void ML_(abandon_helpers) ( void );
+
+/* Given the sorted start offsets of the units of a section of size
+   'sec_szB', computes the offsets [*lo, *hi) of the units that 'part'
+   out of 'n_parts' must read.  The parts have roughly the same size
+   in bytes, and the last one extends to the end of the section. */
+extern void ML_(helper_part_range) ( const XArray* /* of ULong */ unit_offs,
+                                     ULong sec_szB, Int part, Int n_parts,
+                                     /*OUT*/ULong* lo, /*OUT*/ULong* hi );
+
 /* ------ Misc ------ */
 
 /* Show a non-fatal debug info reading error.  Use VG_(core_panic) for
@@ -1017,41 +1017,54 @@ void read_unitinfo_dwarf2( /*OUT*/UnitInfo* ui,
 ////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////
 
-/* Collect the debug info from DWARF3 debugging sections
- * of a given module.
- * 
- * Inputs: given .debug_xxx sections
- * Output: update di to contain all the DWARF3 debug infos
- */
-void ML_(read_debuginfo_dwarf3)
+/* Returns the offsets of the blocks of .debug_info visited by
+   read_dwarf2_blocks, including that of a final truncated one. */
+static XArray* /* of ULong */ find_dwarf2_blocks ( DiSlice escn_debug_info )
+{
+   XArray*  offs = VG_(newXA)( ML_(dinfo_zalloc), "di.rd3.fdb.1",
+                               ML_(dinfo_free), sizeof(ULong) );
+   DiCursor start_img = ML_(cur_from_sli)(escn_debug_info);
+   ULong    off = 0;
+   ULong    blklen;
+   Bool     blklen_is_64;
+
+   while (off < escn_debug_info.szB - 4) {
+      VG_(addToXA)( offs, &off );
+      blklen = read_initial_length_field( ML_(cur_plus)(start_img, off),
+                                          &blklen_is_64 );
+      if (blklen > escn_debug_info.szB)
+         break;
+      off += blklen + (blklen_is_64 ? 12 : 4);
+   }
+   return offs;
+}
+
+/* Read the line info of the compilation units of .debug_info whose
+   block starts at an offset in [lo, hi). */
+static void read_dwarf2_blocks
         ( struct _DebugInfo* di,
           DiSlice escn_debug_info,      /* .debug_info */
-          DiSlice escn_debug_types,     /* .debug_types */
           DiSlice escn_debug_abbv,      /* .debug_abbrev */
           DiSlice escn_debug_line,      /* .debug_line */
           DiSlice escn_debug_str,       /* .debug_str */
-          DiSlice escn_debug_str_alt )  /* .debug_str */
+          DiSlice escn_debug_str_alt,   /* .debug_str */
+          ULong lo, ULong hi )
 {
    UnitInfo ui;
    UShort   ver;
    ULong    blklen;
    Bool     blklen_is_64;
 
-   /* Make sure we at least have a header for the first block */
-   if (escn_debug_info.szB < 4) {
-      ML_(symerr)( di, True, 
-                   "Last block truncated in .debug_info; ignoring" );
-      return;
-   }
-
    DiCursor block_img = DiCursor_INVALID;
    DiCursor end1_img  = ML_(cur_plus)( ML_(cur_from_sli)(escn_debug_info), 
                                        escn_debug_info.szB );
    Int blklen_len = 0;
 
    /* Iterate on all the blocks we find in .debug_info */
-   for ( block_img = ML_(cur_from_sli)(escn_debug_info);
-         ML_(cur_cmpLT)(block_img, ML_(cur_plus)(end1_img, -(DiOffT)4));
+   for ( block_img = ML_(cur_plus)( ML_(cur_from_sli)(escn_debug_info), lo );
+         ML_(cur_cmpLT)(block_img, ML_(cur_plus)(end1_img, -(DiOffT)4))
+         && ML_(cur_minus)(block_img, ML_(cur_from_sli)(escn_debug_info))
+            < hi;
          block_img = ML_(cur_plus)(block_img, blklen + blklen_len) ) {
 
       /* Read the compilation unit header in .debug_info section - See
@@ -1114,6 +1127,51 @@ void ML_(read_debuginfo_dwarf3)
    }
 }
 
+/* Collect the debug info from DWARF3 debugging sections
+ * of a given module.
+ * 
+ * Inputs: given .debug_xxx sections
+ * Output: update di to contain all the DWARF3 debug infos
+ */
+void ML_(read_debuginfo_dwarf3)
+        ( struct _DebugInfo* di,
+          DiSlice escn_debug_info,      /* .debug_info */
+          DiSlice escn_debug_types,     /* .debug_types */
+          DiSlice escn_debug_abbv,      /* .debug_abbrev */
+          DiSlice escn_debug_line,      /* .debug_line */
+          DiSlice escn_debug_str,       /* .debug_str */
+          DiSlice escn_debug_str_alt )  /* .debug_str */
+{
+   Int   part = 0, n_parts = 1;
+   ULong lo = 0, hi = ~0ULL;
+
+   /* Make sure we at least have a header for the first block */
+   if (escn_debug_info.szB < 4) {
+      ML_(symerr)( di, True, 
+                   "Last block truncated in .debug_info; ignoring" );
+      return;
+   }
+
+   /* The size of .debug_line is what matters, but it is split along
+      the compilation units of .debug_info. */
+   if (ML_(want_helpers)( di, escn_debug_line )) {
+      XArray* blocks = find_dwarf2_blocks( escn_debug_info );
+      part = ML_(fork_helpers)( di, VG_(sizeXA)(blocks), &n_parts );
+      ML_(helper_part_range)( blocks, escn_debug_info.szB, part, n_parts,
+                              &lo, &hi );
+      VG_(deleteXA)( blocks );
+   }
+
+   read_dwarf2_blocks( di, escn_debug_info, escn_debug_abbv,
+                       escn_debug_line, escn_debug_str, escn_debug_str_alt,
+                       lo, hi );
+
+   if (part > 0)
+      ML_(finish_helper)( NULL );
+   if (n_parts > 1)
+      (void) ML_(collect_helpers)( di );
+}
+
 
 ////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////
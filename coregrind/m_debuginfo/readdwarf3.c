@@ -4491,6 +4491,30 @@ static void trace_debug_abbrev (const DebugInfo* di,
    }
 }
 
+/* Returns the offsets of the compilation units of 'sec' that the
+   DIE-reading loop in new_dwarf3_reader_wrk visits. */
+static XArray* /* of ULong */ find_CUs ( DiSlice sec )
+{
+   XArray*  offs = VG_(newXA)( ML_(dinfo_zalloc), "di.readdwarf3.fcu.1",
+                               ML_(dinfo_free), sizeof(ULong) );
+   DiCursor start = ML_(cur_from_sli)(sec);
+   ULong    off = 0;
+
+   while (off < sec.szB && sec.szB - off >= 11) {
+      ULong unit_length;
+      VG_(addToXA)( offs, &off );
+      unit_length = ML_(cur_read_UInt)( ML_(cur_plus)(start, off) );
+      if (unit_length == 0xFFFFFFFF) {
+         unit_length = ML_(cur_read_ULong)( ML_(cur_plus)(start, off + 4) );
+         unit_length += 8;
+      }
+      if (unit_length > sec.szB)
+         break;
+      off += unit_length + 4;
+   }
+   return offs;
+}
+
 static
 void new_dwarf3_reader_wrk ( 
    DebugInfo* di,
@@ -4521,6 +4545,8 @@ void new_dwarf3_reader_wrk (
    XArray* /* of TempVar* */ dioff_lookup_tab;
    Int pass;
    VgHashTable *signature_types = NULL;
+   Int   part, n_parts;
+   ULong part_lo, part_hi;
 
    /* Display/trace various information, if requested. */
    if (TD3) {
@@ -4678,6 +4704,24 @@ void new_dwarf3_reader_wrk (
          TRACE_D3("\n------ Parsing .debug_types section ------\n");
       }
 
+      /* When only reading inline info, the CUs are independent of each
+         other, so that helpers can read some of them.  With var info,
+         the type entities of all CUs are merged, which needs them all
+         to be in the same process. */
+      part    = 0;
+      n_parts = 1;
+      part_lo = 0;
+      part_hi = ~0ULL;
+      if (pass < 2 && !VG_(clo_read_var_info)
+          && ML_(want_helpers)( di, info.sli )) {
+         XArray* cus = find_CUs( info.sli );
+         part = ML_(fork_helpers)( di, VG_(sizeXA)(cus), &n_parts );
+         ML_(helper_part_range)( cus, section_size, part, n_parts,
+                                 &part_lo, &part_hi );
+         VG_(deleteXA)( cus );
+         set_position_of_Cursor( &info, part_lo );
+      }
+
       while (True) {
          ULong   cu_start_offset, cu_offset_now;
          CUConst cc;
@@ -4721,6 +4765,8 @@ void new_dwarf3_reader_wrk (
          }
 
          cu_start_offset = get_position_of_Cursor( &info );
+         if (cu_start_offset >= part_hi)
+            break;
          TRACE_D3("\n");
          TRACE_D3("  Compilation Unit @ offset 0x%llx:\n", cu_start_offset);
          /* parse_CU_header initialises the CU's hashtable of abbvs ht_abbvs */
@@ -4851,6 +4897,14 @@ void new_dwarf3_reader_wrk (
             break;
          /* else keep going */
       }
+
+      if (part > 0)
+         ML_(finish_helper)( NULL );
+      if (n_parts > 1) {
+         const HChar* failure = ML_(collect_helpers)( di );
+         if (failure != NULL)
+            barf( failure );
+      }
    }
 
 
@@ -5246,6 +5300,12 @@ ML_(new_dwarf3_reader) (
       /* Can't longjump without giving some sort of reason. */
       vg_assert(d3rd_jmpbuf_reason != NULL);
 
+      /* A helper leaves it to its parent to report the failure, and
+         the parent kills the helpers reading the following parts. */
+      if (ML_(in_helper)())
+         ML_(finish_helper)( d3rd_jmpbuf_reason );
+      ML_(abandon_helpers)();
+
       TRACE_D3("\n------ .debug_info reading failed ------\n");
 
       ML_(symerr)(di, True, d3rd_jmpbuf_reason);
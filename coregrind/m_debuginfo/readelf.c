@@ -38,6 +38,7 @@
 #include "pub_core_libcbase.h"
 #include "pub_core_libcprint.h"
 #include "pub_core_libcassert.h"
+#include "pub_core_libcfile.h"
 #include "pub_core_machine.h"      /* VG_ELF_CLASS */
 #include "pub_core_options.h"
 #include "pub_core_oset.h"
@@ -53,6 +54,7 @@
 #include "priv_readdwarf.h"        /* 'cos ELF contains DWARF */
 #include "priv_readdwarf3.h"
 #include "priv_readexidx.h"
+#include "priv_diskcache.h"
 #include "config.h"
 
 /* --- !!! --- EXTERNAL HEADERS start --- !!! --- */
@@ -87,6 +89,10 @@
    #define ELFCOMPRESS_ZLIB 1
 #endif
 
+#if !defined(ELFCOMPRESS_ZSTD)
+   #define ELFCOMPRESS_ZSTD 2
+#endif
+
 #define SIZE_OF_ZLIB_HEADER 12
 
 /*------------------------------------------------------------*/
@@ -1500,13 +1506,18 @@ Word file_offset_from_svma ( /*OUT*/Bool* ok,
 static Bool check_compression(ElfXX_Shdr* h, DiSlice* s) {
    if (h->sh_flags & SHF_COMPRESSED) {
       ElfXX_Chdr chdr;
+      DiCompression comp;
       ML_(img_get)(&chdr, s->img, s->ioff, sizeof(ElfXX_Chdr));
-      if (chdr.ch_type != ELFCOMPRESS_ZLIB)
+      if (chdr.ch_type == ELFCOMPRESS_ZLIB)
+         comp = DiCompZlib;
+      else if (chdr.ch_type == ELFCOMPRESS_ZSTD)
+         comp = DiCompZstd;
+      else
          return False;
       s->ioff = ML_(img_mark_compressed_part)(s->img,
                                               s->ioff + sizeof(ElfXX_Chdr),
                                               s->szB - sizeof(ElfXX_Chdr),
-                                              (SizeT)chdr.ch_size);
+                                              (SizeT)chdr.ch_size, comp);
       s->szB = chdr.ch_size;
     } else if (h->sh_size > SIZE_OF_ZLIB_HEADER) {
        /* Read the zlib header.  In this case, it should be "ZLIB"
@@ -1532,7 +1543,7 @@ static Bool check_compression(ElfXX_Shdr* h, DiSlice* s) {
           s->ioff = ML_(img_mark_compressed_part)(s->img,
                                                   s->ioff + SIZE_OF_ZLIB_HEADER,
                                                   s->szB - SIZE_OF_ZLIB_HEADER,
-                                                  size);
+                                                  size, DiCompZlib);
           s->szB = size;
        }
     }
@@ -1614,7 +1625,10 @@ static HChar* readlink_path (const HChar *path)
    supplied DebugInfo.
 */
 
-Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
+/* Read the symbols and the DiTab_ TABLES of DI.  If DI already has
+   its symbols (di->have_dinfo), only TABLES are read: they were
+   deferred by an earlier call, and the object's layout is known. */
+static Bool read_elf_debug_info_WRK ( struct _DebugInfo* di, UInt tables )
 {
    /* This function is long and complex.  That, and the presence of
       nested scopes, means it's not always easy to see which parts are
@@ -1694,21 +1708,29 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
    Addr dtrace_data_vaddr = 0;
 #  endif
 
+   /* Are we reading deferred tables of an object read before? */
+   const Bool reload = di->have_dinfo;
+
    vg_assert(di);
    vg_assert(di->fsm.have_rx_map == True);
    vg_assert(di->fsm.have_rw_map == True);
-   vg_assert(di->have_dinfo == False);
    vg_assert(di->fsm.filename);
-   vg_assert(!di->symtab);
-   vg_assert(!di->loctab);
-   vg_assert(!di->inltab);
-   vg_assert(!di->cfsi_base);
-   vg_assert(!di->cfsi_m_ix);
-   vg_assert(!di->cfsi_rd);
-   vg_assert(!di->cfsi_exprs);
-   vg_assert(!di->strpool);
-   vg_assert(!di->fndnpool);
-   vg_assert(!di->soname);
+   if (reload) {
+      vg_assert(tables != 0);
+      vg_assert((tables & ~di->deferred) == 0);
+   } else {
+      vg_assert(!di->symtab);
+      vg_assert(!di->loctab);
+      vg_assert(!di->inltab);
+      vg_assert(!di->cfsi_base);
+      vg_assert(!di->cfsi_m_ix);
+      vg_assert(!di->cfsi_rd);
+      vg_assert(!di->cfsi_exprs);
+      vg_assert(!di->strpool);
+      vg_assert(!di->fndnpool);
+      vg_assert(!di->soname);
+      vg_assert(di->deferred == 0);
+   }
 
    {
       Bool has_nonempty_rx = False;
@@ -1743,9 +1765,14 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
 
    res = False;
 
-   if (VG_(clo_verbosity) > 1 || VG_(clo_trace_redir))
+   if (reload) {
+      if (VG_(clo_verbosity) > 1)
+         VG_(message)(Vg_DebugMsg, "Reading deferred debug info from %s\n",
+                                   di->fsm.filename );
+   } else if (VG_(clo_verbosity) > 1 || VG_(clo_trace_redir)) {
       VG_(message)(Vg_DebugMsg, "Reading syms from %s\n",
                                 di->fsm.filename );
+   }
 
    /* Connect to the primary object image, so that we can read symbols
       and line number info out of it.  It will be disconnected
@@ -1836,6 +1863,11 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
 
    TRACE_SYMTAB("shdr:    string table at %llu\n", shdr_strtab_mioff);
 
+   /* The layout of the object was worked out when its symbols were
+      read; only the debug info sections need finding again. */
+   if (reload)
+      goto find_sections;
+
    svma_ranges = VG_(newXA)(ML_(dinfo_zalloc), "di.relfdi.1",
                             ML_(dinfo_free), sizeof(RangeAndBias));
 
@@ -2537,6 +2569,7 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
                                 di->text_avma - di->text_bias,
                                 di->text_avma );
 
+  find_sections:
    TRACE_SYMTAB("\n");
    TRACE_SYMTAB("------ Finding image addresses "
                 "for debug-info sections ------\n");
@@ -2750,11 +2783,6 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
          }
       }
 
-      if (buildid) {
-         ML_(dinfo_free)(buildid);
-         buildid = NULL; /* paranoia */
-      }
-
       /* As a last-ditch measure, try looking for in the
          --extra-debuginfo-path and/or on the --debuginfo-server, but
          only in the case where --allow-mismatched-debuginfo=yes.
@@ -2772,6 +2800,33 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
          dimg = find_debug_file_ad_hoc( di, di->fsm.filename );
       }
 
+      /* If the tables of an object with this build-id, read with the
+         same debug image, were saved in the --debuginfo-cache-dir,
+         take them from there, and skip reading the symbols and debug
+         info altogether.  Otherwise, remember the build-ids so that
+         they are saved once read. */
+      if (!reload && buildid != NULL && ML_(diskcache_wanted)(di)) {
+         HChar* debug_buildid
+            = dimg != NULL ? find_buildid(dimg, True, True) : NULL;
+         if (dimg == NULL || debug_buildid != NULL) {
+            if (ML_(diskcache_load)(di, buildid, debug_buildid)) {
+               if (debug_buildid)
+                  ML_(dinfo_free)(debug_buildid);
+               ML_(dinfo_free)(buildid);
+               res = True;
+               goto out;
+            }
+            di->cache_buildid
+               = ML_(dinfo_strdup)("di.redi.cache_buildid", buildid);
+            di->cache_debug_buildid = debug_buildid;
+         }
+      }
+
+      if (buildid) {
+         ML_(dinfo_free)(buildid);
+         buildid = NULL; /* paranoia */
+      }
+
       /* TOPLEVEL */
       /* If we were successful in finding a debug image, pull various
          SVMA/bias/size and image addresses out of it. */
@@ -3161,7 +3216,7 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
 
       /* TOPLEVEL */
       /* Read symbols */
-      {
+      if (!reload) {
          void (*read_elf_symtab)(struct _DebugInfo*, const HChar*,
                                  DiSlice*, DiSlice*, DiSlice*, Bool);
          Bool symtab_in_debug;
@@ -3188,7 +3243,7 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
       /* Read .eh_frame and .debug_frame (call-frame-info) if any.  Do
          the .eh_frame section(s) first. */
       vg_assert(di->n_ehframe >= 0 && di->n_ehframe <= N_EHFRAME_SECTS);
-      for (i = 0; i < di->n_ehframe; i++) {
+      for (i = 0; (tables & DiTab_CFI) && i < di->n_ehframe; i++) {
          /* see Comment_on_EH_FRAME_MULTIPLE_INSTANCES above for why
             this next assertion should hold. */
          vg_assert(ML_(sli_is_valid)(ehframe_escn[i]));
@@ -3198,7 +3253,7 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
                                           di->ehframe_avma[i],
                                           True/*is_ehframe*/ );
       }
-      if (ML_(sli_is_valid)(debug_frame_escn)) {
+      if ((tables & DiTab_CFI) && ML_(sli_is_valid)(debug_frame_escn)) {
          ML_(read_callframe_info_dwarf3)( di,
                                           debug_frame_escn,
                                           0/*assume zero avma*/,
@@ -3215,19 +3270,21 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
           && ML_(sli_is_valid)(debug_abbv_escn)
           && ML_(sli_is_valid)(debug_line_escn)) {
          /* The old reader: line numbers and unwind info only */
-         ML_(read_debuginfo_dwarf3) ( di,
-                                      debug_info_escn,
-                                      debug_types_escn,
-                                      debug_abbv_escn,
-                                      debug_line_escn,
-                                      debug_str_escn,
-                                      debug_str_alt_escn );
+         if (tables & DiTab_Loc)
+            ML_(read_debuginfo_dwarf3) ( di,
+                                         debug_info_escn,
+                                         debug_types_escn,
+                                         debug_abbv_escn,
+                                         debug_line_escn,
+                                         debug_str_escn,
+                                         debug_str_alt_escn );
          /* The new reader: read the DIEs in .debug_info to acquire
             information on variable types and locations or inline info.
             But only if the tool asks for it, or the user requests it on
             the command line. */
-         if (VG_(clo_read_var_info) /* the user or tool asked for it */
-             || VG_(clo_read_inline_info)) {
+         if ((tables & DiTab_Dwarf3)
+             && (VG_(clo_read_var_info) /* the user or tool asked for it */
+                 || VG_(clo_read_inline_info))) {
             ML_(new_dwarf3_reader)(
                di, debug_info_escn,     debug_types_escn,
                    debug_abbv_escn,     debug_line_escn,
@@ -3272,7 +3329,8 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
          * remove DebugInfo::{extab_bias, exidx_svma, extab_svma} since
            they are never used.
       */
-      if (di->exidx_present
+      if ((tables & DiTab_CFI)
+          && di->exidx_present
           && di->cfsi_used == 0
           && di->text_present && di->text_size > 0) {
          Addr text_last_svma = di->text_svma + di->text_size - 1;
@@ -3283,6 +3341,36 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
       }
 #     endif /* defined(VGA_arm) */
 
+      /* TOPLEVEL */
+      /* Note which of the tables we have not read yet, but could
+         read later. */
+      if (!reload) {
+         UInt available = 0;
+         if (di->n_ehframe > 0 || ML_(sli_is_valid)(debug_frame_escn))
+            available |= DiTab_CFI;
+#        if defined(VGA_arm)
+         if (di->exidx_present && di->text_present && di->text_size > 0)
+            available |= DiTab_CFI;
+#        endif
+         if (ML_(sli_is_valid)(debug_info_escn)
+             && ML_(sli_is_valid)(debug_abbv_escn)
+             && ML_(sli_is_valid)(debug_line_escn)) {
+            available |= DiTab_Loc;
+            if (VG_(clo_read_var_info) || VG_(clo_read_inline_info))
+               available |= DiTab_Dwarf3;
+         }
+         di->deferred = available & ~tables;
+         if (di->deferred != 0) {
+            struct vg_stat st;
+            if (sr_isError(VG_(stat)(di->fsm.filename, &st))) {
+               di->deferred = 0;
+            } else {
+               di->deferred_size  = st.size;
+               di->deferred_mtime = st.mtime;
+            }
+         }
+      }
+
    } /* "Find interesting sections, read the symbol table(s), read any debug
         information" (a local scope) */
 
@@ -3333,6 +3421,39 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
    /* NOTREACHED */
 }
 
+Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
+{
+   /* Tables to be saved in the --debuginfo-cache-dir must all be
+      read now. */
+   return read_elf_debug_info_WRK(di, VG_(clo_lazy_debuginfo)
+                                      && !ML_(diskcache_wanted)(di)
+                                      ? 0
+                                      : DiTab_CFI | DiTab_Loc | DiTab_Dwarf3);
+}
+
+Bool ML_(read_elf_deferred_debug_info) ( struct _DebugInfo* di, UInt tables )
+{
+   struct vg_stat st;
+
+   vg_assert(di->have_dinfo);
+   tables &= di->deferred;
+   if (tables == 0)
+      return True;
+
+   /* Don't read a file which has been replaced in the meantime:
+      give up on all its deferred tables instead. */
+   if (sr_isError(VG_(stat)(di->fsm.filename, &st))
+       || st.size != di->deferred_size
+       || st.mtime != di->deferred_mtime) {
+      if (VG_(clo_verbosity) > 1)
+         VG_(message)(Vg_DebugMsg,
+                      "%s has changed; not reading its deferred debug info\n",
+                      di->fsm.filename);
+      return False;
+   }
+   return read_elf_debug_info_WRK(di, tables);
+}
+
 #endif // defined(VGO_linux) || defined(VGO_solaris)
 
 /*--------------------------------------------------------------------*/
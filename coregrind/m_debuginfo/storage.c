@@ -44,6 +44,11 @@
 #include "pub_core_libcassert.h"
 #include "pub_core_libcbase.h"
 #include "pub_core_libcprint.h"
+#include "pub_core_libcfile.h"
+#include "pub_core_libcproc.h"
+#include "pub_core_libcsignal.h"
+#include "pub_core_syscall.h"
+#include "pub_core_vkiscnums.h"
 #include "pub_core_xarray.h"
 #include "pub_core_oset.h"
 #include "pub_core_deduppoolalloc.h"
@@ -224,6 +229,436 @@ void ML_(ppDiCfSI) ( const XArray* /* of CfiExpr */ exprs,
 }
 
 
+/*------------------------------------------------------------*/
+/*--- Helper processes                                     ---*/
+/*------------------------------------------------------------*/
+
+/* See the comments in priv_storage.h.  Helpers are processes rather
+   than threads, as neither the allocators nor the DiImage cache nor
+   the dedup pools used by the readers are thread safe.  Being forked
+   copies of the parent, they have its image, abbreviation tables and
+   string pools for free.
+
+   A helper buffers its records in memory, and only writes them to its
+   pipe when it is done: the parent does not read the pipe before it
+   has finished its own part, and a helper blocked on a full pipe
+   would not be parsing anything. */
+
+#define N_HELPERS_MAX 64
+
+/* Each part has at least this many units. */
+#define HELPERS_MIN_UNITS_PER_PART 4
+
+/* Record tags.  A record is a tag byte followed by the record's
+   fields.  Strings are a UInt length (NO_STR for a NULL string)
+   followed by the characters, without a terminating zero. */
+#define HREC_FNDN   'F' /* UInt fndn_ix, str filename, str dirname */
+#define HREC_LINE   'L' /* UInt fndn_ix, Addr this, Addr next,
+                           Int lineno, Int entry */
+#define HREC_INL    'I' /* Addr lo, Addr hi, str inlinedfn, UInt fndn_ix,
+                           Int lineno, UShort level */
+#define HREC_END    'E' /* (part read successfully) */
+#define HREC_FAILED 'X' /* str reason */
+
+#define NO_STR 0xFFFFFFFF
+
+typedef
+   struct {
+      Int pid;
+      Int fd;   /* read end of the pipe to the helper */
+   }
+   Helper;
+
+/* In the parent: the running helpers, in part order. */
+static Helper helpers[N_HELPERS_MAX];
+static Int    n_helpers = 0;
+
+/* In a helper: the write end of the pipe, and the records not yet
+   sent.  helper_fd is -1 in the parent. */
+static Int     helper_fd   = -1;
+static XArray* helper_recs = NULL; /* of UChar */
+
+Bool ML_(in_helper) ( void )
+{
+   return helper_fd != -1;
+}
+
+static void put_bytes ( const void* p, Word n )
+{
+   VG_(addBytesToXA)( helper_recs, p, n );
+}
+
+static void put_str ( const HChar* str )
+{
+   UInt len = str == NULL ? NO_STR : VG_(strlen)(str);
+   put_bytes( &len, sizeof(len) );
+   if (str != NULL)
+      put_bytes( str, len );
+}
+
+#define PUT(_v)  put_bytes( &(_v), sizeof(_v) )
+
+static void record_FnDn ( UInt fndn_ix,
+                          const HChar* filename, const HChar* dirname )
+{
+   UChar tag = HREC_FNDN;
+   PUT(tag); PUT(fndn_ix); put_str(filename); put_str(dirname);
+}
+
+static void record_LineInfo ( UInt fndn_ix, Addr this, Addr next,
+                              Int lineno, Int entry )
+{
+   UChar tag = HREC_LINE;
+   PUT(tag); PUT(fndn_ix); PUT(this); PUT(next); PUT(lineno); PUT(entry);
+}
+
+static void record_InlInfo ( Addr addr_lo, Addr addr_hi,
+                             const HChar* inlinedfn, UInt fndn_ix,
+                             Int lineno, UShort level )
+{
+   UChar tag = HREC_INL;
+   PUT(tag); PUT(addr_lo); PUT(addr_hi); put_str(inlinedfn);
+   PUT(fndn_ix); PUT(lineno); PUT(level);
+}
+
+#undef PUT
+
+/* Reaps a helper.  Helpers are cloned without an exit signal, so that
+   the client never sees a SIGCHLD for them, and hence have to be
+   waited for with __WCLONE. */
+static void reap_helper ( const Helper* h )
+{
+   Int status;
+#  if defined(VGO_linux)
+   VG_(waitpid)( h->pid, &status, __VKI_WCLONE );
+#  else
+   VG_(waitpid)( h->pid, &status, 0 );
+#  endif
+}
+
+void ML_(abandon_helpers) ( void )
+{
+   Int i;
+   for (i = 0; i < n_helpers; i++) {
+      VG_(kill)( helpers[i].pid, VKI_SIGKILL );
+      VG_(close)( helpers[i].fd );
+      reap_helper( &helpers[i] );
+   }
+   n_helpers = 0;
+}
+
+Bool ML_(want_helpers) ( const DebugInfo* di, DiSlice sec )
+{
+   /* The helpers' output would be interleaved with ours if tracing,
+      and the DiImage connection to a debuginfo server cannot be
+      shared. */
+   return VG_(clo_debuginfo_helpers) > 0
+          && !di->trace_symtab && !di->ddump_line
+          && ML_(sli_is_valid)(sec)
+          /* Smaller sections are read sequentially: forking is not
+             free, and neither is replaying the records. */
+          && sec.szB >= VG_(clo_debuginfo_helpers_min_size)
+          && ML_(img_is_local)(sec.img);
+}
+
+Int ML_(fork_helpers) ( DebugInfo* di, Word n_units, /*OUT*/Int* n_parts )
+{
+   Int i, j;
+   Int n_wanted = VG_(clo_debuginfo_helpers);
+
+   vg_assert(n_helpers == 0);
+   vg_assert(helper_fd == -1);
+   if (n_wanted > N_HELPERS_MAX)
+      n_wanted = N_HELPERS_MAX;
+   if (n_wanted > n_units / HELPERS_MIN_UNITS_PER_PART - 1)
+      n_wanted = n_units / HELPERS_MIN_UNITS_PER_PART - 1;
+
+   *n_parts = 1;
+#  if defined(VGO_linux)
+   for (i = 0; i < n_wanted; i++) {
+      Int    fds[2];
+      SysRes res;
+
+      if (VG_(pipe)(fds) != 0)
+         break;
+      /* A plain fork, except that there is no exit signal. */
+      res = VG_(do_syscall5)( __NR_clone, 0, 0, 0, 0, 0 );
+      if (sr_isError(res)) {
+         VG_(close)(fds[0]);
+         VG_(close)(fds[1]);
+         break;
+      }
+
+      if (sr_Res(res) == 0) {
+         /* We are the helper reading part i+1.  Nothing must interrupt
+            us, and we must not keep the pipes of the helpers forked
+            before us open. */
+         vki_sigset_t all;
+         VG_(discard_output_sinks)();
+         VG_(sigfillset)(&all);
+         VG_(sigprocmask)(VKI_SIG_SETMASK, &all, NULL);
+         for (j = 0; j < n_helpers; j++)
+            VG_(close)( helpers[j].fd );
+         n_helpers = 0;
+         VG_(close)(fds[0]);
+         helper_fd   = fds[1];
+         helper_recs = VG_(newXA)( ML_(dinfo_zalloc),
+                                   "di.storage.fork_helpers.1",
+                                   ML_(dinfo_free), sizeof(UChar) );
+         *n_parts = n_wanted + 1;
+         return i + 1;
+      }
+
+      VG_(close)(fds[1]);
+      helpers[n_helpers].pid = sr_Res(res);
+      helpers[n_helpers].fd  = VG_(safe_fd)(fds[0]);
+      n_helpers++;
+   }
+
+   if (n_helpers < n_wanted) {
+      /* The helpers already forked expect n_wanted + 1 parts.  Rather
+         than telling them otherwise, read everything ourselves. */
+      if (VG_(clo_verbosity) > 1)
+         VG_(message)(Vg_DebugMsg,
+                      "Warning: could not start debug info helpers "
+                      "for %s\n", di->fsm.filename);
+      ML_(abandon_helpers)();
+      return 0;
+   }
+   *n_parts = n_helpers + 1;
+#  endif
+   return 0;
+}
+
+void ML_(finish_helper) ( const HChar* failure )
+{
+   UChar tag = failure == NULL ? HREC_END : HREC_FAILED;
+   UChar* p;
+   Word   n;
+
+   vg_assert(ML_(in_helper)());
+   put_bytes( &tag, sizeof(tag) );
+   if (failure != NULL)
+      put_str( failure );
+
+   p = VG_(indexXA)( helper_recs, 0 );
+   n = VG_(sizeXA)( helper_recs );
+   while (n > 0) {
+      Int w = VG_(write)( helper_fd, p, n > 65536 ? 65536 : n );
+      if (w <= 0)
+         break; /* The parent abandoned us. */
+      p += w;
+      n -= w;
+   }
+   /* Only our own messages are buffered (see ML_(fork_helpers)).  The
+      parent goes on running: none of its shutdown must be done here,
+      in particular not telling an attached gdb that we exited. */
+   VG_(flush_output_sinks)();
+   VG_(exit_now)(0);
+   /*NOTREACHED*/
+   vg_assert(0);
+}
+
+/* Buffered reading of the records of a helper, in the parent. */
+typedef
+   struct {
+      Int   fd;
+      Int   pos;
+      Int   len;
+      UChar buf[16384];
+   }
+   HelperIn;
+
+static Bool get_bytes ( HelperIn* in, void* p, Word n )
+{
+   UChar* dst = p;
+   if (LIKELY(in->len - in->pos >= n)) {
+      VG_(memcpy)( dst, &in->buf[in->pos], n );
+      in->pos += n;
+      return True;
+   }
+   while (n > 0) {
+      Word avail;
+      if (in->pos == in->len) {
+         Int r = VG_(read)( in->fd, in->buf, sizeof(in->buf) );
+         if (r <= 0)
+            return False;
+         in->pos = 0;
+         in->len = r;
+      }
+      avail = in->len - in->pos;
+      if (avail > n)
+         avail = n;
+      VG_(memcpy)( dst, &in->buf[in->pos], avail );
+      in->pos += avail;
+      dst     += avail;
+      n       -= avail;
+   }
+   return True;
+}
+
+/* Reads a string into *buf, growing it as needed.  *str is set to
+   *buf, or to NULL for a NULL string. */
+static Bool get_str ( HelperIn* in, HChar** buf, UInt* bufsz,
+                      /*OUT*/const HChar** str )
+{
+   UInt len;
+   if (!get_bytes( in, &len, sizeof(len) ))
+      return False;
+   if (len == NO_STR) {
+      *str = NULL;
+      return True;
+   }
+   if (len + 1 > *bufsz) {
+      if (*buf != NULL)
+         ML_(dinfo_free)( *buf );
+      *bufsz = len + 1 < 256 ? 256 : len + 1;
+      *buf   = ML_(dinfo_zalloc)( "di.storage.get_str.1", *bufsz );
+   }
+   if (!get_bytes( in, *buf, len ))
+      return False;
+   (*buf)[len] = 0;
+   *str = *buf;
+   return True;
+}
+
+#define GET(_v)  if (!get_bytes( in, &(_v), sizeof(_v) )) goto died
+#define GET_STR(_ix, _s) \
+   if (!get_str( in, &strbuf[_ix], &strbuf_szB[_ix], &(_s) )) goto died
+
+/* Adds the records of helper 'h' to 'di', counting the line and
+   inlined call records in *n_lines and *n_inls.  Returns NULL, or the
+   reason why the helper failed. */
+static const HChar* replay_helper ( DebugInfo* di, const Helper* h,
+                                    /*OUT*/UWord* n_lines,
+                                    /*OUT*/UWord* n_inls )
+{
+   static HelperIn in_buf;
+   static HChar*   strbuf[2]     = { NULL, NULL };
+   static UInt     strbuf_szB[2] = { 0, 0 };
+   static HChar    failure[256];
+   HelperIn* in = &in_buf;
+   /* Maps the helper's fndn_ix to ours. */
+   XArray* fndn_map = VG_(newXA)( ML_(dinfo_zalloc),
+                                  "di.storage.replay_helper.1",
+                                  ML_(dinfo_free), sizeof(UInt) );
+   const HChar* res = NULL;
+   const HChar *s1, *s2;
+   UInt   fndn_ix;
+   Addr   this, next;
+   Int    lineno, entry;
+   UShort level;
+   UChar  tag;
+
+#  define MAP_FNDN(_ix) \
+      ((_ix) == 0 ? 0 \
+       : (vg_assert((_ix) < VG_(sizeXA)(fndn_map)), \
+          *(UInt*)VG_(indexXA)( fndn_map, (_ix) )))
+
+   in->fd  = h->fd;
+   in->pos = in->len = 0;
+   *n_lines = *n_inls = 0;
+   while (True) {
+      GET(tag);
+      switch (tag) {
+         case HREC_FNDN: {
+            UInt zero = 0, ix;
+            GET(fndn_ix); GET_STR(0, s1); GET_STR(1, s2);
+            ix = ML_(addFnDn)( di, s1, s2 );
+            while (VG_(sizeXA)(fndn_map) <= fndn_ix)
+               VG_(addToXA)( fndn_map, &zero );
+            *(UInt*)VG_(indexXA)( fndn_map, fndn_ix ) = ix;
+            break;
+         }
+         case HREC_LINE:
+            GET(fndn_ix); GET(this); GET(next); GET(lineno); GET(entry);
+            ML_(addLineInfo)( di, MAP_FNDN(fndn_ix), this, next,
+                              lineno, entry );
+            (*n_lines)++;
+            break;
+         case HREC_INL:
+            GET(this); GET(next); GET_STR(0, s1);
+            GET(fndn_ix); GET(lineno); GET(level);
+            ML_(addInlInfo)( di, this, next,
+                             s1 == NULL ? NULL : ML_(addStr)( di, s1, -1 ),
+                             MAP_FNDN(fndn_ix), lineno, level );
+            (*n_inls)++;
+            break;
+         case HREC_END:
+            goto out;
+         case HREC_FAILED:
+            GET_STR(0, s1);
+            VG_(strncpy)( failure, s1 == NULL ? "?" : s1, sizeof(failure) );
+            failure[sizeof(failure) - 1] = 0;
+            res = failure;
+            goto out;
+         default:
+            vg_assert(0);
+      }
+   }
+
+  died:
+   res = "debug info helper process died";
+  out:
+   VG_(deleteXA)( fndn_map );
+   return res;
+#  undef MAP_FNDN
+}
+
+#undef GET
+#undef GET_STR
+
+const HChar* ML_(collect_helpers) ( DebugInfo* di )
+{
+   const HChar* failure = NULL;
+   UWord n_lines, n_inls;
+   Int i;
+
+   for (i = 0; i < n_helpers; i++) {
+      if (failure == NULL) {
+         failure = replay_helper( di, &helpers[i], &n_lines, &n_inls );
+         if (failure == NULL && VG_(clo_verbosity) > 1)
+            VG_(message)(Vg_DebugMsg,
+                         "debug info helper %d for %s: merged %'lu line "
+                         "and %'lu inlined call records\n",
+                         i + 1, di->fsm.filename, n_lines, n_inls);
+      } else
+         VG_(kill)( helpers[i].pid, VKI_SIGKILL );
+      VG_(close)( helpers[i].fd );
+      reap_helper( &helpers[i] );
+   }
+   n_helpers = 0;
+   return failure;
+}
+
+/* The offset at which part 'part' starts: that of the first unit
+   starting at or after part * sec_szB / n_parts. */
+static ULong part_start ( const XArray* unit_offs,
+                          ULong sec_szB, Int part, Int n_parts )
+{
+   ULong limit = sec_szB / n_parts * part;
+   Word  i;
+   if (part == 0)
+      return 0;
+   for (i = 0; i < VG_(sizeXA)( unit_offs ); i++) {
+      ULong off = *(const ULong*)VG_(indexXA)( unit_offs, i );
+      if (off >= limit)
+         return off;
+   }
+   return sec_szB;
+}
+
+void ML_(helper_part_range) ( const XArray* unit_offs,
+                              ULong sec_szB, Int part, Int n_parts,
+                              /*OUT*/ULong* lo, /*OUT*/ULong* hi )
+{
+   vg_assert(part >= 0 && part < n_parts);
+   *lo = part_start( unit_offs, sec_szB, part, n_parts );
+   *hi = part == n_parts - 1
+            ? ~0ULL : part_start( unit_offs, sec_szB, part + 1, n_parts );
+}
+
+
 /*------------------------------------------------------------*/
 /*--- Adding stuff                                         ---*/
 /*------------------------------------------------------------*/
@@ -264,6 +699,8 @@ UInt ML_(addFnDn) (struct _DebugInfo* di,
    fndn.filename = ML_(addStr)(di, filename, -1);
    fndn.dirname = dirname ? ML_(addStr)(di, dirname, -1) : NULL;
    fndn_ix = VG_(allocFixedEltDedupPA) (di->fndnpool, sizeof(FnDn), &fndn);
+   if (UNLIKELY(ML_(in_helper)()))
+      record_FnDn(fndn_ix, filename, dirname);
    return fndn_ix;
 }
 
@@ -512,6 +949,11 @@ void ML_(addLineInfo) ( struct _DebugInfo* di,
    DiLoc loc;
    UWord size = next - this;
 
+   if (UNLIKELY(ML_(in_helper)())) {
+      record_LineInfo(fndn_ix, this, next, lineno, entry);
+      return;
+   }
+
    /* Ignore zero-sized locs */
    if (this == next) return;
 
@@ -643,6 +1085,11 @@ void ML_(addInlInfo) ( struct _DebugInfo* di,
 {
    DiInlLoc inl;
 
+   if (UNLIKELY(ML_(in_helper)())) {
+      record_InlInfo(addr_lo, addr_hi, inlinedfn, fndn_ix, lineno, level);
+      return;
+   }
+
    /* Similar paranoia as in ML_(addLineInfo). Unclear if needed. */
    if (addr_lo >= addr_hi) {
        if (VG_(clo_verbosity) > 2) {
@@ -2325,6 +2772,18 @@ void ML_(finish_CFSI_arrays) ( struct _DebugInfo* di )
 }
 
 
+/* The string pools can only be frozen once no more tables will be
+   read, as reading the deferred ones adds to them. */
+static void freeze_pools_if_complete ( struct _DebugInfo* di )
+{
+   if (di->deferred != 0)
+      return;
+   if (di->strpool)
+      VG_(freezeDedupPA) (di->strpool, ML_(dinfo_shrink_block));
+   if (di->fndnpool)
+      VG_(freezeDedupPA) (di->fndnpool, ML_(dinfo_shrink_block));
+}
+
 /* Canonicalise the tables held by 'di', in preparation for use.  Call
    this after finishing adding entries to these tables. */
 void ML_(canonicaliseTables) ( struct _DebugInfo* di )
@@ -2336,10 +2795,24 @@ void ML_(canonicaliseTables) ( struct _DebugInfo* di )
    if (di->cfsi_m_pool)
       VG_(freezeDedupPA) (di->cfsi_m_pool, ML_(dinfo_shrink_block));
    canonicaliseVarInfo ( di );
-   if (di->strpool)
-      VG_(freezeDedupPA) (di->strpool, ML_(dinfo_shrink_block));
-   if (di->fndnpool)
-      VG_(freezeDedupPA) (di->fndnpool, ML_(dinfo_shrink_block));
+   freeze_pools_if_complete ( di );
+}
+
+void ML_(canonicaliseDeferredTables) ( struct _DebugInfo* di, UInt tables )
+{
+   vg_assert((tables & di->deferred) == 0);
+   if (tables & DiTab_Loc)
+      canonicaliseLoctab ( di );
+   if (tables & DiTab_Dwarf3) {
+      canonicaliseInltab ( di );
+      canonicaliseVarInfo ( di );
+   }
+   if (tables & DiTab_CFI) {
+      ML_(canonicaliseCFI) ( di );
+      if (di->cfsi_m_pool)
+         VG_(freezeDedupPA) (di->cfsi_m_pool, ML_(dinfo_shrink_block));
+   }
+   freeze_pools_if_complete ( di );
 }
 
 
@@ -2352,10 +2825,15 @@ void ML_(canonicaliseTables) ( struct _DebugInfo* di )
 
 Word ML_(search_one_symtab) ( const DebugInfo* di, Addr ptr,
                               Bool findText )
+{
+   return ML_(search_one_symtab_from) ( di, ptr, findText, 0 );
+}
+
+Word ML_(search_one_symtab_from) ( const DebugInfo* di, Addr ptr,
+                                   Bool findText, Word lo )
 {
    Addr a_mid_lo, a_mid_hi;
    Word mid,
-        lo = 0, 
         hi = di->symtab_used-1;
    while (True) {
       /* current unsearched space is from lo to hi, inclusive. */
@@ -2380,10 +2858,14 @@ Word ML_(search_one_symtab) ( const DebugInfo* di, Addr ptr,
    if not found.  Binary search.  */
 
 Word ML_(search_one_loctab) ( const DebugInfo* di, Addr ptr )
+{
+   return ML_(search_one_loctab_from) ( di, ptr, 0 );
+}
+
+Word ML_(search_one_loctab_from) ( const DebugInfo* di, Addr ptr, Word lo )
 {
    Addr a_mid_lo, a_mid_hi;
    Word mid, 
-        lo = 0, 
         hi = di->loctab_used-1;
    while (True) {
       /* current unsearched space is from lo to hi, inclusive. */
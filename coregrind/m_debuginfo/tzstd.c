@@ -0,0 +1,939 @@
+/*--------------------------------------------------------------------*/
+/*--- Tiny zstd decompressor                               tzstd.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   Copyright (C) 2019-2019 The Valgrind Developers
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+/* A decompressor for the Zstandard format, as described in RFC 8878,
+   for reading ELFCOMPRESS_ZSTD debug sections.  It is the counterpart
+   of tinfl.c for ELFCOMPRESS_ZLIB ones, and is used the same way:
+   the whole of a section is decompressed into a buffer big enough to
+   hold it, as given by the section's Elf_Chdr.
+
+   It is written for simplicity rather than speed, since only the
+   sections which are read are decompressed, and only once.  It does
+   not support dictionaries (which ELF sections never use), and does
+   not verify the optional content checksum.  Corrupt input makes it
+   fail, but never read or write out of bounds. */
+
+#ifndef TZSTD_HEADER_INCLUDED
+#define TZSTD_HEADER_INCLUDED
+
+#include "pub_core_basics.h"
+
+/* Decompresses the zstd frames in [pSrc_buf, +src_buf_len) into
+   [pOut_buf, +out_buf_len).  Returns the number of bytes written, or
+   TZSTD_DECOMPRESS_MEM_TO_MEM_FAILED if the input is not valid or does
+   not fit in the output buffer. */
+#define TZSTD_DECOMPRESS_MEM_TO_MEM_FAILED ((SizeT)(-1))
+SizeT tzstd_decompress_mem_to_mem(void *pOut_buf, SizeT out_buf_len,
+                                  const void *pSrc_buf, SizeT src_buf_len);
+
+#endif // #ifdef TZSTD_HEADER_INCLUDED
+
+#ifndef TZSTD_HEADER_FILE_ONLY
+
+#include "pub_core_mallocfree.h"
+#include "pub_core_libcbase.h"
+
+#define TZSTD_MAGIC           0xFD2FB528U
+#define TZSTD_SKIPPABLE_MAGIC 0x184D2A50U  /* low 4 bits are free */
+#define TZSTD_BLOCK_MAX       (128 * 1024)
+
+/* Maximum symbols and accuracy logs of the FSE tables. */
+#define TZSTD_LL_MAX_SYMBOL   35
+#define TZSTD_ML_MAX_SYMBOL   52
+#define TZSTD_OF_MAX_SYMBOL   31
+#define TZSTD_LL_MAX_LOG      9
+#define TZSTD_ML_MAX_LOG      9
+#define TZSTD_OF_MAX_LOG      8
+#define TZSTD_HW_MAX_LOG      6    /* for Huffman weights */
+#define TZSTD_FSE_MAX_LOG     9
+#define TZSTD_FSE_MAX_SYMBOL  52
+
+#define TZSTD_HUF_MAX_BITS    11
+
+static const Short tzstd_ll_default_norm[TZSTD_LL_MAX_SYMBOL + 1] = {
+   4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1,
+   2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1,
+   -1, -1, -1, -1
+};
+static const Short tzstd_ml_default_norm[TZSTD_ML_MAX_SYMBOL + 1] = {
+   1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+   1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+   1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1,
+   -1, -1, -1, -1, -1
+};
+static const Short tzstd_of_default_norm[29] = {
+   1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+   1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1
+};
+
+static const UInt tzstd_ll_base[TZSTD_LL_MAX_SYMBOL + 1] = {
+   0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+   16, 18, 20, 22, 24, 28, 32, 40, 48, 64, 0x80, 0x100, 0x200, 0x400,
+   0x800, 0x1000, 0x2000, 0x4000, 0x8000, 0x10000
+};
+static const UChar tzstd_ll_bits[TZSTD_LL_MAX_SYMBOL + 1] = {
+   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+   1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11, 12,
+   13, 14, 15, 16
+};
+static const UInt tzstd_ml_base[TZSTD_ML_MAX_SYMBOL + 1] = {
+   3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+   19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34,
+   35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 0x83, 0x103, 0x203,
+   0x403, 0x803, 0x1003, 0x2003, 0x4003, 0x8003, 0x10003
+};
+static const UChar tzstd_ml_bits[TZSTD_ML_MAX_SYMBOL + 1] = {
+   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+   1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10, 11,
+   12, 13, 14, 15, 16
+};
+
+/* A decoding table for FSE (tANS) coded symbols. */
+typedef
+   struct {
+      UChar  symbol;
+      UChar  nb_bits;
+      UShort base;     /* next state = base + (nb_bits bits) */
+   }
+   tzstd_fse_entry;
+
+typedef
+   struct {
+      Bool            valid;
+      UInt            log;
+      tzstd_fse_entry t[1 << TZSTD_FSE_MAX_LOG];
+   }
+   tzstd_fse_table;
+
+/* A decoding table for Huffman coded literals, indexed by the next
+   max_bits bits of the stream. */
+typedef
+   struct {
+      UChar symbol;
+      UChar nb_bits;
+   }
+   tzstd_huf_entry;
+
+typedef
+   struct {
+      Bool            valid;
+      UInt            max_bits;
+      tzstd_huf_entry t[1 << TZSTD_HUF_MAX_BITS];
+   }
+   tzstd_huf_table;
+
+/* The state carried from block to block of a frame. */
+typedef
+   struct {
+      tzstd_huf_table huf;
+      tzstd_fse_table ll, of, ml;
+      UInt            rep[3];
+      UChar           lits[TZSTD_BLOCK_MAX];
+   }
+   tzstd_state;
+
+static UInt tzstd_highbit ( UInt x )
+{
+   UInt r = 0;
+   while (x >>= 1)
+      r++;
+   return r;
+}
+
+static UInt tzstd_le16 ( const UChar* p )
+{
+   return p[0] | (p[1] << 8);
+}
+
+static UInt tzstd_le32 ( const UChar* p )
+{
+   return (UInt)p[0] | ((UInt)p[1] << 8) | ((UInt)p[2] << 16)
+          | ((UInt)p[3] << 24);
+}
+
+/* Returns the |n| (at most 56) bits at bit |pos| of the |len| bytes at
+   |p|, taken as a little endian number.  Bits outside the buffer,
+   which can be asked for at the ends of streams, read as zero. */
+static ULong tzstd_bits_at ( const UChar* p, SizeT len, Long pos, UInt n )
+{
+   ULong v = 0;
+   UInt  i, nbytes, shift;
+   SizeT first;
+
+   if (n == 0)
+      return 0;
+   if (pos < 0) {
+      if (pos + (Long)n <= 0)
+         return 0;
+      return tzstd_bits_at(p, len, 0, n + pos) << (-pos);
+   }
+   first  = pos >> 3;
+   shift  = pos & 7;
+   nbytes = (shift + n + 7) >> 3;
+   for (i = 0; i < nbytes; i++) {
+      if (first + i < len)
+         v |= (ULong)p[first + i] << (8 * i);
+   }
+   return (v >> shift) & ((1ULL << n) - 1);
+}
+
+/* Bitstreams of FSE and Huffman coded data are read backwards, from
+   the last byte, whose highest set bit marks the end of the data.
+   |pos| is the number of bits still to be read. */
+typedef
+   struct {
+      const UChar* p;
+      SizeT        len;
+      Long         pos;
+   }
+   tzstd_bits;
+
+static Bool tzstd_bits_init ( tzstd_bits* b, const UChar* p, SizeT len )
+{
+   if (len == 0 || p[len - 1] == 0)
+      return False;
+   b->p   = p;
+   b->len = len;
+   b->pos = (Long)(len - 1) * 8 + tzstd_highbit(p[len - 1]);
+   return True;
+}
+
+static ULong tzstd_bits_read ( tzstd_bits* b, UInt n )
+{
+   b->pos -= n;
+   return tzstd_bits_at(b->p, b->len, b->pos, n);
+}
+
+static ULong tzstd_bits_peek ( const tzstd_bits* b, UInt n )
+{
+   return tzstd_bits_at(b->p, b->len, b->pos - n, n);
+}
+
+
+/*------------------------------------------------------------*/
+/*--- FSE tables                                           ---*/
+/*------------------------------------------------------------*/
+
+/* Builds |t| from the normalised counts |norm| of symbols
+   0 .. n_symbols-1, for accuracy log |log|. */
+static Bool tzstd_build_fse ( tzstd_fse_table* t, const Short* norm,
+                              UInt n_symbols, UInt log )
+{
+   UInt   size = 1 << log;
+   UInt   high = size - 1;
+   UInt   step = (size >> 1) + (size >> 3) + 3;
+   UInt   pos  = 0;
+   UInt   s, u;
+   Int    i;
+   UShort next[TZSTD_FSE_MAX_SYMBOL + 1];
+
+   if (log > TZSTD_FSE_MAX_LOG || n_symbols > TZSTD_FSE_MAX_SYMBOL + 1)
+      return False;
+
+   /* Symbols with a "less than 1" probability go at the end. */
+   for (s = 0; s < n_symbols; s++) {
+      if (norm[s] == -1) {
+         t->t[high--].symbol = s;
+         next[s] = 1;
+      } else {
+         next[s] = norm[s];
+      }
+   }
+   /* The others are spread over the rest of the table. */
+   for (s = 0; s < n_symbols; s++) {
+      for (i = 0; i < norm[s]; i++) {
+         t->t[pos].symbol = s;
+         do {
+            pos = (pos + step) & (size - 1);
+         } while (pos > high);
+      }
+   }
+   if (pos != 0)
+      return False;
+
+   for (u = 0; u < size; u++) {
+      UInt ns = next[t->t[u].symbol]++;
+      UInt nb = log - tzstd_highbit(ns);
+      t->t[u].nb_bits = nb;
+      t->t[u].base    = (ns << nb) - size;
+   }
+   t->log   = log;
+   t->valid = True;
+   return True;
+}
+
+/* Reads an FSE table description from the |len| bytes at |p|, for
+   symbols up to |max_symbol| and an accuracy log up to |max_log|, and
+   builds the table.  Sets |*used| to the number of bytes read. */
+static Bool tzstd_read_fse ( tzstd_fse_table* t, const UChar* p, SizeT len,
+                             UInt max_symbol, UInt max_log,
+                             /*OUT*/SizeT* used )
+{
+   Short norm[TZSTD_FSE_MAX_SYMBOL + 1];
+   Long  pos = 4;
+   UInt  log, n_bits, sym = 0;
+   Int   remaining, threshold;
+   Bool  prev0 = False;
+
+   if (len < 1)
+      return False;
+   log = (p[0] & 0xF) + 5;
+   if (log > max_log)
+      return False;
+   remaining = (1 << log) + 1;
+   threshold = 1 << log;
+   n_bits    = log + 1;
+
+   while (remaining > 1 && sym <= max_symbol) {
+      Int max, count;
+      if (prev0) {
+         /* A zero count is followed by a count of repeated zeros. */
+         UInt n0 = sym, r;
+         do {
+            r = tzstd_bits_at(p, len, pos, 2);
+            pos += 2;
+            n0 += r;
+         } while (r == 3);
+         if (n0 > max_symbol)
+            return False;
+         while (sym < n0)
+            norm[sym++] = 0;
+      }
+      max = (2 * threshold - 1) - remaining;
+      count = tzstd_bits_at(p, len, pos, n_bits - 1);
+      if (count < max) {
+         pos += n_bits - 1;
+      } else {
+         count = tzstd_bits_at(p, len, pos, n_bits);
+         if (count >= threshold)
+            count -= max;
+         pos += n_bits;
+      }
+      count--;
+      remaining -= count < 0 ? -count : count;
+      norm[sym++] = count;
+      prev0 = count == 0;
+      if (remaining < 1)
+         return False;
+      while (remaining < threshold) {
+         n_bits--;
+         threshold >>= 1;
+      }
+   }
+   if (remaining != 1 || (SizeT)((pos + 7) >> 3) > len)
+      return False;
+   *used = (pos + 7) >> 3;
+   return tzstd_build_fse(t, norm, sym, log);
+}
+
+static void tzstd_rle_fse ( tzstd_fse_table* t, UChar symbol )
+{
+   t->t[0].symbol  = symbol;
+   t->t[0].nb_bits = 0;
+   t->t[0].base    = 0;
+   t->log   = 0;
+   t->valid = True;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Literals                                             ---*/
+/*------------------------------------------------------------*/
+
+/* Reads a Huffman tree description from the |len| bytes at |p|, and
+   builds the decoding table.  Sets |*used| to the number of bytes
+   read. */
+static Bool tzstd_read_huf ( tzstd_huf_table* h, const UChar* p, SizeT len,
+                             /*OUT*/SizeT* used )
+{
+   UChar weight[256];
+   UInt  rank_count[TZSTD_HUF_MAX_BITS + 1];
+   UInt  rank_start[TZSTD_HUF_MAX_BITS + 2];
+   UInt  n = 0, i, w, total, max_bits, rest;
+
+   if (len < 1)
+      return False;
+   if (p[0] >= 128) {
+      /* Weights stored directly, 4 bits each. */
+      UInt n_bytes;
+      n = p[0] - 127;
+      n_bytes = (n + 1) / 2;
+      if (1 + n_bytes > len)
+         return False;
+      for (i = 0; i < n; i++)
+         weight[i] = (i & 1) ? (p[1 + i / 2] & 0xF) : (p[1 + i / 2] >> 4);
+      *used = 1 + n_bytes;
+   } else {
+      /* Weights compressed with FSE, using two interleaved states. */
+      tzstd_fse_table* ft;
+      tzstd_bits b;
+      SizeT      hdr, csize = p[0];
+      UInt       s1, s2;
+      if (csize == 0 || 1 + csize > len)
+         return False;
+      ft = VG_(malloc)("tzstd.read_huf.1", sizeof(tzstd_fse_table));
+      if (!tzstd_read_fse(ft, p + 1, csize, TZSTD_HUF_MAX_BITS,
+                          TZSTD_HW_MAX_LOG, &hdr)
+          || !tzstd_bits_init(&b, p + 1 + hdr, csize - hdr)) {
+         VG_(free)(ft);
+         return False;
+      }
+      s1 = tzstd_bits_read(&b, ft->log);
+      s2 = tzstd_bits_read(&b, ft->log);
+      while (True) {
+         if (n >= 255) {
+            VG_(free)(ft);
+            return False;
+         }
+         weight[n++] = ft->t[s1].symbol;
+         s1 = ft->t[s1].base + tzstd_bits_read(&b, ft->t[s1].nb_bits);
+         if (b.pos < 0) {
+            weight[n++] = ft->t[s2].symbol;
+            break;
+         }
+         if (n >= 255) {
+            VG_(free)(ft);
+            return False;
+         }
+         weight[n++] = ft->t[s2].symbol;
+         s2 = ft->t[s2].base + tzstd_bits_read(&b, ft->t[s2].nb_bits);
+         if (b.pos < 0) {
+            weight[n++] = ft->t[s1].symbol;
+            break;
+         }
+      }
+      VG_(free)(ft);
+      *used = 1 + csize;
+   }
+
+   /* The weight of the last symbol is implied by the others: it is
+      the one which makes the total a power of 2. */
+   total = 0;
+   for (i = 0; i < n; i++) {
+      if (weight[i] > TZSTD_HUF_MAX_BITS)
+         return False;
+      if (weight[i] > 0)
+         total += 1 << (weight[i] - 1);
+   }
+   if (total == 0 || n >= 256)
+      return False;
+   max_bits = tzstd_highbit(total) + 1;
+   rest = (1 << max_bits) - total;
+   if (max_bits > TZSTD_HUF_MAX_BITS || (rest & (rest - 1)) != 0)
+      return False;
+   weight[n++] = tzstd_highbit(rest) + 1;
+
+   /* Codes are assigned in order of increasing weight, then of
+      increasing symbol. */
+   for (w = 0; w <= TZSTD_HUF_MAX_BITS; w++)
+      rank_count[w] = 0;
+   for (i = 0; i < n; i++)
+      rank_count[weight[i]]++;
+   rank_start[1] = 0;
+   for (w = 1; w <= TZSTD_HUF_MAX_BITS; w++)
+      rank_start[w + 1] = rank_start[w] + (rank_count[w] << (w - 1));
+   for (i = 0; i < n; i++) {
+      UInt j, len_w;
+      w = weight[i];
+      if (w == 0)
+         continue;
+      len_w = 1 << (w - 1);
+      for (j = rank_start[w]; j < rank_start[w] + len_w; j++) {
+         h->t[j].symbol  = i;
+         h->t[j].nb_bits = max_bits + 1 - w;
+      }
+      rank_start[w] += len_w;
+   }
+   h->max_bits = max_bits;
+   h->valid    = True;
+   return True;
+}
+
+/* Decodes |n| literals from the Huffman coded stream of |len| bytes at
+   |p| into |out|. */
+static Bool tzstd_huf_stream ( const tzstd_huf_table* h,
+                               const UChar* p, SizeT len,
+                               UChar* out, SizeT n )
+{
+   tzstd_bits b;
+   SizeT      i;
+
+   if (!tzstd_bits_init(&b, p, len))
+      return False;
+   for (i = 0; i < n; i++) {
+      const tzstd_huf_entry* e = &h->t[tzstd_bits_peek(&b, h->max_bits)];
+      out[i] = e->symbol;
+      b.pos -= e->nb_bits;
+   }
+   return b.pos == 0;
+}
+
+/* Reads the literals section from the |len| bytes at |p|.  Sets
+   |*lits| and |*n_lits| to the literals, and |*used| to the number of
+   bytes read. */
+static Bool tzstd_literals ( tzstd_state* st, const UChar* p, SizeT len,
+                             /*OUT*/const UChar** lits, /*OUT*/SizeT* n_lits,
+                             /*OUT*/SizeT* used )
+{
+   UInt  type, size_format, n_streams, hsz;
+   SizeT regen, csize;
+
+   if (len < 1)
+      return False;
+   type        = p[0] & 3;
+   size_format = (p[0] >> 2) & 3;
+
+   if (type == 0 || type == 1) {
+      /* Raw or RLE literals. */
+      switch (size_format) {
+         case 0: case 2:
+            hsz = 1;
+            regen = p[0] >> 3;
+            break;
+         case 1:
+            hsz = 2;
+            if (len < hsz) return False;
+            regen = (p[0] >> 4) + (p[1] << 4);
+            break;
+         default:
+            hsz = 3;
+            if (len < hsz) return False;
+            regen = (p[0] >> 4) + (p[1] << 4) + (p[2] << 12);
+            break;
+      }
+      if (regen > TZSTD_BLOCK_MAX)
+         return False;
+      if (type == 0) {
+         if (hsz + regen > len)
+            return False;
+         *lits = p + hsz;
+         *used = hsz + regen;
+      } else {
+         if (hsz + 1 > len)
+            return False;
+         VG_(memset)(st->lits, p[hsz], regen);
+         *lits = st->lits;
+         *used = hsz + 1;
+      }
+      *n_lits = regen;
+      return True;
+   }
+
+   /* Huffman coded literals, with a new tree (type 2) or the one of
+      the previous block (type 3). */
+   switch (size_format) {
+      case 0: case 1:
+         hsz = 3;
+         if (len < hsz) return False;
+         n_streams = size_format == 0 ? 1 : 4;
+         regen = (p[0] >> 4) | ((p[1] & 0x3F) << 4);
+         csize = (p[1] >> 6) | (p[2] << 2);
+         break;
+      case 2: {
+         UInt hdr;
+         hsz = 4;
+         if (len < hsz) return False;
+         n_streams = 4;
+         hdr = tzstd_le32(p);
+         regen = (hdr >> 4) & 0x3FFF;
+         csize = hdr >> 18;
+         break;
+      }
+      default: {
+         ULong hdr;
+         hsz = 5;
+         if (len < hsz) return False;
+         n_streams = 4;
+         hdr = tzstd_le32(p) | ((ULong)p[4] << 32);
+         regen = (hdr >> 4) & 0x3FFFF;
+         csize = (hdr >> 22) & 0x3FFFF;
+         break;
+      }
+   }
+   if (regen > TZSTD_BLOCK_MAX || hsz + csize > len)
+      return False;
+   p += hsz;
+   *used = hsz + csize;
+
+   if (type == 2) {
+      SizeT hu;
+      if (!tzstd_read_huf(&st->huf, p, csize, &hu))
+         return False;
+      p     += hu;
+      csize -= hu;
+   } else if (!st->huf.valid) {
+      return False;
+   }
+
+   if (n_streams == 1) {
+      if (!tzstd_huf_stream(&st->huf, p, csize, st->lits, regen))
+         return False;
+   } else {
+      SizeT sz[4], seg = (regen + 3) / 4, done = 0;
+      UInt  i;
+      if (csize < 6)
+         return False;
+      sz[0] = tzstd_le16(p);
+      sz[1] = tzstd_le16(p + 2);
+      sz[2] = tzstd_le16(p + 4);
+      if (sz[0] + sz[1] + sz[2] > csize - 6 || 3 * seg > regen)
+         return False;
+      sz[3] = csize - 6 - sz[0] - sz[1] - sz[2];
+      p += 6;
+      for (i = 0; i < 4; i++) {
+         SizeT n = i < 3 ? seg : regen - 3 * seg;
+         if (!tzstd_huf_stream(&st->huf, p, sz[i], st->lits + done, n))
+            return False;
+         p    += sz[i];
+         done += n;
+      }
+   }
+   *lits   = st->lits;
+   *n_lits = regen;
+   return True;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Sequences                                            ---*/
+/*------------------------------------------------------------*/
+
+/* Sets up the table |t| according to the compression |mode|, from the
+   |len| bytes at |p|.  Sets |*used| to the number of bytes read. */
+static Bool tzstd_seq_table ( tzstd_fse_table* t, UInt mode,
+                              const UChar* p, SizeT len,
+                              const Short* default_norm, UInt n_default,
+                              UInt default_log, UInt max_symbol,
+                              UInt max_log, /*OUT*/SizeT* used )
+{
+   *used = 0;
+   switch (mode) {
+      case 0: /* predefined */
+         return tzstd_build_fse(t, default_norm, n_default, default_log);
+      case 1: /* RLE */
+         if (len < 1 || p[0] > max_symbol)
+            return False;
+         tzstd_rle_fse(t, p[0]);
+         *used = 1;
+         return True;
+      case 2: /* FSE compressed */
+         return tzstd_read_fse(t, p, len, max_symbol, max_log, used);
+      default: /* repeat */
+         return t->valid;
+   }
+}
+
+/* Decodes the compressed block of |len| bytes at |p|, appending its
+   data at |*op| in |out|.  Matches may reach back to |frame_start|. */
+static Bool tzstd_block ( tzstd_state* st, const UChar* p, SizeT len,
+                          UChar* out, SizeT out_len, SizeT frame_start,
+                          /*INOUT*/SizeT* op )
+{
+   const UChar* lits;
+   SizeT        n_lits, used, lit_pos = 0, pos = *op;
+   UInt         n_seqs, i;
+   tzstd_bits   b;
+   UInt         ll_state, of_state, ml_state;
+
+   if (!tzstd_literals(st, p, len, &lits, &n_lits, &used))
+      return False;
+   p   += used;
+   len -= used;
+
+   /* Number of sequences */
+   if (len < 1)
+      return False;
+   if (p[0] < 128) {
+      n_seqs = p[0];
+      used = 1;
+   } else if (p[0] < 255) {
+      if (len < 2) return False;
+      n_seqs = ((p[0] - 128) << 8) + p[1];
+      used = 2;
+   } else {
+      if (len < 3) return False;
+      n_seqs = p[1] + (p[2] << 8) + 0x7F00;
+      used = 3;
+   }
+   p   += used;
+   len -= used;
+
+   if (n_seqs > 0) {
+      UInt modes;
+      if (len < 1)
+         return False;
+      modes = p[0];
+      if ((modes & 3) != 0)
+         return False;
+      p++;
+      len--;
+      if (!tzstd_seq_table(&st->ll, modes >> 6, p, len,
+                           tzstd_ll_default_norm, TZSTD_LL_MAX_SYMBOL + 1, 6,
+                           TZSTD_LL_MAX_SYMBOL, TZSTD_LL_MAX_LOG, &used))
+         return False;
+      p += used; len -= used;
+      if (!tzstd_seq_table(&st->of, (modes >> 4) & 3, p, len,
+                           tzstd_of_default_norm, 29, 5,
+                           TZSTD_OF_MAX_SYMBOL, TZSTD_OF_MAX_LOG, &used))
+         return False;
+      p += used; len -= used;
+      if (!tzstd_seq_table(&st->ml, (modes >> 2) & 3, p, len,
+                           tzstd_ml_default_norm, TZSTD_ML_MAX_SYMBOL + 1, 6,
+                           TZSTD_ML_MAX_SYMBOL, TZSTD_ML_MAX_LOG, &used))
+         return False;
+      p += used; len -= used;
+
+      if (!tzstd_bits_init(&b, p, len))
+         return False;
+      ll_state = tzstd_bits_read(&b, st->ll.log);
+      of_state = tzstd_bits_read(&b, st->of.log);
+      ml_state = tzstd_bits_read(&b, st->ml.log);
+
+      for (i = 0; i < n_seqs; i++) {
+         UInt  ll_code = st->ll.t[ll_state].symbol;
+         UInt  of_code = st->of.t[of_state].symbol;
+         UInt  ml_code = st->ml.t[ml_state].symbol;
+         SizeT offset, ml, ll, j;
+         ULong of_value;
+
+         if (ll_code > TZSTD_LL_MAX_SYMBOL || ml_code > TZSTD_ML_MAX_SYMBOL
+             || of_code > TZSTD_OF_MAX_SYMBOL)
+            return False;
+         of_value = (1ULL << of_code) + tzstd_bits_read(&b, of_code);
+         ml = tzstd_ml_base[ml_code]
+              + tzstd_bits_read(&b, tzstd_ml_bits[ml_code]);
+         ll = tzstd_ll_base[ll_code]
+              + tzstd_bits_read(&b, tzstd_ll_bits[ll_code]);
+
+         if (of_value > 3) {
+            offset = of_value - 3;
+            st->rep[2] = st->rep[1];
+            st->rep[1] = st->rep[0];
+            st->rep[0] = offset;
+         } else {
+            /* A repeated offset.  With no literals, the first one is
+               not a candidate, and the last is replaced by the first
+               one minus 1. */
+            UInt idx = of_value + (ll == 0 ? 1 : 0);
+            switch (idx) {
+               case 1:
+                  offset = st->rep[0];
+                  break;
+               case 2:
+                  offset = st->rep[1];
+                  st->rep[1] = st->rep[0];
+                  st->rep[0] = offset;
+                  break;
+               case 3:
+                  offset = st->rep[2];
+                  st->rep[2] = st->rep[1];
+                  st->rep[1] = st->rep[0];
+                  st->rep[0] = offset;
+                  break;
+               default:
+                  offset = st->rep[0] - 1;
+                  st->rep[2] = st->rep[1];
+                  st->rep[1] = st->rep[0];
+                  st->rep[0] = offset;
+                  break;
+            }
+         }
+
+         if (i + 1 < n_seqs) {
+            ll_state = st->ll.t[ll_state].base
+                       + tzstd_bits_read(&b, st->ll.t[ll_state].nb_bits);
+            ml_state = st->ml.t[ml_state].base
+                       + tzstd_bits_read(&b, st->ml.t[ml_state].nb_bits);
+            of_state = st->of.t[of_state].base
+                       + tzstd_bits_read(&b, st->of.t[of_state].nb_bits);
+         }
+         if (b.pos < 0)
+            return False;
+
+         /* Copy the literals, then the match, which may overlap its
+            own output. */
+         if (ll > n_lits - lit_pos || ll > out_len - pos
+             || ml > out_len - pos - ll)
+            return False;
+         VG_(memcpy)(out + pos, lits + lit_pos, ll);
+         lit_pos += ll;
+         pos     += ll;
+         if (offset == 0 || offset > pos - frame_start)
+            return False;
+         for (j = 0; j < ml; j++)
+            out[pos + j] = out[pos + j - offset];
+         pos += ml;
+      }
+      if (b.pos != 0)
+         return False;
+   } else if (len != 0) {
+      return False;
+   }
+
+   /* The remaining literals */
+   if (n_lits - lit_pos > out_len - pos)
+      return False;
+   VG_(memcpy)(out + pos, lits + lit_pos, n_lits - lit_pos);
+   *op = pos + n_lits - lit_pos;
+   return True;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Frames                                               ---*/
+/*------------------------------------------------------------*/
+
+static Bool tzstd_frames ( tzstd_state* st, UChar* out, SizeT out_len,
+                           const UChar* in, SizeT in_len, /*OUT*/SizeT* op )
+{
+   /* Invariant: ip <= in_len, so that in_len - ip does not wrap round.
+      Each check below is in the form "n > in_len - ip". */
+   SizeT ip = 0;
+
+   *op = 0;
+   while (ip < in_len) {
+      UInt  magic, fhd, fcs_szB, did_szB, did = 0, i;
+      Bool  last;
+      SizeT frame_start = *op;
+
+      if (4 > in_len - ip)
+         return False;
+      magic = tzstd_le32(in + ip);
+      if ((magic & 0xFFFFFFF0U) == TZSTD_SKIPPABLE_MAGIC) {
+         SizeT sz;
+         if (8 > in_len - ip)
+            return False;
+         sz = tzstd_le32(in + ip + 4);
+         if (sz > in_len - ip - 8)
+            return False;
+         ip += 8 + sz;
+         continue;
+      }
+      if (magic != TZSTD_MAGIC)
+         return False;
+      ip += 4;
+
+      /* Frame header */
+      if (1 > in_len - ip)
+         return False;
+      fhd = in[ip++];
+      if (fhd & 8)
+         return False; /* reserved bit */
+      did_szB = (fhd & 3) == 3 ? 4 : (fhd & 3);
+      switch (fhd >> 6) {
+         case 0:  fcs_szB = (fhd & 0x20) ? 1 : 0; break;
+         case 1:  fcs_szB = 2; break;
+         case 2:  fcs_szB = 4; break;
+         default: fcs_szB = 8; break;
+      }
+      if (!(fhd & 0x20)) {
+         /* window descriptor: all the output is the window */
+         if (1 > in_len - ip)
+            return False;
+         ip++;
+      }
+      if (did_szB + fcs_szB > in_len - ip)
+         return False;
+      for (i = 0; i < did_szB; i++)
+         did |= in[ip + i] << (8 * i);
+      if (did != 0)
+         return False;
+      ip += did_szB + fcs_szB;
+
+      st->huf.valid = st->ll.valid = st->of.valid = st->ml.valid = False;
+      st->rep[0] = 1;
+      st->rep[1] = 4;
+      st->rep[2] = 8;
+
+      /* Blocks */
+      do {
+         UInt  bh, type;
+         SizeT size;
+         if (3 > in_len - ip)
+            return False;
+         bh   = in[ip] | (in[ip + 1] << 8) | (in[ip + 2] << 16);
+         last = bh & 1;
+         type = (bh >> 1) & 3;
+         size = bh >> 3;
+         ip  += 3;
+         switch (type) {
+            case 0: /* raw */
+               if (size > in_len - ip || size > out_len - *op)
+                  return False;
+               VG_(memcpy)(out + *op, in + ip, size);
+               ip  += size;
+               *op += size;
+               break;
+            case 1: /* RLE */
+               if (1 > in_len - ip || size > out_len - *op)
+                  return False;
+               VG_(memset)(out + *op, in[ip], size);
+               ip  += 1;
+               *op += size;
+               break;
+            case 2: /* compressed */
+               if (size > in_len - ip || size > TZSTD_BLOCK_MAX)
+                  return False;
+               if (!tzstd_block(st, in + ip, size, out, out_len,
+                                frame_start, op))
+                  return False;
+               ip += size;
+               break;
+            default:
+               return False;
+         }
+      } while (!last);
+
+      /* Content checksum, not checked */
+      if (fhd & 4) {
+         if (4 > in_len - ip)
+            return False;
+         ip += 4;
+      }
+   }
+   return True;
+}
+
+SizeT tzstd_decompress_mem_to_mem(void *pOut_buf, SizeT out_buf_len,
+                                  const void *pSrc_buf, SizeT src_buf_len)
+{
+   tzstd_state* st = VG_(malloc)("tzstd.decompress_mem_to_mem.1",
+                                 sizeof(tzstd_state));
+   SizeT out_len;
+   Bool  ok = tzstd_frames(st, pOut_buf, out_buf_len,
+                           pSrc_buf, src_buf_len, &out_len);
+   VG_(free)(st);
+   return ok ? out_len : TZSTD_DECOMPRESS_MEM_TO_MEM_FAILED;
+}
+
+#endif // #ifndef TZSTD_HEADER_FILE_ONLY
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                  tzstd.c ---*/
+/*--------------------------------------------------------------------*/
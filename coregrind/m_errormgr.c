@@ -33,9 +33,11 @@
 #include "pub_core_threadstate.h"      // For VG_N_THREADS
 #include "pub_core_debuginfo.h"
 #include "pub_core_debuglog.h"
+#include "pub_core_deduppoolalloc.h"
 #include "pub_core_errormgr.h"
 #include "pub_core_execontext.h"
 #include "pub_core_gdbserver.h"
+#include "pub_core_hashtable.h"
 #include "pub_core_libcbase.h"
 #include "pub_core_libcassert.h"
 #include "pub_core_libcfile.h"
@@ -69,14 +71,45 @@
 #define M_COLLECT_NO_ERRORS_AFTER_FOUND 10000000
 
 /* The list of error contexts found, both suppressed and unsuppressed.
-   Initially empty, and grows as errors are detected. */
+   Initially empty, and grows as errors are detected.  The most recently
+   matched or added error is at the front. */
 static Error* errors = NULL;
 
+/* Hash index over the errors list, so that VG_(maybe_record_error)
+   does not have to compare a new error with every recorded one.  Each
+   error is chained in the bucket given by hash_Error at the resolution
+   errors_htab_res; the table is rebuilt when that resolution changes
+   or when it becomes full.  Within a chain, the errors are kept in the
+   same relative order as in the errors list, so the first match found
+   in a chain is the one a search of the whole list would find. */
+static Error** errors_htab      = NULL;
+static UInt    errors_htab_size = 0;
+static UInt    errors_htab_used = 0;
+static VgRes   errors_htab_res  = Vg_MedRes;
+
 /* The list of suppression directives, as read from the specified
    suppressions file.  Note that the list gets rearranged as a result
    of the searches done by is_suppressible_error(). */
 static Supp* suppressions = NULL;
 
+/* Index over the suppressions, so that is_suppressible_error only
+   tries the ones that can match the innermost frame of the error.  A
+   suppression whose first location line is a fun: or obj: line without
+   wildcards is chained in the supp_index bucket of that name; all the
+   others are chained in supp_index_others.  The index is built by the
+   first search.  The candidates are tried in suppressions list order,
+   as given by their stamps, so the suppression used for an error is
+   the same one a search of the whole list would find. */
+static Supp** supp_index        = NULL;
+static UInt   supp_index_size   = 0;
+static UInt   supp_index_n_fun  = 0;
+static UInt   supp_index_n_obj  = 0;
+static Supp*  supp_index_others = NULL;
+static Bool   supp_index_built  = False;
+
+/* Last stamp given to a suppression put at the front of the list. */
+static UInt   supp_stamp        = 0;
+
 /* Running count of unsuppressed errors detected. */
 static UInt n_errs_found = 0;
 
@@ -112,6 +145,11 @@ static UWord em_supplist_searches = 0;
    searching. */
 static UWord em_supplist_cmps = 0;
 
+/* Stats: number of IP names looked up during suppression list
+   searching, and number of them that had to be symbolised. */
+static UWord em_ipnames_lookups    = 0;
+static UWord em_ipnames_symbolised = 0;
+
 /*------------------------------------------------------------*/
 /*--- Error type                                           ---*/
 /*------------------------------------------------------------*/
@@ -127,6 +165,8 @@ static UWord em_supplist_cmps = 0;
 */
 struct _Error {
    struct _Error* next;
+   struct _Error* prev;    // previous error in the errors list
+   struct _Error* hnext;   // next error in the same errors_htab chain
    // Unique tag.  This gives the error a unique identity (handle) by
    // which it can be referred to afterwords.  Currently only used for
    // XML printing.
@@ -226,6 +266,9 @@ typedef
    (0..)) for 'skind'. */
 struct _Supp {
    struct _Supp* next;
+   struct _Supp* prev;   // previous suppression in the suppressions list
+   struct _Supp* inext;  // next suppression in the same supp_index chain
+   UInt stamp;    // Higher for suppressions nearer the front of the list.
    Int count;     // The number of times this error has been suppressed.
    HChar* sname;  // The name by which the suppression is referred to.
 
@@ -315,6 +358,68 @@ static Bool eq_Error ( VgRes res, const Error* e1, const Error* e2 )
    }
 }
 
+/* Hash the part of an error that eq_Error compares at resolution res.
+   The tools' eq_Error only compare details of errors which are already
+   of the same kind and from the same context, so those two are the
+   key. */
+static UWord hash_Error ( VgRes res, const Error* e )
+{
+   return VG_(hash_ExeContext)(res, e->where) ^ ((UWord)e->ekind << 24);
+}
+
+/* Rebuild errors_htab for resolution res, first making it about twice
+   as big if it holds as many errors as it has buckets. */
+static void rehash_errors ( VgRes res )
+{
+   UInt   i;
+   Error *p, *chain, *next;
+
+   if (errors_htab_size == 0 || errors_htab_used >= errors_htab_size) {
+      if (errors_htab != NULL)
+         VG_(free)(errors_htab);
+      errors_htab_size = errors_htab_size == 0 ? 1021
+                                               : 2 * errors_htab_size + 1;
+      errors_htab = VG_(malloc)("errormgr.rehash.1",
+                                errors_htab_size * sizeof(Error*));
+   }
+   for (i = 0; i < errors_htab_size; i++)
+      errors_htab[i] = NULL;
+   errors_htab_res = res;
+
+   /* Chain the errors in reverse list order, then reverse the chains
+      to get them in list order. */
+   for (p = errors; p != NULL; p = p->next) {
+      i = hash_Error(res, p) % errors_htab_size;
+      p->hnext = errors_htab[i];
+      errors_htab[i] = p;
+   }
+   for (i = 0; i < errors_htab_size; i++) {
+      chain = NULL;
+      for (p = errors_htab[i]; p != NULL; p = next) {
+         next = p->hnext;
+         p->hnext = chain;
+         chain = p;
+      }
+      errors_htab[i] = chain;
+   }
+}
+
+/* Put p at the front of the errors list and of its hash chain.  p must
+   not be in either yet. */
+static void add_error_at_front ( Error* p )
+{
+   UInt i = hash_Error(errors_htab_res, p) % errors_htab_size;
+
+   p->prev = NULL;
+   p->next = errors;
+   if (errors != NULL)
+      errors->prev = p;
+   errors = p;
+
+   p->hnext = errors_htab[i];
+   errors_htab[i] = p;
+}
+
 
 /* Helper functions for suppression generation: print a single line of
    a suppression pseudo-stack-trace, either in XML or text mode.  It's
@@ -413,10 +518,11 @@ static void gen_suppression(const Error* err)
    UInt n_ips = VG_(get_ExeContext_n_ips)(ec);
    vg_assert(n_ips > 0);
    vg_assert(n_ips <= VG_DEEPEST_BACKTRACE);
+   Addr ips[n_ips];
+   VG_(get_ExeContext_StackTrace)(ec, ips, n_ips);
    VG_(apply_StackTrace)(printSuppForIp_nonXML,
                          text, VG_(get_ExeContext_epoch)(ec),
-                         VG_(get_ExeContext_StackTrace)(ec),
-                         n_ips);
+                         ips, n_ips);
 
    VG_(xaprintf)(text, "}\n");
    // zero terminate
@@ -444,8 +550,7 @@ static void gen_suppression(const Error* err)
       // Print stack trace elements
       VG_(apply_StackTrace)(printSuppForIp_XML,
                             NULL, VG_(get_ExeContext_epoch)(ec),
-                            VG_(get_ExeContext_StackTrace)(ec),
-                            VG_(get_ExeContext_n_ips)(ec));
+                            ips, n_ips);
 
       // And now the cdata bit
       // XXX FIXME!  properly handle the case where the raw text
@@ -658,6 +763,8 @@ void construct_error ( Error* err, ThreadId tid, ErrorKind ekind, Addr a,
    /* Core-only parts */
    err->unique   = unique_counter++;
    err->next     = NULL;
+   err->prev     = NULL;
+   err->hnext    = NULL;
    err->supp     = NULL;
    err->count    = 1;
    err->tid      = tid;
@@ -689,6 +796,7 @@ void VG_(maybe_record_error) ( ThreadId tid,
           Error* p;
           Error* p_prev;
           UInt   extra_size;
+          UInt   h;
           VgRes  exe_res          = Vg_MedRes;
    static Bool   stopping_message = False;
    static Bool   slowdown_message = False;
@@ -757,9 +865,13 @@ void VG_(maybe_record_error) ( ThreadId tid,
    /* Build ourselves the error */
    construct_error ( &err, tid, ekind, a, s, extra, NULL );
 
+   if (errors_htab == NULL || exe_res != errors_htab_res)
+      rehash_errors(exe_res);
+
    /* First, see if we've got an error record matching this one. */
    em_errlist_searches++;
-   p       = errors;
+   h       = hash_Error(exe_res, &err) % errors_htab_size;
+   p       = errors_htab[h];
    p_prev  = NULL;
    while (p != NULL) {
       em_errlist_cmps++;
@@ -777,17 +889,21 @@ void VG_(maybe_record_error) ( ThreadId tid,
          /* Move p to the front of the list so that future searches
             for it are faster. It also allows to print the last
             error (see VG_(show_last_error). */
-         if (p_prev != NULL) {
-            vg_assert(p_prev->next == p);
-            p_prev->next = p->next;
-            p->next      = errors;
-            errors       = p;
+         if (p != errors) {
+            if (p_prev != NULL)
+               p_prev->hnext = p->hnext;
+            else
+               errors_htab[h] = p->hnext;
+            p->prev->next = p->next;
+            if (p->next != NULL)
+               p->next->prev = p->prev;
+            add_error_at_front(p);
 	 }
 
          return;
       }
       p_prev = p;
-      p      = p->next;
+      p      = p->hnext;
    }
 
    /* Didn't see it.  Copy and add. */
@@ -839,9 +955,11 @@ void VG_(maybe_record_error) ( ThreadId tid,
       p->extra = new_extra;
    }
 
-   p->next = errors;
    p->supp = is_suppressible_error(&err);
-   errors  = p;
+   if (errors_htab_used >= errors_htab_size)
+      rehash_errors(exe_res);
+   add_error_at_front(p);
+   errors_htab_used++;
    if (p->supp == NULL) {
       /* update stats */
       n_err_contexts++;
@@ -972,13 +1090,35 @@ static Bool show_used_suppressions ( void )
    return any_supp;
 }
 
+/* An unsuppressed error and its position in the errors list, for
+   sorting them by count in VG_(show_all_errors). */
+typedef
+   struct {
+      Error* err;
+      UInt   pos;
+   }
+   ErrorPos;
+
+static Int cmp_ErrorPos_by_count ( const void* v1, const void* v2 )
+{
+   const ErrorPos* ep1 = v1;
+   const ErrorPos* ep2 = v2;
+   if (ep1->err->count < ep2->err->count) return -1;
+   if (ep1->err->count > ep2->err->count) return 1;
+   if (ep1->pos < ep2->pos) return -1;
+   if (ep1->pos > ep2->pos) return 1;
+   return 0;
+}
+
 /* Show all the errors that occurred, and possibly also the
    suppressions used. */
 void VG_(show_all_errors) (  Int verbosity, Bool xml )
 {
-   Int    i, n_min;
-   Error *p, *p_min;
-   Bool   any_supp;
+   Int       i;
+   UInt      n_shown;
+   Error    *p, *p_min;
+   ErrorPos* sorted;
+   Bool      any_supp;
 
    if (verbosity == 0)
       return;
@@ -1001,22 +1141,34 @@ void VG_(show_all_errors) (  Int verbosity, Bool xml )
    // We do the following only at -v or above, and only in non-XML
    // mode
 
-   /* Print the contexts in order of increasing error count. 
-      Once an error is shown, we add a huge value to its count to filter it
-      out.
-      After having shown all errors, we reset count to the original value. */
+   /* Print the contexts in order of increasing error count, and in
+      errors list order for equal counts. */
+   sorted = VG_(malloc)("errormgr.sae.1",
+                        (n_err_contexts + 1) * sizeof(ErrorPos));
+   n_shown = 0;
+   for (p = errors; p != NULL; p = p->next) {
+      if (p->supp != NULL) continue;
+      vg_assert(n_shown < n_err_contexts);
+      sorted[n_shown].err = p;
+      sorted[n_shown].pos = n_shown;
+      n_shown++;
+   }
+   VG_(ssort)(sorted, n_shown, sizeof(ErrorPos), cmp_ErrorPos_by_count);
+
+   /* Symbolise the stack traces of all the errors in one go. */
+   {
+      ExeContext** wheres = VG_(malloc)("errormgr.sae.2",
+                                        (n_shown + 1) * sizeof(ExeContext*));
+      for (i = 0; i < n_shown; i++)
+         wheres[i] = sorted[i].err->where;
+      VG_(resolve_ExeContexts)(wheres, n_shown);
+      VG_(free)(wheres);
+   }
+
    for (i = 0; i < n_err_contexts; i++) {
-      n_min = (1 << 30) - 1;
-      p_min = NULL;
-      for (p = errors; p != NULL; p = p->next) {
-         if (p->supp != NULL) continue;
-         if (p->count < n_min) {
-            n_min = p->count;
-            p_min = p;
-         }
-      }
       // XXX: this isn't right.  See bug 203651.
-      if (p_min == NULL) continue; //VG_(core_panic)("show_all_errors()");
+      if (i >= n_shown) continue; //VG_(core_panic)("show_all_errors()");
+      p_min = sorted[i].err;
 
       VG_(umsg)("\n");
       VG_(umsg)("%d errors in context %d of %u:\n",
@@ -1027,21 +1179,16 @@ void VG_(show_all_errors) (  Int verbosity, Bool xml )
       vg_assert(! xml);
 
       if ((i+1 == VG_(clo_dump_error))) {
-         StackTrace ips = VG_(get_ExeContext_StackTrace)(p_min->where);
+         Addr ip;
+         VG_(get_ExeContext_StackTrace)(p_min->where, &ip, 1);
          VG_(translate) ( 0 /* dummy ThreadId; irrelevant due to debugging*/,
-                          ips[0], /*debugging*/True, 0xFE/*verbosity*/,
+                          ip, /*debugging*/True, 0xFE/*verbosity*/,
                           /*bbs_done*/0,
                           /*allow redir?*/True);
       }
-
-      p_min->count = p_min->count + (1 << 30);
    } 
-
-   /* reset the counts, otherwise a 2nd call does not show anything anymore */ 
-   for (p = errors; p != NULL; p = p->next) {
-      if (p->count >= (1 << 30))
-         p->count = p->count - (1 << 30);
-   }
+   VG_(free)(sorted);
+   VG_(forget_resolved_IPs)();
 
 
    any_supp = show_used_suppressions();
@@ -1455,7 +1602,12 @@ static void load_one_suppressions_file ( Int clo_suppressions_i )
          supp->callers[i] = tmp_callers[i];
       }
 
-      supp->next = suppressions;
+      supp->prev  = NULL;
+      supp->next  = suppressions;
+      supp->inext = NULL;
+      supp->stamp = ++supp_stamp;
+      if (suppressions != NULL)
+         suppressions->prev = supp;
       suppressions = supp;
    }
    VG_(free)(buf);
@@ -1481,6 +1633,7 @@ void VG_(load_suppressions) ( void )
 {
    Int i;
    suppressions = NULL;
+   supp_index_built = False;
    for (i = 0; i < VG_(sizeXA)(VG_(clo_suppressions)); i++) {
       if (VG_(clo_verbosity) > 1) {
          VG_(dmsg)("Reading suppressions file: %s\n", 
@@ -1513,6 +1666,100 @@ static Bool supploc_IsQuery ( const void* supplocV )
    return False; /* there's no '?' equivalent in the supp syntax */
 }
 
+/* The function and object names of the IPs seen in errors are kept
+   in the ipnames table, so that matching errors with the suppressions
+   symbolises each IP only once, rather than once per error in which
+   it appears.  The names are interned in ipnames_strs. */
+typedef
+   struct _IPNames {
+      struct _IPNames* next;
+      UWord         key;     // the IP
+      DiEpoch       epoch;   // in which the names were found
+      UInt          n_funs;  // 0 if the function names are not found yet
+      const HChar** funs;    // innermost inlined call first
+      const HChar*  obj;     // NULL if not found yet
+   }
+   IPNames;
+
+static VgHashTable*    ipnames      = NULL;
+static DedupPoolAlloc* ipnames_strs = NULL;
+
+static IPNames* get_IPNames ( DiEpoch ep, Addr ip )
+{
+   IPNames* ipn;
+
+   if (ipnames == NULL) {
+      ipnames = VG_(HT_construct)("errormgr.ipnames");
+      ipnames_strs = VG_(newDedupPA)(16000, 1, VG_(malloc),
+                                     "errormgr.ipnames.strs", VG_(free));
+   }
+
+   em_ipnames_lookups++;
+   ipn = VG_(HT_lookup)(ipnames, ip);
+   if (ipn == NULL) {
+      ipn = VG_(malloc)("errormgr.ipnames.1", sizeof(IPNames));
+      ipn->key = ip;
+      ipn->n_funs = 0;
+      ipn->funs = NULL;
+      ipn->obj = NULL;
+      VG_(HT_add_node)(ipnames, ipn);
+   } else if (ipn->epoch.n != ep.n) {
+      /* The names may differ in another epoch. */
+      if (ipn->funs != NULL)
+         VG_(free)(ipn->funs);
+      ipn->n_funs = 0;
+      ipn->funs = NULL;
+      ipn->obj = NULL;
+   }
+   ipn->epoch = ep;
+   return ipn;
+}
+
+static const HChar* intern_name ( const HChar* name )
+{
+   return VG_(allocEltDedupPA)(ipnames_strs, VG_(strlen)(name) + 1, name);
+}
+
+/* Find the function names of ipn, expanding the inlined calls if
+   inline info is read. */
+static void complete_funs ( IPNames* ipn )
+{
+   InlIPCursor* iipc;
+
+   if (ipn->n_funs > 0)
+      return;
+
+   em_ipnames_symbolised++;
+   iipc = VG_(new_IIPC)(ipn->epoch, ipn->key);
+   do {
+      const HChar *caller;
+      // Nb: C++-mangled names are used in suppressions.  Do, though,
+      // Z-demangle them, since otherwise it's possible to wind
+      // up comparing "malloc" in the suppression against
+      // "_vgrZU_libcZdsoZa_malloc" in the backtrace, and the
+      // two of them need to be made to match.
+      if (!VG_(get_fnname_no_cxx_demangle)(ipn->epoch, ipn->key,
+                                           &caller, iipc))
+         caller = "???";
+      ipn->funs = VG_(realloc)("errormgr.ipnames.2", ipn->funs,
+                               (ipn->n_funs + 1) * sizeof(HChar*));
+      ipn->funs[ipn->n_funs++] = intern_name(caller);
+   } while (VG_(next_IIPC)(iipc));
+   VG_(delete_IIPC)(iipc);
+}
+
+static void complete_obj ( IPNames* ipn )
+{
+   const HChar *obj;
+
+   if (ipn->obj != NULL)
+      return;
+
+   if (!VG_(get_objname)(ipn->epoch, ipn->key, &obj))
+      obj = "???";
+   ipn->obj = intern_name(obj);
+}
+
 /* IPtoFunOrObjCompleter is a lazy completer of the IPs
    needed to match an error with the suppression patterns.
    The matching between an IP and a suppression pattern is done either
@@ -1678,21 +1925,16 @@ static HChar* foComplete(IPtoFunOrObjCompleter* ip2fo,
                                       needFun ? "fun" : "obj",
                                       ixInput, ip2fo->names_free);
       if (needFun) {
+         IPNames* ipn;
          // With inline info, fn names must have been completed already.
          vg_assert (!VG_(clo_read_inline_info));
          /* Get the function name into 'caller_name', or "???"
             if unknown. */
-         // Nb: C++-mangled names are used in suppressions.  Do, though,
-         // Z-demangle them, since otherwise it's possible to wind
-         // up comparing "malloc" in the suppression against
-         // "_vgrZU_libcZdsoZa_malloc" in the backtrace, and the
-         // two of them need to be made to match.
-         if (!VG_(get_fnname_no_cxx_demangle)(ip2fo->epoch,
-                                              ip2fo->ips[ixInput],
-                                              &caller,
-                                              NULL))
-            caller = "???";
+         ipn = get_IPNames(ip2fo->epoch, ip2fo->ips[ixInput]);
+         complete_funs(ipn);
+         caller = ipn->funs[0];
       } else {
+         IPNames* ipn;
          /* Get the object name into 'caller_name', or "???"
             if unknown. */
          UWord i;
@@ -1709,8 +1951,9 @@ static HChar* foComplete(IPtoFunOrObjCompleter* ip2fo,
             last_expand_pos_ips is the last offset in fun/obj where
             ips[pos_ips] has been expanded. */
 
-         if (!VG_(get_objname)(ip2fo->epoch, ip2fo->ips[pos_ips], &caller))
-            caller = "???";
+         ipn = get_IPNames(ip2fo->epoch, ip2fo->ips[pos_ips]);
+         complete_obj(ipn);
+         caller = ipn->obj;
 
          // Have all inlined calls pointing at this object name
          for (i = last_expand_pos_ips - ip2fo->n_offsets_per_ip[pos_ips] + 1;
@@ -1777,30 +2020,27 @@ static void expandInput (IPtoFunOrObjCompleter* ip2fo, UWord ixInput )
       if (VG_(clo_read_inline_info)) {
          // Expand one more IP in one or more calls.
          const Addr IP = ip2fo->ips[ip2fo->n_ips_expanded];
-         InlIPCursor *iipc;
+         IPNames* ipn;
+         UInt     i;
 
-         iipc = VG_(new_IIPC)(ip2fo->epoch, IP);
          // The only thing we really need is the nr of inlined fn calls
          // corresponding to the IP we will expand.
          // However, computing this is mostly the same as finding
          // the function name. So, let's directly complete the function name.
-         do {
-            const HChar *caller;
+         ipn = get_IPNames(ip2fo->epoch, IP);
+         complete_funs(ipn);
+         for (i = 0; i < ipn->n_funs; i++) {
+            const HChar *caller = ipn->funs[i];
             grow_offsets(ip2fo, ip2fo->n_expanded+1);
             ip2fo->fun_offsets[ip2fo->n_expanded] = ip2fo->names_free;
-            if (!VG_(get_fnname_no_cxx_demangle)(ip2fo->epoch, IP,
-                                                 &caller,
-                                                 iipc))
-               caller = "???";
             SizeT  caller_len = VG_(strlen)(caller);
             HChar* caller_name = grow_names(ip2fo, caller_len + 1);
             VG_(strcpy)(caller_name, caller);
             ip2fo->names_free += caller_len + 1;
             ip2fo->n_expanded++;
             ip2fo->n_offsets_per_ip[ip2fo->n_ips_expanded]++;
-         } while (VG_(next_IIPC)(iipc));
+         }
          ip2fo->n_ips_expanded++;
-         VG_(delete_IIPC) (iipc);
       } else {
          // Without inlined fn call info, expansion simply
          // consists in allocating enough elements in (fun|obj)_offsets.
@@ -1942,6 +2182,103 @@ Bool supp_matches_error(const Supp* su, const Error* err)
 
 /////////////////////////////////////////////////////
 
+/* Can su only match errors whose innermost frame has a given function
+   or object name?  If so, su is chained in the supp_index bucket of
+   that name. */
+static Bool supp_is_indexed ( const Supp* su )
+{
+   return (su->callers[0].ty == FunName || su->callers[0].ty == ObjName)
+          && su->callers[0].name_is_simple_str;
+}
+
+static UInt hash_supp_name ( const HChar* name )
+{
+   UInt hash = 5381;
+   while (*name != 0)
+      hash = hash * 33 + (UChar)*name++;
+   return hash;
+}
+
+/* The suppressions found by a search of the index, sorted in
+   suppressions list order before being tried. */
+static Supp** supp_cands      = NULL;
+static UInt   supp_cands_size = 0;
+
+static void build_supp_index ( void )
+{
+   Supp* su;
+   UInt  i, n_supps = 0, n_indexed = 0;
+
+   for (su = suppressions; su != NULL; su = su->next) {
+      n_supps++;
+      if (supp_is_indexed(su))
+         n_indexed++;
+   }
+
+   if (supp_index != NULL)
+      VG_(free)(supp_index);
+   supp_index_size = 64;
+   while (supp_index_size < 2 * n_indexed)
+      supp_index_size *= 2;
+   supp_index = VG_(malloc)("errormgr.bsi.1",
+                            supp_index_size * sizeof(Supp*));
+   for (i = 0; i < supp_index_size; i++)
+      supp_index[i] = NULL;
+   supp_index_n_fun  = 0;
+   supp_index_n_obj  = 0;
+   supp_index_others = NULL;
+
+   for (su = suppressions; su != NULL; su = su->next) {
+      if (supp_is_indexed(su)) {
+         i = hash_supp_name(su->callers[0].name) & (supp_index_size - 1);
+         su->inext = supp_index[i];
+         supp_index[i] = su;
+         if (su->callers[0].ty == FunName)
+            supp_index_n_fun++;
+         else
+            supp_index_n_obj++;
+      } else {
+         su->inext = supp_index_others;
+         supp_index_others = su;
+      }
+   }
+
+   if (supp_cands_size < n_supps) {
+      if (supp_cands != NULL)
+         VG_(free)(supp_cands);
+      supp_cands_size = n_supps;
+      supp_cands = VG_(malloc)("errormgr.bsi.2",
+                               supp_cands_size * sizeof(Supp*));
+   }
+   supp_index_built = True;
+}
+
+/* Add to supp_cands[*n_cands ..] the suppressions whose first location
+   line is 'ty:name' without wildcards. */
+static void add_indexed_supps ( SuppLocTy ty, const HChar* name,
+                                UInt* n_cands )
+{
+   Supp* su;
+   UInt  i = hash_supp_name(name) & (supp_index_size - 1);
+
+   for (su = supp_index[i]; su != NULL; su = su->inext) {
+      if (su->callers[0].ty == ty
+          && VG_(strcmp)(su->callers[0].name, name) == 0) {
+         vg_assert(*n_cands < supp_cands_size);
+         supp_cands[(*n_cands)++] = su;
+      }
+   }
+}
+
+static Int cmp_Supp_by_stamp ( const void* v1, const void* v2 )
+{
+   const Supp* su1 = *(const Supp* const*)v1;
+   const Supp* su2 = *(const Supp* const*)v2;
+   if (su1->stamp > su2->stamp) return -1;
+   if (su1->stamp < su2->stamp) return 1;
+   return 0;
+}
+
 /* Does an error context match a suppression?  ie is this a suppressible
    error?  If so, return a pointer to the Supp record, otherwise NULL.
    Tries to minimise the number of symbol searches since they are expensive.  
@@ -1949,7 +2286,7 @@ Bool supp_matches_error(const Supp* su, const Error* err)
 static Supp* is_suppressible_error ( const Error* err )
 {
    Supp* su;
-   Supp* su_prev;
+   UInt  i, n_cands;
 
    IPtoFunOrObjCompleter ip2fo;
    /* Conceptually, ip2fo contains an array of function names and an array of
@@ -1971,8 +2308,11 @@ static Supp* is_suppressible_error ( const Error* err )
 
    /* Prepare the lazy input completer. */
    ip2fo.epoch = VG_(get_ExeContext_epoch)(err->where);
-   ip2fo.ips = VG_(get_ExeContext_StackTrace)(err->where);
-   ip2fo.n_ips = VG_(get_ExeContext_n_ips)(err->where);
+   const UInt n_ips = VG_(get_ExeContext_n_ips)(err->where);
+   Addr ips[n_ips];
+   VG_(get_ExeContext_StackTrace)(err->where, ips, n_ips);
+   ip2fo.ips = ips;
+   ip2fo.n_ips = n_ips;
    ip2fo.n_ips_expanded = 0;
    ip2fo.n_expanded = 0;
    ip2fo.sz_offsets = 0;
@@ -1983,29 +2323,55 @@ static Supp* is_suppressible_error ( const Error* err )
    ip2fo.names_szB = 0;
    ip2fo.names_free = 0;
 
+   /* Find the suppressions that can match the innermost frame of the
+      error context, and try them in list order. */
+   if (!supp_index_built)
+      build_supp_index();
+   n_cands = 0;
+   if ((supp_index_n_fun > 0 || supp_index_n_obj > 0)
+       && haveInputInpC(&ip2fo, 0)) {
+      /* Nb: the name returned by foComplete is only valid until the
+         next call. */
+      if (supp_index_n_fun > 0)
+         add_indexed_supps(FunName, foComplete(&ip2fo, 0, True/*needFun*/),
+                           &n_cands);
+      if (supp_index_n_obj > 0)
+         add_indexed_supps(ObjName, foComplete(&ip2fo, 0, False/*needFun*/),
+                           &n_cands);
+   }
+   for (su = supp_index_others; su != NULL; su = su->inext) {
+      vg_assert(n_cands < supp_cands_size);
+      supp_cands[n_cands++] = su;
+   }
+   if (n_cands > 1)
+      VG_(ssort)(supp_cands, n_cands, sizeof(Supp*), cmp_Supp_by_stamp);
+
    /* See if the error context matches any suppression. */
    if (DEBUG_ERRORMGR || VG_(debugLog_getLevel)() >= 4)
      VG_(dmsg)("errormgr matching begin\n");
-   su_prev = NULL;
-   for (su = suppressions; su != NULL; su = su->next) {
+   for (i = 0; i < n_cands; i++) {
+      su = supp_cands[i];
       em_supplist_cmps++;
       if (supp_matches_error(su, err) 
           && supp_matches_callers(&ip2fo, su)) {
          /* got a match.  */
          /* Inform the tool that err is suppressed by su. */
          (void)VG_TDICT_CALL(tool_update_extra_suppression_use, err, su);
-         /* Move this entry to the head of the list
-            in the hope of making future searches cheaper. */
-         if (su_prev) {
-            vg_assert(su_prev->next == su);
-            su_prev->next = su->next;
+         /* Move this entry to the head of the list, so that it is
+            tried first by future searches. */
+         if (su != suppressions) {
+            su->prev->next = su->next;
+            if (su->next != NULL)
+               su->next->prev = su->prev;
+            su->prev = NULL;
             su->next = suppressions;
+            suppressions->prev = su;
             suppressions = su;
          }
+         su->stamp = ++supp_stamp;
          clearIPtoFunOrObjCompleter(su, &ip2fo);
          return su;
       }
-      su_prev = su;
    }
    clearIPtoFunOrObjCompleter(NULL, &ip2fo);
    return NULL;      /* no matches */
@@ -2019,6 +2385,10 @@ void VG_(print_errormgr_stats) ( void )
       " errormgr: %'lu supplist searches, %'lu comparisons during search\n",
       em_supplist_searches, em_supplist_cmps
    );
+   VG_(dmsg)(
+      " errormgr: %'lu IP names lookups, %'lu IPs symbolised\n",
+      em_ipnames_lookups, em_ipnames_symbolised
+   );
    VG_(dmsg)(
       " errormgr: %'lu errlist searches, %'lu comparisons during search\n",
       em_errlist_searches, em_errlist_cmps
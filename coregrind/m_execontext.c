@@ -30,6 +30,7 @@
 
 #include "pub_core_basics.h"
 #include "pub_core_debuglog.h"
+#include "pub_core_debuginfo.h"     // VG_(resolve_IPs)
 #include "pub_core_libcassert.h"
 #include "pub_core_libcprint.h"     // For VG_(message)()
 #include "pub_core_mallocfree.h"
@@ -38,6 +39,7 @@
 #include "pub_core_machine.h"       // VG_(get_IP)
 #include "pub_core_threadstate.h"   // VG_(is_valid_tid)
 #include "pub_core_execontext.h"    // self
+#include "pub_core_xarray.h"
 
 /*------------------------------------------------------------*/
 /*--- Low-level ExeContext storage.                        ---*/
@@ -48,13 +50,24 @@
    suppression specifications.  If not used in comparison, the rest
    are purely informational (but often important).
 
-   The contexts are stored in a traditional chained hash table, so as
-   to allow quick determination of whether a new context already
-   exists.  The hash table starts small and expands dynamically, so as
-   to keep the load factor below 1.0.
+   Stack traces recorded by a program tend to share long outer parts
+   (main -> event loop -> request handler -> ...) and only differ in
+   their innermost few frames.  So rather than storing each context as
+   a full array of IPs, the contexts are stored as a tree of frames:
+   each node holds one IP and a link to the node of its caller.  The
+   roots of the tree are outermost frames.  A context is then simply
+   the node of its innermost frame: its IPs are found by following the
+   parent links up to a root.  Nodes which end a recorded context are
+   given an ECU; other nodes are only used as parents.
+
+   To find a node quickly from (parent, IP), all the nodes are also
+   present in a traditional chained hash table.  The hash table starts
+   small and expands dynamically, so as to keep the load factor below
+   1.0.
 
    The idea is only to ever store any one context once, so as to save
-   space and make exact comparisons faster. */
+   space and make exact comparisons faster: two contexts are equal at
+   full depth if and only if they are the same node. */
 
 
 /* Primes for the hash table */
@@ -70,16 +83,25 @@ static SizeT ec_primes[N_EC_PRIMES] = {
 };
 
 
-/* Each element is present in a hash chain, and also contains a
-   variable length array of guest code addresses (the useful part). */
+/* Each node is one frame of one or more stack traces.  Nodes are
+   never freed nor moved, so that an ExeContext* stays valid for ever.
+   They are referred to by their index in the node chunks below; index
+   0 means "no node".  A node is always created after its parent, so a
+   parent has a smaller index than all its children. */
 
 struct _ExeContext {
-   struct _ExeContext* chain;
-   /* A 32-bit unsigned integer that uniquely identifies this
-      ExeContext.  Memcheck uses these for origin tracking.  Values
-      must be nonzero (else Memcheck's origin tracking is hosed), must
-      be a multiple of four, and must be unique.  Hence they start at
-      4. */
+   /* The guest code address of this frame. */
+   Addr ip;
+   /* Index of the node of the caller of this frame, or 0 if this is an
+      outermost frame. */
+   UInt parent;
+   /* Index of the next node in the same hash chain, or 0. */
+   UInt chain;
+   /* A 32-bit unsigned integer that uniquely identifies the ExeContext
+      ending at this node, or 0 if no recorded context ends here.
+      Memcheck uses these for origin tracking.  Values must be nonzero
+      (else Memcheck's origin tracking is hosed), must be a multiple of
+      four, and must be unique.  Hence they start at 4. */
    UInt ecu;
    /* epoch in which the ExeContext can be symbolised. In other words, epoch
       identifies the set of debug info to use to symbolise the Addr in ips
@@ -90,39 +112,62 @@ struct _ExeContext {
       DiEpoch_INVALID is used as a special value to indicate that ExeContext
       is valid in the current epoch. VG_(get_ExeContext_epoch) translates
       this invalid value in the real current epoch.
-      When a debug info is archived, the set of ExeContext is scanned :
-      If an ExeContext with epoch == DiEpoch_INVALID has one or more
-      ips Addr corresponding to the just archived debug info, the ExeContext
-      epoch is changed to the last epoch identifying the set containing the
-      archived debug info. */
+      When a debug info is archived, the set of nodes is scanned :
+      If a node with epoch == DiEpoch_INVALID has an ip corresponding to
+      the just archived debug info, or a parent which has been archived,
+      the node epoch is changed to the last epoch identifying the set
+      containing the archived debug info.  Archived nodes are removed
+      from the hash table, so that new contexts get new nodes. */
    DiEpoch epoch;
-   /* Variable-length array.  The size is 'n_ips'; at
-      least 1, at most VG_DEEPEST_BACKTRACE.  [0] is the current IP,
-      [1] is its caller, [2] is the caller of [1], etc. */
-   UInt n_ips;
-   Addr ips[0];
 };
 
 
+/* The nodes, in chunks of EC_CHUNK_SIZE. */
+#define EC_CHUNK_SHIFT 14
+#define EC_CHUNK_SIZE  (1 << EC_CHUNK_SHIFT)
+static ExeContext** ec_chunks;       /* array [ec_chunks_size] */
+static UInt         ec_chunks_size;
+static UInt         ec_n_nodes = 1;  /* next free index; 0 is not used */
+
+static inline ExeContext* ec_node ( UInt ix )
+{
+   return &ec_chunks[ix >> EC_CHUNK_SHIFT][ix & (EC_CHUNK_SIZE - 1)];
+}
+
 /* This is the dynamically expanding hash table. */
-static ExeContext** ec_htab; /* array [ec_htab_size] of ExeContext* */
+static UInt*        ec_htab; /* array [ec_htab_size] of node indexes */
 static SizeT        ec_htab_size;     /* one of the values in ec_primes */
 static SizeT        ec_htab_size_idx; /* 0 .. N_EC_PRIMES-1 */
 
+/* Node index of each context, indexed by ecu/4 - 1. */
+static UInt*        ec_by_ecu;
+static UInt         ec_by_ecu_size;
+
 /* ECU serial number */
 static UInt ec_next_ecu = 4; /* We must never issue zero */
 
 static ExeContext* null_ExeContext;
 
+/* The previously recorded trace, outermost frame first, and the node
+   of each of its frames.  Consecutive traces mostly have the same
+   outer frames, which can then be found without hashing. */
+static Addr last_ips[VG_DEEPEST_BACKTRACE];
+static UInt last_nodes[VG_DEEPEST_BACKTRACE];
+static UInt last_n_ips;
+
 /* Stats only: the number of times the system was searched to locate a
    context. */
 static ULong ec_searchreqs;
 
-/* Stats only: the number of full context comparisons done. */
+/* Stats only: the number of hash lookups done, and the number of
+   nodes compared in the hash chains. */
+static ULong ec_searchlookups;
 static ULong ec_searchcmps;
 
-/* Stats only: total number of stored contexts. */
+/* Stats only: total number of stored contexts, and the number of IPs
+   they would have used if stored as separate arrays. */
 static ULong ec_totstored;
+static ULong ec_totstored_ips;
 
 /* Number of 2, 4 and (fast) full cmps done. */
 static ULong ec_cmp2s;
@@ -144,8 +189,10 @@ static void init_ExeContext_storage ( void )
    if (LIKELY(init_done))
       return;
    ec_searchreqs = 0;
+   ec_searchlookups = 0;
    ec_searchcmps = 0;
    ec_totstored = 0;
+   ec_totstored_ips = 0;
    ec_cmp2s = 0;
    ec_cmp4s = 0;
    ec_cmpAlls = 0;
@@ -153,9 +200,9 @@ static void init_ExeContext_storage ( void )
    ec_htab_size_idx = 0;
    ec_htab_size = ec_primes[ec_htab_size_idx];
    ec_htab = VG_(malloc)("execontext.iEs1",
-                         sizeof(ExeContext*) * ec_htab_size);
+                         sizeof(UInt) * ec_htab_size);
    for (i = 0; i < ec_htab_size; i++)
-      ec_htab[i] = NULL;
+      ec_htab[i] = 0;
 
    {
       Addr ips[1];
@@ -168,6 +215,31 @@ static void init_ExeContext_storage ( void )
    init_done = True;
 }
 
+/* Number of IPs in the context ending at e. */
+static UInt n_ips_of ( const ExeContext* e )
+{
+   UInt n = 1;
+   while (e->parent != 0) {
+      e = ec_node(e->parent);
+      n++;
+   }
+   return n;
+}
+
+/* Copy at most max_n_ips IPs of the context ending at e into ips,
+   innermost first.  Returns the number of IPs copied. */
+static UInt ips_of ( const ExeContext* e, /*OUT*/Addr* ips, UInt max_n_ips )
+{
+   UInt n = 0;
+   while (n < max_n_ips) {
+      ips[n++] = e->ip;
+      if (e->parent == 0)
+         break;
+      e = ec_node(e->parent);
+   }
+   return n;
+}
+
 DiEpoch VG_(get_ExeContext_epoch)( const ExeContext* e )
 {
    if (is_DiEpoch_INVALID (e->epoch))
@@ -179,49 +251,52 @@ DiEpoch VG_(get_ExeContext_epoch)( const ExeContext* e )
 /* Print stats. */
 void VG_(print_ExeContext_stats) ( Bool with_stacktraces )
 {
-   Int i;
-   ULong total_n_ips;
+   UInt i;
    ExeContext* ec;
 
    init_ExeContext_storage();
 
    if (with_stacktraces) {
+      Addr ips[VG_DEEPEST_BACKTRACE];
+      UInt n_ips;
       VG_(message)(Vg_DebugMsg, "   exectx: Printing contexts stacktraces\n");
-      for (i = 0; i < ec_htab_size; i++) {
-         for (ec = ec_htab[i]; ec; ec = ec->chain) {
-            VG_(message)(Vg_DebugMsg,
-                         "   exectx: stacktrace ecu %u epoch %u n_ips %u\n",
-                         ec->ecu, ec->epoch.n, ec->n_ips);
-            VG_(pp_StackTrace)( VG_(get_ExeContext_epoch)(ec),
-                                ec->ips, ec->n_ips );
-         }
+      for (i = 0; i < ec_totstored; i++) {
+         ec = ec_node(ec_by_ecu[i]);
+         n_ips = ips_of(ec, ips, VG_DEEPEST_BACKTRACE);
+         VG_(message)(Vg_DebugMsg,
+                      "   exectx: stacktrace ecu %u epoch %u n_ips %u\n",
+                      ec->ecu, ec->epoch.n, n_ips);
+         VG_(pp_StackTrace)( VG_(get_ExeContext_epoch)(ec), ips, n_ips );
       }
-      VG_(message)(Vg_DebugMsg, 
+      VG_(message)(Vg_DebugMsg,
                    "   exectx: Printed %'llu contexts stacktraces\n",
                    ec_totstored);
    }
-   
-   total_n_ips = 0;
-   for (i = 0; i < ec_htab_size; i++) {
-      for (ec = ec_htab[i]; ec; ec = ec->chain)
-         total_n_ips += ec->n_ips;
-   }
-   VG_(message)(Vg_DebugMsg, 
+
+   VG_(message)(Vg_DebugMsg,
       "   exectx: %'lu lists, %'llu contexts (avg %3.2f per list)"
       " (avg %3.2f IP per context)\n",
       ec_htab_size, ec_totstored, (Double)ec_totstored / (Double)ec_htab_size,
-      (Double)total_n_ips / (Double)ec_totstored
+      (Double)ec_totstored_ips / (Double)ec_totstored
    );
-   VG_(message)(Vg_DebugMsg, 
-      "   exectx: %'llu searches, %'llu full compares (%'llu per 1000)\n",
-      ec_searchreqs, ec_searchcmps, 
-      ec_searchreqs == 0 
-         ? 0ULL 
-         : ( (ec_searchcmps * 1000ULL) / ec_searchreqs ) 
+   VG_(message)(Vg_DebugMsg,
+      "   exectx: %'u frame nodes, %'lu bytes"
+      " (%'llu bytes as separate IP arrays)\n",
+      ec_n_nodes - 1, (SizeT)(ec_n_nodes - 1) * sizeof(ExeContext),
+      ec_totstored * (sizeof(ExeContext) + sizeof(Addr))
+      + (ec_totstored_ips - ec_totstored) * sizeof(Addr)
    );
-   VG_(message)(Vg_DebugMsg, 
+   VG_(message)(Vg_DebugMsg,
+      "   exectx: %'llu searches, %'llu lookups,"
+      " %'llu full compares (%'llu per 1000)\n",
+      ec_searchreqs, ec_searchlookups, ec_searchcmps,
+      ec_searchreqs == 0
+         ? 0ULL
+         : ( (ec_searchcmps * 1000ULL) / ec_searchreqs )
+   );
+   VG_(message)(Vg_DebugMsg,
       "   exectx: %'llu cmp2, %'llu cmp4, %'llu cmpAll\n",
-      ec_cmp2s, ec_cmp4s, ec_cmpAlls 
+      ec_cmp2s, ec_cmp4s, ec_cmpAlls
    );
 }
 
@@ -229,51 +304,171 @@ void VG_(print_ExeContext_stats) ( Bool with_stacktraces )
 /* Print an ExeContext. */
 void VG_(pp_ExeContext) ( ExeContext* ec )
 {
-   VG_(pp_StackTrace)( VG_(get_ExeContext_epoch)(ec), ec->ips, ec->n_ips );
+   Addr ips[VG_DEEPEST_BACKTRACE];
+   UInt n_ips = ips_of(ec, ips, VG_DEEPEST_BACKTRACE);
+   VG_(pp_StackTrace)( VG_(get_ExeContext_epoch)(ec), ips, n_ips );
+}
+
+void VG_(resolve_ExeContexts) ( ExeContext* const* ecs, UWord n_ecs )
+{
+   Addr    ips[VG_DEEPEST_BACKTRACE];
+   UInt    n_ips, k;
+   UWord   i, j;
+   DiEpoch ep;
+   XArray* batch;
+   Bool*   done;
+
+   if (n_ecs == 0)
+      return;
+
+   /* VG_(resolve_IPs) takes the IPs of one epoch at a time.  Most
+      often, all the ExeContexts are of the same epoch. */
+   batch = VG_(newXA)(VG_(malloc), "execontext.rEs.1", VG_(free),
+                      sizeof(Addr));
+   done = VG_(calloc)("execontext.rEs.2", n_ecs, sizeof(Bool));
+   for (i = 0; i < n_ecs; i++) {
+      if (done[i] || ecs[i] == NULL)
+         continue;
+      ep = VG_(get_ExeContext_epoch)(ecs[i]);
+      VG_(dropTailXA)(batch, VG_(sizeXA)(batch));
+      for (j = i; j < n_ecs; j++) {
+         if (done[j] || ecs[j] == NULL
+             || VG_(get_ExeContext_epoch)(ecs[j]).n != ep.n)
+            continue;
+         done[j] = True;
+         n_ips = ips_of(ecs[j], ips, VG_DEEPEST_BACKTRACE);
+         for (k = 0; k < n_ips; k++)
+            VG_(addToXA)(batch, &ips[k]);
+      }
+      if (VG_(sizeXA)(batch) > 0)
+         VG_(resolve_IPs)(ep, VG_(indexXA)(batch, 0), VG_(sizeXA)(batch));
+   }
+   VG_(free)(done);
+   VG_(deleteXA)(batch);
 }
 
 
+static inline UWord ROLW ( UWord w, Int n )
+{
+   Int bpw = 8 * sizeof(UWord);
+   w = (w << n) | (w >> (bpw-n));
+   return w;
+}
+
+static UWord calc_hash ( UInt parent, Addr ip, UWord htab_sz )
+{
+   UWord hash = ROLW(parent, 19) ^ ip;
+   vg_assert(htab_sz > 0);
+   return hash % htab_sz;
+}
+
+/* Rebuild the hash chains in a table of new_size entries, leaving
+   out the archived nodes. */
+static void rehash_ec_htab ( SizeT new_size )
+{
+   UInt  i;
+   UInt* new_ec_htab;
+
+   new_ec_htab = VG_(malloc)("execontext.reh1", sizeof(UInt) * new_size);
+   for (i = 0; i < new_size; i++)
+      new_ec_htab[i] = 0;
+
+   for (i = 1; i < ec_n_nodes; i++) {
+      ExeContext* cur = ec_node(i);
+      if (is_DiEpoch_INVALID (cur->epoch)) {
+         UWord hash = calc_hash(cur->parent, cur->ip, new_size);
+         vg_assert(hash < new_size);
+         cur->chain = new_ec_htab[hash];
+         new_ec_htab[hash] = i;
+      } else {
+         cur->chain = 0;
+      }
+   }
+
+   VG_(free)(ec_htab);
+   ec_htab      = new_ec_htab;
+   ec_htab_size = new_size;
+}
+
+static void resize_ec_htab ( void )
+{
+   SizeT new_size;
+
+   vg_assert(ec_htab_size_idx >= 0 && ec_htab_size_idx < N_EC_PRIMES);
+   if (ec_htab_size_idx == N_EC_PRIMES-1)
+      return; /* out of primes - can't resize further */
+
+   new_size = ec_primes[ec_htab_size_idx + 1];
+
+   VG_(debugLog)(
+      1, "execontext",
+         "resizing htab from size %lu to %lu (idx %lu)  Total#nodes=%u\n",
+         ec_htab_size, new_size, ec_htab_size_idx + 1, ec_n_nodes - 1);
+
+   rehash_ec_htab(new_size);
+   ec_htab_size_idx++;
+}
+
 void VG_(archive_ExeContext_in_range) (DiEpoch last_epoch,
                                        Addr text_avma, SizeT length )
 {
-   Int i;
+   UInt i;
    ExeContext* ec;
    ULong n_archived = 0;
+   Bool  any_archived = False;
    const Addr text_avma_end = text_avma + length - 1;
 
    if (VG_(clo_verbosity) > 1)
       VG_(message)(Vg_DebugMsg, "Scanning and archiving ExeContexts ...\n");
-   for (i = 0; i < ec_htab_size; i++) {
-      for (ec = ec_htab[i]; ec; ec = ec->chain) {
-         if (is_DiEpoch_INVALID (ec->epoch))
-            for (UInt j = 0; j < ec->n_ips; j++) {
-               if (UNLIKELY(ec->ips[j] >= text_avma
-                            && ec->ips[j] <= text_avma_end)) {
-                  ec->epoch = last_epoch;
-                  n_archived++;
-                  break;
-               }
-            }
+   /* Parents come before their children, so a single pass in index
+      order also archives all the descendants of an archived node. */
+   for (i = 1; i < ec_n_nodes; i++) {
+      ec = ec_node(i);
+      if (!is_DiEpoch_INVALID (ec->epoch))
+         continue;
+      if ((ec->ip >= text_avma && ec->ip <= text_avma_end)
+          || (ec->parent != 0
+              && !is_DiEpoch_INVALID (ec_node(ec->parent)->epoch))) {
+         ec->epoch = last_epoch;
+         any_archived = True;
+         if (ec->ecu != 0)
+            n_archived++;
       }
    }
+   if (any_archived) {
+      rehash_ec_htab(ec_htab_size);
+      last_n_ips = 0;
+   }
    if (VG_(clo_verbosity) > 1)
       VG_(message)(Vg_DebugMsg,
                    "Scanned %'llu ExeContexts, archived %'llu ExeContexts\n",
                    ec_totstored, n_archived);
 }
 
+/* Compare the first n frames of two contexts. */
+static Bool eq_n_frames ( UInt n, const ExeContext* e1,
+                          const ExeContext* e2 )
+{
+   UInt i;
+   for (i = 0; i < n; i++) {
+      if (e1 == e2)         return True;
+      if (e1->ip != e2->ip) return False;
+      if (i + 1 == n)       break;
+      if (e1->parent == 0 || e2->parent == 0)
+         return e1->parent == e2->parent;
+      e1 = ec_node(e1->parent);
+      e2 = ec_node(e2->parent);
+   }
+   return True;
+}
+
 /* Compare two ExeContexts.  Number of callers considered depends on res. */
 Bool VG_(eq_ExeContext) ( VgRes res, const ExeContext* e1,
                           const ExeContext* e2 )
 {
-   Int i;
-
-   if (e1 == NULL || e2 == NULL) 
+   if (e1 == NULL || e2 == NULL)
       return False;
 
-   // Must be at least one address in each trace.
-   vg_assert(e1->n_ips >= 1 && e2->n_ips >= 1);
-
    // Note: we compare the epoch in the case below, and not here
    // to have the ec_cmp* stats correct.
 
@@ -281,24 +476,12 @@ Bool VG_(eq_ExeContext) ( VgRes res, const ExeContext* e1,
    case Vg_LowRes:
       /* Just compare the top two callers. */
       ec_cmp2s++;
-      for (i = 0; i < 2; i++) {
-         if ( (e1->n_ips <= i) &&  (e2->n_ips <= i)) return True;
-         if ( (e1->n_ips <= i) && !(e2->n_ips <= i)) return False;
-         if (!(e1->n_ips <= i) &&  (e2->n_ips <= i)) return False;
-         if (e1->ips[i] != e2->ips[i])               return False;
-      }
-      return e1->epoch.n == e2->epoch.n;
+      return eq_n_frames(2, e1, e2) && e1->epoch.n == e2->epoch.n;
 
    case Vg_MedRes:
       /* Just compare the top four callers. */
       ec_cmp4s++;
-      for (i = 0; i < 4; i++) {
-         if ( (e1->n_ips <= i) &&  (e2->n_ips <= i)) return True;
-         if ( (e1->n_ips <= i) && !(e2->n_ips <= i)) return False;
-         if (!(e1->n_ips <= i) &&  (e2->n_ips <= i)) return False;
-         if (e1->ips[i] != e2->ips[i])               return False;
-      }
-      return e1->epoch.n == e2->epoch.n;
+      return eq_n_frames(4, e1, e2) && e1->epoch.n == e2->epoch.n;
 
    case Vg_HighRes:
       ec_cmpAlls++;
@@ -311,6 +494,34 @@ Bool VG_(eq_ExeContext) ( VgRes res, const ExeContext* e1,
    }
 }
 
+/* Hash the frames of e that VG_(eq_ExeContext) compares at resolution
+   res, so that two ExeContexts equal at res have equal hashes. */
+UWord VG_(hash_ExeContext) ( VgRes res, const ExeContext* e )
+{
+   UInt  i, n;
+   UWord hash;
+
+   if (e == NULL)
+      return 0;
+
+   switch (res) {
+   case Vg_LowRes:  n = 2; break;
+   case Vg_MedRes:  n = 4; break;
+   case Vg_HighRes: return (UWord)e;
+   default:
+      VG_(core_panic)("VG_(hash_ExeContext): unrecognised VgRes");
+   }
+
+   hash = e->epoch.n;
+   for (i = 0; i < n; i++) {
+      hash = ROLW(hash, 19) ^ e->ip;
+      if (e->parent == 0)
+         break;
+      e = ec_node(e->parent);
+   }
+   return hash;
+}
+
 /* VG_(record_ExeContext) is the head honcho here.  Take a snapshot of
    the client's stack.  Search our collection of ExeContexts to see if
    we already have it, and if not, allocate a new one.  Either way,
@@ -323,63 +534,54 @@ Bool VG_(eq_ExeContext) ( VgRes res, const ExeContext* e1,
    Also checks whether the hash table needs expanding, and expands it
    if so. */
 
-static inline UWord ROLW ( UWord w, Int n )
+/* Find the current-epoch node for ip called from parent, or allocate
+   a new one. */
+static UInt find_or_add_node ( UInt parent, Addr ip )
 {
-   Int bpw = 8 * sizeof(UWord);
-   w = (w << n) | (w >> (bpw-n));
-   return w;
-}
+   UWord       hash;
+   UInt        ix;
+   ExeContext* node;
 
-static UWord calc_hash ( const Addr* ips, UInt n_ips, UWord htab_sz )
-{
-   UInt  i;
-   UWord hash = 0;
-   vg_assert(htab_sz > 0);
-   for (i = 0; i < n_ips; i++) {
-      hash ^= ips[i];
-      hash = ROLW(hash, 19);
+   ec_searchlookups++;
+   hash = calc_hash( parent, ip, ec_htab_size );
+   for (ix = ec_htab[hash]; ix != 0; ix = node->chain) {
+      ec_searchcmps++;
+      node = ec_node(ix);
+      if (node->ip == ip && node->parent == parent)
+         return ix;
    }
-   return hash % htab_sz;
-}
 
-static void resize_ec_htab ( void )
-{
-   SizeT        i;
-   SizeT        new_size;
-   ExeContext** new_ec_htab;
-
-   vg_assert(ec_htab_size_idx >= 0 && ec_htab_size_idx < N_EC_PRIMES);
-   if (ec_htab_size_idx == N_EC_PRIMES-1)
-      return; /* out of primes - can't resize further */
-
-   new_size = ec_primes[ec_htab_size_idx + 1];
-   new_ec_htab = VG_(malloc)("execontext.reh1",
-                             sizeof(ExeContext*) * new_size);
-
-   VG_(debugLog)(
-      1, "execontext",
-         "resizing htab from size %lu to %lu (idx %lu)  Total#ECs=%llu\n",
-         ec_htab_size, new_size, ec_htab_size_idx + 1, ec_totstored);
-
-   for (i = 0; i < new_size; i++)
-      new_ec_htab[i] = NULL;
+   /* Bummer.  We have to allocate a new node. */
+   ix = ec_n_nodes;
+   if ((ix >> EC_CHUNK_SHIFT) >= ec_chunks_size) {
+      ec_chunks_size = ec_chunks_size == 0 ? 64 : 2 * ec_chunks_size;
+      ec_chunks = VG_(realloc)("execontext.fon1", ec_chunks,
+                               ec_chunks_size * sizeof(ExeContext*));
+   }
+   if ((ix & (EC_CHUNK_SIZE - 1)) == 0 || ix == 1)
+      ec_chunks[ix >> EC_CHUNK_SHIFT]
+         = VG_(perm_malloc)( EC_CHUNK_SIZE * sizeof(struct _ExeContext),
+                             vg_alignof(struct _ExeContext) );
+   ec_n_nodes++;
+   if (ec_n_nodes == 0)
+      VG_(core_panic)("m_execontext: more than 2^32 ExeContext nodes");
+
+   node = ec_node(ix);
+   node->ip     = ip;
+   node->parent = parent;
+   node->ecu    = 0;
+   node->epoch  = DiEpoch_INVALID();
+   node->chain  = ec_htab[hash];
+   ec_htab[hash] = ix;
 
-   for (i = 0; i < ec_htab_size; i++) {
-      ExeContext* cur = ec_htab[i];
-      while (cur) {
-         ExeContext* next = cur->chain;
-         UWord hash = calc_hash(cur->ips, cur->n_ips, new_size);
-         vg_assert(hash < new_size);
-         cur->chain = new_ec_htab[hash];
-         new_ec_htab[hash] = cur;
-         cur = next;
-      }
+   /* Resize the hash table, maybe? */
+   if ( ((ULong)(ec_n_nodes - 1)) > ((ULong)ec_htab_size) ) {
+      vg_assert(ec_htab_size_idx >= 0 && ec_htab_size_idx < N_EC_PRIMES);
+      if (ec_htab_size_idx < N_EC_PRIMES-1)
+         resize_ec_htab();
    }
 
-   VG_(free)(ec_htab);
-   ec_htab      = new_ec_htab;
-   ec_htab_size = new_size;
-   ec_htab_size_idx++;
+   return ix;
 }
 
 /* Used by the outer as a marker to separate the frames of the inner valgrind
@@ -455,79 +657,41 @@ static ExeContext* record_ExeContext_wrk ( ThreadId tid, Word first_ip_delta,
    getting to this point. */
 static ExeContext* record_ExeContext_wrk2 ( const Addr* ips, UInt n_ips )
 {
-   Int         i;
-   Bool        same;
-   UWord       hash;
-   ExeContext* new_ec;
-   ExeContext* list;
-   ExeContext  *prev2, *prev;
-
-   static UInt ctr = 0;
+   UInt        d, shared;
+   UInt        ix;
+   ExeContext* ec;
 
    vg_assert(n_ips >= 1 && n_ips <= VG_(clo_backtrace_size));
-
-   /* Now figure out if we've seen this one before.  First hash it so
-      as to determine the list number. */
-   hash = calc_hash( ips, n_ips, ec_htab_size );
-
-   /* And (the expensive bit) look a for matching entry in the list. */
+   vg_assert(n_ips <= VG_DEEPEST_BACKTRACE);
 
    ec_searchreqs++;
 
-   prev2 = NULL;
-   prev  = NULL;
-   list  = ec_htab[hash];
-
-   while (True) {
-      if (list == NULL) break;
-      ec_searchcmps++;
-      same = list->n_ips == n_ips && is_DiEpoch_INVALID (list->epoch);
-      for (i = 0; i < n_ips && same ; i++) {
-         same = list->ips[i] == ips[i];
-      }
-      if (same) break;
-      prev2 = prev;
-      prev  = list;
-      list  = list->chain;
+   /* Walk down the tree from the outermost frame.  The outer frames
+      that this trace has in common with the previous one are already
+      known. */
+   ix = 0;
+   for (shared = 0; shared < n_ips && shared < last_n_ips; shared++) {
+      if (ips[n_ips - 1 - shared] != last_ips[shared])
+         break;
+      ix = last_nodes[shared];
    }
-
-   if (list != NULL) {
-      /* Yay!  We found it.  Once every 8 searches, move it one step
-         closer to the start of the list to make future searches
-         cheaper. */
-      if (0 == ((ctr++) & 7)) {
-         if (prev2 != NULL && prev != NULL) {
-            /* Found at 3rd or later position in the chain. */
-            vg_assert(prev2->chain == prev);
-            vg_assert(prev->chain  == list);
-            prev2->chain = list;
-            prev->chain  = list->chain;
-            list->chain  = prev;
-         }
-         else if (prev2 == NULL && prev != NULL) {
-            /* Found at 2nd position in the chain. */
-            vg_assert(ec_htab[hash] == prev);
-            vg_assert(prev->chain == list);
-            prev->chain = list->chain;
-            list->chain = prev;
-            ec_htab[hash] = list;
-         }
-      }
-      return list;
+   for (d = shared; d < n_ips; d++) {
+      last_ips[d] = ips[n_ips - 1 - d];
+      ix = find_or_add_node( ix, last_ips[d] );
+      last_nodes[d] = ix;
    }
+   last_n_ips = n_ips;
 
-   /* Bummer.  We have to allocate a new context record. */
-   ec_totstored++;
+   ec = ec_node(ix);
+   if (LIKELY(ec->ecu != 0))
+      return ec;
 
-   new_ec = VG_(perm_malloc)( sizeof(struct _ExeContext) 
-                              + n_ips * sizeof(Addr),
-                              vg_alignof(struct _ExeContext));
-
-   for (i = 0; i < n_ips; i++)
-      new_ec->ips[i] = ips[i];
+   /* This node did not end a context yet.  Make it one. */
+   ec_totstored++;
+   ec_totstored_ips += n_ips;
 
    vg_assert(VG_(is_plausible_ECU)(ec_next_ecu));
-   new_ec->ecu = ec_next_ecu;
+   ec->ecu = ec_next_ecu;
    ec_next_ecu += 4;
    if (ec_next_ecu == 0) {
       /* Urr.  Now we're hosed; we emitted 2^30 ExeContexts already
@@ -535,19 +699,15 @@ static ExeContext* record_ExeContext_wrk2 ( const Addr* ips, UInt n_ips )
       VG_(core_panic)("m_execontext: more than 2^30 ExeContexts created");
    }
 
-   new_ec->n_ips = n_ips;
-   new_ec->chain = ec_htab[hash];
-   new_ec->epoch = DiEpoch_INVALID();
-   ec_htab[hash] = new_ec;
-
-   /* Resize the hash table, maybe? */
-   if ( ((ULong)ec_totstored) > ((ULong)ec_htab_size) ) {
-      vg_assert(ec_htab_size_idx >= 0 && ec_htab_size_idx < N_EC_PRIMES);
-      if (ec_htab_size_idx < N_EC_PRIMES-1)
-         resize_ec_htab();
+   if (ec_totstored > ec_by_ecu_size) {
+      ec_by_ecu_size = ec_by_ecu_size == 0 ? 1024 : 2 * ec_by_ecu_size;
+      ec_by_ecu = VG_(realloc)("execontext.rEw2", ec_by_ecu,
+                               ec_by_ecu_size * sizeof(UInt));
    }
+   ec_by_ecu[ec_totstored - 1] = ix;
+   vg_assert(ec->ecu / 4 == ec_totstored);
 
-   return new_ec;
+   return ec;
 }
 
 ExeContext* VG_(record_ExeContext)( ThreadId tid, Word first_ip_delta ) {
@@ -566,9 +726,10 @@ ExeContext* VG_(make_depth_1_ExeContext_from_Addr)( Addr a ) {
    return record_ExeContext_wrk2( &a, 1 );
 }
 
-StackTrace VG_(get_ExeContext_StackTrace) ( ExeContext* e ) {
-   return e->ips;
-}  
+UInt VG_(get_ExeContext_StackTrace) ( const ExeContext* e,
+                                      /*OUT*/Addr* ips, UInt max_n_ips ) {
+   return ips_of(e, ips, max_n_ips);
+}
 
 UInt VG_(get_ECU_from_ExeContext)( const ExeContext* e ) {
    vg_assert(VG_(is_plausible_ECU)(e->ecu));
@@ -576,23 +737,15 @@ UInt VG_(get_ECU_from_ExeContext)( const ExeContext* e ) {
 }
 
 Int VG_(get_ExeContext_n_ips)( const ExeContext* e ) {
-   vg_assert(e->n_ips >= 1);
-   return e->n_ips;
+   return n_ips_of(e);
 }
 
 ExeContext* VG_(get_ExeContext_from_ECU)( UInt ecu )
 {
-   UWord i;
-   ExeContext* ec;
    vg_assert(VG_(is_plausible_ECU)(ecu));
-   vg_assert(ec_htab_size > 0);
-   for (i = 0; i < ec_htab_size; i++) {
-      for (ec = ec_htab[i]; ec; ec = ec->chain) {
-         if (ec->ecu == ecu)
-            return ec;
-      }
-   }
-   return NULL;
+   if (ecu / 4 > ec_totstored)
+      return NULL;
+   return ec_node(ec_by_ecu[ecu / 4 - 1]);
 }
 
 ExeContext* VG_(make_ExeContext_from_StackTrace)( const Addr* ips, UInt n_ips )
@@ -1545,6 +1545,11 @@ Bool VG_(strtok_get_address_and_size) (Addr* address,
    return True;
 }
 
+void VG_(gdbserver_update_n_threads)(void)
+{
+   remote_utils_update_n_threads();
+}
+
 void VG_(gdbserver_status_output)(void)
 {
    const int nr_gdbserved_addresses 
@@ -149,6 +149,14 @@ void remote_utils_output_status(void)
                 shared->written_by_vgdb, shared->seen_by_valgrind);
 }
 
+void remote_utils_update_n_threads(void)
+{
+   /* vgdb reads this each time it attaches to the process to find
+      which part of VG_(threads) to examine. */
+   if (shared != NULL)
+      shared->vg_n_threads = VG_N_THREADS;
+}
+
 /* Returns 0 if vgdb and connection state looks good,
    otherwise returns an int value telling which check failed. */
 static
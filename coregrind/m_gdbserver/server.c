@@ -30,8 +30,10 @@
 #include "pub_core_execontext.h"
 #include "pub_core_syswrap.h"      // VG_(show_open_fds)
 #include "pub_core_scheduler.h"
+#include "pub_core_signals.h"      // VG_(print_signal_stats)
 #include "pub_core_transtab.h"
 #include "pub_core_debuginfo.h"
+#include "pub_core_redir.h"        // VG_(print_redir_stats)
 #include "pub_core_addrinfo.h"
 #include "pub_core_aspacemgr.h"
 
@@ -170,7 +172,10 @@ void VG_(print_all_stats) (Bool memory_stats, Bool tool_stats)
    VG_(print_translation_stats)();
    VG_(print_tt_tc_stats)();
    VG_(print_scheduler_stats)();
+   VG_(print_signal_stats)();
    VG_(print_ExeContext_stats)( False /* with_stacktraces */ );
+   VG_(print_debuginfo_stats)();
+   VG_(print_redir_stats)();
    VG_(print_errormgr_stats)();
    if (tool_stats && VG_(needs).print_stats) {
       VG_TDICT_CALL(tool_print_stats);
@@ -79,6 +79,9 @@ extern int remote_desc_activity(const char *msg);
 /* output some status of gdbserver communication */
 extern void remote_utils_output_status(void);
 
+/* Tell vgdb about the current size of the thread table. */
+extern void remote_utils_update_n_threads(void);
+
 /* True if there is a connection with gdb. */
 extern Bool remote_connected(void);
 
@@ -1412,6 +1412,66 @@ Int VG_(setsockopt) ( Int sd, Int level, Int optname, void *optval,
 #  endif
 }
 
+#if defined(VGO_linux)
+/* The server side of a socket.  These are only needed by the
+   --server mode (m_zygote), which only exists on Linux. */
+
+#  if defined(VGP_x86_linux) || defined(VGP_ppc32_linux) \
+      || defined(VGP_ppc64be_linux) || defined(VGP_ppc64le_linux) \
+      || defined(VGP_s390x_linux)
+static Int my_socketcall ( Int call, UWord a0, UWord a1, UWord a2 )
+{
+   SysRes res;
+   UWord  args[3];
+   args[0] = a0;
+   args[1] = a1;
+   args[2] = a2;
+   res = VG_(do_syscall2)(__NR_socketcall, call, (UWord)&args);
+   return sr_isError(res) ? -1 : sr_Res(res);
+}
+#    define SOCKET_SYSCALL3(_call, _nr, _a0, _a1, _a2) \
+        my_socketcall(_call, _a0, _a1, _a2)
+#  elif defined(VGP_amd64_linux) || defined(VGP_arm_linux) \
+        || defined(VGP_mips32_linux) || defined(VGP_mips64_linux) \
+        || defined(VGP_arm64_linux)
+static Int my_socket_syscall ( UWord nr, UWord a0, UWord a1, UWord a2 )
+{
+   SysRes res = VG_(do_syscall3)(nr, a0, a1, a2);
+   return sr_isError(res) ? -1 : sr_Res(res);
+}
+#    define SOCKET_SYSCALL3(_call, _nr, _a0, _a1, _a2) \
+        my_socket_syscall(_nr, _a0, _a1, _a2)
+#  else
+#    error "Unknown platform"
+#  endif
+
+Int VG_(bind) ( Int sd, const struct vki_sockaddr *addr, Int addrlen )
+{
+   return SOCKET_SYSCALL3(VKI_SYS_BIND, __NR_bind,
+                          sd, (UWord)addr, addrlen);
+}
+
+Int VG_(listen) ( Int sd, Int backlog )
+{
+   return SOCKET_SYSCALL3(VKI_SYS_LISTEN, __NR_listen,
+                          sd, backlog, 0);
+}
+
+Int VG_(accept) ( Int sd )
+{
+   return SOCKET_SYSCALL3(VKI_SYS_ACCEPT, __NR_accept,
+                          sd, (UWord)NULL, (UWord)NULL);
+}
+
+Int VG_(recvmsg) ( Int sd, struct vki_msghdr *msg, Int flags )
+{
+   return SOCKET_SYSCALL3(VKI_SYS_RECVMSG, __NR_recvmsg,
+                          sd, (UWord)msg, flags);
+}
+
+#  undef SOCKET_SYSCALL3
+#endif // defined(VGO_linux)
+
 
 const HChar *VG_(basename)(const HChar *path)
 {
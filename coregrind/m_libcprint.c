@@ -341,8 +341,15 @@ void VG_(print_preamble)(Bool logging_to_fd)
    After startup, the gdbserver monitor command might temporarily
    set the fd of log_output_sink to -2 to indicate that output is
    to be given to gdb rather than output to the startup fd */
-OutputSink VG_(log_output_sink) = {  2, VgLogTo_Fd, NULL }; /* 2 = stderr */
-OutputSink VG_(xml_output_sink) = { -1, VgLogTo_Fd, NULL }; /* disabled */
+#define SINK_BUF_SZB 16384
+
+static HChar log_sink_buf[SINK_BUF_SZB];
+static HChar xml_sink_buf[SINK_BUF_SZB];
+
+OutputSink VG_(log_output_sink)                         /* 2 = stderr */
+   = {  2, VgLogTo_Fd, NULL, log_sink_buf, 0, -1 };
+OutputSink VG_(xml_output_sink)                         /* disabled */
+   = { -1, VgLogTo_Fd, NULL, xml_sink_buf, 0, -1 };
 
 static void revert_sink_to_stderr ( OutputSink *sink )
 {
@@ -448,8 +455,14 @@ static Bool reopen_sink_if_needed(const HChar *clo_fname_unexpanded,
    return False;
 }
 
+/* The pid shown in the preamble of messages, so as not to do a getpid
+   syscall for each line.  0 if not known yet. */
+static Int vmessage_pid = 0;
+
 void VG_(logging_atfork_child)(ThreadId tid)
 {
+   vmessage_pid = 0;
+
    /* If --child-silent-after-fork=yes was specified, set the output file
       descriptors to 'impossible' values. This is noticed by
       send_bytes_to_logging_sink(), which duly stops writing any further
@@ -473,6 +486,38 @@ void VG_(logging_atfork_child)(ThreadId tid)
    }
 }
 
+/* The fds given by --log-fd and --xml-fd, for
+   VG_(logging_server_child). */
+static Int log_fd_initial = 2;
+static Int xml_fd_initial = -1;
+
+static void server_child_sink(const HChar *clo_fname_unexpanded,
+                              OutputSink *sink, Int initial_fd, Bool is_xml)
+{
+   if (sink->type == VgLogTo_Fd) {
+      if (initial_fd >= 0 && initial_fd <= 2
+          && sink->fd >= 0 && sink->fd != initial_fd) {
+         VG_(dup2)(initial_fd, sink->fd);
+         VG_(fcntl)(sink->fd, VKI_F_SETFD, VKI_FD_CLOEXEC);
+      }
+   } else {
+      reopen_sink_if_needed(clo_fname_unexpanded, sink, is_xml);
+   }
+}
+
+/* In a child of a --server Valgrind, which has just taken over the
+   stdin, stdout and stderr of its client: make the sinks that were
+   set up from one of these fds write to the client's, and re-open
+   the log files whose names depend on the pid. */
+void VG_(logging_server_child)(void)
+{
+   vmessage_pid = 0;
+   server_child_sink(VG_(clo_log_fname_unexpanded),
+                     &VG_(log_output_sink), log_fd_initial, False);
+   server_child_sink(VG_(clo_xml_fname_unexpanded),
+                     &VG_(xml_output_sink), xml_fd_initial, True);
+}
+
 /* Initializes normal log and xml sinks (of type fd, file, or socket).
    Any problem encountered is considered a hard error and causes V. to exit.
 
@@ -565,6 +610,9 @@ void VG_(init_log_xml_sinks)(VgLogTo log_to, VgLogTo xml_to,
       );
    }
 
+   log_fd_initial = log_fd;
+   xml_fd_initial = xml_fd;
+
    // Finalise the output fds: the log fd ..
    if (log_fd >= 0) {
       finalize_sink_fd(&VG_(log_output_sink), log_fd, False);
@@ -586,9 +634,9 @@ void VG_(init_log_xml_sinks)(VgLogTo log_to, VgLogTo xml_to,
    }
 }
 
-/* Do the low-level send of a message to the logging sink. */
+/* Do the low-level write of a message to the logging sink. */
 static
-void send_bytes_to_logging_sink ( OutputSink* sink, const HChar* msg, Int nbytes )
+void write_to_logging_sink ( OutputSink* sink, const HChar* msg, Int nbytes )
 {
    if (sink->type == VgLogTo_Socket) {
       Int rc = VG_(write_socket)( sink->fd, msg, nbytes );
@@ -611,6 +659,68 @@ void send_bytes_to_logging_sink ( OutputSink* sink, const HChar* msg, Int nbytes
    }
 }
 
+/* Write the output buffered for sink. */
+static void flush_sink ( OutputSink* sink )
+{
+   Int fd     = sink->fd;
+   Int nbytes = sink->buf_used;
+
+   if (nbytes == 0)
+      return;
+   sink->buf_used = 0;
+
+   /* gdbserver can switch sink->fd for a while, to send the output of
+      a monitor command elsewhere.  The buffered output still goes
+      where it was meant to. */
+   sink->fd = sink->buf_fd;
+   write_to_logging_sink( sink, sink->buf, nbytes );
+   /* Only buffered sinks are files and sockets: if sink is now an fd,
+      writing to its socket failed and it was reverted to stderr. */
+   if (sink->type != VgLogTo_Fd)
+      sink->fd = fd;
+}
+
+/* Send a message to the logging sink, through its buffer if it is a
+   file or a socket. */
+static
+void send_bytes_to_logging_sink ( OutputSink* sink, const HChar* msg, Int nbytes )
+{
+   if (sink->buf_used > 0 && sink->fd != sink->buf_fd)
+      flush_sink(sink);
+
+   if (VG_(clo_output_buffering) && sink->type != VgLogTo_Fd
+       && sink->fd >= 0) {
+      if (sink->buf_used + nbytes > SINK_BUF_SZB)
+         flush_sink(sink);
+      if (nbytes < SINK_BUF_SZB) {
+         VG_(memcpy)(sink->buf + sink->buf_used, msg, nbytes);
+         sink->buf_used += nbytes;
+         sink->buf_fd = sink->fd;
+         return;
+      }
+   }
+
+   write_to_logging_sink( sink, msg, nbytes );
+}
+
+void VG_(flush_output_sinks)(void)
+{
+   flush_sink(&VG_(log_output_sink));
+   flush_sink(&VG_(xml_output_sink));
+}
+
+void VG_(discard_output_sinks)(void)
+{
+   VG_(log_output_sink).buf_used = 0;
+   VG_(xml_output_sink).buf_used = 0;
+}
+
+void VG_(logging_atfork_pre)(ThreadId tid)
+{
+   /* Otherwise the child would write the buffered output again. */
+   VG_(flush_output_sinks)();
+}
+
 
 /* ---------------------------------------------------------------------
    printf() and friends
@@ -1018,7 +1128,9 @@ static void add_to__vmessage_buf ( HChar c, void *p )
                b->buf[b->buf_used++] = tmp[i];
          }
 
-         VG_(sprintf)(tmp, "%d", VG_(getpid)());
+         if (vmessage_pid == 0)
+            vmessage_pid = VG_(getpid)();
+         VG_(sprintf)(tmp, "%d", vmessage_pid);
          tmp[sizeof(tmp)-1] = 0;
          for (i = 0; tmp[i]; i++)
             b->buf[b->buf_used++] = tmp[i];
@@ -845,6 +845,10 @@ Int VG_(ptrace) ( Int request, Int pid, void *addr, void *data )
 
 Int VG_(fork) ( void )
 {
+   /* Don't let the child inherit (and later write out) a copy of
+      the buffered output. */
+   VG_(flush_output_sinks)();
+
 #  if defined(VGP_arm64_linux)
    SysRes res;
    res = VG_(do_syscall5)(__NR_clone, VKI_SIGCHLD,
@@ -66,6 +66,7 @@
 #include "pub_core_trampoline.h"
 #include "pub_core_transtab.h"
 #include "pub_core_inner.h"
+#include "pub_core_zygote.h"
 #if defined(ENABLE_INNER_CLIENT_REQUEST)
 #include "pub_core_clreq.h"
 #endif 
@@ -115,6 +116,7 @@ static void usage_NORETURN ( Bool debug_help )
 "    --log-fd=<number>         log messages to file descriptor [2=stderr]\n"
 "    --log-file=<file>         log messages to <file>\n"
 "    --log-socket=ipaddr:port  log messages to socket ipaddr:port\n"
+"    --output-buffering=no|yes buffer output to log/XML files and sockets? [yes]\n"
 "\n"
 "  user options for Valgrind tools that report errors:\n"
 "    --xml=yes                 emit error output in XML (some tools only)\n"
@@ -155,6 +157,8 @@ static void usage_NORETURN ( Bool debug_help )
 "                              size/blocks, full: profile current and cumulative\n"
 "                              allocated size/blocks and freed size/blocks.\n"
 "    --xtree-memory-file=<file>   xtree memory report file [xtmemory.kcg.%%p]\n"
+"    --malloc-fast-path=no|yes call the tool's malloc functions without\n"
+"                              leaving the translated code [no]\n"
 "\n"
 "  uncommon user options for all Valgrind tools:\n"
 "    --fullpath-after=         (with nothing after the '=')\n"
@@ -183,6 +187,12 @@ static void usage_NORETURN ( Bool debug_help )
 "                              and use it to print better error messages in\n"
 "                              tools that make use of it (Memcheck, Helgrind,\n"
 "                              DRD) [no]\n"
+"    --lazy-debuginfo=no|yes   read line number, unwind, inline and variable\n"
+"                              info of an object only when first needed [no]\n"
+"    --debuginfo-helpers=<number>  read large DWARF debug info with <number>\n"
+"                              helper processes [0]\n"
+"    --debuginfo-cache-dir=<dir>  cache the debug info of objects with a\n"
+"                              build-id in <dir>\n"
 "    --vgdb-poll=<number>      gdbserver poll max every <number> basic blocks [%d] \n"
 "    --vgdb-shadow-registers=no|yes   let gdb see the shadow registers [no]\n"
 "    --vgdb-prefix=<prefix>    prefix for vgdb FIFOs [%s]\n"
@@ -201,10 +211,20 @@ static void usage_NORETURN ( Bool debug_help )
 "           android-gpu-sgx5xx android-gpu-adreno3xx none\n"
 "    --merge-recursive-frames=<number>  merge frames between identical\n"
 "           program counters in max <number> frames) [0]\n"
+"    --unwind=cfi|fp|auto      unwind the stack using the CFI, the frame\n"
+"           pointer chain, or whichever is right for each code address\n"
+"           (amd64 only) [cfi]\n"
+"    --shadow-call-stack=no|yes  take stack traces from a call stack\n"
+"           maintained at each call and return (x86 and amd64 only) [no]\n"
 "    --num-transtab-sectors=<number> size of translated code cache [%d]\n"
 "           more sectors may increase performance, but use more memory.\n"
 "    --avg-transtab-entry-size=<number> avg size in bytes of a translated\n"
 "           basic block [0, meaning use tool provided default]\n"
+"    --huge-pages=no|yes|auto  use transparent huge pages for shadow memory\n"
+"           and the translated code cache? [no]\n"
+"    --max-tool-memory=<number> give back the memory of translations, line\n"
+"           info of unloaded code and tool histories when Valgrind's own\n"
+"           memory use gets close to <number> bytes [0, meaning no limit]\n"
 "    --aspace-minaddr=0xPP     avoid mapping memory below 0xPP [guessed]\n"
 "    --valgrind-stacksize=<number> size of valgrind (host) thread's stack\n"
 "                               (in bytes) ["
@@ -229,6 +249,10 @@ static void usage_NORETURN ( Bool debug_help )
 "              attempt to avoid expensive address-space-resync operations\n"
 "    --max-threads=<number>    maximum number of threads that valgrind can\n"
 "                              handle [%d]\n"
+"    --server=<path>           start up once, then run the programs given by\n"
+"                              'valgrind --connect=<path> prog' [no server]\n"
+"    --connect=<path>          run the program on the --server=<path> Valgrind,\n"
+"                              with that server's tool and options\n"
 "\n";
 
    const HChar usage2[] = 
@@ -258,6 +282,8 @@ static void usage_NORETURN ( Bool debug_help )
 "                              heap blocks allocated for Valgrind internal use (in bytes) [4]\n"
 "    --wait-for-gdb=yes|no     pause on startup to wait for gdb attach\n"
 "    --sym-offsets=yes|no      show syms in form 'name+offset'? [no]\n"
+"    --debuginfo-helpers-min-size=<number>  only use debug info helpers for\n"
+"                              sections of at least <number> bytes [1048576]\n"
 "    --progress-interval=<number>  report progress every <number>\n"
 "                                  CPU seconds [0, meaning disabled]\n"
 "    --command-line-only=no|yes  only use command line options [no]\n"
@@ -419,6 +445,9 @@ static void early_process_cmd_line_options ( /*OUT*/Int* need_help )
       // Set up VG_(clo_max_threads); needed for VG_(tl_pre_clo_init)
       else if VG_INT_CLO(str, "--max-threads", VG_(clo_max_threads)) {}
 
+      // Set up VG_(clo_server), which changes the startup sequence.
+      else if VG_STR_CLO(str, "--server", VG_(clo_server)) {}
+
       // Set up VG_(clo_sim_hints). This is needed a.o. for an inner
       // running in an outer, to have "no-inner-prefix" enabled
       // as early as possible.
@@ -440,8 +469,14 @@ static void early_process_cmd_line_options ( /*OUT*/Int* need_help )
       VG_(exit)(0);
    }
 
-   /* For convenience */
-   VG_N_THREADS = VG_(clo_max_threads);
+   /* The thread table starts small and grows on demand, up to
+      VG_(clo_max_threads) entries. */
+   VG_N_THREADS = VG_MIN(VG_N_THREADS_INITIAL, VG_(clo_max_threads));
+
+#  if !defined(VGO_linux)
+   if (VG_(clo_server) != NULL)
+      VG_(fmsg_bad_option)("--server", "--server is only supported on Linux\n");
+#  endif
 
 #  if defined(VGO_solaris) || defined(VGO_darwin)
    /* Sim hint no-nptl-pthread-stackcache should be ignored. */
@@ -550,6 +585,7 @@ void main_process_cmd_line_options( void )
       else if VG_STREQN(17, arg, "--max-stackframe=")    {}
       else if VG_STREQN(17, arg, "--main-stacksize=")    {}
       else if VG_STREQN(14, arg, "--max-threads=")       {}
+      else if VG_STREQN( 9, arg, "--server=")            {}
       else if VG_STREQN(12, arg, "--sim-hints=")         {}
       else if VG_STREQN(15, arg, "--profile-heap=")      {}
       else if VG_STREQN(20, arg, "--core-redzone-size=") {}
@@ -642,6 +678,8 @@ void main_process_cmd_line_options( void )
       else if VG_BOOL_CLO(arg, "--show-below-main",  VG_(clo_show_below_main)) {}
       else if VG_BOOL_CLO(arg, "--keep-debuginfo",   VG_(clo_keep_debuginfo)) {}
       else if VG_BOOL_CLO(arg, "--time-stamp",       VG_(clo_time_stamp)) {}
+      else if VG_BOOL_CLO(arg, "--output-buffering",
+                               VG_(clo_output_buffering)) {}
       else if VG_BOOL_CLO(arg, "--track-fds",        VG_(clo_track_fds)) {}
       else if VG_BOOL_CLO(arg, "--trace-children",   VG_(clo_trace_children)) {}
       else if VG_BOOL_CLO(arg, "--child-silent-after-fork",
@@ -677,6 +715,14 @@ void main_process_cmd_line_options( void )
                                VG_(clo_progress_interval), 0, 3600) {}
       else if VG_BOOL_CLO(arg, "--read-inline-info", VG_(clo_read_inline_info)) {}
       else if VG_BOOL_CLO(arg, "--read-var-info",    VG_(clo_read_var_info)) {}
+      else if VG_BOOL_CLO(arg, "--lazy-debuginfo",   VG_(clo_lazy_debuginfo)) {}
+      else if VG_BINT_CLO(arg, "--debuginfo-helpers",
+                               VG_(clo_debuginfo_helpers), 0, 64) {}
+      else if VG_BINT_CLO(arg, "--debuginfo-helpers-min-size",
+                               VG_(clo_debuginfo_helpers_min_size),
+                               0, 1024*1024*1024) {}
+      else if VG_STR_CLO (arg, "--debuginfo-cache-dir",
+                               VG_(clo_debuginfo_cache_dir)) {}
 
       else if VG_INT_CLO (arg, "--dump-error",       VG_(clo_dump_error))   {}
       else if VG_INT_CLO (arg, "--input-fd",         VG_(clo_input_fd))     {}
@@ -689,9 +735,26 @@ void main_process_cmd_line_options( void )
       else if VG_BINT_CLO(arg, "--avg-transtab-entry-size",
                                VG_(clo_avg_transtab_entry_size),
                                50, 5000) {}
+      else if VG_XACT_CLO(arg, "--huge-pages=no",
+                          VG_(clo_huge_pages), Vg_HugePagesNo) {}
+      else if VG_XACT_CLO(arg, "--huge-pages=yes",
+                          VG_(clo_huge_pages), Vg_HugePagesYes) {}
+      else if VG_XACT_CLO(arg, "--huge-pages=auto",
+                          VG_(clo_huge_pages), Vg_HugePagesAuto) {}
+      else if VG_BINT_CLO(arg, "--max-tool-memory",
+                               VG_(clo_max_tool_memory),
+                               0, 1000*1000*1000*1000LL) {}
       else if VG_BINT_CLO(arg, "--merge-recursive-frames",
                                VG_(clo_merge_recursive_frames), 0,
                                VG_DEEPEST_BACKTRACE) {}
+      else if VG_XACT_CLO(arg, "--unwind=cfi",
+                          VG_(clo_unwind), Vg_UnwindCFI) {}
+      else if VG_XACT_CLO(arg, "--unwind=fp",
+                          VG_(clo_unwind), Vg_UnwindFP) {}
+      else if VG_XACT_CLO(arg, "--unwind=auto",
+                          VG_(clo_unwind), Vg_UnwindAuto) {}
+      else if VG_BOOL_CLO(arg, "--shadow-call-stack",
+                          VG_(clo_shadow_call_stack)) {}
 
       else if VG_XACT_CLO(arg, "--smc-check=none", 
                           VG_(clo_smc_check), Vg_SmcNone) {}
@@ -911,6 +974,18 @@ void main_process_cmd_line_options( void )
    if (VG_(clo_vex_control).guest_chase_thresh < 0)
       VG_(clo_vex_control).guest_chase_thresh = 0;
 
+   if (VG_(clo_shadow_call_stack)) {
+#     if defined(VGA_x86) || defined(VGA_amd64)
+      /* The shadow call stack is pushed at the end of each superblock
+         ending in a call, so calls must not be chased into. */
+      VG_(clo_vex_control).guest_chase_thresh = 0;
+#     else
+      /* Elsewhere, calls do not push the return address on the stack;
+         the option has no effect. */
+      VG_(clo_shadow_call_stack) = False;
+#     endif
+   }
+
    /* Check various option values */
 
    if (VG_(clo_verbosity) < 0)
@@ -1020,7 +1095,7 @@ void main_process_cmd_line_options( void )
    /* Register child at-fork handler which will take care of handling
       --child-silent-after-fork clo and also reopening output sinks for forked
       children, if requested via --log|xml-file= options. */
-   VG_(atfork)(NULL, NULL, VG_(logging_atfork_child));
+   VG_(atfork)(VG_(logging_atfork_pre), NULL, VG_(logging_atfork_child));
 
    // Suppressions related stuff
 
@@ -1094,6 +1169,103 @@ static void setup_file_descriptors(void)
 }
 
 
+/* Create fake /proc/<pid>/cmdline and /proc/<pid>/auxv files
+   and then unlink them, but hold onto the fds, so we can hand
+   them out to the client when it tries to open
+   /proc/<pid>/cmdline or /proc/<pid>/auxv for itself. */
+static void create_fake_proc_files ( void )
+{
+#if defined(VGO_linux) || defined(VGO_solaris)
+   HChar  buf[50];   // large enough
+   HChar  buf2[VG_(mkstemp_fullname_bufsz)(sizeof buf - 1)];
+   Int    fd, r;
+
+#if defined(VGO_linux) || defined(SOLARIS_PROC_CMDLINE)
+   /* Fake /proc/<pid>/cmdline only on Linux and Solaris if supported. */
+   HChar  nul[1];
+   const HChar* exename;
+   Int    i;
+
+   VG_(debugLog)(1, "main", "Create fake /proc/<pid>/cmdline\n");
+
+   VG_(sprintf)(buf, "proc_%d_cmdline", VG_(getpid)());
+   fd = VG_(mkstemp)( buf, buf2 );
+   if (fd == -1)
+      VG_(err_config_error)("Can't create client cmdline file in %s\n", buf2);
+
+   nul[0] = 0;
+   exename = VG_(args_the_exename);
+   VG_(write)(fd, exename, VG_(strlen)( exename ));
+   VG_(write)(fd, nul, 1);
+
+   for (i = 0; i < VG_(sizeXA)( VG_(args_for_client) ); i++) {
+      HChar* arg = * (HChar**) VG_(indexXA)( VG_(args_for_client), i );
+      VG_(write)(fd, arg, VG_(strlen)( arg ));
+      VG_(write)(fd, nul, 1);
+   }
+
+   /* Don't bother to seek the file back to the start; instead do
+	 it every time a copy of it is given out (by PRE(sys_open) or
+	 PRE(sys_openat)). That is probably more robust across fork() etc. */
+
+   /* Now delete it, but hang on to the fd. */
+   r = VG_(unlink)( buf2 );
+   if (r)
+      VG_(err_config_error)("Can't delete client cmdline file in %s\n", buf2);
+
+   VG_(cl_cmdline_fd) = fd;
+#endif // defined(VGO_linux) || defined(SOLARIS_PROC_CMDLINE)
+
+   /* Fake /proc/<pid>/auxv on both Linux and Solaris. */
+   VG_(debugLog)(1, "main", "Create fake /proc/<pid>/auxv\n");
+
+   VG_(sprintf)(buf, "proc_%d_auxv", VG_(getpid)());
+   fd = VG_(mkstemp)( buf, buf2 );
+   if (fd == -1)
+      VG_(err_config_error)("Can't create client auxv file in %s\n", buf2);
+
+   UWord *client_auxv = VG_(client_auxv);
+   unsigned int client_auxv_len = 0;
+   while (*client_auxv != 0) {
+      client_auxv++;
+      client_auxv++;
+      client_auxv_len += 2 * sizeof(UWord);
+   }
+   client_auxv_len += 2 * sizeof(UWord);
+
+   VG_(write)(fd, VG_(client_auxv), client_auxv_len);
+
+   /* Don't bother to seek the file back to the start; instead do
+	 it every time a copy of it is given out (by PRE(sys_open)). 
+	 That is probably more robust across fork() etc. */
+
+   /* Now delete it, but hang on to the fd. */
+   r = VG_(unlink)( buf2 );
+   if (r)
+      VG_(err_config_error)("Can't delete client auxv file in %s\n", buf2);
+
+   VG_(cl_auxv_fd) = fd;
+
+#if defined(VGO_solaris)
+   /* Fake /proc/<pid>/psinfo on Solaris.
+    * Contents will be fetched and partially faked later on the fly. */
+   VG_(debugLog)(1, "main", "Create fake /proc/<pid>/psinfo\n");
+
+   VG_(sprintf)(buf, "proc_%d_psinfo", VG_(getpid)());
+   fd = VG_(mkstemp)( buf, buf2 );
+   if (fd == -1)
+      VG_(err_config_error)("Can't create client psinfo file in %s\n", buf2);
+
+   /* Now delete it, but hang on to the fd. */
+   r = VG_(unlink)( buf2 );
+   if (r)
+      VG_(err_config_error)("Can't delete client psinfo file in %s\n", buf2);
+
+   VG_(cl_psinfo_fd) = fd;
+#endif /* VGO_solaris */
+#endif
+}
+
 /*====================================================================*/
 /*=== main()                                                       ===*/
 /*====================================================================*/
@@ -1466,8 +1638,11 @@ Int valgrind_main ( Int argc, HChar **argv, HChar **envp )
    //
    // p: _start_in_C (for zeroing out the_iicii and putting some
    //    initial values into it)
+   //
+   // With --server, this is done in each forked child instead, see
+   // "Start the server" below.
    //--------------------------------------------------------------
-   if (!need_help) {
+   if (!need_help && VG_(clo_server) == NULL) {
       VG_(debugLog)(1, "main", "Create initial image\n");
 
 #     if defined(VGO_linux) || defined(VGO_darwin) || defined(VGO_solaris)
@@ -1508,97 +1683,8 @@ Int valgrind_main ( Int argc, HChar **argv, HChar **envp )
 #if defined(VGO_solaris)
    VG_(cl_psinfo_fd) = -1;
 #endif
-
-#if defined(VGO_linux) || defined(VGO_solaris)
-   if (!need_help) {
-      HChar  buf[50];   // large enough
-      HChar  buf2[VG_(mkstemp_fullname_bufsz)(sizeof buf - 1)];
-      Int    fd, r;
-
-#if defined(VGO_linux) || defined(SOLARIS_PROC_CMDLINE)
-      /* Fake /proc/<pid>/cmdline only on Linux and Solaris if supported. */
-      HChar  nul[1];
-      const HChar* exename;
-
-      VG_(debugLog)(1, "main", "Create fake /proc/<pid>/cmdline\n");
-
-      VG_(sprintf)(buf, "proc_%d_cmdline", VG_(getpid)());
-      fd = VG_(mkstemp)( buf, buf2 );
-      if (fd == -1)
-         VG_(err_config_error)("Can't create client cmdline file in %s\n", buf2);
-
-      nul[0] = 0;
-      exename = VG_(args_the_exename);
-      VG_(write)(fd, exename, VG_(strlen)( exename ));
-      VG_(write)(fd, nul, 1);
-
-      for (i = 0; i < VG_(sizeXA)( VG_(args_for_client) ); i++) {
-         HChar* arg = * (HChar**) VG_(indexXA)( VG_(args_for_client), i );
-         VG_(write)(fd, arg, VG_(strlen)( arg ));
-         VG_(write)(fd, nul, 1);
-      }
-
-      /* Don't bother to seek the file back to the start; instead do
-	 it every time a copy of it is given out (by PRE(sys_open) or
-	 PRE(sys_openat)). That is probably more robust across fork() etc. */
-
-      /* Now delete it, but hang on to the fd. */
-      r = VG_(unlink)( buf2 );
-      if (r)
-         VG_(err_config_error)("Can't delete client cmdline file in %s\n", buf2);
-
-      VG_(cl_cmdline_fd) = fd;
-#endif // defined(VGO_linux) || defined(SOLARIS_PROC_CMDLINE)
-
-      /* Fake /proc/<pid>/auxv on both Linux and Solaris. */
-      VG_(debugLog)(1, "main", "Create fake /proc/<pid>/auxv\n");
-
-      VG_(sprintf)(buf, "proc_%d_auxv", VG_(getpid)());
-      fd = VG_(mkstemp)( buf, buf2 );
-      if (fd == -1)
-         VG_(err_config_error)("Can't create client auxv file in %s\n", buf2);
-
-      UWord *client_auxv = VG_(client_auxv);
-      unsigned int client_auxv_len = 0;
-      while (*client_auxv != 0) {
-         client_auxv++;
-         client_auxv++;
-         client_auxv_len += 2 * sizeof(UWord);
-      }
-      client_auxv_len += 2 * sizeof(UWord);
-
-      VG_(write)(fd, VG_(client_auxv), client_auxv_len);
-
-      /* Don't bother to seek the file back to the start; instead do
-	 it every time a copy of it is given out (by PRE(sys_open)). 
-	 That is probably more robust across fork() etc. */
-
-      /* Now delete it, but hang on to the fd. */
-      r = VG_(unlink)( buf2 );
-      if (r)
-         VG_(err_config_error)("Can't delete client auxv file in %s\n", buf2);
-
-      VG_(cl_auxv_fd) = fd;
-
-#if defined(VGO_solaris)
-      /* Fake /proc/<pid>/psinfo on Solaris.
-       * Contents will be fetched and partially faked later on the fly. */
-      VG_(debugLog)(1, "main", "Create fake /proc/<pid>/psinfo\n");
-
-      VG_(sprintf)(buf, "proc_%d_psinfo", VG_(getpid)());
-      fd = VG_(mkstemp)( buf, buf2 );
-      if (fd == -1)
-         VG_(err_config_error)("Can't create client psinfo file in %s\n", buf2);
-
-      /* Now delete it, but hang on to the fd. */
-      r = VG_(unlink)( buf2 );
-      if (r)
-         VG_(err_config_error)("Can't delete client psinfo file in %s\n", buf2);
-
-      VG_(cl_psinfo_fd) = fd;
-#endif /* VGO_solaris */
-   }
-#endif
+   if (!need_help && VG_(clo_server) == NULL)
+      create_fake_proc_files();
 
    //--------------------------------------------------------------
    // Init tool part 1: pre_clo_init
@@ -1644,9 +1730,11 @@ Int valgrind_main ( Int argc, HChar **argv, HChar **envp )
    //   p: main_process_cmd_line_options()
    //         [for VG_(clo_verbosity), VG_(clo_xml)]
    //--------------------------------------------------------------
-   VG_(debugLog)(1, "main", "Print the preamble...\n");
-   VG_(print_preamble)(VG_(log_output_sink).type != VgLogTo_File);
-   VG_(debugLog)(1, "main", "...finished the preamble\n");
+   if (VG_(clo_server) == NULL) {
+      VG_(debugLog)(1, "main", "Print the preamble...\n");
+      VG_(print_preamble)(VG_(log_output_sink).type != VgLogTo_File);
+      VG_(debugLog)(1, "main", "...finished the preamble\n");
+   }
 
    //--------------------------------------------------------------
    // Init tool part 2: post_clo_init
@@ -1685,6 +1773,36 @@ Int valgrind_main ( Int argc, HChar **argv, HChar **envp )
    VG_(debugLog)(1, "main", "Initialise redirects\n");
    VG_(redir_initialise)();
 
+#  if defined(VGO_linux)
+   //--------------------------------------------------------------
+   // Start the server, if requested.  Everything done so far is
+   // shared by all the clients; VG_(zygote_serve) only returns in a
+   // forked child that has taken over a client's fds, cwd and args.
+   // The child then does the client specific steps skipped above.
+   //   p: redir_initialise [last client independent step]
+   //   p: main_process_cmd_line_options() [for VG_(clo_suppressions)]
+   //--------------------------------------------------------------
+   if (VG_(clo_server) != NULL) {
+      if (VG_(needs).core_errors || VG_(needs).tool_errors) {
+         VG_(debugLog)(1, "main", "Load suppressions\n");
+         VG_(load_suppressions)();
+      }
+
+      VG_(debugLog)(1, "main", "Start the server\n");
+      the_iicii.argv     = argv;
+      the_iicii.envp     = VG_(zygote_serve)();
+      the_iicii.toolname = VG_(clo_toolname);
+
+      VG_(debugLog)(1, "main", "Create initial image\n");
+      the_iifii = VG_(ii_create_image)( the_iicii, &vex_archinfo );
+      create_fake_proc_files();
+
+      VG_(debugLog)(1, "main", "Print the preamble...\n");
+      VG_(print_preamble)(VG_(log_output_sink).type != VgLogTo_File);
+      VG_(debugLog)(1, "main", "...finished the preamble\n");
+   }
+#  endif
+
    //--------------------------------------------------------------
    // Allow GDB attach
    //   p: main_process_cmd_line_options()  [for VG_(clo_wait_for_gdb)]
@@ -2002,7 +2120,8 @@ Int valgrind_main ( Int argc, HChar **argv, HChar **envp )
    // Read suppression file
    //   p: main_process_cmd_line_options()  [for VG_(clo_suppressions)]
    //--------------------------------------------------------------
-   if (VG_(needs).core_errors || VG_(needs).tool_errors) {
+   if ((VG_(needs).core_errors || VG_(needs).tool_errors)
+       && VG_(clo_server) == NULL) {
       VG_(debugLog)(1, "main", "Load suppressions\n");
       VG_(load_suppressions)();
    }
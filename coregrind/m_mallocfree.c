@@ -56,6 +56,8 @@ Long VG_(free_queue_volume) = 0;
 Long VG_(free_queue_length) = 0;
 
 static void cc_analyse_alloc_arena ( ArenaId aid ); /* fwds */
+static void print_client_cache_stats ( void ); /* fwds */
+static Bool is_client_cached ( void* ptr, SizeT pszB ); /* fwds */
 
 /*------------------------------------------------------------*/
 /*--- Main types                                           ---*/
@@ -179,17 +181,48 @@ STATIC_ASSERT(VG_MIN_MALLOC_SZB % sizeof(void *) == 0);
 // created, and then can be split and the splittings remerged, but Blocks
 // always cover its entire length -- there's never any unused bytes at the
 // end, for example.
+// 'pool_pszB' is 0, except for the superblocks of the size-class pools
+// (see Pool below), which have no Blocks: their payload_bytes[] is an
+// array of pool_pszB sized payloads.
 typedef
    struct _Superblock {
       SizeT n_payload_bytes;
       struct _Superblock* unsplittable;
+      SizeT pool_pszB;
       UByte padding[ VG_MIN_MALLOC_SZB -
-                        ((sizeof(struct _Superblock*) + sizeof(SizeT)) %
+                        ((sizeof(struct _Superblock*) + 2 * sizeof(SizeT)) %
                          VG_MIN_MALLOC_SZB) ];
       UByte payload_bytes[0];
    }
    Superblock;
 
+// The small payloads allocated in the non-client arenas are taken from
+// size-class pools rather than made into Blocks: a payload of up to
+// POOL_MAX_PSZB bytes then costs no header, redzones or size fields, and
+// its allocation and freeing do not search or merge in the free lists.
+// Each pool hands out the payloads of its superblocks (marked with
+// their pool_pszB) by bumping 'bump' up to 'limit', and keeps the freed
+// ones in a LIFO list linked through their first word.  The superblocks
+// of a pool start small and double in size up to POOL_MAX_SB_SZB, so that
+// a pool of little use costs little.  The pools never give their
+// superblocks back.  They are not used with --profile-heap=yes
+// nor with a non default --core-redzone-size, as these want each
+// allocation to be a Block.
+#define POOL_MAX_PSZB   128
+#define N_POOLS         (POOL_MAX_PSZB / VG_MIN_MALLOC_SZB)
+#define POOL_MIN_SB_SZB 16384
+#define POOL_MAX_SB_SZB 1048576
+
+typedef
+   struct {
+      void* freelist;
+      Addr  bump;
+      Addr  limit;
+      SizeT n_inuse;       // payloads handed out and not freed
+      SizeT sb_szB;        // size of the next superblock
+   }
+   Pool;
+
 // An arena. 'freelist' is a circular, doubly-linked list.  'rz_szB' is
 // elastic, in that it can be bigger than asked-for to ensure alignment.
 typedef
@@ -222,6 +255,12 @@ typedef
       Superblock*  sblocks_initial[SBLOCKS_SIZE_INITIAL];
       Superblock*  deferred_reclaimed_sb;
 
+      // The size-class pools, for payloads of VG_MIN_MALLOC_SZB,
+      // 2*VG_MIN_MALLOC_SZB, ... POOL_MAX_PSZB bytes.  Only used if
+      // 'use_pools' is set.
+      Bool         use_pools;
+      Pool         pools[N_POOLS];
+
       // VG_(arena_perm_malloc) returns memory from superblocks
       // only used for permanent blocks. No overhead. These superblocks
       // are not stored in sblocks array above.
@@ -241,6 +280,7 @@ typedef
       ULong        stats__tot_blocks; /* total # blocks alloc'd */
       ULong        stats__tot_bytes; /* total # bytes alloc'd */
       ULong        stats__nsearches; /* total # freelist checks */
+      ULong        stats__pool_tot_blocks; /* total # blocks alloc'd in pools */
       // If profiling, when should the next profile happen at
       // (in terms of stats__bytes_on_loan_max) ?
       SizeT        next_profile_at;
@@ -248,6 +288,47 @@ typedef
    }
    Arena;
 
+static Bool is_pool_free ( Arena* a, Superblock* sb, void* ptr ); /* fwds */
+
+/* Size-class caches of the client arena.  Programs doing many small
+   allocations spend most of their time in the arena free lists:
+   searching them, splitting the block found, and merging it again
+   with its free neighbours when it is freed.  So the small blocks
+   freed in the client arena are first kept in a cache of the running
+   thread, which has a LIFO list per size class, ie. per
+   payload size up to CC_MAX_PSZB.  An allocation of one of these sizes
+   is then served from the cache, without looking at the free lists.
+
+   The cached blocks stay marked as in use, with their normal layout
+   (headers and redzones), so that for the rest of this file and for
+   the tools they are ordinary blocks.  The link to the next block of
+   a list is in the first word of the payload.  The caches are bounded,
+   and a block which does not fit is freed as usual. */
+
+#define CC_MAX_PSZB     512
+#define CC_N_CLASSES    (CC_MAX_PSZB / VG_MIN_MALLOC_SZB + 1)
+#define CC_MAX_BLOCKS   64      // per size class and thread
+#define CC_MAX_SZB      65536   // payload bytes per thread
+
+typedef
+   struct {
+      void* head[CC_N_CLASSES];     // payloads, linked by their first word
+      UInt  n_blocks[CC_N_CLASSES];
+      SizeT szB;                    // payload bytes in all the lists
+   }
+   ClientCache;
+
+static ClientCache* client_caches;     // indexed by ThreadId
+static UInt         n_client_caches;
+
+// Stats only
+static ULong stats__cc_hits;
+static ULong stats__cc_misses;
+static ULong stats__cc_frees;
+static ULong stats__cc_overflows;
+static SizeT stats__cc_blocks;          // blocks currently cached
+static SizeT stats__cc_szB;             // payload bytes currently cached
+
 
 /*------------------------------------------------------------*/
 /*--- Low-level functions for working with Blocks.         ---*/
@@ -606,6 +687,11 @@ void arena_init ( ArenaId aid, const HChar* name, SizeT rz_szB,
    a->sblocks_size             = SBLOCKS_SIZE_INITIAL;
    a->sblocks_used             = 0;
    a->deferred_reclaimed_sb    = 0;
+   a->use_pools                = VG_AR_CLIENT != aid
+                                 && !VG_(clo_profile_heap)
+                                 && VG_(clo_core_redzone_size)
+                                    == CORE_REDZONE_DEFAULT_SZB;
+   VG_(memset)(a->pools, 0, sizeof(a->pools));
    a->perm_malloc_current      = 0;
    a->perm_malloc_limit        = 0;
    a->stats__perm_bytes_on_loan= 0;
@@ -619,6 +705,7 @@ void arena_init ( ArenaId aid, const HChar* name, SizeT rz_szB,
    a->stats__tot_blocks        = 0;
    a->stats__tot_bytes         = 0;
    a->stats__nsearches         = 0;
+   a->stats__pool_tot_blocks   = 0;
    a->next_profile_at          = 25 * 1000 * 1000;
    vg_assert(sizeof(a->sblocks_initial) 
              == SBLOCKS_SIZE_INITIAL * sizeof(Superblock*));
@@ -627,7 +714,7 @@ void arena_init ( ArenaId aid, const HChar* name, SizeT rz_szB,
 /* Print vital stats for an arena. */
 void VG_(print_all_arena_stats) ( void )
 {
-   UInt i;
+   UInt i, j;
    for (i = 0; i < VG_N_ARENAS; i++) {
       Arena* a = arenaId_to_ArenaP(i);
       VG_(message)(Vg_DebugMsg,
@@ -645,7 +732,22 @@ void VG_(print_all_arena_stats) ( void )
                    a->stats__nsearches,
                    a->rz_szB
       );
+      if (a->stats__pool_tot_blocks > 0) {
+         SizeT n_inuse = 0, inuse_szB = 0;
+         for (j = 0; j < N_POOLS; j++) {
+            n_inuse   += a->pools[j].n_inuse;
+            inuse_szB += a->pools[j].n_inuse * (j + 1) * VG_MIN_MALLOC_SZB;
+         }
+         VG_(message)(Vg_DebugMsg,
+                      "%-8s: pools: %'lu/%'lu curr blocks/bytes, "
+                      "%'lu overhead bytes saved,"
+                      "  %10llu totalloc-blocks\n",
+                      a->name, n_inuse, inuse_szB,
+                      n_inuse * overhead_szB(a),
+                      a->stats__pool_tot_blocks);
+      }
    }
+   print_client_cache_stats();
 }
 
 void VG_(print_arena_cc_analysis) ( void )
@@ -828,7 +930,7 @@ void deferred_reclaimSuperblock ( Arena* a, Superblock* sb);
 // If not enough memory available, either aborts (for non-client memory)
 // or returns 0 (for client memory).
 static
-Superblock* newSuperblock ( Arena* a, SizeT cszB )
+Superblock* newSuperblock ( Arena* a, SizeT cszB, SizeT pool_pszB )
 {
    Superblock* sb;
    SysRes      sres;
@@ -847,10 +949,11 @@ Superblock* newSuperblock ( Arena* a, SizeT cszB )
    // Take into account admin bytes in the Superblock.
    cszB += sizeof(Superblock);
 
-   if (cszB < a->min_sblock_szB) cszB = a->min_sblock_szB;
+   // Pool superblocks are of the size asked for, and never unsplittable.
+   if (cszB < a->min_sblock_szB && pool_pszB == 0) cszB = a->min_sblock_szB;
    cszB = VG_PGROUNDUP(cszB);
 
-   if (cszB >= a->min_unsplittable_sblock_szB)
+   if (cszB >= a->min_unsplittable_sblock_szB && pool_pszB == 0)
       unsplittable = True;
    else
       unsplittable = False;   
@@ -879,6 +982,7 @@ Superblock* newSuperblock ( Arena* a, SizeT cszB )
    vg_assert(0 == (Addr)sb % VG_MIN_MALLOC_SZB);
    sb->n_payload_bytes = cszB - sizeof(Superblock);
    sb->unsplittable = (unsplittable ? sb : NULL);
+   sb->pool_pszB = pool_pszB;
    a->stats__bytes_mmaped += cszB;
    if (a->stats__bytes_mmaped > a->stats__bytes_mmaped_max)
       a->stats__bytes_mmaped_max = a->stats__bytes_mmaped;
@@ -890,6 +994,47 @@ Superblock* newSuperblock ( Arena* a, SizeT cszB )
    return sb;
 }
 
+// Insert new_sb in the sorted superblock array of a.
+static
+void addSuperblock ( Arena* a, Superblock* new_sb )
+{
+   UInt i;
+
+   vg_assert(a->sblocks_used <= a->sblocks_size);
+   if (a->sblocks_used == a->sblocks_size) {
+      Superblock ** array;
+      SysRes sres = VG_(am_mmap_anon_float_valgrind)(sizeof(Superblock *) *
+                                                     a->sblocks_size * 2);
+      if (sr_isError(sres)) {
+         VG_(out_of_memory_NORETURN)("arena_init", sizeof(Superblock *) * 
+                                                   a->sblocks_size * 2);
+         /* NOTREACHED */
+      }
+      array = (Superblock**)(Addr)sr_Res(sres);
+      for (i = 0; i < a->sblocks_used; ++i) array[i] = a->sblocks[i];
+
+      a->sblocks_size *= 2;
+      a->sblocks = array;
+      VG_(debugLog)(1, "mallocfree", 
+                       "sblock array for arena `%s' resized to %lu\n", 
+                       a->name, a->sblocks_size);
+   }
+
+   vg_assert(a->sblocks_used < a->sblocks_size);
+   
+   i = a->sblocks_used;
+   while (i > 0) {
+      if (a->sblocks[i-1] > new_sb) {
+         a->sblocks[i] = a->sblocks[i-1];
+      } else {
+         break;
+      }
+      --i;
+   }   
+   a->sblocks[i] = new_sb;
+   a->sblocks_used++;
+}
+
 // Reclaims the given superblock:
 //  * removes sb from arena sblocks list.
 //  * munmap the superblock segment.
@@ -1288,6 +1433,10 @@ void ppSuperblocks ( Arena* a )
       VG_(printf)( "superblock %u at %p %s, sb->n_pl_bs = %lu\n",
                    blockno++, sb, (sb->unsplittable ? "unsplittable" : ""),
                    sb->n_payload_bytes);
+      if (sb->pool_pszB > 0) {
+         VG_(printf)( "   pool of %lu bytes payloads\n", sb->pool_pszB );
+         continue;
+      }
       for (i = 0; i < sb->n_payload_bytes; i += b_bszB) {
          Block* b = (Block*)&sb->payload_bytes[i];
          b_bszB   = get_bszB(b);
@@ -1336,6 +1485,16 @@ static void sanity_check_malloc_arena ( ArenaId aid )
       Superblock * sb = a->sblocks[j];
       lastWasFree = False;
       superblockctr++;
+      if (sb->pool_pszB > 0) {
+         // Only payloads in there, checked with the pools below.
+         if (!a->use_pools || sb->pool_pszB > POOL_MAX_PSZB
+             || sb->pool_pszB % VG_MIN_MALLOC_SZB != 0) {
+            VG_(printf)("sanity_check_malloc_arena: sb %p: "
+                        "BAD POOL SIZE %lu\n", sb, sb->pool_pszB);
+            BOMB;
+         }
+         continue;
+      }
       for (i = 0; i < sb->n_payload_bytes; i += mk_plain_bszB(b_bszB)) {
          blockctr_sb++;
          b     = (Block*)&sb->payload_bytes[i];
@@ -1365,6 +1524,26 @@ static void sanity_check_malloc_arena ( ArenaId aid )
 
    arena_bytes_on_loan += a->stats__perm_bytes_on_loan;
 
+   // Check the free lists of the pools, and count their payloads on loan.
+   for (listno = 0; listno < N_POOLS; listno++) {
+      Pool* pool = &a->pools[listno];
+      void* v;
+      for (v = pool->freelist; v != NULL; v = *(void**)v) {
+         Superblock* sb = maybe_findSb( a, (Addr)v );
+         if (sb == NULL || sb->pool_pszB != (listno + 1) * VG_MIN_MALLOC_SZB
+             || ((Addr)v - (Addr)&sb->payload_bytes[0]) % sb->pool_pszB) {
+            VG_(printf)( "sanity_check_malloc_arena: pool %u at %p: "
+                         "BAD FREE PAYLOAD\n", listno, v );
+            BOMB;
+         }
+      }
+      arena_bytes_on_loan += pool->n_inuse * (listno + 1) * VG_MIN_MALLOC_SZB;
+   }
+
+   // The blocks in the size-class caches are in use, but not on loan.
+   if (aid == VG_AR_CLIENT)
+      arena_bytes_on_loan -= stats__cc_szB;
+
    if (arena_bytes_on_loan != a->stats__bytes_on_loan) {
 #     ifdef VERBOSE_MALLOC
       VG_(printf)( "sanity_check_malloc_arena: a->bytes_on_loan %lu, "
@@ -1582,6 +1761,13 @@ void VG_(describe_arena_addr) ( Addr a, AddrArenaInfo* aai )
 
          aai->aid = i;
          aai->name = arena->name;
+         if (sb->pool_pszB > 0) {
+            aai->block_szB = sb->pool_pszB;
+            aai->rwoffset = (a - (Addr)&sb->payload_bytes[0])
+                            % sb->pool_pszB;
+            aai->free = is_pool_free(arena, sb, (void*)(a - aai->rwoffset));
+            return;
+         }
          for (j = 0; j < sb->n_payload_bytes; j += mk_plain_bszB(b_bszB)) {
             b     = (Block*)&sb->payload_bytes[j];
             b_bszB = get_bszB_as_is(b);
@@ -1591,7 +1777,10 @@ void VG_(describe_arena_addr) ( Addr a, AddrArenaInfo* aai )
          vg_assert (b);
          aai->block_szB = get_pszB(arena, b);
          aai->rwoffset = a - (Addr)get_block_payload(arena, b);
-         aai->free = !is_inuse_block(b);
+         aai->free = !is_inuse_block(b)
+                     || (i == VG_AR_CLIENT
+                         && is_client_cached(get_block_payload(arena, b),
+                                             aai->block_szB));
          return;
       }
    }
@@ -1733,13 +1922,206 @@ void add_one_block_to_stats (Arena* a, SizeT loaned)
    a->stats__tot_bytes  += (ULong)loaned;
 }
 
+/*------------------------------------------------------------*/
+/*--- Size-class pools for the non-client arenas.          ---*/
+/*------------------------------------------------------------*/
+
+// Return the pool superblock holding the payload ptr, or NULL if ptr is
+// the payload of a Block.
+static __inline__
+Superblock* findPoolSb ( Arena* a, void* ptr )
+{
+   Superblock* sb;
+   if (!a->use_pools)
+      return NULL;
+   sb = findSb( a, (Block*)ptr );
+   return sb->pool_pszB > 0 ? sb : NULL;
+}
+
+// Allocate a payload of pszB bytes (aligned, at most POOL_MAX_PSZB)
+// from the pool of that size.
+static
+void* pool_malloc ( Arena* a, SizeT pszB )
+{
+   Pool* pool;
+   void* v;
+
+   if (pszB == 0)
+      pszB = VG_MIN_MALLOC_SZB;
+   pool = &a->pools[pszB / VG_MIN_MALLOC_SZB - 1];
+
+   if (pool->freelist != NULL) {
+      v = pool->freelist;
+      INNER_REQUEST(VALGRIND_MAKE_MEM_DEFINED(v, sizeof(void*)));
+      pool->freelist = *(void**)v;
+   } else {
+      if (pool->bump + pszB > pool->limit) {
+         Superblock* sb;
+         if (pool->sb_szB == 0)
+            pool->sb_szB = POOL_MIN_SB_SZB;
+         sb = newSuperblock(a, pool->sb_szB - sizeof(Superblock), pszB);
+         if (pool->sb_szB < POOL_MAX_SB_SZB)
+            pool->sb_szB *= 2;
+         addSuperblock(a, sb);
+         pool->bump  = (Addr)&sb->payload_bytes[0];
+         pool->limit = pool->bump
+                       + sb->n_payload_bytes / pszB * pszB;
+      }
+      v = (void*)pool->bump;
+      pool->bump += pszB;
+   }
+   pool->n_inuse++;
+   a->stats__pool_tot_blocks++;
+   add_one_block_to_stats (a, pszB);
+
+   INNER_REQUEST(VALGRIND_MALLOCLIKE_BLOCK(v, pszB, 0, False));
+   return v;
+}
+
+// Give back the payload ptr to the pool of sb.
+static
+void pool_free ( Arena* a, Superblock* sb, void* ptr )
+{
+   SizeT pszB = sb->pool_pszB;
+   Pool* pool = &a->pools[pszB / VG_MIN_MALLOC_SZB - 1];
+
+   vg_assert2(((Addr)ptr - (Addr)&sb->payload_bytes[0]) % pszB == 0,
+              probably_your_fault);
+   vg_assert(pool->n_inuse > 0);
+   pool->n_inuse--;
+   a->stats__bytes_on_loan -= pszB;
+
+   // As for a Block, fill it up with junk (see VG_(arena_free)).
+   VG_(memset)(ptr, 0xDD, pszB);
+   *(void**)ptr = pool->freelist;
+   pool->freelist = ptr;
+   INNER_REQUEST(VALGRIND_FREELIKE_BLOCK(ptr, 0));
+   INNER_REQUEST(VALGRIND_MAKE_MEM_NOACCESS(ptr, pszB));
+}
+
+// Is the payload at ptr of the pool superblock sb free ?  Slow, only used
+// to describe addresses.
+static
+Bool is_pool_free ( Arena* a, Superblock* sb, void* ptr )
+{
+   Pool* pool = &a->pools[sb->pool_pszB / VG_MIN_MALLOC_SZB - 1];
+   void* v;
+
+   if ((Addr)ptr >= pool->bump && (Addr)ptr < pool->limit)
+      return True;   // Not yet handed out.
+   if ((Addr)ptr >= (Addr)&sb->payload_bytes[0]
+                    + sb->n_payload_bytes / sb->pool_pszB * sb->pool_pszB)
+      return True;   // In the unused tail of sb.
+   for (v = pool->freelist; v != NULL; v = *(void**)v)
+      if (v == ptr)
+         return True;
+   return False;
+}
+
+/*------------------------------------------------------------*/
+/*--- Size-class caches for the client arena.              ---*/
+/*------------------------------------------------------------*/
+
+static ClientCache* get_client_cache ( void )
+{
+   ThreadId tid = VG_(running_tid);
+   if (UNLIKELY(tid == VG_INVALID_THREADID))
+      return NULL;
+   if (UNLIKELY(tid >= n_client_caches))
+      VG_(grow_thread_array)("mallocfree.gcc.1", (void**)&client_caches,
+                             &n_client_caches, sizeof(ClientCache), tid + 1);
+   return &client_caches[tid];
+}
+
+/* Take a block of payload size pszB (aligned) from the running
+   thread's cache, or return NULL if there is none. */
+static void* client_cache_malloc ( Arena* a, SizeT pszB )
+{
+   ClientCache* cache = get_client_cache();
+   UInt         cls = pszB / VG_MIN_MALLOC_SZB;
+   void*        v;
+
+   if (cache == NULL || cache->head[cls] == NULL) {
+      stats__cc_misses++;
+      return NULL;
+   }
+   v = cache->head[cls];
+   cache->head[cls] = *(void**)v;
+   cache->n_blocks[cls]--;
+   cache->szB -= pszB;
+   stats__cc_hits++;
+   stats__cc_blocks--;
+   stats__cc_szB -= pszB;
+
+   add_one_block_to_stats (a, pszB);
+   INNER_REQUEST(VALGRIND_MALLOCLIKE_BLOCK(v, pszB, a->rz_szB, False));
+   return v;
+}
+
+/* Put the freed block v, of payload size pszB, in the running thread's
+   cache.  Returns False if it does not fit there. */
+static Bool client_cache_free ( Arena* a, void* v, SizeT pszB )
+{
+   ClientCache* cache = get_client_cache();
+   UInt         cls = pszB / VG_MIN_MALLOC_SZB;
+
+   vg_assert(pszB <= CC_MAX_PSZB && pszB % VG_MIN_MALLOC_SZB == 0);
+   if (cache == NULL
+       || cache->n_blocks[cls] >= CC_MAX_BLOCKS
+       || cache->szB + pszB > CC_MAX_SZB) {
+      stats__cc_overflows++;
+      return False;
+   }
+
+   INNER_REQUEST(VALGRIND_FREELIKE_BLOCK(v, 0));
+   INNER_REQUEST(VALGRIND_MAKE_MEM_DEFINED(v, sizeof(void*)));
+   *(void**)v = cache->head[cls];
+   cache->head[cls] = v;
+   cache->n_blocks[cls]++;
+   cache->szB += pszB;
+   stats__cc_frees++;
+   stats__cc_blocks++;
+   stats__cc_szB += pszB;
+   return True;
+}
+
+/* Is the block with payload ptr of size pszB in a cache ?  Slow, only
+   used to describe addresses. */
+static Bool is_client_cached ( void* ptr, SizeT pszB )
+{
+   UInt  tid;
+   void* v;
+
+   if (pszB > CC_MAX_PSZB)
+      return False;
+   for (tid = 0; tid < n_client_caches; tid++)
+      for (v = client_caches[tid].head[pszB / VG_MIN_MALLOC_SZB];
+           v != NULL; v = *(void**)v)
+         if (v == ptr)
+            return True;
+   return False;
+}
+
+static void print_client_cache_stats ( void )
+{
+   if (!client_inited)
+      return;
+   VG_(message)(Vg_DebugMsg,
+                "client  : size-class caches: %'llu hits, %'llu misses,"
+                " %'llu frees cached, %'llu not;"
+                " %'lu blocks (%'lu bytes) cached\n",
+                stats__cc_hits, stats__cc_misses,
+                stats__cc_frees, stats__cc_overflows,
+                stats__cc_blocks, stats__cc_szB);
+}
+
 /* Allocate a piece of memory of req_pszB bytes on the given arena.
    The function may return NULL if (and only if) aid == VG_AR_CLIENT.
    Otherwise, the function returns a non-NULL value. */
 void* VG_(arena_malloc) ( ArenaId aid, const HChar* cc, SizeT req_pszB )
 {
    SizeT       req_bszB, frag_bszB, b_bszB;
-   UInt        lno, i;
+   UInt        lno;
    Superblock* new_sb = NULL;
    Block*      b = NULL;
    Arena*      a;
@@ -1753,10 +2135,19 @@ void* VG_(arena_malloc) ( ArenaId aid, const HChar* cc, SizeT req_pszB )
    req_pszB = align_req_pszB(req_pszB);
    req_bszB = pszB_to_bszB(a, req_pszB);
 
+   if (aid == VG_AR_CLIENT && req_pszB <= CC_MAX_PSZB) {
+      v = client_cache_malloc(a, req_pszB);
+      if (v != NULL)
+         return v;
+   }
+
    // You must provide a cost-center name against which to charge
    // this allocation; it isn't optional.
    vg_assert(cc);
 
+   if (a->use_pools && req_pszB <= POOL_MAX_PSZB)
+      return pool_malloc(a, req_pszB);
+
    // Scan through all the big-enough freelists for a block.
    //
    // Nb: this scanning might be expensive in some cases.  Eg. if you
@@ -1805,7 +2196,7 @@ void* VG_(arena_malloc) ( ArenaId aid, const HChar* cc, SizeT req_pszB )
 
    // If we reach here, no suitable block found, allocate a new superblock
    vg_assert(lno == N_MALLOC_LISTS);
-   new_sb = newSuperblock(a, req_bszB);
+   new_sb = newSuperblock(a, req_bszB, 0);
    if (NULL == new_sb) {
       // Should only fail if for client, otherwise, should have aborted
       // already.
@@ -1813,39 +2204,7 @@ void* VG_(arena_malloc) ( ArenaId aid, const HChar* cc, SizeT req_pszB )
       return NULL;
    }
 
-   vg_assert(a->sblocks_used <= a->sblocks_size);
-   if (a->sblocks_used == a->sblocks_size) {
-      Superblock ** array;
-      SysRes sres = VG_(am_mmap_anon_float_valgrind)(sizeof(Superblock *) *
-                                                     a->sblocks_size * 2);
-      if (sr_isError(sres)) {
-         VG_(out_of_memory_NORETURN)("arena_init", sizeof(Superblock *) * 
-                                                   a->sblocks_size * 2);
-         /* NOTREACHED */
-      }
-      array = (Superblock**)(Addr)sr_Res(sres);
-      for (i = 0; i < a->sblocks_used; ++i) array[i] = a->sblocks[i];
-
-      a->sblocks_size *= 2;
-      a->sblocks = array;
-      VG_(debugLog)(1, "mallocfree", 
-                       "sblock array for arena `%s' resized to %lu\n", 
-                       a->name, a->sblocks_size);
-   }
-
-   vg_assert(a->sblocks_used < a->sblocks_size);
-   
-   i = a->sblocks_used;
-   while (i > 0) {
-      if (a->sblocks[i-1] > new_sb) {
-         a->sblocks[i] = a->sblocks[i-1];
-      } else {
-         break;
-      }
-      --i;
-   }   
-   a->sblocks[i] = new_sb;
-   a->sblocks_used++;
+   addSuperblock(a, new_sb);
 
    b = (Block*)&new_sb->payload_bytes[0];
    lno = pszB_to_listNo(bszB_to_pszB(a, new_sb->n_payload_bytes));
@@ -2098,6 +2457,16 @@ void VG_(arena_free) ( ArenaId aid, void* ptr )
    if (ptr == NULL) {
       return;
    }
+
+   if (a->use_pools) {
+      sb = findSb( a, (Block*)ptr );
+      if (sb->pool_pszB > 0) {
+         pool_free(a, sb, ptr);
+         return;
+      }
+   } else {
+      sb = NULL;
+   }
       
    b = get_payload_block(a, ptr);
 
@@ -2108,10 +2477,15 @@ void VG_(arena_free) ( ArenaId aid, void* ptr )
 
    b_bszB   = get_bszB(b);
    b_pszB   = bszB_to_pszB(a, b_bszB);
-   sb       = findSb( a, b );
+   if (sb == NULL)
+      sb    = findSb( a, b );
 
    a->stats__bytes_on_loan -= b_pszB;
 
+   if (aid == VG_AR_CLIENT && b_pszB <= CC_MAX_PSZB && !sb->unsplittable
+       && client_cache_free(a, ptr, b_pszB))
+      return;
+
    /* If this is one of V's areas, fill it up with junk to enhance the
       chances of catching any later reads of it.  Note, 0xDD is
       carefully chosen junk :-), in that: (1) 0xDDDDDDDD is an invalid
@@ -2257,9 +2631,13 @@ void* VG_(arena_memalign) ( ArenaId aid, const HChar* cc,
          as unsplittable superblocks cannot be split. */
       const SizeT save_min_unsplittable_sblock_szB 
          = a->min_unsplittable_sblock_szB;
+      const Bool save_use_pools = a->use_pools;
       a->min_unsplittable_sblock_szB = MAX_PSZB;
+      /* For the same reason, it must not come from a pool. */
+      a->use_pools = False;
       base_p = VG_(arena_malloc) ( aid, cc, base_pszB_req );
       a->min_unsplittable_sblock_szB = save_min_unsplittable_sblock_szB;
+      a->use_pools = save_use_pools;
    }
    a->stats__bytes_on_loan = saved_bytes_on_loan;
 
@@ -2333,7 +2711,11 @@ void* VG_(arena_memalign) ( ArenaId aid, const HChar* cc,
 SizeT VG_(arena_malloc_usable_size) ( ArenaId aid, void* ptr )
 {
    Arena* a = arenaId_to_ArenaP(aid);
-   Block* b = get_payload_block(a, ptr);
+   Superblock* sb = findPoolSb(a, ptr);
+   Block* b;
+   if (sb != NULL)
+      return sb->pool_pszB;
+   b = get_payload_block(a, ptr);
    return get_pszB(a, b);
 }
 
@@ -2387,14 +2769,14 @@ void VG_(mallinfo) ( ThreadId tid, struct vg_mallinfo* mi )
    // We don't have fastbins so smblks & fsmblks are always 0. Also we don't
    // have a separate mmap allocator so set hblks & hblkhd to 0.
    mi->arena    = a->stats__bytes_mmaped;
-   mi->ordblks  = free_blocks + VG_(free_queue_length);
+   mi->ordblks  = free_blocks + stats__cc_blocks + VG_(free_queue_length);
    mi->smblks   = 0;
    mi->hblks    = 0;
    mi->hblkhd   = 0;
    mi->usmblks  = 0;
    mi->fsmblks  = 0;
    mi->uordblks = a->stats__bytes_on_loan - VG_(free_queue_volume);
-   mi->fordblks = free_blocks_size + VG_(free_queue_volume);
+   mi->fordblks = free_blocks_size + stats__cc_szB + VG_(free_queue_volume);
    mi->keepcost = 0; // may want some value in here
 }
 
@@ -2436,6 +2818,7 @@ void* VG_(arena_realloc) ( ArenaId aid, const HChar* cc,
    SizeT  old_pszB;
    void*  p_new;
    Block* b;
+   Superblock* sb;
 
    ensure_mm_init(aid);
    a = arenaId_to_ArenaP(aid);
@@ -2451,11 +2834,16 @@ void* VG_(arena_realloc) ( ArenaId aid, const HChar* cc,
       return NULL;
    }
 
-   b = get_payload_block(a, ptr);
-   vg_assert(blockSane(a, b));
+   sb = findPoolSb(a, ptr);
+   if (sb != NULL) {
+      old_pszB = sb->pool_pszB;
+   } else {
+      b = get_payload_block(a, ptr);
+      vg_assert(blockSane(a, b));
 
-   vg_assert(is_inuse_block(b));
-   old_pszB = get_pszB(a, b);
+      vg_assert(is_inuse_block(b));
+      old_pszB = get_pszB(a, b);
+   }
 
    if (req_pszB <= old_pszB) {
       return ptr;
@@ -2483,6 +2871,9 @@ void VG_(arena_realloc_shrink) ( ArenaId aid,
    ensure_mm_init(aid);
 
    a = arenaId_to_ArenaP(aid);
+   // A pool payload cannot be shrunk.
+   if (findPoolSb(a, ptr) != NULL)
+      return;
    b = get_payload_block(a, ptr);
    vg_assert(blockSane(a, b));
    vg_assert(is_inuse_block(b));
@@ -2612,7 +3003,7 @@ void* VG_(arena_perm_malloc) ( ArenaId aid, SizeT size, Int align  )
       // The superblock structure is not needed, so we will use the full
       // memory range of it. This superblock is however counted in the
       // mmaped statistics.
-      Superblock* new_sb = newSuperblock (a, size);
+      Superblock* new_sb = newSuperblock (a, size, 0);
       a->perm_malloc_limit = (Addr)&new_sb->payload_bytes[new_sb->n_payload_bytes - 1];
 
       // We do not mind starting allocating from the beginning of the superblock
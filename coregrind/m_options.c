@@ -84,6 +84,7 @@ Bool   VG_(clo_child_silent_after_fork) = False;
 const HChar *VG_(clo_log_fname_unexpanded) = NULL;
 const HChar *VG_(clo_xml_fname_unexpanded) = NULL;
 Bool   VG_(clo_time_stamp)     = False;
+Bool   VG_(clo_output_buffering) = True;
 Int    VG_(clo_input_fd)       = 0; /* stdin */
 Bool   VG_(clo_default_supp)   = True;
 XArray *VG_(clo_suppressions);   // array of strings
@@ -123,10 +124,16 @@ Bool VG_(clo_xtree_compress_strings) = True;
 Int    VG_(clo_dump_error)     = 0;
 Int    VG_(clo_backtrace_size) = 12;
 Int    VG_(clo_merge_recursive_frames) = 0; // default value: no merge
+VgUnwind VG_(clo_unwind)       = Vg_UnwindCFI;
+Bool VG_(clo_shadow_call_stack) = False;
 UInt   VG_(clo_sim_hints)      = 0;
 Bool   VG_(clo_sym_offsets)    = False;
 Bool   VG_(clo_read_inline_info) = False; // Or should be put it to True by default ???
 Bool   VG_(clo_read_var_info)  = False;
+Bool   VG_(clo_lazy_debuginfo) = False;
+Int    VG_(clo_debuginfo_helpers) = 0;
+Long   VG_(clo_debuginfo_helpers_min_size) = 1024 * 1024;
+const HChar* VG_(clo_debuginfo_cache_dir) = NULL;
 XArray *VG_(clo_req_tsyms);  // array of strings
 Bool   VG_(clo_run_libc_freeres) = True;
 Bool   VG_(clo_run_cxx_freeres) = True;
@@ -164,6 +171,10 @@ UInt VG_(clo_resync_filter) = 1; /* enabled, but quiet */
 UInt VG_(clo_resync_filter) = 0; /* disabled */
 #endif
 
+VgHugePages VG_(clo_huge_pages) = Vg_HugePagesNo;
+Long VG_(clo_max_tool_memory) = 0; /* 0 == no limit */
+const HChar* VG_(clo_server) = NULL;
+
 
 /*====================================================================*/
 /*=== File expansion                                               ===*/
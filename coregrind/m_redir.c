@@ -246,9 +246,38 @@ typedef
       /* VARIABLE PARTS -- used transiently whilst processing redirections */
       Bool   mark; /* set if spec requires further processing */
       Bool   done; /* set if spec was successfully matched */
+      /* INDEX PARTS -- set when the owning TopSpec's index is built */
+      struct _Spec* inext; /* next spec in the same index chain */
+      UInt   ord;          /* position of the spec in the list */
+      UInt   sopatt_ix;    /* index of from_sopatt in SpecIndex.sopatts */
    }
    Spec;
 
+/* An index of the specs of a TopSpec, so that the symbols of a
+   DebugInfo need not be matched against each spec in turn.  Specs
+   whose fnname pattern is a literal are chained in the bucket of the
+   hash of the whole name.  Specs whose pattern starts with at least
+   SPEC_PREFIX_LEN literal characters are chained in the bucket of the
+   hash of that prefix.  The few remaining specs are kept in the
+   residual list, and tried against every symbol.  All chains are in
+   list order (increasing .ord).
+
+   Also, the distinct soname patterns are listed in sopatts, as many
+   specs share the same one: each needs to be matched against a
+   soname only once. */
+#define SPEC_PREFIX_LEN 8
+
+typedef
+   struct {
+      UInt    n_buckets;
+      Spec**  buckets;
+      Spec*   residual;
+      UInt    n_sopatts;
+      const HChar** sopatts;
+      Bool*   sopatt_marks;
+   }
+   SpecIndex;
+
 /* Top-level data structure.  It contains a pointer to a DebugInfo and
    also a list of the specs harvested from that DebugInfo.  Note that
    seginfo is allowed to be NULL, meaning that the specs are
@@ -259,6 +288,7 @@ typedef
       struct _TopSpec* next; /* linked list */
       const DebugInfo* seginfo;    /* symbols etc */
       Spec*      specs;      /* specs pulled out of seginfo */
+      SpecIndex* index;      /* index of specs, NULL if not built yet */
       Bool       mark; /* transient temporary used during deletion */
    }
    TopSpec;
@@ -297,6 +327,12 @@ static OSet* activeSet = NULL;
 /* Wrapper routine for indirect functions */
 static Addr iFuncWrapper;
 
+/* Stats, for --stats=yes */
+static UInt  stats__redir_notify_new = 0;
+static UInt  stats__redir_notify_delete = 0;
+static UInt  stats__redir_ms = 0;
+static ULong stats__redir_fnpatt_matches = 0;
+
 /*------------------------------------------------------------*/
 /*--- FWDses                                               ---*/
 /*------------------------------------------------------------*/
@@ -316,14 +352,15 @@ static void   handle_maybe_load_notifier( const HChar* soname,
 
 static void   handle_require_text_symbols ( const DebugInfo* );
 
+static void   free_spec_index ( TopSpec* ts );
+
 /*------------------------------------------------------------*/
 /*--- NOTIFICATIONS                                        ---*/
 /*------------------------------------------------------------*/
 
 static 
 void generate_and_add_actives ( 
-        /* spec list and the owning TopSpec */
-        Spec*    specs, 
+        /* the TopSpec owning the specs */
         TopSpec* parent_spec,
 	/* debuginfo and the owning TopSpec */
         const DebugInfo* di,
@@ -404,6 +441,7 @@ void VG_(redir_notify_new_DebugInfo)( const DebugInfo* newdi )
    Bool         isText;
    const HChar* newdi_soname;
    Bool         dehacktivate_pthread_stack_cache_var_search = False;
+   UInt         start_ms = VG_(read_millisecond_timer)();
    const HChar* const pthread_soname = "libpthread.so.0";
    const HChar* const pthread_stack_cache_actsize_varname
       = "stack_cache_actsize";
@@ -713,6 +751,7 @@ void VG_(redir_notify_new_DebugInfo)( const DebugInfo* newdi )
    newts->next    = NULL; /* not significant */
    newts->seginfo = newdi;
    newts->specs   = specList;
+   newts->index   = NULL; /* built when first needed */
    newts->mark    = False; /* not significant */
 
    /* We now need to augment the active set with the following partial
@@ -735,19 +774,19 @@ void VG_(redir_notify_new_DebugInfo)( const DebugInfo* newdi )
    /* Case (1) */
    for (ts = topSpecs; ts; ts = ts->next) {
       if (ts->seginfo)
-         generate_and_add_actives( specList,    newts,
+         generate_and_add_actives( newts,
                                    ts->seginfo, ts );
    }
 
    /* Case (2) */
    for (ts = topSpecs; ts; ts = ts->next) {
-      generate_and_add_actives( ts->specs, ts, 
-                                newdi,     newts );
+      generate_and_add_actives( ts, 
+                                newdi, newts );
    }
 
    /* Case (3) */
-   generate_and_add_actives( specList, newts, 
-                             newdi,    newts );
+   generate_and_add_actives( newts, 
+                             newdi, newts );
 
    /* Finally, add the new TopSpec. */
    newts->next = topSpecs;
@@ -760,6 +799,9 @@ void VG_(redir_notify_new_DebugInfo)( const DebugInfo* newdi )
       names in the module against any --require-text-symbol=
       specifications we might have. */
    handle_require_text_symbols(newdi);
+
+   stats__redir_notify_new++;
+   stats__redir_ms += VG_(read_millisecond_timer)() - start_ms;
 }
 
 /* Add a new target for an indirect function. Adds a new redirection
@@ -788,6 +830,93 @@ void VG_(redir_add_ifunc_target)( Addr old_from, Addr new_from )
     }
 }
 
+/* Hash the first n characters of str. */
+static UInt hash_spec_name ( const HChar* str, SizeT n )
+{
+   UInt  h = 5381;
+   SizeT i;
+   for (i = 0; i < n; i++)
+      h = (h << 5) + h + (UChar)str[i];
+   return h;
+}
+
+static void add_to_spec_chain ( Spec** chain, Spec* sp )
+{
+   /* Specs are added in list order, so append at the end. */
+   while (*chain)
+      chain = &(*chain)->inext;
+   sp->inext = NULL;
+   *chain = sp;
+}
+
+/* Build the index of the specs of ts, if not done yet. */
+static SpecIndex* get_spec_index ( TopSpec* ts )
+{
+   SpecIndex* ix;
+   Spec*      sp;
+   UInt       n_specs, i;
+
+   if (ts->index)
+      return ts->index;
+
+   n_specs = 0;
+   for (sp = ts->specs; sp; sp = sp->next)
+      n_specs++;
+
+   ix = dinfo_zalloc("redir.gsi.1", sizeof(SpecIndex));
+   ix->n_buckets    = 2 * n_specs + 1;
+   ix->buckets      = dinfo_zalloc("redir.gsi.2",
+                                   ix->n_buckets * sizeof(Spec*));
+   ix->residual     = NULL;
+   ix->n_sopatts    = 0;
+   ix->sopatts      = dinfo_zalloc("redir.gsi.3",
+                                   (n_specs + 1) * sizeof(HChar*));
+   ix->sopatt_marks = dinfo_zalloc("redir.gsi.4",
+                                   (n_specs + 1) * sizeof(Bool));
+
+   n_specs = 0;
+   for (sp = ts->specs; sp; sp = sp->next) {
+      const HChar* fnpatt = sp->from_fnpatt;
+      SizeT        lit;
+
+      sp->ord = n_specs++;
+
+      for (i = 0; i < ix->n_sopatts; i++)
+         if (0 == VG_(strcmp)(ix->sopatts[i], sp->from_sopatt))
+            break;
+      if (i == ix->n_sopatts)
+         ix->sopatts[ix->n_sopatts++] = sp->from_sopatt;
+      sp->sopatt_ix = i;
+
+      for (lit = 0; fnpatt[lit] != 0; lit++)
+         if (fnpatt[lit] == '*' || fnpatt[lit] == '?')
+            break;
+      if (fnpatt[lit] == 0)
+         add_to_spec_chain(&ix->buckets[hash_spec_name(fnpatt, lit)
+                                        % ix->n_buckets], sp);
+      else if (lit >= SPEC_PREFIX_LEN)
+         add_to_spec_chain(&ix->buckets[hash_spec_name(fnpatt,
+                                                       SPEC_PREFIX_LEN)
+                                        % ix->n_buckets], sp);
+      else
+         add_to_spec_chain(&ix->residual, sp);
+   }
+
+   ts->index = ix;
+   return ix;
+}
+
+static void free_spec_index ( TopSpec* ts )
+{
+   if (ts->index == NULL)
+      return;
+   dinfo_free(ts->index->buckets);
+   dinfo_free(ts->index->sopatts);
+   dinfo_free(ts->index->sopatt_marks);
+   dinfo_free(ts->index);
+   ts->index = NULL;
+}
+
 /* Do one element of the basic cross product: add to the active set,
    all matches resulting from comparing all the given specs against
    all the symbols in the given seginfo.  If a conflicting binding
@@ -795,29 +924,43 @@ void VG_(redir_add_ifunc_target)( Addr old_from, Addr new_from )
 
 static 
 void generate_and_add_actives ( 
-        /* spec list and the owning TopSpec */
-        Spec*    specs, 
+        /* the TopSpec owning the specs */
         TopSpec* parent_spec,
 	/* seginfo and the owning TopSpec */
         const DebugInfo* di,
         TopSpec* parent_sym 
      )
 {
+   Spec*   specs = parent_spec->specs;
    Spec*   sp;
+   Spec*   chain_full;
+   Spec*   chain_prefix;
+   Spec*   chain_resid;
+   SpecIndex* ix;
    Bool    anyMark, isText, isIFunc, isGlobal;
    Active  act;
    Int     nsyms, i;
+   UInt    j, b_full, b_prefix;
+   SizeT   len;
    SymAVMAs  sym_avmas;
    const HChar*  sym_name_pri;
    const HChar** sym_names_sec;
+   const HChar*  soname = VG_(DebugInfo_get_soname)(di);
+
+   if (specs == NULL)
+      return;
+   ix = get_spec_index(parent_spec);
+
+   /* First figure out which of the specs match the seginfo's soname,
+      matching each distinct soname pattern only once.  Also clear the
+      'done' bits, so that after the main loop below tell which of the
+      Specs really did get done. */
+   for (j = 0; j < ix->n_sopatts; j++)
+      ix->sopatt_marks[j] = VG_(string_match)( ix->sopatts[j], soname );
 
-   /* First figure out which of the specs match the seginfo's soname.
-      Also clear the 'done' bits, so that after the main loop below
-      tell which of the Specs really did get done. */
    anyMark = False;
    for (sp = specs; sp; sp = sp->next) {
       sp->done = False;
-      const HChar *soname = VG_(DebugInfo_get_soname)(di);
 
       /* When searching for global public symbols (like for the somalloc
          synonym symbols), exclude the dynamic (runtime) linker as it is very
@@ -829,7 +972,7 @@ void generate_and_add_actives (
          continue;
       }
 
-      sp->mark = VG_(string_match)( sp->from_sopatt, soname );
+      sp->mark = ix->sopatt_marks[sp->sopatt_ix];
       anyMark = anyMark || sp->mark;
    }
 
@@ -854,9 +997,40 @@ void generate_and_add_actives (
          if (!isText)
             continue;
 
-         for (sp = specs; sp; sp = sp->next) {
+         /* Only the specs chained in the buckets for the whole name
+            and for its prefix, and the residual ones, can match.
+            Visit them in list order, as a plain walk over the list
+            would. */
+         len = VG_(strlen)(*names);
+         b_full = hash_spec_name(*names, len) % ix->n_buckets;
+         chain_full = ix->buckets[b_full];
+         chain_prefix = NULL;
+         if (len > SPEC_PREFIX_LEN) {
+            b_prefix = hash_spec_name(*names, SPEC_PREFIX_LEN)
+                       % ix->n_buckets;
+            if (b_prefix != b_full)
+               chain_prefix = ix->buckets[b_prefix];
+         }
+         chain_resid = ix->residual;
+
+         while (True) {
+            sp = chain_full;
+            if (chain_prefix && (sp == NULL || chain_prefix->ord < sp->ord))
+               sp = chain_prefix;
+            if (chain_resid && (sp == NULL || chain_resid->ord < sp->ord))
+               sp = chain_resid;
+            if (sp == NULL)
+               break;
+            if (sp == chain_full)
+               chain_full = sp->inext;
+            else if (sp == chain_prefix)
+               chain_prefix = sp->inext;
+            else
+               chain_resid = sp->inext;
+
             if (!sp->mark)
                continue; /* soname doesn't match */
+            stats__redir_fnpatt_matches++;
             if (VG_(string_match)( sp->from_fnpatt, *names )
 		&& (sp->isGlobal == False || isGlobal == True)) {
                /* got a new binding.  Add to collection. */
@@ -883,7 +1057,7 @@ void generate_and_add_actives (
                }
 
             }
-         } /* for (sp = specs; sp; sp = sp->next) */
+         } /* while (True) over the candidate specs */
 
       } /* iterating over names[] */
       free_symname_array(names_init, &twoslots[0]);
@@ -1088,6 +1262,7 @@ void VG_(redir_notify_delete_DebugInfo)( const DebugInfo* delsi )
    Active*  act;
    Bool     delMe;
    Addr     addr;
+   UInt     start_ms = VG_(read_millisecond_timer)();
 
    vg_assert(delsi);
 
@@ -1161,6 +1336,7 @@ void VG_(redir_notify_delete_DebugInfo)( const DebugInfo* delsi )
       sp_next = sp->next;
       dinfo_free(sp);
    }
+   free_spec_index(ts);
 
    if (tsPrev == NULL) {
       /* first in list */
@@ -1172,6 +1348,22 @@ void VG_(redir_notify_delete_DebugInfo)( const DebugInfo* delsi )
 
    if (VG_(clo_trace_redir))
       show_redir_state("after VG_(redir_notify_delete_DebugInfo)");
+
+   stats__redir_notify_delete++;
+   stats__redir_ms += VG_(read_millisecond_timer)() - start_ms;
+}
+
+
+void VG_(print_redir_stats) ( void )
+{
+   VG_(message)(Vg_DebugMsg,
+                "redir: %'u new DebugInfos, %'u deleted, %'u ms\n",
+                stats__redir_notify_new, stats__redir_notify_delete,
+                stats__redir_ms);
+   VG_(message)(Vg_DebugMsg,
+                "redir: %'llu fnname patterns matched, %'u actives\n",
+                stats__redir_fnpatt_matches,
+                VG_(OSetGen_Size)(activeSet));
 }
 
 
@@ -1284,6 +1476,8 @@ static void add_hardwired_spec (const  HChar* sopatt, const HChar* fnpatt,
 
    spec->next = topSpecs->specs;
    topSpecs->specs = spec;
+   /* The index no longer covers all the specs. */
+   free_spec_index(topSpecs);
 }
 
 
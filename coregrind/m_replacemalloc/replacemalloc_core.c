@@ -32,6 +32,9 @@
 #include "pub_core_libcbase.h"
 #include "pub_core_libcprint.h"
 #include "pub_core_libcassert.h"
+#include "pub_core_vki.h"
+#include "pub_core_vkiscnums.h"
+#include "pub_core_syscall.h"
 #include "pub_core_tooliface.h"       // VG_(needs)
 #include "pub_core_mallocfree.h"
 #include "pub_core_options.h"
@@ -52,6 +55,10 @@ Bool VG_(clo_trace_malloc)  = False;
    default: 0, i.e. use VG_MIN_MALLOC_SZB. */
 UInt VG_(clo_alignment)     = VG_MIN_MALLOC_SZB;
 
+/* Call the tool's malloc replacement functions directly from generated
+   code?  default: YES */
+Bool VG_(clo_malloc_fast_path) = False;
+
 
 Bool VG_(replacement_malloc_process_cmd_line_option)(const HChar* arg)
 {
@@ -75,6 +82,8 @@ Bool VG_(replacement_malloc_process_cmd_line_option)(const HChar* arg)
                        VG_(clo_xtree_memory_file)) {}
    else if VG_BOOL_CLO(arg, "--xtree-compress-strings",
                        VG_(clo_xtree_compress_strings)) {}
+   else if VG_BOOL_CLO(arg, "--malloc-fast-path",
+                       VG_(clo_malloc_fast_path)) {}
 
    else if VG_BOOL_CLO(arg, "--trace-malloc",  VG_(clo_trace_malloc)) {}
    else 
@@ -116,6 +125,25 @@ SizeT VG_(cli_malloc_usable_size) ( void* p )
 {                                                            
    return VG_(arena_malloc_usable_size)(VG_AR_CLIENT, p);
 }                                                            
+
+SizeT VG_(cli_discard_pages) ( void* p, SizeT nbytes )
+{
+#  if defined(VGO_linux)
+   Addr   start = VG_PGROUNDUP((Addr)p);
+   Addr   end   = VG_PGROUNDDN((Addr)p + nbytes);
+   SysRes sres;
+
+   if (end <= start)
+      return 0;
+   /* The arena only ever writes the block headers and trailers, which
+      are outside of [p, p+nbytes), so the zero pages do no harm. */
+   sres = VG_(do_syscall3)(__NR_madvise, start, end - start,
+                           VKI_MADV_DONTNEED);
+   return sr_isError(sres) ? 0 : end - start;
+#  else
+   return 0;
+#  endif
+}
   
 Bool VG_(addr_is_in_block)( Addr a, Addr start, SizeT size, SizeT rz_szB )
 {
@@ -125,6 +125,7 @@ static ULong vgdb_next_poll;
 static void do_client_request ( ThreadId tid );
 static void scheduler_sanity ( ThreadId tid );
 static void mostly_clear_thread_record ( ThreadId tid );
+static void init_thread_record ( ThreadId tid );
 
 /* Stats. */
 static ULong n_scheduling_events_MINOR = 0;
@@ -135,6 +136,11 @@ static ULong n_scheduling_events_MAJOR = 0;
 static ULong stats__n_xindirs = 0;
 static ULong stats__n_xindir_misses = 0;
 
+/* Stats: number of client requests done by the scheduler, and number
+   of malloc replacement calls done without leaving generated code. */
+static ULong stats__n_client_requests = 0;
+static ULong stats__n_malloc_fast_paths = 0;
+
 /* And 32-bit temp bins for the above, so that 32-bit platforms don't
    have to do 64 bit incs on the hot path through
    VG_(cp_disp_xindir). */
@@ -145,6 +151,10 @@ static ULong stats__n_xindir_misses = 0;
 static UInt sanity_fast_count = 0;
 static UInt sanity_slow_count = 0;
 
+/* Stats: number of times memory was given back because of
+   --max-tool-memory. */
+static ULong stats__n_memory_sheds = 0;
+
 void VG_(print_scheduler_stats)(void)
 {
    VG_(message)(Vg_DebugMsg,
@@ -157,9 +167,17 @@ void VG_(print_scheduler_stats)(void)
    VG_(message)(Vg_DebugMsg,
       "scheduler: %'llu/%'llu major/minor sched events.\n",
       n_scheduling_events_MAJOR, n_scheduling_events_MINOR);
+   VG_(message)(Vg_DebugMsg,
+      "scheduler: %'llu client requests, %'llu malloc calls from"
+      " generated code.\n",
+      stats__n_client_requests, stats__n_malloc_fast_paths);
    VG_(message)(Vg_DebugMsg, 
                 "   sanity: %u cheap, %u expensive checks.\n",
                 sanity_fast_count, sanity_slow_count );
+   if (VG_(clo_max_tool_memory) > 0)
+      VG_(message)(Vg_DebugMsg,
+                   "scheduler: %'llu memory sheds for --max-tool-memory.\n",
+                   stats__n_memory_sheds);
 }
 
 /*
@@ -222,6 +240,126 @@ static void maybe_progress_report ( UInt reporting_interval_seconds )
    }
 }
 
+/* Return how much memory Valgrind uses for itself, if that could be
+   THRESHOLD bytes or more, and 0 otherwise.  The size of the mappings is
+   cheap to get and an upper bound; only when it is over the threshold
+   are the resident pages counted.  Counting them sweeps all of
+   Valgrind's mappings, so when that finds the use under the threshold,
+   it is not done again until the mappings have grown by a sixteenth of
+   the limit or a second has passed. */
+static ULong tool_memory_use ( ULong threshold )
+{
+   static ULong recount_at_size = 0;
+   static UInt  recount_at_ms   = 0;
+
+   const ULong limit  = (ULong)VG_(clo_max_tool_memory);
+   const ULong mapped = VG_(am_get_anonsize_valgrind)(False/*!resident*/);
+   ULong resident;
+
+   if (mapped < threshold)
+      return 0;
+   if (mapped < recount_at_size
+       && VG_(read_millisecond_timer)() < recount_at_ms)
+      return 0;
+
+   resident = VG_(am_get_anonsize_valgrind)(True/*resident*/);
+   if (resident < threshold) {
+      recount_at_size = mapped + limit / 16;
+      recount_at_ms   = VG_(read_millisecond_timer)() + 1000;
+      return 0;
+   }
+   recount_at_size = 0;
+   return resident;
+}
+
+/* The ways of giving back memory, cheapest loss first. */
+typedef
+   enum {
+      ShedTranstab,    /* translations of all but the youngest sector */
+      ShedLineInfo,    /* line info kept for unloaded code */
+      ShedTool,        /* whatever the tool can spare */
+      N_SHED_STEPS
+   }
+   ShedStep;
+
+static const HChar* shed_step_name ( ShedStep step )
+{
+   switch (step) {
+      case ShedTranstab: return "releasing old translation sectors";
+      case ShedLineInfo: return "discarding archived line tables";
+      case ShedTool:     return "asking the tool to shed memory";
+      default:           vg_assert(0);
+   }
+}
+
+static void do_shed_step ( ShedStep step )
+{
+   switch (step) {
+      case ShedTranstab: VG_(release_old_transtab_sectors)(); break;
+      case ShedLineInfo: VG_(discard_archived_line_tables)(); break;
+      case ShedTool:     VG_TDICT_CALL(tool_shed_memory); break;
+      default:           vg_assert(0);
+   }
+}
+
+/* If Valgrind's own memory use has got close to --max-tool-memory, give
+   back what can be given back, cheapest loss first.  Each step is only
+   taken if the previous ones did not bring the use back under the
+   threshold.  A step that did not lower the use is skipped until the
+   use has grown by the limit: repeating it at each shed would only lose
+   more translations or precision for no gain. */
+static void maybe_shed_memory ( void )
+{
+   /* After shedding, wait for the use to grow by a sixteenth of the
+      limit before trying again, so as not to throw away the working
+      set of translations at every timeslice when what is left cannot
+      be given back. */
+   static ULong shed_again_at = 0;
+   static Bool  warned = False;
+   static ULong step_retry_at[N_SHED_STEPS];
+
+   const ULong limit = (ULong)VG_(clo_max_tool_memory);
+   const ULong threshold = limit - limit / 8;
+   ULong    used = tool_memory_use( VG_MAX(threshold, shed_again_at) );
+   ULong    after;
+   ShedStep step;
+
+   if (LIKELY(used < threshold || used < shed_again_at))
+      return;
+
+   stats__n_memory_sheds++;
+   if (VG_(clo_verbosity) > 1)
+      VG_(dmsg)("Using %'llu bytes, close to --max-tool-memory=%lld: "
+                "giving back memory\n", used, VG_(clo_max_tool_memory));
+
+   for (step = 0; step < N_SHED_STEPS && used >= threshold; step++) {
+      if (used < step_retry_at[step])
+         continue;
+      if (step == ShedTool && !VG_(needs).shed_memory)
+         continue;
+      do_shed_step(step);
+      after = VG_(am_get_anonsize_valgrind)(True/*resident*/);
+      if (after >= used) {
+         step_retry_at[step] = used + limit;
+         if (VG_(clo_verbosity) > 1)
+            VG_(dmsg)("%s gave back no memory, skipping it until the use "
+                      "reaches %'llu bytes\n",
+                      shed_step_name(step), step_retry_at[step]);
+      }
+      used = after;
+   }
+
+   if (VG_(clo_verbosity) > 1)
+      VG_(dmsg)("Using %'llu bytes after giving back memory\n", used);
+   if (used > limit && !warned) {
+      warned = True;
+      VG_(umsg)("Warning: Valgrind uses %'llu bytes, more than "
+                "--max-tool-memory=%lld,\n", used, VG_(clo_max_tool_memory));
+      VG_(umsg)("   and cannot give back enough memory to go below it.\n");
+   }
+   shed_again_at = used + limit / 16;
+}
+
 static
 void print_sched_event ( ThreadId tid, const HChar* what )
 {
@@ -284,19 +422,26 @@ const HChar* name_of_sched_event ( UInt event )
   }
 }
 
-/* Allocate a completely empty ThreadState record. */
+/* Allocate a completely empty ThreadState record, growing the thread
+   table if all its entries are in use. */
 ThreadId VG_(alloc_ThreadState) ( void )
 {
    Int i;
    for (i = 1; i < VG_N_THREADS; i++) {
-      if (VG_(threads)[i].status == VgTs_Empty) {
-	 VG_(threads)[i].status = VgTs_Init;
-	 VG_(threads)[i].exitreason = VgSrc_None;
-         if (VG_(threads)[i].thread_name)
-            VG_(free)(VG_(threads)[i].thread_name);
-         VG_(threads)[i].thread_name = NULL;
-         return i;
-      }
+      if (VG_(threads)[i].status == VgTs_Empty)
+         break;
+   }
+   if (i == VG_N_THREADS)
+      i = VG_(grow_Threads)(init_thread_record);
+
+   if (i != VG_INVALID_THREADID) {
+      vg_assert(VG_(threads)[i].status == VgTs_Empty);
+      VG_(threads)[i].status = VgTs_Init;
+      VG_(threads)[i].exitreason = VgSrc_None;
+      if (VG_(threads)[i].thread_name)
+         VG_(free)(VG_(threads)[i].thread_name);
+      VG_(threads)[i].thread_name = NULL;
+      return i;
    }
    VG_(printf)("Use --max-threads=INT to specify a larger number of threads\n"
                "and rerun valgrind\n");
@@ -383,6 +528,10 @@ void VG_(release_BigLock)(ThreadId tid, ThreadStatus sleepstate,
       print_sched_event(tid, buf);
    }
 
+   /* Don't let buffered output sit around while we sleep: push it
+      out now, so that the log stays reasonably up to date. */
+   VG_(flush_output_sinks)();
+
    /* Release the_BigLock; this will reschedule any runnable
       thread. */
    VG_(release_BigLock_LL)(NULL);
@@ -578,7 +727,9 @@ void mostly_clear_thread_record ( ThreadId tid )
 {
    vki_sigset_t savedmask;
 
-   vg_assert(tid >= 0 && tid < VG_N_THREADS);
+   /* NB: not VG_N_THREADS, as this is also used to set up new entries
+      before the thread table is grown to include them. */
+   vg_assert(tid >= 0 && tid < VG_(clo_max_threads));
    VG_(cleanup_thread)(&VG_(threads)[tid].arch);
    VG_(threads)[tid].tid = tid;
 
@@ -601,6 +752,26 @@ void mostly_clear_thread_record ( ThreadId tid )
    VG_(threads)[tid].sched_jmpbuf_valid = False;
 }
 
+/* Set up a fresh entry of the thread table, leaving it VgTs_Empty. */
+static void init_thread_record ( ThreadId tid )
+{
+   /* Paranoia .. completely zero it out. */
+   VG_(memset)( & VG_(threads)[tid], 0, sizeof( VG_(threads)[tid] ) );
+
+   VG_(threads)[tid].sig_queue = NULL;
+
+   os_state_init(&VG_(threads)[tid]);
+   mostly_clear_thread_record(tid);
+
+   VG_(threads)[tid].status                    = VgTs_Empty;
+   VG_(threads)[tid].client_stack_szB          = 0;
+   VG_(threads)[tid].client_stack_highest_byte = (Addr)NULL;
+   VG_(threads)[tid].err_disablement_level     = 0;
+   VG_(threads)[tid].thread_name               = NULL;
+
+   VG_(clear_syscallInfo)(tid);
+}
+
 /*                                                                             
    Called in the child after fork.  If the parent has multiple
    threads, then we've inherited a VG_(threads) array describing them,
@@ -674,21 +845,10 @@ ThreadId VG_(scheduler_init_phase1) ( void )
 
    init_BigLock();
 
-   for (i = 0 /* NB; not 1 */; i < VG_N_THREADS; i++) {
-      /* Paranoia .. completely zero it out. */
-      VG_(memset)( & VG_(threads)[i], 0, sizeof( VG_(threads)[i] ) );
-
-      VG_(threads)[i].sig_queue = NULL;
-
-      os_state_init(&VG_(threads)[i]);
-      mostly_clear_thread_record(i);
-
-      VG_(threads)[i].status                    = VgTs_Empty;
-      VG_(threads)[i].client_stack_szB          = 0;
-      VG_(threads)[i].client_stack_highest_byte = (Addr)NULL;
-      VG_(threads)[i].err_disablement_level     = 0;
-      VG_(threads)[i].thread_name               = NULL;
-   }
+   /* Only the initial part of the thread table is set up here; the rest
+      is initialised by VG_(alloc_ThreadState) as the table grows. */
+   for (i = 0 /* NB; not 1 */; i < VG_N_THREADS; i++)
+      init_thread_record(i);
 
    tid_main = VG_(alloc_ThreadState)();
 
@@ -1254,6 +1414,10 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
    if (VG_(clo_trace_sched))
       print_sched_event(tid, "entering VG_(scheduler)");      
 
+   /* Whatever the previous thread in this slot left on its shadow call
+      stack is of no use to this one. */
+   VG_(shadow_stack_reset)(tid);
+
    /* Do vgdb initialization (but once). Only the first (main) task
       starting up will do the below.
       Initialize gdbserver earlier than at the first 
@@ -1370,6 +1534,10 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
             maybe_progress_report( VG_(clo_progress_interval) );
          }
 
+         /* Possibly give back memory, if close to --max-tool-memory */
+         if (UNLIKELY(VG_(clo_max_tool_memory) > 0))
+            maybe_shed_memory();
+
 	 /* Look for any pending signals for this thread, and set them up
 	    for delivery */
 	 VG_(poll_signals)(tid);
@@ -1485,6 +1653,7 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
       }
 
       case VEX_TRC_JMP_CLIENTREQ:
+	 stats__n_client_requests++;
 	 do_client_request(tid);
 	 break;
 
@@ -2223,6 +2392,68 @@ void do_client_request ( ThreadId tid )
 }
 
 
+/* Is f one of the tool's malloc replacement functions, which
+   vg_replace_malloc.c calls with VALGRIND_NON_SIMD_CALL[123] ? */
+static Bool is_tool_malloc_fn ( Addr f )
+{
+   return f == (Addr)VG_(tdict).tool_malloc
+       || f == (Addr)VG_(tdict).tool_free
+       || f == (Addr)VG_(tdict).tool___builtin_new
+       || f == (Addr)VG_(tdict).tool___builtin_delete
+       || f == (Addr)VG_(tdict).tool___builtin_vec_new
+       || f == (Addr)VG_(tdict).tool___builtin_vec_delete
+       || f == (Addr)VG_(tdict).tool_calloc
+       || f == (Addr)VG_(tdict).tool_realloc
+       || f == (Addr)VG_(tdict).tool_memalign
+       || f == (Addr)VG_(tdict).tool_malloc_usable_size;
+}
+
+/* Called from generated code, by a superblock ending in a client
+   request, just before it would go back to the scheduler to have the
+   request done (see vg_malloc_fast_path_pass in m_translate.c).  The
+   guest state is up to date.  If the request is a call of one of the
+   tool's malloc replacement functions, do the call here, exactly as
+   do_client_request would, and return 1: the thread then continues in
+   generated code.  Otherwise, return 0 and do nothing.
+
+   The tool's functions are Valgrind code, which e.g. copies the block
+   for realloc: while they run, a fault must not be taken for one of
+   the client, so VG_(in_generated_code) is cleared as in the
+   scheduler. */
+UWord VG_(malloc_fast_path) ( void )
+{
+   ThreadId tid = VG_(get_running_tid)();
+   UWord* arg = (UWord*)(Addr)(CLREQ_ARGS(VG_(threads)[tid].arch));
+
+   switch (arg[0]) {
+      case VG_USERREQ__CLIENT_CALL1: {
+         UWord (*f)(ThreadId, UWord) = (__typeof__(f))arg[1];
+         if (f == NULL || !is_tool_malloc_fn((Addr)f))
+            return 0;
+         vg_assert(VG_(in_generated_code));
+         VG_(in_generated_code) = False;
+         SET_CLCALL_RETVAL(tid, f ( tid, arg[2] ), (Addr)f );
+         VG_(in_generated_code) = True;
+         break;
+      }
+      case VG_USERREQ__CLIENT_CALL2: {
+         UWord (*f)(ThreadId, UWord, UWord) = (__typeof__(f))arg[1];
+         if (f == NULL || !is_tool_malloc_fn((Addr)f))
+            return 0;
+         vg_assert(VG_(in_generated_code));
+         VG_(in_generated_code) = False;
+         SET_CLCALL_RETVAL(tid, f ( tid, arg[2], arg[3] ), (Addr)f );
+         VG_(in_generated_code) = True;
+         break;
+      }
+      default:
+         return 0;
+   }
+   stats__n_malloc_fast_paths++;
+   return 1;
+}
+
+
 /* ---------------------------------------------------------------------
    Sanity checking (permanently engaged)
    ------------------------------------------------------------------ */
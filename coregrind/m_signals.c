@@ -192,6 +192,10 @@
    VG_(sigtimedwait_zero).  This is trivial on Linux, since it's just a
    syscall.  But on Darwin and AIX, we have to cobble together the
    functionality in a tedious, longwinded and probably error-prone way.
+   Since polling happens at every timeslice, the common nothing-queued
+   case is kept down to that single syscall: the signal queues are only
+   locked (by blocking all host signals) when they are non-empty or a
+   signal is actually to be delivered.
 
    Finally, if a gdb is debugging the process under valgrind,
    the signal can be ignored if gdb tells this. So, before resuming the
@@ -246,9 +250,15 @@ Int VG_(max_signal) = _VKI_NSIG;
 
 typedef struct SigQueue {
    Int	next;
+   UInt n_queued;  /* number of sigs[] entries with si_signo != 0 */
    vki_siginfo_t sigs[N_QUEUED_SIGNALS];
 } SigQueue;
 
+/* Signal polling stats. */
+static ULong stats__n_polls = 0;
+static ULong stats__n_fast_polls = 0;
+static ULong stats__n_polled_sigs = 0;
+
 /* ------ Macros for pulling stuff out of ucontexts ------ */
 
 /* Q: what does VG_UCONTEXT_SYSCALL_SYSRES do?  A: let's suppose the
@@ -1409,6 +1419,7 @@ void push_signal_frame ( ThreadId tid, const vki_siginfo_t *siginfo,
 {
    Bool         on_altstack;
    Addr         esp_top_of_frame;
+   Addr         old_sp;
    ThreadState* tst;
    Int		sigNo = siginfo->si_signo;
 
@@ -1448,6 +1459,8 @@ void push_signal_frame ( ThreadId tid, const vki_siginfo_t *siginfo,
    vg_assert(scss.scss_per_sig[sigNo].scss_handler != VKI_SIG_IGN);
    vg_assert(scss.scss_per_sig[sigNo].scss_handler != VKI_SIG_DFL);
 
+   old_sp = VG_(get_SP)(tid);
+
    /* This may fail if the client stack is busted; if that happens,
       the whole process will exit rather than simply calling the
       signal handler. */
@@ -1456,6 +1469,8 @@ void push_signal_frame ( ThreadId tid, const vki_siginfo_t *siginfo,
                          scss.scss_per_sig[sigNo].scss_flags,
                          &tst->sig_mask,
                          scss.scss_per_sig[sigNo].scss_restorer);
+
+   VG_(shadow_stack_signal_frame) (tid, old_sp);
 }
 
 
@@ -1555,6 +1570,8 @@ void VG_(kill_self)(Int sigNo)
    vki_sigaction_toK_t   sa, origsa2;
    vki_sigaction_fromK_t origsa;   
 
+   VG_(flush_output_sinks)();
+
    sa.ksa_handler = VKI_SIG_DFL;
    sa.sa_flags = 0;
 #  if !defined(VGP_x86_darwin) && !defined(VGP_amd64_darwin) && \
@@ -2218,6 +2235,8 @@ void queue_signal(ThreadId tid, const vki_siginfo_t *si)
    if (sq->sigs[sq->next].si_signo != 0)
       VG_(umsg)("Signal %d being dropped from thread %u's queue\n",
                 sq->sigs[sq->next].si_signo, tid);
+   else
+      sq->n_queued++;
 
    sq->sigs[sq->next] = *si;
    sq->next = (sq->next+1) % N_QUEUED_SIGNALS;
@@ -2226,14 +2245,15 @@ void queue_signal(ThreadId tid, const vki_siginfo_t *si)
 }
 
 /*
-   Returns the next queued signal for thread tid which is in "set".
-   tid==0 means process-wide signal.  Set si_signo to 0 when the
-   signal has been delivered.
+   Returns the next queued signal for thread tid which is in "set",
+   and the queue it is in in *sqp.  tid==0 means process-wide signal.
+   Use dequeue_signal to remove it once it has been delivered.
 
    Must be called with all signals blocked, to protect against async
    deliveries.
 */
-static vki_siginfo_t *next_queued(ThreadId tid, const vki_sigset_t *set)
+static vki_siginfo_t *next_queued(ThreadId tid, const vki_sigset_t *set,
+                                  /*OUT*/SigQueue **sqp)
 {
    ThreadState *tst = VG_(get_ThreadState)(tid);
    SigQueue *sq;
@@ -2241,7 +2261,8 @@ static vki_siginfo_t *next_queued(ThreadId tid, const vki_sigset_t *set)
    vki_siginfo_t *ret = NULL;
 
    sq = tst->sig_queue;
-   if (sq == NULL)
+   *sqp = sq;
+   if (sq == NULL || sq->n_queued == 0)
       goto out;
    
    idx = sq->next;
@@ -2266,6 +2287,24 @@ static vki_siginfo_t *next_queued(ThreadId tid, const vki_sigset_t *set)
    return ret;
 }
 
+/* Remove a signal returned by next_queued from its queue. */
+static void dequeue_signal(SigQueue *sq, vki_siginfo_t *si)
+{
+   vg_assert(sq->n_queued > 0);
+   si->si_signo = 0;
+   sq->n_queued--;
+}
+
+/* True if thread tid (or the process, for tid==0) has no signals
+   queued.  Cheap enough to be done without blocking host signals: at
+   worst, a signal queued concurrently by sync_signalhandler is picked
+   up at the next poll. */
+static Bool no_queued_signals(ThreadId tid)
+{
+   const SigQueue *sq = VG_(threads)[tid].sig_queue;
+   return sq == NULL || sq->n_queued == 0;
+}
+
 static int sanitize_si_code(int si_code)
 {
 #if defined(VGO_linux)
@@ -2944,6 +2983,7 @@ void VG_(poll_signals)(ThreadId tid)
    vki_sigset_t pollset;
    ThreadState *tst = VG_(get_ThreadState)(tid);
    vki_sigset_t saved_mask;
+   SigQueue *sq = NULL;
 
    if (tst->exitreason == VgSrc_FatalSig) {
       /* This task has been requested to die due to a fatal signal
@@ -2959,29 +2999,51 @@ void VG_(poll_signals)(ThreadId tid)
       return;
    }
 
+   stats__n_polls++;
+
    /* look for all the signals this thread isn't blocking */
    /* pollset = ~tst->sig_mask */
    VG_(sigcomplementset)( &pollset, &tst->sig_mask );
 
-   block_all_host_signals(&saved_mask); // protect signal queue
-
-   /* First look for any queued pending signals */
-   sip = next_queued(tid, &pollset); /* this thread */
-
-   if (sip == NULL)
-      sip = next_queued(0, &pollset); /* process-wide */
-
-   /* If there was nothing queued, ask the kernel for a pending signal */
-   if (sip == NULL && VG_(sigtimedwait_zero)(&pollset, &si) > 0) {
+   if (no_queued_signals(tid) && no_queued_signals(0)) {
+      /* The common case: nothing queued, so only the kernel can have a
+         signal for us.  VG_(sigtimedwait_zero) is atomic w.r.t. async
+         deliveries, so there is no need to block host signals around
+         it; only do that once there is actually something to deliver.
+         This makes a poll one syscall rather than three. */
+      stats__n_fast_polls++;
+      if (VG_(sigtimedwait_zero)(&pollset, &si) <= 0)
+         return;
       if (VG_(clo_trace_signals))
          VG_(dmsg)("poll_signals: got signal %d for thread %u exitreason %s\n",
                    si.si_signo, tid,
                    VG_(name_of_VgSchedReturnCode)(tst->exitreason));
+      block_all_host_signals(&saved_mask);
       sip = &si;
+   } else {
+      block_all_host_signals(&saved_mask); // protect signal queue
+
+      /* First look for any queued pending signals */
+      sip = next_queued(tid, &pollset, &sq); /* this thread */
+
+      if (sip == NULL)
+         sip = next_queued(0, &pollset, &sq); /* process-wide */
+
+      /* If there was nothing queued, ask the kernel for a pending
+         signal */
+      if (sip == NULL && VG_(sigtimedwait_zero)(&pollset, &si) > 0) {
+         if (VG_(clo_trace_signals))
+            VG_(dmsg)("poll_signals: got signal %d for thread %u "
+                      "exitreason %s\n",
+                      si.si_signo, tid,
+                      VG_(name_of_VgSchedReturnCode)(tst->exitreason));
+         sip = &si;
+      }
    }
 
    if (sip != NULL) {
       /* OK, something to do; deliver it */
+      stats__n_polled_sigs++;
       if (VG_(clo_trace_signals))
          VG_(dmsg)("Polling found signal %d for tid %u exitreason %s\n",
                    sip->si_signo, tid,
@@ -2991,13 +3053,21 @@ void VG_(poll_signals)(ThreadId tid)
       else if (VG_(clo_trace_signals))
          VG_(dmsg)("   signal %d ignored\n", sip->si_signo);
 	 
-      sip->si_signo = 0;	/* remove from signal queue, if that's
-				   where it came from */
+      if (sip != &si)
+         dequeue_signal(sq, sip);  /* it came from a signal queue */
    }
 
    restore_all_host_signals(&saved_mask);
 }
 
+void VG_(print_signal_stats)(void)
+{
+   VG_(message)(Vg_DebugMsg,
+      "  signals: %'llu polls, %'llu without queue locking, "
+      "%'llu signals found\n",
+      stats__n_polls, stats__n_fast_polls, stats__n_polled_sigs);
+}
+
 /* At startup, copy the process' real signal state to the SCSS.
    Whilst doing this, block all real signals.  Then calculate SKSS and
    set the kernel to that.  Also initialise DCSS. 
@@ -36,7 +36,9 @@
 #include "pub_core_libcbase.h"
 #include "pub_core_libcassert.h"
 #include "pub_core_libcprint.h"
+#include "pub_core_debuglog.h"
 #include "pub_core_machine.h"
+#include "pub_core_mallocfree.h"
 #include "pub_core_options.h"
 #include "pub_core_stacks.h"        // VG_(stack_limits)
 #include "pub_core_stacktrace.h"
@@ -502,6 +504,43 @@ UInt VG_(get_StackTrace_wrk) ( ThreadId tid_if_known,
 #if defined(VGP_amd64_linux) || defined(VGP_amd64_darwin) \
     || defined(VGP_amd64_solaris)
 
+/* For --unwind=auto, the same scheme as for x86 above is used: the
+   first time the stack is unwound from a given IP, the fp chain
+   unwind is checked against the CFI one, and the outcome is cached,
+   so that afterwards only the one found to be right is done. */
+#define N_FP_CF_VERIF 1021
+#define FPUNWIND 0
+#define NOINFO   1
+#define CFUNWIND 2
+
+static Addr fp_CF_verif_cache [N_FP_CF_VERIF];
+static UInt fp_CF_verif_generation = 0;
+
+/* Unwind one frame by following the %rbp chain, for frames made by
+   functions which begin "pushq %rbp ; movq %rsp, %rbp".  Returns False,
+   leaving |uregs| unchanged, if %rbp does not look like a frame pointer
+   into the stack.  With |aligned|, %rbp must also be 8-aligned, as it
+   always is for a real frame pointer; this is only asked for
+   --unwind=fp|auto, so that the fallback used when there is no CFI
+   stays as it was. */
+static Bool use_fp_chain ( /*MOD*/D3UnwindRegs* uregs,
+                           Addr fp_min, Addr fp_max, Bool aligned )
+{
+   /* Note: re "- 1 * sizeof(UWord)", need to take account of the
+      fact that we are prodding at & ((UWord*)fp)[1] and so need to
+      adjust the limit check accordingly.  Omitting this has been
+      observed to cause segfaults on rare occasions. */
+   if (fp_min <= uregs->xbp && uregs->xbp <= fp_max - 1 * sizeof(UWord)
+       && (!aligned || VG_IS_8_ALIGNED(uregs->xbp))) {
+      Addr fp = uregs->xbp;
+      uregs->xip = (((UWord*)fp)[1]);
+      uregs->xsp = fp + sizeof(Addr) /*saved %rbp*/ + sizeof(Addr) /*ra*/;
+      uregs->xbp = (((UWord*)fp)[0]);
+      return True;
+   }
+   return False;
+}
+
 UInt VG_(get_StackTrace_wrk) ( ThreadId tid_if_known,
                                /*OUT*/Addr* ips, UInt max_n_ips,
                                /*OUT*/Addr* sps, /*OUT*/Addr* fps,
@@ -607,8 +646,15 @@ UInt VG_(get_StackTrace_wrk) ( ThreadId tid_if_known,
     * a tail call occurs and we wind up using the CFI info for the
     * next function which is completely wrong.
     */
+   if (VG_(clo_unwind) == Vg_UnwindAuto
+       && UNLIKELY (fp_CF_verif_generation != VG_(debuginfo_generation)())) {
+      fp_CF_verif_generation = VG_(debuginfo_generation)();
+      VG_(memset)(&fp_CF_verif_cache, 0, sizeof(fp_CF_verif_cache));
+   }
+
    while (True) {
       Addr old_xsp;
+      const HChar* unwind_case; // used when debug is True.
 
       if (i >= max_n_ips)
          break;
@@ -617,61 +663,59 @@ UInt VG_(get_StackTrace_wrk) ( ThreadId tid_if_known,
 
       /* Try to derive a new (ip,sp,fp) triple from the current set. */
 
-      /* First off, see if there is any CFI info to hand which can
-         be used. */
-      if ( VG_(use_CF_info)( &uregs, fp_min, fp_max ) ) {
-         if (0 == uregs.xip || 1 == uregs.xip) break;
-         if (old_xsp >= uregs.xsp) {
-            if (debug)
-               VG_(printf) ("     CF end of stack old_xsp %p >= xsp %p\n",
-                            (void*)old_xsp, (void*)uregs.xsp);
-            break;
+      /* With --unwind=fp, follow the %rbp chain, unless it looks
+         bogus, in which case carry on as for --unwind=cfi. */
+      if (VG_(clo_unwind) == Vg_UnwindFP
+          && use_fp_chain( &uregs, fp_min, fp_max, True )) {
+         unwind_case = "F";
+         goto unwind_done;
+      }
+
+      /* With --unwind=auto, use the %rbp chain if it is known to give
+         the same result as the CFI for this IP.  If that is not known
+         yet, find out. */
+      if (VG_(clo_unwind) == Vg_UnwindAuto) {
+         UWord hash = uregs.xip % N_FP_CF_VERIF;
+         Addr  xip_verif = uregs.xip ^ fp_CF_verif_cache [hash];
+         if (xip_verif == FPUNWIND) {
+            if (use_fp_chain( &uregs, fp_min, fp_max, True )) {
+               unwind_case = "FF";
+               goto unwind_done;
+            }
+         } else if (xip_verif > CFUNWIND) {
+            D3UnwindRegs cf_uregs = uregs;
+            D3UnwindRegs fp_uregs = uregs;
+            if (VG_(use_CF_info)( &cf_uregs, fp_min, fp_max )) {
+               if (use_fp_chain( &fp_uregs, fp_min, fp_max, True )
+                   && fp_uregs.xip == cf_uregs.xip
+                   && fp_uregs.xsp == cf_uregs.xsp
+                   && fp_uregs.xbp == cf_uregs.xbp)
+                  fp_CF_verif_cache [hash] = uregs.xip ^ FPUNWIND;
+               else
+                  fp_CF_verif_cache [hash] = uregs.xip ^ CFUNWIND;
+               uregs = cf_uregs;
+               unwind_case = "CV";
+               goto unwind_done;
+            }
+            fp_CF_verif_cache [hash] = uregs.xip ^ NOINFO;
          }
-         if (sps) sps[i] = uregs.xsp;
-         if (fps) fps[i] = uregs.xbp;
-         ips[i++] = uregs.xip - 1; /* -1: refer to calling insn, not the RA */
-         if (debug)
-            VG_(printf)("     ipsC[%d]=%#08lx rbp %#08lx rsp %#08lx\n",
-                        i-1, ips[i-1], uregs.xbp, uregs.xsp);
-         uregs.xip = uregs.xip - 1; /* as per comment at the head of this loop */
-         RECURSIVE_MERGE(cmrf,ips,i);
-         continue;
+      }
+
+      /* See if there is any CFI info to hand which can be used. */
+      if ( VG_(use_CF_info)( &uregs, fp_min, fp_max ) ) {
+         unwind_case = "C";
+         goto unwind_done;
       }
 
       /* If VG_(use_CF_info) fails, it won't modify ip/sp/fp, so
          we can safely try the old-fashioned method. */
-      /* This bit is supposed to deal with frames resulting from
-         functions which begin "pushq %rbp ; movq %rsp, %rbp".
-         Unfortunately, since we can't (easily) look at the insns at
-         the start of the fn, like GDB does, there's no reliable way
-         to tell.  Hence the hack of first trying out CFI, and if that
-         fails, then use this as a fallback. */
-      /* Note: re "- 1 * sizeof(UWord)", need to take account of the
-         fact that we are prodding at & ((UWord*)fp)[1] and so need to
-         adjust the limit check accordingly.  Omitting this has been
-         observed to cause segfaults on rare occasions. */
-      if (fp_min <= uregs.xbp && uregs.xbp <= fp_max - 1 * sizeof(UWord)) {
-         /* fp looks sane, so use it. */
-         uregs.xip = (((UWord*)uregs.xbp)[1]);
-         if (0 == uregs.xip || 1 == uregs.xip) break;
-         uregs.xsp = uregs.xbp + sizeof(Addr) /*saved %rbp*/ 
-                               + sizeof(Addr) /*ra*/;
-         if (old_xsp >= uregs.xsp) {
-            if (debug)
-               VG_(printf) ("     FF end of stack old_xsp %p >= xsp %p\n",
-                            (void*)old_xsp, (void*)uregs.xsp);
-            break;
-         }
-         uregs.xbp = (((UWord*)uregs.xbp)[0]);
-         if (sps) sps[i] = uregs.xsp;
-         if (fps) fps[i] = uregs.xbp;
-         ips[i++] = uregs.xip - 1; /* -1: refer to calling insn, not the RA */
-         if (debug)
-            VG_(printf)("     ipsF[%d]=%#08lx rbp %#08lx rsp %#08lx\n",
-                        i-1, ips[i-1], uregs.xbp, uregs.xsp);
-         uregs.xip = uregs.xip - 1; /* as per comment at the head of this loop */
-         RECURSIVE_MERGE(cmrf,ips,i);
-         continue;
+      /* Since we can't (easily) look at the insns at the start of the
+         fn, like GDB does, there's no reliable way to tell whether it
+         set up a frame pointer.  Hence the hack of first trying out
+         CFI, and if that fails, then use this as a fallback. */
+      if (use_fp_chain( &uregs, fp_min, fp_max, False )) {
+         unwind_case = "F";
+         goto unwind_done;
       }
 
       /* Last-ditch hack (evidently GDB does something similar).  We
@@ -706,12 +750,35 @@ UInt VG_(get_StackTrace_wrk) ( ThreadId tid_if_known,
 
       /* No luck at all.  We have to give up. */
       break;
+
+   unwind_done:
+      /* Add a frame in ips/sps/fps */
+      if (0 == uregs.xip || 1 == uregs.xip) break;
+      if (old_xsp >= uregs.xsp) {
+         if (debug)
+            VG_(printf) ("     %s end of stack old_xsp %p >= xsp %p\n",
+                         unwind_case, (void*)old_xsp, (void*)uregs.xsp);
+         break;
+      }
+      if (sps) sps[i] = uregs.xsp;
+      if (fps) fps[i] = uregs.xbp;
+      ips[i++] = uregs.xip - 1; /* -1: refer to calling insn, not the RA */
+      if (debug)
+         VG_(printf)("     ips%s[%d]=%#08lx rbp %#08lx rsp %#08lx\n",
+                     unwind_case, i-1, ips[i-1], uregs.xbp, uregs.xsp);
+      uregs.xip = uregs.xip - 1; /* as per comment at the head of this loop */
+      RECURSIVE_MERGE(cmrf,ips,i);
    }
 
    n_found = i;
    return n_found;
 }
 
+#undef N_FP_CF_VERIF
+#undef FPUNWIND
+#undef NOINFO
+#undef CFUNWIND
+
 #endif
 
 /* -----------------------ppc32/64 ---------------------- */
@@ -1478,6 +1545,160 @@ UInt VG_(get_StackTrace_wrk) ( ThreadId tid_if_known,
 /*---                                                      ---*/
 /*------------------------------------------------------------*/
 
+/*------------------------------------------------------------*/
+/*--- Shadow call stacks                                   ---*/
+/*------------------------------------------------------------*/
+
+/* With --shadow-call-stack=yes, the generated code calls
+   VG_(shadow_stack_call) at the end of each superblock ending in a
+   call, and VG_(shadow_stack_ret) at the end of each one ending in a
+   return (see m_translate.c).  So each thread has a stack of the return
+   addresses of its active calls, and stack traces are copied from it
+   rather than unwound.
+
+   Each frame records the SP just after its call, that is, the address
+   of the return address.  A frame is live as long as SP is at or below
+   that, so frames abandoned by a longjmp or a C++ exception are
+   discarded lazily, the next time the stack is pushed, popped or
+   looked at.
+
+   A signal frame pushed on the same stack is recorded as a frame with
+   a zero return address, and stack traces going through it are left
+   to the unwinder, which knows how to step over it.  A signal handler
+   running on an alternate stack above the current one would make SP
+   move above all the frames, so the shadow stack is then given up for
+   the rest of the thread's life. */
+
+typedef
+   struct {
+      Addr ra;    /* return address, or 0 for a signal frame */
+      Addr sp;    /* SP just after the call */
+   }
+   ShadowFrame;
+
+typedef
+   struct {
+      ShadowFrame* frames;
+      UInt         used;
+      UInt         size;
+      Bool         lost;
+   }
+   ShadowStack;
+
+/* Indexed by ThreadId. */
+static ShadowStack* shadow_stacks   = NULL;
+static UInt         n_shadow_stacks = 0;
+
+static ShadowStack* get_shadow_stack ( ThreadId tid )
+{
+   if (UNLIKELY(tid >= n_shadow_stacks))
+      VG_(grow_thread_array)("stacktrace.gss.1", (void**)&shadow_stacks,
+                             &n_shadow_stacks, sizeof shadow_stacks[0],
+                             VG_N_THREADS);
+   vg_assert(tid < n_shadow_stacks);
+   return &shadow_stacks[tid];
+}
+
+/* Discard the frames which have been returned from, now that SP is
+   sp. */
+static inline void shadow_stack_sync ( ShadowStack* ss, Addr sp )
+{
+   while (ss->used > 0 && ss->frames[ss->used - 1].sp < sp)
+      ss->used--;
+}
+
+static void shadow_stack_push ( ShadowStack* ss, Addr ra, Addr sp )
+{
+   /* A frame with the same SP as the new one is a stale one. */
+   shadow_stack_sync(ss, sp + 1);
+   if (UNLIKELY(ss->used == ss->size)) {
+      ss->size   = ss->size == 0 ? 64 : 2 * ss->size;
+      ss->frames = VG_(realloc)("stacktrace.ssp.1", ss->frames,
+                                ss->size * sizeof ss->frames[0]);
+   }
+   ss->frames[ss->used].ra = ra;
+   ss->frames[ss->used].sp = sp;
+   ss->used++;
+}
+
+/* CALLED FROM GENERATED CODE */
+VG_REGPARM(1) void VG_(shadow_stack_call) ( Addr sp )
+{
+   ShadowStack* ss = get_shadow_stack(VG_(get_running_tid)());
+   if (UNLIKELY(ss->lost))
+      return;
+   /* The call has just pushed the return address. */
+   shadow_stack_push(ss, *(Addr*)sp, sp);
+}
+
+/* CALLED FROM GENERATED CODE */
+VG_REGPARM(1) void VG_(shadow_stack_ret) ( Addr sp )
+{
+   ShadowStack* ss = get_shadow_stack(VG_(get_running_tid)());
+   shadow_stack_sync(ss, sp);
+}
+
+void VG_(shadow_stack_reset) ( ThreadId tid )
+{
+   ShadowStack* ss;
+
+   if (!VG_(clo_shadow_call_stack))
+      return;
+   ss = get_shadow_stack(tid);
+   ss->used = 0;
+   ss->lost = False;
+}
+
+void VG_(shadow_stack_signal_frame) ( ThreadId tid, Addr old_sp )
+{
+   ShadowStack* ss;
+   Addr         sp;
+
+   if (!VG_(clo_shadow_call_stack))
+      return;
+   ss = get_shadow_stack(tid);
+   sp = VG_(get_SP)(tid);
+   if (sp > old_sp) {
+      if (!ss->lost)
+         VG_(debugLog)(1, "stacktrace", "thread %u: signal delivered on "
+                       "an alternate stack, giving up its shadow call "
+                       "stack\n", tid);
+      ss->used = 0;
+      ss->lost = True;
+   } else if (!ss->lost) {
+      shadow_stack_push(ss, 0, sp);
+   }
+}
+
+/* Copy a stack trace for tid, whose IP and SP are ip and sp, from its
+   shadow call stack.  Returns 0 if it has to be unwound instead. */
+static UInt get_StackTrace_from_shadow_stack ( ThreadId tid,
+                                               /*OUT*/StackTrace ips,
+                                               UInt max_n_ips,
+                                               Addr ip, Addr sp )
+{
+   ShadowStack* ss   = get_shadow_stack(tid);
+   Int          cmrf = VG_(clo_merge_recursive_frames);
+   UInt         i, j;
+
+   if (ss->lost)
+      return 0;
+   shadow_stack_sync(ss, sp);
+
+   ips[0] = ip;
+   i = 1;
+   j = ss->used;
+   while (i < max_n_ips && j > 0) {
+      j--;
+      if (ss->frames[j].ra == 0)
+         return 0;
+      ips[i++] = ss->frames[j].ra - 1; /* -1: refer to calling insn, not
+                                          the RA */
+      RECURSIVE_MERGE(cmrf,ips,i);
+   }
+   return i;
+}
+
 /*------------------------------------------------------------*/
 /*--- Exported functions.                                  ---*/
 /*------------------------------------------------------------*/
@@ -1527,6 +1748,18 @@ UInt VG_(get_StackTrace_with_deltas)(
    }
 #  endif
 
+   /* With --shadow-call-stack=yes, there is usually no need to unwind
+      at all. */
+   if (VG_(clo_shadow_call_stack) && sps == NULL && fps == NULL) {
+      UInt n_found
+         = get_StackTrace_from_shadow_stack(
+              tid, ips, n_ips,
+              (Addr)(startRegs.r_pc + (Long)first_ip_delta),
+              (Addr)(startRegs.r_sp + (Long)first_sp_delta));
+      if (n_found > 0)
+         return n_found;
+   }
+
    /* See if we can get a better idea of the stack limits */
    VG_(stack_limits)( (Addr)startRegs.r_sp,
                       &stack_lowest_byte, &stack_highest_byte );
@@ -3113,6 +3113,7 @@ PRE(sys_execve)
             VG_(printf)("env: %s\n", *cpp);
    }
 
+   VG_(flush_output_sinks)();
    SET_STATUS_from_SysRes( 
       VG_(do_syscall3)(__NR_execve, (UWord)path, (UWord)argv, (UWord)envp) 
    );
@@ -1624,14 +1624,22 @@ typedef
    }
    SyscallInfo;
 
+/* syscallInfo has room for VG_(clo_max_threads) entries, so that it
+   never moves even though sci pointers into it are held across blocking
+   syscalls.  Only the entries covering the thread table have been
+   initialised: the scheduler clears each one as it sets up the
+   corresponding ThreadState. */
 SyscallInfo *syscallInfo;
 
-/* The scheduler needs to be able to zero out these records after a
-   fork, hence this is exported from m_syswrap. */
+/* The scheduler needs to be able to zero out these records when
+   creating thread table entries and after a fork, hence this is
+   exported from m_syswrap. */
 void VG_(clear_syscallInfo) ( ThreadId tid )
 {
-   vg_assert(syscallInfo);
-   vg_assert(tid >= 0 && tid < VG_N_THREADS);
+   if (syscallInfo == NULL)
+      syscallInfo = VG_(malloc)("scinfo", VG_(clo_max_threads)
+                                          * sizeof syscallInfo[0]);
+   vg_assert(tid >= 0 && tid < VG_(clo_max_threads));
    VG_(memset)( & syscallInfo[tid], 0, sizeof( syscallInfo[tid] ));
    syscallInfo[tid].status.what = SsIdle;
 }
@@ -1648,21 +1656,6 @@ Word VG_(is_in_syscall_no) (ThreadId tid )
    return syscallInfo[tid].orig_args.sysno;
 }
 
-static void ensure_initialised ( void )
-{
-   Int i;
-   static Bool init_done = False;
-   if (init_done) 
-      return;
-   init_done = True;
-
-   syscallInfo = VG_(malloc)("scinfo", VG_N_THREADS * sizeof syscallInfo[0]);
-
-   for (i = 0; i < VG_N_THREADS; i++) {
-      VG_(clear_syscallInfo)( i );
-   }
-}
-
 /* --- This is the main function of this file. --- */
 
 void VG_(client_syscall) ( ThreadId tid, UInt trc )
@@ -1673,8 +1666,6 @@ void VG_(client_syscall) ( ThreadId tid, UInt trc )
    SyscallArgLayout         layout;
    SyscallInfo*             sci;
 
-   ensure_initialised();
-
    vg_assert(VG_(is_valid_tid)(tid));
    vg_assert(tid >= 1 && tid < VG_N_THREADS);
    vg_assert(VG_(is_running_thread)(tid));
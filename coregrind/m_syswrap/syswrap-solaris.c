@@ -3895,6 +3895,7 @@ PRE(sys_execve)
             VG_(printf)("env: %s\n", *cpp);
    }
 
+   VG_(flush_output_sinks)();
 #if defined(SOLARIS_EXECVE_SYSCALL_TAKES_FLAGS)
    res = VG_(do_syscall4)(__NR_execve, (UWord) path, (UWord) argv,
                           (UWord) envp, ARG4 & ~VKI_EXEC_DESCRIPTOR);
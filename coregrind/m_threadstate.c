@@ -31,8 +31,13 @@
 #include "pub_core_basics.h"
 #include "pub_core_vki.h"
 #include "pub_core_threadstate.h"
+#include "pub_core_aspacemgr.h"     // VG_(am_mmap_anon_float_valgrind)
 #include "pub_core_mallocfree.h"    // VG_(malloc)
+#include "pub_core_libcbase.h"
 #include "pub_core_libcassert.h"
+#include "pub_core_debuglog.h"
+#include "pub_core_options.h"       // VG_(clo_max_threads)
+#include "pub_core_gdbserver.h"     // VG_(gdbserver_update_n_threads)
 #include "pub_core_inner.h"
 #if defined(ENABLE_INNER_CLIENT_REQUEST)
 #include "helgrind/helgrind.h"
@@ -53,26 +58,83 @@ ThreadState *VG_(inner_threads);
 /*--- Operations.                                          ---*/
 /*------------------------------------------------------------*/
 
+static void annotate_thread_slot(ThreadId tid)
+{
+   INNER_REQUEST(
+      ANNOTATE_BENIGN_RACE_SIZED(&VG_(threads)[tid].status,
+                                 sizeof(VG_(threads)[tid].status), ""));
+   INNER_REQUEST(
+      ANNOTATE_BENIGN_RACE_SIZED(&VG_(threads)[tid].os_state.exitcode,
+                                 sizeof(VG_(threads)[tid].os_state.exitcode),
+                                 ""));
+}
+
 void VG_(init_Threads)(void)
 {
    ThreadId tid;
-
-   VG_(threads) = VG_(arena_memalign) (VG_AR_CORE, "init_Threads",
-                                       LibVEX_GUEST_STATE_ALIGN,
-                                       VG_N_THREADS * sizeof VG_(threads)[0]);
-
-   for (tid = 1; tid < VG_N_THREADS; tid++) {
-      INNER_REQUEST(
-         ANNOTATE_BENIGN_RACE_SIZED(&VG_(threads)[tid].status,
-                                    sizeof(VG_(threads)[tid].status), ""));
-      INNER_REQUEST(
-         ANNOTATE_BENIGN_RACE_SIZED(&VG_(threads)[tid].os_state.exitcode,
-                                    sizeof(VG_(threads)[tid].os_state.exitcode),
-                                    ""));
+   SizeT    szB;
+   SysRes   sres;
+
+   /* Reserve room for the largest table we might need.  The kernel only
+      backs the pages once they are touched, so the slots beyond
+      VG_N_THREADS cost address space but no memory. */
+   szB = VG_PGROUNDUP(VG_(clo_max_threads) * sizeof VG_(threads)[0]);
+   sres = VG_(am_mmap_anon_float_valgrind)( szB );
+   if (sr_isError(sres)) {
+      VG_(out_of_memory_NORETURN)("init_Threads", szB);
+      /*NOTREACHED*/
    }
+   VG_(threads) = (ThreadState*)(Addr)sr_Res(sres);
+   vg_assert(VG_IS_PAGE_ALIGNED(VG_(threads)));
+
+   for (tid = 1; tid < VG_N_THREADS; tid++)
+      annotate_thread_slot(tid);
    INNER_REQUEST(VALGRIND_INNER_THREADS(VG_(threads)));
 }
 
+ThreadId VG_(grow_Threads)( void (*init_thread)(ThreadId) )
+{
+   ThreadId tid;
+   UInt     old_n = VG_N_THREADS;
+   UInt     new_n = VG_MIN(2 * old_n, VG_(clo_max_threads));
+
+   if (new_n <= old_n)
+      return VG_INVALID_THREADID;
+
+   VG_(debugLog)(1, "threadstate", "growing thread table from %u to %u "
+                 "entries\n", old_n, new_n);
+
+   /* Initialise the new entries before making them visible: threads
+      that do not hold the lock (e.g. in signal handlers) may be scanning
+      the table up to VG_N_THREADS. */
+   for (tid = old_n; tid < new_n; tid++) {
+      vg_assert(VG_(threads)[tid].status == VgTs_Empty);
+      annotate_thread_slot(tid);
+      init_thread(tid);
+   }
+   VG_N_THREADS = new_n;
+   VG_(gdbserver_update_n_threads)();
+
+   return old_n;
+}
+
+void VG_(grow_thread_array) ( const HChar* cc, void** arr,
+                              UInt* n_elems, SizeT eltSzB,
+                              UInt min_elems )
+{
+   UInt new_n;
+
+   vg_assert(*n_elems == 0 || *arr != NULL);
+   if (LIKELY(min_elems <= *n_elems))
+      return;
+
+   new_n = VG_MAX(min_elems, 2 * *n_elems);
+   *arr = VG_(realloc)(cc, *arr, new_n * eltSzB);
+   VG_(memset)((HChar*)*arr + *n_elems * eltSzB, 0,
+               (new_n - *n_elems) * eltSzB);
+   *n_elems = new_n;
+}
+
 const HChar* VG_(name_of_ThreadStatus) ( ThreadStatus status )
 {
    switch (status) {
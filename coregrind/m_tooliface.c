@@ -95,6 +95,7 @@ VgNeeds VG_(needs) = {
    .syscall_wrapper      = False,
    .sanity_checks        = False,
    .print_stats          = False,
+   .shed_memory          = False,
    .info_location        = False,
    .var_info	         = False,
    .malloc_replacement   = False,
@@ -327,6 +328,14 @@ void VG_(needs_print_stats) (
    VG_(tdict).tool_print_stats = print_stats;
 }
 
+void VG_(needs_shed_memory) (
+   void (*shed_memory)(void)
+)
+{
+   VG_(needs).shed_memory = True;
+   VG_(tdict).tool_shed_memory = shed_memory;
+}
+
 void VG_(needs_info_location) (
    void (*info_location)(DiEpoch, Addr)
 )
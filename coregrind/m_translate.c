@@ -43,9 +43,12 @@
 
 #include "pub_core_debuginfo.h"  // VG_(get_fnname_w_offset)
 #include "pub_core_redir.h"      // VG_(redir_do_lookup)
+#include "pub_core_replacemalloc.h" // VG_(clo_malloc_fast_path)
+#include "pub_core_scheduler.h"  // VG_(malloc_fast_path)
 
 #include "pub_core_signals.h"    // VG_(synth_fault_{perms,mapping}
 #include "pub_core_stacks.h"     // VG_(unknown_SP_update*)()
+#include "pub_core_stacktrace.h" // VG_(shadow_stack_{call,ret})
 #include "pub_core_tooliface.h"  // VG_(tdict)
 
 #include "pub_core_translate.h"
@@ -675,6 +678,135 @@ IRSB* vg_SP_update_pass ( void*             closureV,
 #undef DO_DIE
 }
 
+/*------------------------------------------------------------*/
+/*--- Shadow call stack pass                               ---*/
+/*------------------------------------------------------------*/
+
+/* With --shadow-call-stack=yes, this pass makes each superblock which
+   ends in a call or a return tell m_stacktrace about it, passing the
+   final SP.  Calls are not chased into in that case (see m_main.c), so
+   each one ends its superblock.  Calls to the original of a wrapped
+   function end in Ijk_NoRedir, and push a return address too. */
+static
+IRSB* vg_shadow_stack_pass ( void*             closureV,
+                             IRSB*             sb_in, 
+                             const VexGuestLayout*   layout, 
+                             const VexGuestExtents*  vge,
+                             const VexArchInfo*      vai,
+                             IRType            gWordTy, 
+                             IRType            hWordTy )
+{
+   IRTemp       sp;
+   IRDirty*     di;
+   void*        fn;
+   const HChar* fn_name;
+
+   switch (sb_in->jumpkind) {
+      case Ijk_Call:
+      case Ijk_NoRedir:
+         fn      = VG_(shadow_stack_call);
+         fn_name = "VG_(shadow_stack_call)";
+         break;
+      case Ijk_Ret:
+         fn      = VG_(shadow_stack_ret);
+         fn_name = "VG_(shadow_stack_ret)";
+         break;
+      default:
+         return sb_in;
+   }
+
+   vg_assert(gWordTy == hWordTy);
+   sp = newIRTemp(sb_in->tyenv, gWordTy);
+   addStmtToIRSB( sb_in,
+                  IRStmt_WrTmp(sp, IRExpr_Get(layout->offset_SP, gWordTy)) );
+   di = unsafeIRDirty_0_N( 1/*regparms*/, fn_name,
+                           VG_(fnptr_to_fnentry)( fn ),
+                           mkIRExprVec_1( IRExpr_RdTmp(sp) ) );
+   addStmtToIRSB( sb_in, IRStmt_Dirty(di) );
+   return sb_in;
+}
+
+/*------------------------------------------------------------*/
+/*--- Malloc fast path pass                                ---*/
+/*------------------------------------------------------------*/
+
+/* With --malloc-fast-path=yes, a superblock which ends in a client
+   request first calls VG_(malloc_fast_path), which does the request if
+   it is a call of one of the tool's malloc replacement functions.  The
+   superblock then carries on to the next one directly, and only goes
+   back to the scheduler for the other requests.
+
+   The call is declared to modify the whole guest state and its
+   shadows, so that all of it is up to date for the tool (which will
+   typically take a stack trace) and for the scheduler if the request
+   is not done here.  This pass runs after the tool's instrumentation,
+   which thus never sees the call. */
+static
+IRSB* vg_malloc_fast_path_pass ( IRSB* sb_in, const VexGuestLayout* layout,
+                                 IRType hWordTy )
+{
+   IRTemp   done, not_done;
+   IRDirty* di;
+   Int      i;
+
+   if (sb_in->jumpkind != Ijk_ClientReq || sb_in->next->tag != Iex_Const)
+      return sb_in;
+
+   /* The tool sees the thread at the instruction after the request,
+      as it would in the scheduler. */
+   addStmtToIRSB( sb_in, IRStmt_Put(layout->offset_IP, sb_in->next) );
+
+   done = newIRTemp(sb_in->tyenv, hWordTy);
+   di = unsafeIRDirty_1_N( done, 0/*regparms*/, "VG_(malloc_fast_path)",
+                           VG_(fnptr_to_fnentry)( VG_(malloc_fast_path) ),
+                           mkIRExprVec_0() );
+   di->nFxState = 3;
+   for (i = 0; i < 3; i++) {
+      di->fxState[i].fx        = Ifx_Modify;
+      di->fxState[i].offset    = i * layout->total_sizeB;
+      di->fxState[i].size      = layout->total_sizeB;
+      di->fxState[i].nRepeats  = 0;
+      di->fxState[i].repeatLen = 0;
+   }
+   addStmtToIRSB( sb_in, IRStmt_Dirty(di) );
+
+   not_done = newIRTemp(sb_in->tyenv, Ity_I1);
+   addStmtToIRSB( sb_in,
+      IRStmt_WrTmp( not_done,
+                    hWordTy == Ity_I64
+                       ? IRExpr_Binop(Iop_CmpEQ64, IRExpr_RdTmp(done),
+                                      IRExpr_Const(IRConst_U64(0)))
+                       : IRExpr_Binop(Iop_CmpEQ32, IRExpr_RdTmp(done),
+                                      IRExpr_Const(IRConst_U32(0))) ) );
+   addStmtToIRSB( sb_in,
+      IRStmt_Exit( IRExpr_RdTmp(not_done), Ijk_ClientReq,
+                   sb_in->next->Iex.Const.con, layout->offset_IP ) );
+   sb_in->jumpkind = Ijk_Boring;
+   return sb_in;
+}
+
+/* The core's own instrumentation, done after the tool's: the passes
+   above which are needed, in that order. */
+static
+IRSB* vg_core_instrument ( void*             closureV,
+                           IRSB*             sb_in, 
+                           const VexGuestLayout*   layout, 
+                           const VexGuestExtents*  vge,
+                           const VexArchInfo*      vai,
+                           IRType            gWordTy, 
+                           IRType            hWordTy )
+{
+   if (need_to_handle_SP_assignment())
+      sb_in = vg_SP_update_pass(closureV, sb_in, layout, vge, vai,
+                                gWordTy, hWordTy);
+   if (VG_(clo_shadow_call_stack))
+      sb_in = vg_shadow_stack_pass(closureV, sb_in, layout, vge, vai,
+                                   gWordTy, hWordTy);
+   if (VG_(needs).malloc_replacement && VG_(clo_malloc_fast_path))
+      sb_in = vg_malloc_fast_path_pass(sb_in, layout, hWordTy);
+   return sb_in;
+}
+
 /*------------------------------------------------------------*/
 /*--- Main entry point for the JITter.                     ---*/
 /*------------------------------------------------------------*/
@@ -1770,7 +1902,10 @@ Bool VG_(translate) ( ThreadId tid,
    }
    /* No need for type kludgery here. */
    vta.instrument2       = need_to_handle_SP_assignment()
-                              ? vg_SP_update_pass
+                           || VG_(clo_shadow_call_stack)
+                           || (VG_(needs).malloc_replacement
+                               && VG_(clo_malloc_fast_path))
+                              ? vg_core_instrument
                               : NULL;
    vta.finaltidy         = VG_(needs).final_IR_tidy_pass
                               ? VG_(tdict).tool_final_IR_tidy_pass
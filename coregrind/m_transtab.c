@@ -507,6 +507,8 @@ static ULong n_in_sc_count = 0;
 static ULong n_dump_count = 0;
 static ULong n_dump_osize = 0;
 static ULong n_sectors_recycled = 0;
+/* Number of sectors given back by VG_(release_old_transtab_sectors). */
+static ULong n_sectors_released = 0;
 
 /* Number/osize of translations discarded due to requests to do so. */
 static ULong n_disc_count = 0;
@@ -1504,6 +1506,74 @@ static void add_to_empty_tt_list (SECno sNo, TTEno tteno)
    sectors[sNo].empty_tt_list = tteno;
 }
 
+/* Throw away all the translations in sector SNO, which must have
+   been initialised, leaving its tt/tc empty but still allocated. */
+static void dumpSector ( SECno sno )
+{
+   Sector* sec = &sectors[sno];
+
+   vg_assert(sec->ttC != NULL);
+   vg_assert(sec->ttH != NULL);
+   vg_assert(sec->tc_next != NULL);
+   n_dump_count += sec->tt_n_inuse;
+
+   VexArch     arch_host = VexArch_INVALID;
+   VexArchInfo archinfo_host;
+   VG_(bzero_inline)(&archinfo_host, sizeof(archinfo_host));
+   VG_(machine_get_VexArchInfo)( &arch_host, &archinfo_host );
+   VexEndness endness_host = archinfo_host.endness;
+
+   /* Visit each just-about-to-be-abandoned translation. */
+   if (DEBUG_TRANSTAB) VG_(printf)("QQQ unlink-entire-sector: %d START\n",
+                                   sno);
+   sec->empty_tt_list = HTT_EMPTY;
+   for (TTEno ei = 0; ei < N_TTES_PER_SECTOR; ei++) {
+      if (sec->ttH[ei].status == InUse) {
+         vg_assert(sec->ttC[ei].n_tte2ec >= 1);
+         vg_assert(sec->ttC[ei].n_tte2ec <= 3);
+         n_dump_osize += TTEntryH__osize(&sec->ttH[ei]);
+         /* Tell the tool too. */
+         if (VG_(needs).superblock_discards) {
+            VexGuestExtents vge_tmp;
+            TTEntryH__to_VexGuestExtents( &vge_tmp, &sec->ttH[ei] );
+            VG_TDICT_CALL( tool_discard_superblock_info,
+                           sec->ttC[ei].entry, vge_tmp );
+         }
+         unchain_in_preparation_for_deletion(arch_host,
+                                             endness_host, sno, ei);
+      } else {
+         vg_assert(sec->ttC[ei].n_tte2ec == 0);
+      }
+      sec->ttH[ei].status   = Empty;
+      sec->ttC[ei].n_tte2ec = 0;
+      add_to_empty_tt_list(sno, ei);
+   }
+   for (HTTno hi = 0; hi < N_HTTES_PER_SECTOR; hi++)
+      sec->htt[hi] = HTT_EMPTY;
+
+   if (DEBUG_TRANSTAB) VG_(printf)("QQQ unlink-entire-sector: %d END\n",
+                                   sno);
+
+   /* Free up the eclass structures. */
+   for (EClassNo e = 0; e < ECLASS_N; e++) {
+      if (sec->ec2tte_size[e] == 0) {
+         vg_assert(sec->ec2tte_used[e] == 0);
+         vg_assert(sec->ec2tte[e] == NULL);
+      } else {
+         vg_assert(sec->ec2tte[e] != NULL);
+         ttaux_free(sec->ec2tte[e]);
+         sec->ec2tte[e] = NULL;
+         sec->ec2tte_size[e] = 0;
+         sec->ec2tte_used[e] = 0;
+      }
+   }
+
+   /* Empty out the host extents array. */
+   vg_assert(sec->host_extents != NULL);
+   VG_(dropTailXA)(sec->host_extents, VG_(sizeXA)(sec->host_extents));
+   vg_assert(VG_(sizeXA)(sec->host_extents) == 0);
+}
+
 static void initialiseSector ( SECno sno )
 {
    UInt i;
@@ -1534,7 +1604,7 @@ static void initialiseSector ( SECno sno )
       if (VG_(clo_stats) || VG_(debugLog_getLevel)() >= 1)
          VG_(dmsg)("transtab: " "allocate sector %d\n", sno);
 
-      sres = VG_(am_mmap_anon_float_valgrind)( 8 * tc_sector_szQ );
+      sres = VG_(am_mmap_anon_float_valgrind_huge)( 8 * tc_sector_szQ );
       if (sr_isError(sres)) {
          VG_(out_of_memory_NORETURN)("initialiseSector(TC)", 
                                      8 * tc_sector_szQ );
@@ -1542,7 +1612,7 @@ static void initialiseSector ( SECno sno )
       }
       sec->tc = (ULong*)(Addr)sr_Res(sres);
 
-      sres = VG_(am_mmap_anon_float_valgrind)
+      sres = VG_(am_mmap_anon_float_valgrind_huge)
                 ( N_TTES_PER_SECTOR * sizeof(TTEntryC) );
       if (sr_isError(sres)) {
          VG_(out_of_memory_NORETURN)("initialiseSector(TTC)", 
@@ -1551,7 +1621,7 @@ static void initialiseSector ( SECno sno )
       }
       sec->ttC = (TTEntryC*)(Addr)sr_Res(sres);
 
-      sres = VG_(am_mmap_anon_float_valgrind)
+      sres = VG_(am_mmap_anon_float_valgrind_huge)
                 ( N_TTES_PER_SECTOR * sizeof(TTEntryH) );
       if (sr_isError(sres)) {
          VG_(out_of_memory_NORETURN)("initialiseSector(TTH)", 
@@ -1567,7 +1637,7 @@ static void initialiseSector ( SECno sno )
          add_to_empty_tt_list(sno, ei);
       }
 
-      sres = VG_(am_mmap_anon_float_valgrind)
+      sres = VG_(am_mmap_anon_float_valgrind_huge)
                 ( N_HTTES_PER_SECTOR * sizeof(TTEno) );
       if (sr_isError(sres)) {
          VG_(out_of_memory_NORETURN)("initialiseSector(HTT)", 
@@ -1602,66 +1672,7 @@ static void initialiseSector ( SECno sno )
          VG_(dmsg)("transtab: " "recycle  sector %d\n", sno);
       n_sectors_recycled++;
 
-      vg_assert(sec->ttC != NULL);
-      vg_assert(sec->ttH != NULL);
-      vg_assert(sec->tc_next != NULL);
-      n_dump_count += sec->tt_n_inuse;
-
-      VexArch     arch_host = VexArch_INVALID;
-      VexArchInfo archinfo_host;
-      VG_(bzero_inline)(&archinfo_host, sizeof(archinfo_host));
-      VG_(machine_get_VexArchInfo)( &arch_host, &archinfo_host );
-      VexEndness endness_host = archinfo_host.endness;
-
-      /* Visit each just-about-to-be-abandoned translation. */
-      if (DEBUG_TRANSTAB) VG_(printf)("QQQ unlink-entire-sector: %d START\n",
-                                      sno);
-      sec->empty_tt_list = HTT_EMPTY;
-      for (TTEno ei = 0; ei < N_TTES_PER_SECTOR; ei++) {
-         if (sec->ttH[ei].status == InUse) {
-            vg_assert(sec->ttC[ei].n_tte2ec >= 1);
-            vg_assert(sec->ttC[ei].n_tte2ec <= 3);
-            n_dump_osize += TTEntryH__osize(&sec->ttH[ei]);
-            /* Tell the tool too. */
-            if (VG_(needs).superblock_discards) {
-               VexGuestExtents vge_tmp;
-               TTEntryH__to_VexGuestExtents( &vge_tmp, &sec->ttH[ei] );
-               VG_TDICT_CALL( tool_discard_superblock_info,
-                              sec->ttC[ei].entry, vge_tmp );
-            }
-            unchain_in_preparation_for_deletion(arch_host,
-                                                endness_host, sno, ei);
-         } else {
-            vg_assert(sec->ttC[ei].n_tte2ec == 0);
-         }
-         sec->ttH[ei].status   = Empty;
-         sec->ttC[ei].n_tte2ec = 0;
-         add_to_empty_tt_list(sno, ei);
-      }
-      for (HTTno hi = 0; hi < N_HTTES_PER_SECTOR; hi++)
-         sec->htt[hi] = HTT_EMPTY;
-
-      if (DEBUG_TRANSTAB) VG_(printf)("QQQ unlink-entire-sector: %d END\n",
-                                      sno);
-
-      /* Free up the eclass structures. */
-      for (EClassNo e = 0; e < ECLASS_N; e++) {
-         if (sec->ec2tte_size[e] == 0) {
-            vg_assert(sec->ec2tte_used[e] == 0);
-            vg_assert(sec->ec2tte[e] == NULL);
-         } else {
-            vg_assert(sec->ec2tte[e] != NULL);
-            ttaux_free(sec->ec2tte[e]);
-            sec->ec2tte[e] = NULL;
-            sec->ec2tte_size[e] = 0;
-            sec->ec2tte_used[e] = 0;
-         }
-      }
-
-      /* Empty out the host extents array. */
-      vg_assert(sec->host_extents != NULL);
-      VG_(dropTailXA)(sec->host_extents, VG_(sizeXA)(sec->host_extents));
-      vg_assert(VG_(sizeXA)(sec->host_extents) == 0);
+      dumpSector(sno);
 
       /* Sanity check: ensure it is already in
          sector_search_order[]. */
@@ -1686,6 +1697,66 @@ static void initialiseSector ( SECno sno )
    }
 }
 
+static void unmapSectorPart ( void* p, SizeT szB )
+{
+   SysRes sres = VG_(am_munmap_valgrind)( (Addr)p, VG_PGROUNDUP(szB) );
+   vg_assert(!sr_isError(sres));
+}
+
+/* Give the memory of all the sectors other than the youngest back to
+   the kernel, throwing away their translations.  The sectors are
+   allocated again when the youngest sector moves on to them, so this
+   only reduces the memory used until the program has run enough new
+   code to fill them up again. */
+void VG_(release_old_transtab_sectors) ( void )
+{
+   SECno sno, i, j;
+
+   vg_assert(init_done);
+   for (sno = 0; sno < n_sectors; sno++) {
+      Sector* sec = &sectors[sno];
+      if (sno == youngest_sector || sec->tc == NULL)
+         continue;
+
+      if (VG_(clo_stats) || VG_(debugLog_getLevel)() >= 1)
+         VG_(dmsg)("transtab: " "release  sector %d\n", sno);
+      n_sectors_released++;
+
+      dumpSector(sno);
+
+      unmapSectorPart( sec->tc, 8 * tc_sector_szQ );
+      unmapSectorPart( sec->ttC, N_TTES_PER_SECTOR * sizeof(TTEntryC) );
+      unmapSectorPart( sec->ttH, N_TTES_PER_SECTOR * sizeof(TTEntryH) );
+      unmapSectorPart( sec->htt, N_HTTES_PER_SECTOR * sizeof(TTEno) );
+      VG_(deleteXA)(sec->host_extents);
+      sec->tc           = NULL;
+      sec->ttC          = NULL;
+      sec->ttH          = NULL;
+      sec->htt          = NULL;
+      sec->host_extents = NULL;
+      sec->tc_next      = NULL;
+      sec->tt_n_inuse   = 0;
+      sec->empty_tt_list = HTT_EMPTY;
+
+      /* Remove it from sector_search_order[], keeping the remaining
+         sectors in order and the unused slots at the end. */
+      for (i = 0; i < n_sectors; i++) {
+         if (sector_search_order[i] == sno)
+            break;
+      }
+      vg_assert(i >= 0 && i < n_sectors);
+      for (j = i; j + 1 < n_sectors; j++)
+         sector_search_order[j] = sector_search_order[j + 1];
+      sector_search_order[n_sectors - 1] = INV_SNO;
+   }
+
+   invalidateFastCache();
+
+   { Bool sane = sanity_check_sector_search_order();
+     vg_assert(sane);
+   }
+}
+
 /* Add a translation of vge to TT/TC.  The translation is temporarily
    in code[0 .. code_len-1].
 
@@ -2590,8 +2661,9 @@ void VG_(print_tt_tc_stats) ( void )
                 n_in_tsize / (n_in_count ? n_in_count : 1));
    VG_(message)(Vg_DebugMsg,
                 " transtab: dumped     %'llu (%'llu -> ?" "?) "
-                "(sectors recycled %'llu)\n",
-                n_dump_count, n_dump_osize, n_sectors_recycled );
+                "(sectors recycled %'llu, released %'llu)\n",
+                n_dump_count, n_dump_osize, n_sectors_recycled,
+                n_sectors_released );
    VG_(message)(Vg_DebugMsg,
                 " transtab: discarded  %'llu (%'llu -> ?" "?)\n",
                 n_disc_count, n_disc_osize );
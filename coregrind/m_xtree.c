@@ -145,12 +145,17 @@ static Int ips_order_cmp(const void* vleft, const void* vright)
    const Xecu right_xecu = *(const Xecu*)vright;
    const xec* left  = VG_(indexXA)(xec_data_for_sort, left_xecu);
    const xec* right = VG_(indexXA)(xec_data_for_sort, right_xecu);
-   const StackTrace left_ips  = VG_(get_ExeContext_StackTrace)(left->ec)
-      + left->top;
-   const StackTrace right_ips = VG_(get_ExeContext_StackTrace)(right->ec)
-      + right->top;
+   Addr left_buf[left->top + left->n_ips_sel];
+   Addr right_buf[right->top + right->n_ips_sel];
+   const StackTrace left_ips  = left_buf + left->top;
+   const StackTrace right_ips = right_buf + right->top;
    UInt i;
 
+   VG_(get_ExeContext_StackTrace)(left->ec, left_buf,
+                                  left->top + left->n_ips_sel);
+   VG_(get_ExeContext_StackTrace)(right->ec, right_buf,
+                                  right->top + right->n_ips_sel);
+
    const UInt c_n_ips_sel = left->n_ips_sel < right->n_ips_sel 
       ? left->n_ips_sel : right->n_ips_sel;
 
@@ -317,8 +322,9 @@ static Xecu find_or_insert (XTree* xt, ExeContext* ec)
       } else {
          UInt top;
          UInt n_ips_sel = VG_(get_ExeContext_n_ips)(xe.ec);
-         xt->filter_IPs_fn(VG_(get_ExeContext_StackTrace)(xe.ec), n_ips_sel,
-                           &top, &n_ips_sel);
+         Addr ips[n_ips_sel];
+         VG_(get_ExeContext_StackTrace)(xe.ec, ips, n_ips_sel);
+         xt->filter_IPs_fn(ips, n_ips_sel, &top, &n_ips_sel);
          xe.top = (UShort)top;
          xe.n_ips_sel = (UShort)n_ips_sel;
       }
@@ -486,6 +492,20 @@ void VG_(XT_callgrind_print)
 
    n_xecu = VG_(sizeXA)(xt->data);
    vg_assert (n_xecu <= VG_(sizeXA)(shared->xec));
+
+   /* All the frames of all the stack traces are described below:
+      symbolise them in one go. */
+   {
+      ExeContext** ecs = VG_(malloc)(xt->cc, (n_xecu + 1)
+                                             * sizeof(ExeContext*));
+      for (Xecu xecu = 0; xecu < n_xecu; xecu++) {
+         xec* xe = (xec*)VG_(indexXA)(shared->xec, xecu);
+         ecs[xecu] = xe->n_ips_sel == 0 ? NULL : xe->ec;
+      }
+      VG_(resolve_ExeContexts)(ecs, n_xecu);
+      VG_(free)(ecs);
+   }
+
    for (Xecu xecu = 0; xecu < n_xecu; xecu++) {
       xec* xe = (xec*)VG_(indexXA)(shared->xec, xecu);
       if (xe->n_ips_sel == 0)
@@ -549,11 +569,14 @@ void VG_(XT_callgrind_print)
          UInt called_linenum;
          UInt prev_linenum;
 
-         const Addr* ips = VG_(get_ExeContext_StackTrace)(xe->ec) + xe->top;
+         Addr ips_buf[xe->top + xe->n_ips_sel];
+         const Addr* ips = ips_buf + xe->top;
          const DiEpoch ep = VG_(get_ExeContext_epoch)(xe->ec);
 
          Int ips_idx = xe->n_ips_sel - 1;
 
+         VG_(get_ExeContext_StackTrace)(xe->ec, ips_buf,
+                                        xe->top + xe->n_ips_sel);
          if (0) {
             VG_(printf)("entry img %s\n", img);
             VG_(pp_ExeContext)(xe->ec);
@@ -603,6 +626,7 @@ void VG_(XT_callgrind_print)
       in the output file. */
    FP("totals: %s\n", img_value(xt->tmp_data));
    VG_(fclose)(fp);
+   VG_(forget_resolved_IPs)();
    VG_(deleteDedupPA)(fnname_ddpa);
    VG_(deleteDedupPA)(filename_ddpa);
    VG_(free)(filename_buf);
@@ -797,19 +821,33 @@ static void ms_output_group (VgFile* fp, UInt depth, Ms_Group* group,
 }
 
 /* Allocate and build an array of Ms_Ec sorted by addresses in the
-   Ms_Ec StackTrace. */
+   Ms_Ec StackTrace.  The StackTraces are copied out of the execontexts
+   into a single array, returned in *vips_buf, to be freed together
+   with *vms_ec. */
 static void prepare_ms_ec (XTree* xt,
                            ULong (*report_value)(const void* value),
-                           ULong* top_total, Ms_Ec** vms_ec, UInt* vn_ec)
+                           ULong* top_total, Ms_Ec** vms_ec, UInt* vn_ec,
+                           Addr** vips_buf)
 {
    XT_shared* shared = xt->shared;
    const UInt n_xecu = VG_(sizeXA)(shared->xec);
    const UInt n_data_xecu = VG_(sizeXA)(xt->data);
    Ms_Ec* ms_ec = VG_(malloc)("XT_massif_print.ms_ec", n_xecu * sizeof(Ms_Ec));
    UInt n_xecu_sel = 0; // Nr of xecu that are selected for output.
+   SizeT n_ips_buf = 0;
+   Addr* ips_buf;
 
    vg_assert(n_data_xecu <= n_xecu);
 
+   for (Xecu xecu = 0; xecu < n_data_xecu; xecu++) {
+      xec* xe = (xec*)VG_(indexXA)(shared->xec, xecu);
+      if (xe->n_ips_sel > 0)
+         n_ips_buf += xe->top + xe->n_ips_sel;
+   }
+   ips_buf = VG_(malloc)("XT_massif_print.ips_buf",
+                         (n_ips_buf == 0 ? 1 : n_ips_buf) * sizeof(Addr));
+   n_ips_buf = 0;
+
    // Ensure we have in shared->ips_order_xecu our xecu sorted by StackTrace.
    ensure_ips_order_xecu_valid(shared);
 
@@ -825,7 +863,10 @@ static void prepare_ms_ec (XTree* xt,
       if (ms_ec[n_xecu_sel].n_ips == 0)
          continue;
             
-      ms_ec[n_xecu_sel].ips = VG_(get_ExeContext_StackTrace)(xe->ec) + xe->top;
+      VG_(get_ExeContext_StackTrace)(xe->ec, ips_buf + n_ips_buf,
+                                     xe->top + xe->n_ips_sel);
+      ms_ec[n_xecu_sel].ips = ips_buf + n_ips_buf + xe->top;
+      n_ips_buf += xe->top + xe->n_ips_sel;
       ms_ec[n_xecu_sel].report_value
          = (*report_value)(VG_(indexXA)(xt->data, xecu));
       *top_total += ms_ec[n_xecu_sel].report_value;
@@ -836,6 +877,7 @@ static void prepare_ms_ec (XTree* xt,
       
    *vms_ec = ms_ec;
    *vn_ec = n_xecu_sel;
+   *vips_buf = ips_buf;
 }
 
 MsFile* VG_(XT_massif_open)
@@ -896,6 +938,7 @@ void VG_(XT_massif_print)
    /* Following variables only used for detailed snapshot. */
    UInt n_ec = 0;
    Ms_Ec* ms_ec = NULL;
+   Addr* ips_buf = NULL;
    const HChar* kind = 
       header->detailed ? (header->peak ? "peak" : "detailed") : "empty";
 
@@ -903,7 +946,7 @@ void VG_(XT_massif_print)
    if (header->detailed) {
       /* Prepare the Ms_Ec sorted array of stacktraces and the groups
          at level 0. */
-      prepare_ms_ec(xt, report_value, &top_total, &ms_ec, &n_ec);
+      prepare_ms_ec(xt, report_value, &top_total, &ms_ec, &n_ec, &ips_buf);
       DMSG(1, "XT_print_massif ms_ec n_ec %u\n", n_ec);
    } else if (xt == NULL) {
       /* Non detailed, no xt => use the sz provided in the header. */
@@ -967,6 +1010,7 @@ void VG_(XT_massif_print)
 
       VG_(free)(groups);
       VG_(free)(ms_ec);
+      VG_(free)(ips_buf);
    }
 }
 
@@ -0,0 +1,433 @@
+/*--------------------------------------------------------------------*/
+/*--- Server mode: fork pre-initialised Valgrinds.      m_zygote.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   Copyright (C) 2019-2019 The Valgrind Developers
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#if defined(VGO_linux)
+
+#include "pub_core_basics.h"
+#include "pub_core_vki.h"
+#include "pub_core_vkiscnums.h"
+#include "pub_core_libcbase.h"
+#include "pub_core_libcassert.h"
+#include "pub_core_libcfile.h"
+#include "pub_core_libcprint.h"
+#include "pub_core_libcproc.h"
+#include "pub_core_libcsignal.h"
+#include "pub_core_mallocfree.h"
+#include "pub_core_xarray.h"
+#include "pub_core_clientstate.h"
+#include "pub_core_options.h"
+#include "pub_core_syscall.h"
+#include "pub_core_zygote.h"      // self
+
+/* A connection whose request is being received.  The server never
+   blocks on a connection: it reads what is available each time the
+   connection becomes readable, and only acts on the request once it
+   is complete. */
+typedef
+   struct {
+      Int           conn;
+      Int           fds[3];       // the client's stdin, stdout and stderr
+      ZygoteRequest hdr;
+      UInt          hdr_got;      // bytes of hdr received so far
+      HChar*        payload;      // cwd, args and env, NUL separated
+      UInt          payload_got;  // bytes of payload received so far
+   }
+   ServerConn;
+
+/* A running child and the connection to report its exit status on. */
+typedef
+   struct {
+      Int pid;
+      Int conn;            // -1 once the client has gone away
+   }
+   ServerChild;
+
+/* The most fds taken from a single message.  Any more are dropped by
+   the kernel, which sets MSG_CTRUNC. */
+#define MAX_FDS_PER_MSG 16
+
+static Int make_listen_socket ( const HChar* path )
+{
+   struct vki_sockaddr_un addr;
+   struct vg_stat         st;
+   Int                    sd;
+
+   if (VG_(strlen)(path) >= sizeof(addr.sun_path))
+      VG_(fmsg_bad_option)("--server", "socket path '%s' is too long\n",
+                           path);
+
+   /* Remove a socket left behind by a previous server, but nothing
+      else. */
+   if (!sr_isError(VG_(stat)(path, &st)) && VKI_S_ISSOCK(st.mode))
+      VG_(unlink)(path);
+
+   VG_(memset)(&addr, 0, sizeof(addr));
+   addr.sun_family = VKI_AF_UNIX;
+   VG_(strcpy)(addr.sun_path, path);
+
+   sd = VG_(socket)(VKI_AF_UNIX, VKI_SOCK_STREAM, 0);
+   if (sd < 0
+       || VG_(bind)(sd, (struct vki_sockaddr *)&addr, sizeof(addr)) < 0
+       || VG_(listen)(sd, 64) < 0)
+      VG_(fmsg_bad_option)("--server", "cannot listen on socket '%s'\n",
+                           path);
+   VG_(fcntl)(sd, VKI_F_SETFD, VKI_FD_CLOEXEC);
+   return sd;
+}
+
+static void close_conn ( ServerConn* sc )
+{
+   Int i;
+   for (i = 0; i < 3; i++)
+      if (sc->fds[i] >= 0)
+         VG_(close)(sc->fds[i]);
+   if (sc->payload)
+      VG_(free)(sc->payload);
+   VG_(close)(sc->conn);
+}
+
+/* Keep the first three fds passed by the client, and close any other
+   one: a misbehaving client must not make the server leak fds. */
+static void take_fds ( ServerConn* sc, struct vki_msghdr* msg )
+{
+   struct vki_cmsghdr* cmsg;
+   Int                 i, j, n_fds, *fds;
+
+   for (cmsg = VKI_CMSG_FIRSTHDR(msg); cmsg != NULL;
+        cmsg = VKI_CMSG_NXTHDR(msg, cmsg)) {
+      if (cmsg->cmsg_level != VKI_SOL_SOCKET
+          || cmsg->cmsg_type != VKI_SCM_RIGHTS
+          || cmsg->cmsg_len < VKI_CMSG_ALIGN(sizeof(struct vki_cmsghdr)))
+         continue;
+      fds   = VKI_CMSG_DATA(cmsg);
+      n_fds = (cmsg->cmsg_len - VKI_CMSG_ALIGN(sizeof(struct vki_cmsghdr)))
+              / sizeof(Int);
+      for (i = 0; i < n_fds; i++) {
+         for (j = 0; j < 3 && sc->fds[j] >= 0; j++)
+            ;
+         if (j < 3)
+            sc->fds[j] = fds[i];
+         else
+            VG_(close)(fds[i]);
+      }
+   }
+}
+
+/* Read what is available of the request on SC->conn.  Returns 1 once
+   the request is complete, 0 if more is to come, and -1 if the client
+   went away or sent a malformed request. */
+static Int continue_request ( ServerConn* sc )
+{
+   struct vki_msghdr msg;
+   struct vki_iovec  iov;
+   UWord             cbuf[VKI_CMSG_ALIGN(sizeof(struct vki_cmsghdr)
+                                         + MAX_FDS_PER_MSG * sizeof(Int))
+                          / sizeof(UWord) + 1];
+   Int               n, i, nstr;
+
+   if (sc->hdr_got < sizeof(sc->hdr)) {
+      /* The fds come with the first byte of the header, but take them
+         from any message, so that none is left open. */
+      iov.iov_base = (HChar*)&sc->hdr + sc->hdr_got;
+      iov.iov_len  = sizeof(sc->hdr) - sc->hdr_got;
+      VG_(memset)(&msg, 0, sizeof(msg));
+      msg.msg_iov        = &iov;
+      msg.msg_iovlen     = 1;
+      msg.msg_control    = cbuf;
+      msg.msg_controllen = sizeof(cbuf);
+      n = VG_(recvmsg)(sc->conn, &msg, 0);
+      if (n > 0)
+         take_fds(sc, &msg);
+      if (n <= 0)
+         return -1;
+      sc->hdr_got += n;
+      if (sc->hdr_got < sizeof(sc->hdr))
+         return 0;
+
+      if (sc->hdr.magic != VG_ZYGOTE_MAGIC
+          || sc->hdr.n_args == 0
+          || sc->hdr.payload_szB == 0
+          || sc->hdr.payload_szB > VG_ZYGOTE_MAX_PAYLOAD
+          || sc->fds[0] < 0 || sc->fds[1] < 0 || sc->fds[2] < 0)
+         goto bad;
+      sc->payload = VG_(malloc)("zygote.continue_request.1",
+                                sc->hdr.payload_szB);
+      return 0;
+   }
+
+   n = VG_(read)(sc->conn, sc->payload + sc->payload_got,
+                 sc->hdr.payload_szB - sc->payload_got);
+   if (n == -VKI_EAGAIN)
+      return 0;
+   if (n <= 0)
+      return -1;
+   sc->payload_got += n;
+   if (sc->payload_got < sc->hdr.payload_szB)
+      return 0;
+
+   if (sc->payload[sc->hdr.payload_szB - 1] != 0)
+      goto bad;
+   for (i = 0, nstr = 0; i < sc->hdr.payload_szB; i++)
+      if (sc->payload[i] == 0)
+         nstr++;
+   if (nstr != 1 + sc->hdr.n_args + sc->hdr.n_env)
+      goto bad;
+   return 1;
+
+  bad:
+   VG_(umsg)("server: ignoring malformed request\n");
+   return -1;
+}
+
+static void send_Int ( Int conn, Int v )
+{
+   if (conn >= 0)
+      (void)VG_(write_socket)(conn, &v, sizeof(v));
+}
+
+/* Reap all the children that have finished, and tell their clients. */
+static void reap_children ( XArray* children )
+{
+   Int pid, status, i;
+
+   while ((pid = VG_(waitpid)(-1, &status, VKI_WNOHANG)) > 0) {
+      for (i = 0; i < VG_(sizeXA)(children); i++) {
+         ServerChild* c = VG_(indexXA)(children, i);
+         if (c->pid != pid)
+            continue;
+         if (c->conn >= 0) {
+            send_Int(c->conn, status);
+            VG_(close)(c->conn);
+         }
+         VG_(removeIndexXA)(children, i);
+         break;
+      }
+   }
+}
+
+/* In the child: take over what the client sent, and return its
+   environment. */
+static HChar** become_client ( ServerConn* sc )
+{
+   HChar*  p = sc->payload;
+   HChar** env;
+   UInt    i;
+   Int     fd;
+   SysRes  sres;
+
+   for (fd = 0; fd < 3; fd++) {
+      if (sc->fds[fd] != fd) {
+         VG_(dup2)(sc->fds[fd], fd);
+         VG_(close)(sc->fds[fd]);
+      }
+   }
+
+   sres = VG_(do_syscall1)(__NR_chdir, (UWord)p);
+   if (sr_isError(sres)) {
+      VG_(fmsg)("server: cannot change directory to '%s'\n", p);
+      VG_(exit)(1);
+   }
+   VG_(record_startup_wd)();
+   p += VG_(strlen)(p) + 1;
+
+   VG_(args_the_exename) = p;
+   p += VG_(strlen)(p) + 1;
+   VG_(args_for_client) = VG_(newXA)(VG_(malloc), "zygote.become_client.1",
+                                     VG_(free), sizeof(HChar*));
+   for (i = 1; i < sc->hdr.n_args; i++) {
+      VG_(addToXA)(VG_(args_for_client), &p);
+      p += VG_(strlen)(p) + 1;
+   }
+
+   env = VG_(malloc)("zygote.become_client.2",
+                     (sc->hdr.n_env + 1) * sizeof(HChar*));
+   for (i = 0; i < sc->hdr.n_env; i++) {
+      env[i] = p;
+      p += VG_(strlen)(p) + 1;
+   }
+   env[i] = NULL;
+
+   /* Children started with --trace-children=yes must not become
+      servers themselves. */
+   for (i = 0; i < VG_(sizeXA)(VG_(args_for_valgrind)); i++) {
+      HChar* arg = *(HChar**)VG_(indexXA)(VG_(args_for_valgrind), i);
+      if (VG_STREQN(9, arg, "--server=")) {
+         VG_(removeIndexXA)(VG_(args_for_valgrind), i);
+         break;
+      }
+   }
+
+   VG_(logging_server_child)();
+   return env;
+}
+
+HChar** VG_(zygote_serve) ( void )
+{
+   XArray*          children;
+   XArray*          conns;
+   struct vki_pollfd* pfds = NULL;
+   Int              n_pfds = 0;
+   Int              listen_sd, chld_fd, conn, pid, i, j, n, n_conns;
+   vki_sigset_t     chld, saved_mask;
+   SysRes           sres;
+
+   vg_assert(VG_(clo_server) != NULL);
+   listen_sd = make_listen_socket(VG_(clo_server));
+
+   /* Have SIGCHLD delivered through a signalfd, so that the poll below
+      wakes up as soon as a child finishes.  If that is not available,
+      children are only reaped when the poll times out. */
+   VG_(sigemptyset)(&chld);
+   VG_(sigaddset)(&chld, VKI_SIGCHLD);
+   VG_(sigprocmask)(VKI_SIG_BLOCK, &chld, &saved_mask);
+   sres = VG_(do_syscall4)(__NR_signalfd4, -1, (UWord)&chld,
+                           sizeof(vki_sigset_t), 0);
+   chld_fd = sr_isError(sres) ? -1 : sr_Res(sres);
+   if (chld_fd >= 0)
+      VG_(fcntl)(chld_fd, VKI_F_SETFD, VKI_FD_CLOEXEC);
+   children = VG_(newXA)(VG_(malloc), "zygote.serve.1",
+                         VG_(free), sizeof(ServerChild));
+   conns = VG_(newXA)(VG_(malloc), "zygote.serve.3",
+                      VG_(free), sizeof(ServerConn));
+   if (VG_(clo_verbosity) > 0)
+      VG_(umsg)("Server is listening on %s\n", VG_(clo_server));
+
+   while (True) {
+      reap_children(children);
+
+      /* Watch the listening socket for new clients, the connections
+         whose request is still coming, and the connections of running
+         children for clients that have gone away. */
+      n_conns = VG_(sizeXA)(conns);
+      n = 2 + n_conns + VG_(sizeXA)(children);
+      if (n > n_pfds) {
+         n_pfds = 2 * n;
+         pfds = VG_(realloc)("zygote.serve.2", pfds,
+                             n_pfds * sizeof(struct vki_pollfd));
+      }
+      pfds[0].fd = listen_sd;
+      pfds[0].events = VKI_POLLIN;
+      pfds[1].fd = chld_fd;        // ignored by poll if -1
+      pfds[1].events = VKI_POLLIN;
+      for (i = 0; i < n_conns; i++) {
+         pfds[2 + i].fd = ((ServerConn*)VG_(indexXA)(conns, i))->conn;
+         pfds[2 + i].events = VKI_POLLIN;
+      }
+      for (i = 2 + n_conns; i < n; i++) {
+         pfds[i].fd = ((ServerChild*)VG_(indexXA)(children,
+                                                 i - 2 - n_conns))->conn;
+         pfds[i].events = VKI_POLLIN;
+      }
+      if (sr_isError(VG_(poll)(pfds, n, chld_fd >= 0 ? 1000 : 100)))
+         continue;
+
+      if (chld_fd >= 0 && (pfds[1].revents & VKI_POLLIN)) {
+         /* Drain the signalfd; reap_children finds out which ones. */
+         UChar siginfo[128];
+         (void)VG_(read)(chld_fd, siginfo, sizeof(siginfo));
+      }
+
+      for (i = 2 + n_conns; i < n; i++) {
+         ServerChild* c = VG_(indexXA)(children, i - 2 - n_conns);
+         if (c->conn >= 0 && pfds[i].revents != 0) {
+            VG_(kill)(c->pid, VKI_SIGTERM);
+            VG_(close)(c->conn);
+            c->conn = -1;
+         }
+      }
+
+      /* Go backwards, as finished connections are removed. */
+      for (i = n_conns - 1; i >= 0; i--) {
+         ServerConn sc;
+         Int        r;
+
+         if (pfds[2 + i].revents == 0)
+            continue;
+         r = continue_request(VG_(indexXA)(conns, i));
+         if (r == 0)
+            continue;
+         sc = *(ServerConn*)VG_(indexXA)(conns, i);
+         VG_(removeIndexXA)(conns, i);
+         if (r < 0) {
+            close_conn(&sc);
+            continue;
+         }
+
+         pid = VG_(fork)();
+         if (pid == 0) {
+            VG_(close)(listen_sd);
+            VG_(close)(sc.conn);
+            if (chld_fd >= 0)
+               VG_(close)(chld_fd);
+            VG_(sigprocmask)(VKI_SIG_SETMASK, &saved_mask, NULL);
+            for (j = 0; j < VG_(sizeXA)(children); j++) {
+               ServerChild* c = VG_(indexXA)(children, j);
+               if (c->conn >= 0)
+                  VG_(close)(c->conn);
+            }
+            for (j = 0; j < VG_(sizeXA)(conns); j++)
+               close_conn(VG_(indexXA)(conns, j));
+            VG_(deleteXA)(children);
+            VG_(deleteXA)(conns);
+            VG_(free)(pfds);
+            return become_client(&sc);
+         }
+
+         for (j = 0; j < 3; j++)
+            VG_(close)(sc.fds[j]);
+         VG_(free)(sc.payload);
+         send_Int(sc.conn, pid);
+         if (pid < 0) {
+            VG_(close)(sc.conn);
+         } else {
+            ServerChild c = { pid, sc.conn };
+            VG_(addToXA)(children, &c);
+         }
+      }
+
+      if ((pfds[0].revents & VKI_POLLIN) == 0)
+         continue;
+      conn = VG_(accept)(listen_sd);
+      if (conn >= 0) {
+         ServerConn sc;
+         VG_(memset)(&sc, 0, sizeof(sc));
+         sc.conn = conn;
+         sc.fds[0] = sc.fds[1] = sc.fds[2] = -1;
+         VG_(fcntl)(conn, VKI_F_SETFD, VKI_FD_CLOEXEC);
+         VG_(fcntl)(conn, VKI_F_SETFL, VKI_O_NONBLOCK);
+         VG_(addToXA)(conns, &sc);
+      }
+   }
+   /*NOTREACHED*/
+}
+
+#endif // defined(VGO_linux)
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
@@ -107,6 +107,12 @@ extern Bool VG_(am_addr_is_in_extensible_client_stack)( Addr addr );
    out-of-memory messages. */
 extern ULong VG_(am_get_anonsize_total)( void );
 
+/* Return the amount of space in Valgrind's own anonymous mappings
+   (arenas, shadow memory, translation cache, ...), or if RESIDENT, the
+   part of it which is backed by memory.  Is used to check
+   --max-tool-memory. */
+extern ULong VG_(am_get_anonsize_valgrind)( Bool resident );
+
 /* Show the segment array on the debug log, at given loglevel. */
 extern void VG_(am_show_nsegments) ( Int logLevel, const HChar* who );
 
@@ -242,6 +248,11 @@ extern SysRes VG_(am_mmap_anon_float_client) ( SizeT length, Int prot );
    itself more address space when needed. */
 extern SysRes VG_(am_mmap_anon_float_valgrind)( SizeT cszB );
 
+/* As VG_(am_mmap_anon_float_valgrind), but for big long-lived
+   mappings: if --huge-pages is in effect, the mapping is placed on a
+   huge page boundary and advised to be backed by huge pages. */
+extern SysRes VG_(am_mmap_anon_float_valgrind_huge)( SizeT cszB );
+
 /* Map privately a file at an unconstrained address for V, and update the
    segment array accordingly.  This is used by V for transiently
    mapping in object files to read their debug info.  */
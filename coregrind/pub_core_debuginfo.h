@@ -146,6 +146,14 @@ extern Bool VG_(use_CF_info) ( /*MOD*/D3UnwindRegs* uregs,
    info (e.g. CFI info or FPO info or ...). */
 extern UInt VG_(debuginfo_generation) (void);
 
+/* Free the line number and inlined call tables of the DebugInfos
+   archived by --keep-debuginfo=yes, to save memory.  Returns the number
+   of DebugInfos that had any. */
+extern UInt VG_(discard_archived_line_tables) ( void );
+
+/* Show the hit rate of the CFI lookup cache, for --stats=yes. */
+extern void VG_(print_debuginfo_stats) ( void );
+
 
 
 /* True if some FPO information is loaded.
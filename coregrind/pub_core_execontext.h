@@ -53,12 +53,17 @@ extern void VG_(print_ExeContext_stats) ( Bool with_stacktraces );
 extern void VG_(archive_ExeContext_in_range) (DiEpoch last_epoch,
                                               Addr text_avma, SizeT length );
 
-// Extract the StackTrace from an ExeContext.
-// (Minor hack: we use Addr* as the return type instead of StackTrace so
-// that modules #including this file don't also have to #include
-// pub_core_stacktrace.h also.)
-extern
-/*StackTrace*/Addr* VG_(get_ExeContext_StackTrace) ( ExeContext* e );
+// Extract the StackTrace from an ExeContext: copies at most max_n_ips of
+// its IPs, innermost first, into ips and returns the number copied.
+// ExeContexts share their outer frames, so they do not hold their
+// StackTrace as a single array.
+extern UInt VG_(get_ExeContext_StackTrace) ( const ExeContext* e,
+                                             /*OUT*/Addr* ips,
+                                             UInt max_n_ips );
+
+// Hash the frames of an ExeContext that VG_(eq_ExeContext) compares at
+// resolution res: ExeContexts that are equal at res hash equal.
+extern UWord VG_(hash_ExeContext) ( VgRes res, const ExeContext* e );
 
 
 #endif   // __PUB_CORE_EXECONTEXT_H
@@ -176,6 +176,10 @@ typedef
 /* output various gdbserver statistics and status. */
 extern void VG_(gdbserver_status_output)(void);
 
+/* To be called when the thread table has grown, so that vgdb
+   examines the new entries. */
+extern void VG_(gdbserver_update_n_threads)(void);
+
 /* Shared structure between vgdb and the process running 
    under valgrind.
    We define two variants: a 32 bit and a 64 bit.
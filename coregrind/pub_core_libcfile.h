@@ -77,6 +77,15 @@ extern Int VG_(getsockopt)  ( Int sd, Int level, Int optname,
 extern Int VG_(setsockopt)  ( Int sd, Int level, Int optname,
                               void *optval, Int optlen );
 
+#if defined(VGO_linux)
+/* Server side of a socket; these return -1 on failure. */
+extern Int VG_(bind)    ( Int sd, const struct vki_sockaddr *addr,
+                          Int addrlen );
+extern Int VG_(listen)  ( Int sd, Int backlog );
+extern Int VG_(accept)  ( Int sd );
+extern Int VG_(recvmsg) ( Int sd, struct vki_msghdr *msg, Int flags );
+#endif
+
 extern Int VG_(access) ( const HChar* path, Bool irusr, Bool iwusr,
                                             Bool ixusr );
 
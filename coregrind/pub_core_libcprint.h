@@ -46,12 +46,16 @@ typedef
    }
    VgLogTo;
 
-/* An output file descriptor wrapped up with its type and expanded name. */
+/* An output file descriptor wrapped up with its type and expanded name,
+   and the output buffered for it (see VG_(flush_output_sinks)). */
 typedef
    struct {
       Int fd;
       VgLogTo type;
       HChar *fsname_expanded; // 'fs' stands for file or socket
+      HChar *buf;             // output not written yet
+      Int   buf_used;
+      Int   buf_fd;           // the fd the output in buf is for
    }
    OutputSink;
  
@@ -66,8 +70,28 @@ extern void VG_(init_log_xml_sinks)(VgLogTo log_to, VgLogTo xml_to,
 
 extern void VG_(print_preamble)(Bool logging_to_fd);
 
+/* With --output-buffering=yes, the output to files and sockets is
+   buffered, and only written when the buffer is full or when this is
+   called: when a thread gives up the BigLock (at the end of each
+   timeslice, and before a syscall that may block), before fork and
+   exec, and when Valgrind exits or is killed by a signal.  Output to
+   file descriptors (--log-fd, --xml-fd) is never buffered, so that
+   it stays interleaved with the client's output. */
+extern void VG_(flush_output_sinks)(void);
+
+/* Forgets the buffered output.  For a child made by a raw clone rather
+   than VG_(fork): it has a copy of the parent's buffer, which the
+   parent writes itself. */
+extern void VG_(discard_output_sinks)(void);
+
+extern void VG_(logging_atfork_pre)(ThreadId tid);
+
 extern void VG_(logging_atfork_child)(ThreadId tid);
 
+/* Make the logging sinks of a child of a --server Valgrind refer to
+   the client's stdio (or to the right per-pid file). */
+extern void VG_(logging_server_child)(void);
+
 /* Get the elapsed wallclock time since startup into buf which has size
    bufsize. The function will assert if bufsize is not large enough.
    Upon return, buf will contain the zero-terminated wallclock time as
@@ -129,6 +129,9 @@ extern const HChar *VG_(clo_xml_fname_unexpanded);
 /* Add timestamps to log messages?  default: NO */
 extern Bool  VG_(clo_time_stamp);
 
+/* Buffer the output to log and XML files and sockets?  default: YES */
+extern Bool  VG_(clo_output_buffering);
+
 /* The file descriptor to read for input.  default: 0 == stdin */
 extern Int   VG_(clo_input_fd);
 
@@ -243,6 +246,17 @@ extern Bool VG_(clo_sym_offsets);
 extern Bool VG_(clo_read_inline_info);
 /* Read DWARF3 variable info even if tool doesn't ask for it? */
 extern Bool VG_(clo_read_var_info);
+/* Read the line number info, call frame info and DWARF3 inline and
+   variable info of an object only when first needed? */
+extern Bool VG_(clo_lazy_debuginfo);
+/* Number of helper processes reading the DWARF line and inlined call
+   info of large objects in parallel.  0 means read it sequentially. */
+extern Int VG_(clo_debuginfo_helpers);
+/* Smallest DWARF section read with the help of helper processes. */
+extern Long VG_(clo_debuginfo_helpers_min_size);
+/* Directory in which the debug info tables of objects with a build-id
+   are cached, or NULL. */
+extern const HChar* VG_(clo_debuginfo_cache_dir);
 /* Which prefix to strip from full source file paths, if any. */
 extern const HChar* VG_(clo_prefix_to_strip);
 
@@ -306,8 +320,14 @@ extern Word VG_(clo_max_stackframe);
    be? */
 extern Word VG_(clo_main_stacksize);
 
-/* The maximum number of threads we support. */
-#define MAX_THREADS_DEFAULT 500
+/* The maximum number of threads we support.  The thread table only
+   reserves address space for this many threads and grows on demand, so
+   the default can be generous where address space is plentiful. */
+#if VG_WORDSIZE == 8
+#  define MAX_THREADS_DEFAULT 10000
+#else
+#  define MAX_THREADS_DEFAULT 500
+#endif
 extern UInt VG_(clo_max_threads);
 
 /* If the same IP is found twice in a backtrace in a sequence of max
@@ -318,6 +338,25 @@ extern UInt VG_(clo_max_threads);
    Note that the value is changeable by a gdbsrv command. */
 extern Int VG_(clo_merge_recursive_frames);
 
+/* How to unwind the stack on amd64: with the CFI, falling back to the
+   frame pointer chain where there is none (the default); with the
+   frame pointer chain, falling back to the CFI where a frame pointer
+   looks bogus; or with the frame pointer chain wherever it has been
+   checked to give the same result as the CFI. */
+typedef
+   enum {
+      Vg_UnwindCFI,
+      Vg_UnwindFP,
+      Vg_UnwindAuto
+   }
+   VgUnwind;
+extern VgUnwind VG_(clo_unwind);
+
+/* Whether to keep a shadow call stack for each thread, updated by the
+   generated code at each call and return, and take stack traces from
+   it rather than by unwinding the stack (x86 and amd64 only). */
+extern Bool VG_(clo_shadow_call_stack);
+
 /* Max number of sectors that will be used by the translation code cache. */
 extern UInt VG_(clo_num_transtab_sectors);
 
@@ -329,6 +368,29 @@ extern UInt VG_(clo_avg_transtab_entry_size);
    VG_(clo_aspacem_minAddr). */
 extern Addr VG_(clo_aspacem_minAddr);
 
+/* Should the shadow memory and the translation cache be placed in
+   2MB-aligned chunks and advised to be backed by transparent huge
+   pages?  Auto means: yes if the kernel has transparent huge pages
+   enabled (in "always" or "madvise" mode). */
+typedef
+   enum {
+      Vg_HugePagesNo,
+      Vg_HugePagesYes,
+      Vg_HugePagesAuto
+   }
+   VgHugePages;
+extern VgHugePages VG_(clo_huge_pages);
+
+/* When Valgrind's own memory use gets close to this many bytes, give
+   back the memory of the state that can be rebuilt or done without
+   (translations, line info of unloaded code, tool histories).  0 means
+   no limit. */
+extern Long VG_(clo_max_tool_memory);
+
+/* If not NULL, run as a server on this Unix socket path; see
+   pub_core_zygote.h. */
+extern const HChar* VG_(clo_server);
+
 /* How large the Valgrind thread stacks should be. 
    Will be rounded up to a page.. */
 extern Word VG_(clo_valgrind_stacksize);
@@ -75,6 +75,10 @@ extern void VG_(redir_initialise)( void );
 /* Notify the module of a new target for an indirect function. */
 extern void VG_(redir_add_ifunc_target)( Addr old_from, Addr new_from );
 
+/* Show the time spent and work done processing redirections, for
+   --stats=yes. */
+extern void VG_(print_redir_stats)( void );
+
 //--------------------------------------------------------------------
 // Queries
 //--------------------------------------------------------------------
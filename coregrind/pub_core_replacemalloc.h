@@ -55,6 +55,10 @@ struct vg_mallocfunc_info {
    Bool	clo_trace_malloc;
 };
 
+/* Call the tool's malloc replacement functions directly from generated
+   code, rather than by going back to the scheduler?  default: YES */
+extern Bool VG_(clo_malloc_fast_path);
+
 #endif   // __PUB_CORE_REPLACEMALLOC_H
 
 /*--------------------------------------------------------------------*/
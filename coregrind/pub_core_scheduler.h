@@ -112,6 +112,11 @@ extern void VG_(force_vgdb_poll) ( void );
 /* Stats ... */
 extern void VG_(print_scheduler_stats) ( void );
 
+/* Called from generated code to do a client request calling one of the
+   tool's malloc replacement functions.  Returns 0 if the client request
+   is something else, and must go to the scheduler. */
+extern UWord VG_(malloc_fast_path) ( void );
+
 /* If False, a fault is Valgrind-internal (ie, a bug) */
 extern Bool VG_(in_generated_code);
 
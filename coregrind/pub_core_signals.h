@@ -54,6 +54,9 @@ extern void VG_(sigstartup_actions) ( void );
    context to deliver one (viz, create signal frames if needed) */
 extern void VG_(poll_signals) ( ThreadId );
 
+/* Print signal polling stats (for --stats=yes). */
+extern void VG_(print_signal_stats) ( void );
+
 /* Fake system calls for signal handling. */
 extern SysRes VG_(do_sys_sigaltstack) ( ThreadId tid, vki_stack_t* ss,
                                                       vki_stack_t* oss );
@@ -57,6 +57,20 @@ UInt VG_(get_StackTrace_wrk) ( ThreadId tid_if_known,
                                const UnwindStartRegs* startRegs,
                                Addr fp_max_orig );
 
+// With --shadow-call-stack=yes, the generated code calls
+// VG_(shadow_stack_call) at the end of each superblock ending in a
+// call, with SP pointing at the pushed return address, and
+// VG_(shadow_stack_ret) at the end of each one ending in a return.
+extern VG_REGPARM(1) void VG_(shadow_stack_call) ( Addr sp );
+extern VG_REGPARM(1) void VG_(shadow_stack_ret)  ( Addr sp );
+
+// Empty tid's shadow call stack, as a new thread starts in it.
+extern void VG_(shadow_stack_reset) ( ThreadId tid );
+
+// Tell the shadow call stack that a signal frame has just been pushed
+// for tid, whose SP was old_sp before.
+extern void VG_(shadow_stack_signal_frame) ( ThreadId tid, Addr old_sp );
+
 #endif   // __PUB_CORE_STACKTRACE_H
 
 /*--------------------------------------------------------------------*/
@@ -418,9 +418,18 @@ ThreadState;
 
 /* An array of threads, dynamically allocated by VG_(init_Threads).
    NOTE: [0] is never used, to simplify the simulation of initialisers
-   for LinuxThreads. */
+   for LinuxThreads.
+   Address space for VG_(clo_max_threads) entries is reserved up front so
+   that the array never moves (guest state pointers into it are held
+   across blocking syscalls), but only the first VG_N_THREADS entries are
+   initialised and so backed by memory.  VG_(grow_Threads) extends it. */
 extern ThreadState *VG_(threads);
 
+/* Initial number of entries in the thread table.  VG_N_THREADS starts
+   at this (or VG_(clo_max_threads) if that is smaller) and doubles each
+   time the table is full. */
+#define VG_N_THREADS_INITIAL 16
+
 /* In an outer valgrind, VG_(inner_threads) stores the address of
    the inner VG_(threads) array, as reported by the inner using
    the client request INNER_THREADS. */
@@ -438,6 +447,12 @@ extern ThreadId VG_(running_tid);
 /* Initialize the m_threadstate module. */
 void VG_(init_Threads)(void);
 
+/* Grow the thread table, calling init_thread on each new entry before
+   VG_N_THREADS is increased to cover it.  Returns the first new ThreadId,
+   or VG_INVALID_THREADID if the table already has VG_(clo_max_threads)
+   entries. */
+ThreadId VG_(grow_Threads)( void (*init_thread)(ThreadId) );
+
 // Convert a ThreadStatus to a string.
 const HChar* VG_(name_of_ThreadStatus) ( ThreadStatus status );
 
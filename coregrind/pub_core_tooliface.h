@@ -90,6 +90,7 @@ typedef
       Bool syscall_wrapper;
       Bool sanity_checks;
       Bool print_stats;
+      Bool shed_memory;
       Bool info_location;
       Bool var_info;
       Bool malloc_replacement;
@@ -155,6 +156,9 @@ typedef struct {
    // VG_(needs).print_stats
    void (*tool_print_stats)(void);
 
+   // VG_(needs).shed_memory
+   void (*tool_shed_memory)(void);
+
    // VG_(needs).info_location
    void (*tool_info_location)(DiEpoch ep, Addr a);
 
@@ -113,6 +113,10 @@ extern Bool VG_(search_transtab) ( /*OUT*/Addr*  res_hcode,
 extern void VG_(discard_translations) ( Addr  start, ULong range,
                                         const HChar* who );
 
+/* Discard the translations of all but the youngest sector, and give
+   their memory back to the kernel. */
+extern void VG_(release_old_transtab_sectors) ( void );
+
 extern void VG_(print_tt_tc_stats) ( void );
 
 extern UInt VG_(get_bbs_translated) ( void );
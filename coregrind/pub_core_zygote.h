@@ -0,0 +1,78 @@
+/*--------------------------------------------------------------------*/
+/*--- Server mode: fork pre-initialised Valgrinds.                 ---*/
+/*---                                            pub_core_zygote.h ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   Copyright (C) 2019-2019 The Valgrind Developers
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#ifndef __PUB_CORE_ZYGOTE_H
+#define __PUB_CORE_ZYGOTE_H
+
+//--------------------------------------------------------------------
+// PURPOSE: With --server=<path>, Valgrind initialises the core and
+// the tool (options, suppressions, translation table, redirections)
+// without a client, and then waits on a Unix socket.  For each
+// request, made by 'valgrind --connect=<path> prog args' (see
+// launcher-linux.c), it forks, and the child loads and runs the
+// requested program with the client's stdin/stdout/stderr, working
+// directory and environment.  So the startup cost is paid only once.
+//
+// The protocol is, in the order of transmission:
+//   client -> server: a ZygoteRequest, together with the client's
+//                     fds 0, 1 and 2 (SCM_RIGHTS), then
+//                     payload_szB bytes of NUL-terminated strings:
+//                     the working directory, n_args arguments (the
+//                     first being the program) and n_env environment
+//                     entries.
+//   server -> client: an Int, the pid of the forked Valgrind or -1.
+//   server -> client: an Int, the wait status of that Valgrind.
+//
+// This header is also included by the launcher, so it must only
+// contain the protocol definitions and declarations.
+//--------------------------------------------------------------------
+
+#define VG_ZYGOTE_MAGIC          0x315a4756  /* "VGZ1" */
+#define VG_ZYGOTE_MAX_PAYLOAD    (1024 * 1024)
+
+typedef
+   struct {
+      UInt magic;
+      UInt n_args;
+      UInt n_env;
+      UInt payload_szB;
+   }
+   ZygoteRequest;
+
+/* Runs the server on the socket VG_(clo_server).  Only returns in a
+   forked child, once the child has taken over the stdin, stdout,
+   stderr, working directory and arguments of a request.  The returned
+   NULL-terminated array is the environment for the client. */
+extern HChar** VG_(zygote_serve) ( void );
+
+#endif   // __PUB_CORE_ZYGOTE_H
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
@@ -66,6 +66,7 @@ static ULong    s_conflict_set_bitmap2_creation_count;
 static ThreadId s_vg_running_tid  = VG_INVALID_THREADID;
 DrdThreadId     DRD_(g_drd_running_tid) = DRD_INVALID_THREADID;
 ThreadInfo*     DRD_(g_threadinfo);
+UInt            DRD_(g_n_threads);
 struct bitmap*  DRD_(g_conflict_set);
 Bool DRD_(verify_conflict_set);
 static Bool     s_trace_context_switches = False;
@@ -147,12 +148,9 @@ void DRD_(thread_set_join_list_vol)(const int jlv)
 
 void DRD_(thread_init)(void)
 {
-   DRD_(g_threadinfo) = VG_(malloc)("drd.main.ti.1",
-                                DRD_N_THREADS * sizeof DRD_(g_threadinfo)[0]);
-   for (UInt i = 0; i < DRD_N_THREADS; ++i) {
-      static ThreadInfo initval;
-      DRD_(g_threadinfo)[i] = initval;
-   }
+   VG_(grow_thread_array)("drd.main.ti.1", (void**)&DRD_(g_threadinfo),
+                          &DRD_(g_n_threads), sizeof DRD_(g_threadinfo)[0],
+                          VG_N_THREADS);
 }
 
 /**
@@ -190,45 +188,45 @@ static DrdThreadId DRD_(VgThreadIdToNewDrdThreadId)(const ThreadId tid)
    for (i = 1; i < DRD_N_THREADS; i++)
    {
       if (!DRD_(g_threadinfo)[i].valid)
-      {
-         tl_assert(! DRD_(IsValidDrdThreadId)(i));
-
-         DRD_(g_threadinfo)[i].valid         = True;
-         DRD_(g_threadinfo)[i].vg_thread_exists = True;
-         DRD_(g_threadinfo)[i].vg_threadid   = tid;
-         DRD_(g_threadinfo)[i].pt_threadid   = INVALID_POSIX_THREADID;
-         DRD_(g_threadinfo)[i].stack_min     = 0;
-         DRD_(g_threadinfo)[i].stack_min_min = 0;
-         DRD_(g_threadinfo)[i].stack_startup = 0;
-         DRD_(g_threadinfo)[i].stack_max     = 0;
-         DRD_(thread_set_name)(i, "");
-         DRD_(g_threadinfo)[i].on_alt_stack        = False;
-         DRD_(g_threadinfo)[i].is_recording_loads  = True;
-         DRD_(g_threadinfo)[i].is_recording_stores = True;
-         DRD_(g_threadinfo)[i].pthread_create_nesting_level = 0;
-         DRD_(g_threadinfo)[i].synchr_nesting = 0;
-         DRD_(g_threadinfo)[i].deletion_seq = s_deletion_tail - 1;
-         DRD_(g_threadinfo)[i].creator_thread = DRD_INVALID_THREADID;
+         break;
+   }
+   if (i == DRD_N_THREADS)
+   {
+      /* All entries are in use, possibly by threads that have finished but
+         have not yet been joined. Make room for more. */
+      VG_(grow_thread_array)("drd.main.ti.1", (void**)&DRD_(g_threadinfo),
+                             &DRD_(g_n_threads), sizeof DRD_(g_threadinfo)[0],
+                             i + 1);
+   }
+
+   tl_assert(! DRD_(IsValidDrdThreadId)(i));
+
+   DRD_(g_threadinfo)[i].valid         = True;
+   DRD_(g_threadinfo)[i].vg_thread_exists = True;
+   DRD_(g_threadinfo)[i].vg_threadid   = tid;
+   DRD_(g_threadinfo)[i].pt_threadid   = INVALID_POSIX_THREADID;
+   DRD_(g_threadinfo)[i].stack_min     = 0;
+   DRD_(g_threadinfo)[i].stack_min_min = 0;
+   DRD_(g_threadinfo)[i].stack_startup = 0;
+   DRD_(g_threadinfo)[i].stack_max     = 0;
+   DRD_(thread_set_name)(i, "");
+   DRD_(g_threadinfo)[i].on_alt_stack        = False;
+   DRD_(g_threadinfo)[i].is_recording_loads  = True;
+   DRD_(g_threadinfo)[i].is_recording_stores = True;
+   DRD_(g_threadinfo)[i].pthread_create_nesting_level = 0;
+   DRD_(g_threadinfo)[i].synchr_nesting = 0;
+   DRD_(g_threadinfo)[i].deletion_seq = s_deletion_tail - 1;
+   DRD_(g_threadinfo)[i].creator_thread = DRD_INVALID_THREADID;
 #if defined (VGO_solaris)
-         DRD_(g_threadinfo)[i].bind_guard_flag = 0;
+   DRD_(g_threadinfo)[i].bind_guard_flag = 0;
 #endif /* VGO_solaris */
 
-         tl_assert(DRD_(g_threadinfo)[i].sg_first == NULL);
-         tl_assert(DRD_(g_threadinfo)[i].sg_last == NULL);
+   tl_assert(DRD_(g_threadinfo)[i].sg_first == NULL);
+   tl_assert(DRD_(g_threadinfo)[i].sg_last == NULL);
 
-         tl_assert(DRD_(IsValidDrdThreadId)(i));
+   tl_assert(DRD_(IsValidDrdThreadId)(i));
 
-         return i;
-      }
-   }
-
-   VG_(printf)(
-"\nSorry, but the maximum number of threads supported by DRD has been exceeded."
-"Aborting.\n");
-
-   tl_assert(False);
-
-   return DRD_INVALID_THREADID;
+   return i;
 }
 
 /** Convert a POSIX thread ID into a DRD thread ID. */
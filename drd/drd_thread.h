@@ -38,8 +38,11 @@
 
 /* Defines. */
 
-/** Maximum number of threads DRD keeps information about. */
-#define DRD_N_THREADS VG_N_THREADS
+/**
+ * Number of threads DRD can currently keep information about. Grows on
+ * demand, like the Valgrind core's thread table.
+ */
+#define DRD_N_THREADS DRD_(g_n_threads)
 
 /** A number different from any valid DRD thread ID. */
 #define DRD_INVALID_THREADID 0
@@ -123,6 +126,8 @@ typedef struct
 extern DrdThreadId    DRD_(g_drd_running_tid);
 /** Per-thread information managed by DRD. */
 extern ThreadInfo*    DRD_(g_threadinfo);
+/** Number of entries in DRD_(g_threadinfo). */
+extern UInt           DRD_(g_n_threads);
 /** Conflict set for the currently running thread. */
 extern struct bitmap* DRD_(g_conflict_set);
 extern Bool           DRD_(verify_conflict_set);
@@ -1044,6 +1044,10 @@ static  WordFM** /* StackTreeNode */ siTrees;
 
 static  QCache*                      qcaches;
 
+/* Number of entries in each of the above three arrays.  Follows
+   VG_N_THREADS as the core's thread table grows. */
+static  UInt                         n_per_thread;
+
 
 /* Additionally, there is one global variable interval tree
    for the entire process.
@@ -1054,26 +1058,36 @@ static WordFM* /* GlobalTreeNode */ giTree;
 static void invalidate_all_QCaches ( void )
 {
    Word i;
-   for (i = 0; i < VG_N_THREADS; i++) {
+   for (i = 0; i < n_per_thread; i++) {
       QCache__invalidate( &qcaches[i] );
    }
 }
 
-static void ourGlobals_init ( void )
+/* Make room in the per-thread arrays for every ThreadId the core
+   currently knows about. */
+static void grow_per_thread_arrays ( void )
 {
-   Word i;
-
-   shadowStacks = sg_malloc( "di.sg_main.oGi.2",
-                             VG_N_THREADS * sizeof shadowStacks[0] );
-   siTrees = sg_malloc( "di.sg_main.oGi.3", VG_N_THREADS * sizeof siTrees[0] );
-   qcaches = sg_malloc( "di.sg_main.oGi.4", VG_N_THREADS * sizeof qcaches[0] );
-
-   for (i = 0; i < VG_N_THREADS; i++) {
-      shadowStacks[i] = NULL;
-      siTrees[i] = NULL;
-      qcaches[i] = (QCache){};
+   UInt i, n;
+
+   n = n_per_thread;
+   VG_(grow_thread_array)( "di.sg_main.oGi.2", (void**)&shadowStacks, &n,
+                           sizeof shadowStacks[0], VG_N_THREADS );
+   n = n_per_thread;
+   VG_(grow_thread_array)( "di.sg_main.oGi.3", (void**)&siTrees, &n,
+                           sizeof siTrees[0], VG_N_THREADS );
+   n = n_per_thread;
+   VG_(grow_thread_array)( "di.sg_main.oGi.4", (void**)&qcaches, &n,
+                           sizeof qcaches[0], VG_N_THREADS );
+
+   for (i = n_per_thread; i < n; i++) {
+      QCache__invalidate( &qcaches[i] );
    }
-   invalidate_all_QCaches();
+   n_per_thread = n;
+}
+
+static void ourGlobals_init ( void )
+{
+   grow_per_thread_arrays();
    giTree = VG_(newFM)( sg_malloc, "di.sg_main.oGi.1", sg_free, 
                         (Word(*)(UWord,UWord))cmp_intervals_GlobalTreeNode );
 }
@@ -1285,7 +1299,7 @@ static void preen_global_Invars ( Addr a, SizeT len )
    UWord       u;
    StackFrame* frame;
    tl_assert(len > 0);
-   for (i = 0; i < VG_N_THREADS; i++) {
+   for (i = 0; i < n_per_thread; i++) {
       frame = shadowStacks[i];
       if (!frame)
          continue; /* no frames for this thread */
@@ -2437,6 +2451,7 @@ static StackFrame* new_root_StackFrame ( void )
 static void shadowStack_thread_create ( ThreadId parent, ThreadId child )
 {
    tl_assert(is_sane_TId(child));
+   grow_per_thread_arrays();
    if (parent == VG_INVALID_THREADID) {
       /* creating the main thread's stack */
    } else {
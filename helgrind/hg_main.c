@@ -134,7 +134,8 @@ Thread* get_admin_threads ( void ) { return admin_threads; }
 static Lock* admin_locks = NULL;
 
 /* Mapping table for core ThreadIds to Thread* */
-static Thread** map_threads = NULL; /* Array[VG_N_THREADS] of Thread* */
+static Thread** map_threads = NULL; /* Array[n_map_threads] of Thread* */
+static UInt     n_map_threads = 0;  /* follows VG_N_THREADS as it grows */
 
 /* Mapping table for lock guest addresses to Lock* */
 static WordFM* map_locks = NULL; /* WordFM LockAddr Lock* */
@@ -452,12 +453,12 @@ static void pp_map_threads ( Int d )
 {
    Int i, n = 0;
    space(d); VG_(printf)("map_threads ");
-   for (i = 0; i < VG_N_THREADS; i++) {
+   for (i = 0; i < n_map_threads; i++) {
       if (map_threads[i] != NULL)
          n++;
    }
    VG_(printf)("(%d entries) {\n", n);
-   for (i = 0; i < VG_N_THREADS; i++) {
+   for (i = 0; i < n_map_threads; i++) {
       if (map_threads[i] == NULL)
          continue;
       space(d+3);
@@ -611,7 +612,8 @@ static void initialise_data_structures ( Thr* hbthr_root )
    tl_assert(admin_locks == NULL);
 
    tl_assert(map_threads == NULL);
-   map_threads = HG_(zalloc)( "hg.ids.1", VG_N_THREADS * sizeof(Thread*) );
+   VG_(grow_thread_array)( "hg.ids.1", (void**)&map_threads, &n_map_threads,
+                           sizeof(Thread*), VG_N_THREADS );
 
    tl_assert(sizeof(Addr) == sizeof(UWord));
    tl_assert(map_locks == NULL);
@@ -666,6 +668,7 @@ static Thread* map_threads_maybe_lookup ( ThreadId coretid )
 {
    Thread* thr;
    tl_assert( HG_(is_sane_ThreadId)(coretid) );
+   tl_assert( coretid < n_map_threads );
    thr = map_threads[coretid];
    return thr;
 }
@@ -1616,6 +1619,11 @@ void evh__pre_thread_ll_create ( ThreadId parent, ThreadId child )
       VG_(printf)("evh__pre_thread_ll_create(p=%d, c=%d)\n",
                   (Int)parent, (Int)child );
 
+   /* The core may have grown its thread table to make room for
+      the child. */
+   VG_(grow_thread_array)( "hg.ids.1", (void**)&map_threads, &n_map_threads,
+                           sizeof(Thread*), VG_N_THREADS );
+
    if (parent != VG_INVALID_THREADID) {
       Thread* thr_p;
       Thread* thr_c;
@@ -1747,7 +1755,7 @@ void evh__atfork_child ( ThreadId tid )
    thr = map_threads_maybe_lookup( 0/*INVALID*/ );
    tl_assert(!thr);
    /* Clean up all other slots except 'tid'. */
-   for (i = 1; i < VG_N_THREADS; i++) {
+   for (i = 1; i < n_map_threads; i++) {
       if (i == tid)
          continue;
       thr = map_threads_maybe_lookup(i);
@@ -6032,6 +6040,7 @@ static void hg_pre_clo_init ( void )
    //                                hg_expensive_sanity_check);
 
    VG_(needs_print_stats) (hg_print_stats);
+   VG_(needs_shed_memory) (libhb_shed_history);
    VG_(needs_info_location) (hg_info_location);
 
    VG_(needs_malloc_replacement)  (hg_cli__malloc,
@@ -151,6 +151,12 @@ void libhb_copy_shadow_state ( Thr* thr, Addr src, Addr dst, SizeT len );
    garbage-collect its internal data structures. */
 void libhb_maybe_GC ( void );
 
+/* Call this to give back memory when Valgrind's memory use is close to
+   --max-tool-memory.  Throws away the older half of the history of
+   accesses kept to report conflicting accesses, and shrinks the
+   conflict cache accordingly. */
+void libhb_shed_history ( void );
+
 /* Extract info from the conflicting-access machinery. */
 Bool libhb_event_map_lookup ( /*OUT*/ExeContext** resEC,
                               /*OUT*/Thr**        resThr,
@@ -4798,7 +4798,8 @@ static Word cmp_oldref_tsw (const void* node1, const void* node2 )
 
 //////////// BEGIN OldRef pool allocator
 static PoolAlloc* oldref_pool_allocator;
-// Note: We only allocate elements in this pool allocator, we never free them.
+// Note: We only allocate elements in this pool allocator, we only free them
+// in libhb_shed_history.
 // We stop allocating elements at VG_(clo_conflict_cache_size).
 //////////// END OldRef pool allocator
 
@@ -4842,8 +4843,9 @@ static inline void OldRef_newest(OldRef *new)
 static VgHashTable* oldrefHT    = NULL; /* Hash table* OldRef* */
 static UWord     oldrefHTN    = 0;    /* # elems in oldrefHT */
 /* Note: the nr of ref in the oldrefHT will always be equal to
-   the nr of elements that were allocated from the OldRef pool allocator
-   as we never free an OldRef : we just re-use them. */
+   the nr of elements that are allocated from the OldRef pool allocator
+   as we only free an OldRef when removing it from oldrefHT : otherwise
+   we just re-use them. */
 
 
 /* allocates a new OldRef or re-use the lru one if all allowed OldRef
@@ -7381,6 +7383,37 @@ void libhb_copy_shadow_state ( Thr* thr, Addr src, Addr dst, SizeT len )
    Filter__clear_range( thr->filter, dst, len ); 
 }
 
+void libhb_shed_history ( void )
+{
+   /* Throw away the least recently used half of the conflicting-access
+      history, and do not let it grow back: races on the locations
+      concerned will be reported without the stack of the previous
+      access. */
+   const UWord n_keep = oldrefHTN / 2;
+
+   while (oldrefHTN > n_keep) {
+      OldRef *oldref = lru.next;
+      OldRef *oldref_ht;
+
+      OldRef_unchain(oldref);
+      oldref_ht = VG_(HT_gen_remove) (oldrefHT, oldref, cmp_oldref_tsw);
+      tl_assert (oldref == oldref_ht);
+      ctxt__rcdec( oldref->acc.rcec );
+      VG_(freeEltPA) ( oldref_pool_allocator, oldref );
+      oldrefHTN--;
+   }
+   HG_(clo_conflict_cache_size) = n_keep > 0 ? n_keep : 1;
+
+   /* And get rid of the stacks that were only referenced from there. */
+   if (stats__ctxt_tab_curr > RCEC_referenced)
+      do_RCEC_GC();
+
+   if (VG_(clo_verbosity) > 1)
+      VG_(message)(Vg_DebugMsg,
+                   "libhb: conflict cache reduced to %lu entries\n",
+                   HG_(clo_conflict_cache_size));
+}
+
 void libhb_maybe_GC ( void )
 {
    /* GC the unreferenced (zero rc) RCECs when
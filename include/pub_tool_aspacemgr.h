@@ -151,9 +151,16 @@ extern const HChar* VG_(am_get_filename)( NSegment const * );
 extern Bool VG_(am_is_valid_for_client) ( Addr start, SizeT len, 
                                           UInt prot );
 
-/* Really just a wrapper around VG_(am_mmap_anon_float_valgrind). */
+/* Allocate shadow memory.  Basically a wrapper around
+   VG_(am_mmap_anon_float_valgrind), but with --huge-pages enabled,
+   the memory comes from huge-page backed chunks. */
 extern void* VG_(am_shadow_alloc)(SizeT size);
 
+/* Release memory obtained from VG_(am_shadow_alloc).  'size' must be
+   the size it was allocated with.  Memory carved from a huge-page
+   chunk is kept for reuse rather than unmapped. */
+extern void VG_(am_shadow_free)(void* p, SizeT size);
+
 /* Unmap the given address range and update the segment array
    accordingly.  This fails if the range isn't valid for valgrind. */
 extern SysRes VG_(am_munmap_valgrind)( Addr start, SizeT length );
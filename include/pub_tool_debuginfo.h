@@ -212,6 +212,20 @@ extern Bool VG_(next_IIPC)(InlIPCursor *iipc);
 /* Free all memory associated with iipc. */
 extern void VG_(delete_IIPC)(InlIPCursor *iipc);
 
+/* Look up in one go the function names, object names and source
+   locations of the n_ips code addresses in ips, at epoch ep.  The
+   addresses can be in any order and have duplicates: they are sorted,
+   and each DebugInfo's tables are then walked only once.  The results
+   are cached, and answer the subsequent VG_(describe_IP),
+   VG_(get_fnname), VG_(get_objname), VG_(get_filename_linenum), ...
+   queries about these addresses.  This is much cheaper than looking
+   the addresses up one by one, when producing big reports: call it
+   with all the addresses to be shown, write the report, then call
+   VG_(forget_resolved_IPs) to free the cache.  The cache is also
+   dropped whenever debug info is loaded or discarded. */
+extern void VG_(resolve_IPs) ( DiEpoch ep, const Addr* ips, UWord n_ips );
+extern void VG_(forget_resolved_IPs) ( void );
+
 
 
 /* Get an XArray of StackBlock which describe the stack (auto) blocks
@@ -96,6 +96,12 @@ extern Bool VG_(eq_ExeContext) ( VgRes res, const ExeContext* e1,
 // Print an ExeContext.
 extern void VG_(pp_ExeContext) ( ExeContext* ec );
 
+// Look up in one go the debug info of all the frames of the n_ecs
+// ExeContexts in ecs (NULL entries are ignored), so that printing many
+// of them with VG_(pp_ExeContext) is cheaper.  See VG_(resolve_IPs) in
+// pub_tool_debuginfo.h; call VG_(forget_resolved_IPs) when done.
+extern void VG_(resolve_ExeContexts) ( ExeContext* const* ecs, UWord n_ecs );
+
 // Get the 32-bit unique reference number for this ExeContext
 // (the "ExeContext Unique").  Guaranteed to be nonzero and to be a
 // multiple of four (iow, the lowest two bits are guaranteed to
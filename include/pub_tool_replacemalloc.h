@@ -45,6 +45,12 @@ extern void  VG_(cli_free)   ( void* p );
 // Returns the usable size of a heap-block.  It's the asked-for size plus
 // possibly some more due to rounding up.
 extern SizeT VG_(cli_malloc_usable_size)( void* p );
+// Gives back to the kernel the memory of the whole pages of the nbytes
+// at p, which must be within a client block not to be used until it is
+// freed.  The block keeps its address range, but these pages read as
+// zeros afterwards.  Returns the number of bytes given back (0 if this is
+// not supported on this platform).
+extern SizeT VG_(cli_discard_pages)( void* p, SizeT nbytes );
 
 
 /* If a tool uses deferred freeing (e.g. memcheck to catch accesses to
@@ -33,9 +33,26 @@
 
 #include "pub_tool_basics.h"   // ThreadID
 
-/* The maximum number of pthreads that we support. */
+/* The number of entries currently in the thread table.  Every ThreadId
+   handed out so far is below this.  The table starts small and grows on
+   demand (never beyond --max-threads entries), so VG_N_THREADS can
+   increase each time a thread is created; it never decreases. */
 extern UInt VG_N_THREADS;
 
+/* Make sure the array *arr, currently holding *n_elems elements of
+   eltSzB bytes each, has room for at least min_elems elements.  If not,
+   it is reallocated (and so may move), growing at least geometrically;
+   the new elements are zeroed and *n_elems is updated.  *arr may be NULL
+   with *n_elems == 0, in which case a new array is allocated.
+
+   Tools keeping arrays indexed by ThreadId use this to follow the growth
+   of the thread table, typically by passing VG_N_THREADS as min_elems
+   from their pre_thread_ll_create callback.  Such arrays must be walked
+   using their own *n_elems as bound rather than VG_N_THREADS. */
+extern void VG_(grow_thread_array) ( const HChar* cc, void** arr,
+                                     UInt* n_elems, SizeT eltSzB,
+                                     UInt min_elems );
+
 /* Special magic value for an invalid ThreadId.  It corresponds to
    LinuxThreads using zero as the initial value for
    pthread_mutex_t.__m_owner and pthread_cond_t.__c_waiting. */
@@ -459,6 +459,15 @@ extern void VG_(needs_print_stats) (
    void (*print_stats)(void)
 );
 
+/* Can the tool give back some of its memory when asked to? */
+extern void VG_(needs_shed_memory) (
+   // Called when Valgrind's memory use gets close to --max-tool-memory,
+   // after the core has released what it can.  The tool should free the
+   // state it can do without, at the cost of less precise results (e.g.
+   // shorter histories), and avoid growing that state again.
+   void (*shed_memory)(void)
+);
+
 /* Has the tool a tool specific function to retrieve and print location info
    of an address ? */
 extern void VG_(needs_info_location) (
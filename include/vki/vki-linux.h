@@ -1291,6 +1291,14 @@ struct  vki_seminfo {
 #define VKI_MREMAP_MAYMOVE	1
 #define VKI_MREMAP_FIXED	2
 
+//----------------------------------------------------------------------
+// From linux-2.6.38/include/asm-generic/mman-common.h
+//----------------------------------------------------------------------
+
+#define VKI_MADV_DONTNEED	4	/* Don't need these pages */
+#define VKI_MADV_HUGEPAGE	14	/* Worth backing with hugepages */
+#define VKI_MADV_NOHUGEPAGE	15	/* Not worth backing with hugepages */
+
 //----------------------------------------------------------------------
 // From linux-2.6.31-rc4/include/linux/futex.h
 //----------------------------------------------------------------------
@@ -125,6 +125,9 @@ Bool MC_(is_mempool_block)( MC_Chunk* mc_search );
    is found. */
 MC_Chunk* MC_(get_freed_block_bracketting)( Addr a );
 
+/* Prints the stats of the queue of freed blocks without their pages. */
+void MC_(print_discarded_freelist_stats) ( void );
+
 /* For efficient pooled alloc/free of the MC_Chunk. */
 extern PoolAlloc* MC_(chunk_poolalloc);
 
@@ -621,6 +624,10 @@ extern Long MC_(clo_freelist_vol);
    in the "big block" freed blocks queue. */
 extern Long MC_(clo_freelist_big_blocks);
 
+/* Max volume of the queue of freed big blocks whose pages are given back
+   to the kernel.  0 means such blocks go in the "big block" queue. */
+extern Long MC_(clo_freelist_discard_vol);
+
 /* Do leak check at exit?  default: NO */
 extern LeakCheckMode MC_(clo_leak_check);
 
@@ -1650,6 +1650,19 @@ static void print_results(ThreadId tid, LeakCheckParams* lcp)
                                 MC_(XT_Leak_sub),
                                 VG_(XT_filter_maybe_below_main));
 
+   // Symbolise the allocation stacks of the loss records in one go:
+   // matching them against the suppressions and printing them is then
+   // cheaper.
+   if (n_lossrecords > start_lr_output_scan) {
+      ExeContext** ecs = VG_(malloc)("mc.pr.2",
+                                     (n_lossrecords - start_lr_output_scan)
+                                     * sizeof(ExeContext*));
+      for (i = start_lr_output_scan; i < n_lossrecords; i++)
+         ecs[i - start_lr_output_scan] = lr_array[i]->key.allocated_at;
+      VG_(resolve_ExeContexts)(ecs, n_lossrecords - start_lr_output_scan);
+      VG_(free)(ecs);
+   }
+
    // Print the loss records (in size order) and collect summary stats.
    for (i = start_lr_output_scan; i < n_lossrecords; i++) {
       Bool count_as_error, print_record;
@@ -1687,6 +1700,7 @@ static void print_results(ThreadId tid, LeakCheckParams* lcp)
          VG_(tool_panic)("unknown loss mode");
       }
    }
+   VG_(forget_resolved_IPs)();
 
    if (lcp->xt_filename != NULL) {
       VG_(XT_callgrind_print)(leak_xt,
@@ -1832,8 +1832,7 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
          PROF_EVENT(MCPE_SET_ADDRESS_RANGE_PERMS_LOOP64K_FREE_DIST_SM);
          // Free the non-distinguished sec-map that we're replacing.  This
          // case happens moderately often, enough to be worthwhile.
-         SysRes sres = VG_(am_munmap_valgrind)((Addr)*sm_ptr, sizeof(SecMap));
-         tl_assert2(! sr_isError(sres), "SecMap valgrind munmap failure\n");
+         VG_(am_shadow_free)(*sm_ptr, sizeof(SecMap));
       }
       update_SM_counts(*sm_ptr, example_dsm);
       // Make the sec-map entry point to the example DSM
@@ -5931,6 +5930,7 @@ static Bool mc_expensive_sanity_check ( void )
 Bool          MC_(clo_partial_loads_ok)       = True;
 Long          MC_(clo_freelist_vol)           = 20*1000*1000LL;
 Long          MC_(clo_freelist_big_blocks)    =  1*1000*1000LL;
+Long          MC_(clo_freelist_discard_vol)   = 0;
 LeakCheckMode MC_(clo_leak_check)             = LC_Summary;
 VgRes         MC_(clo_leak_resolution)        = Vg_HighRes;
 UInt          MC_(clo_show_leak_kinds)        = R2S(Possible) | R2S(Unreached);
@@ -6038,6 +6038,10 @@ static Bool mc_process_cmd_line_options(const HChar* arg)
                        MC_(clo_freelist_big_blocks),
                        0, 10*1000*1000*1000LL) {}
 
+   else if VG_BINT_CLO(arg, "--freelist-discard-vol",
+                       MC_(clo_freelist_discard_vol),
+                       0, 1000*1000*1000*1000LL) {}
+
    else if VG_XACT_CLO(arg, "--leak-check=no",
                             MC_(clo_leak_check), LC_Off) {}
    else if VG_XACT_CLO(arg, "--leak-check=summary",
@@ -6195,6 +6199,8 @@ static void mc_print_usage(void)
 "                                     Use extra-precise definedness tracking [auto]\n"
 "    --freelist-vol=<number>          volume of freed blocks queue     [20000000]\n"
 "    --freelist-big-blocks=<number>   releases first blocks with size>= [1000000]\n"
+"    --freelist-discard-vol=<number>  volume of freed big blocks kept\n"
+"                                     without their pages [0]\n"
 "    --workaround-gcc296-bugs=no|yes  self explanatory [no].  Deprecated.\n"
 "                                     Use --ignore-range-below-sp instead.\n"
 "    --ignore-ranges=0xPP-0xQQ[,0xRR-0xSS]   assume given addresses are OK\n"
@@ -7889,6 +7895,8 @@ static void mc_print_stats (void)
 
    VG_(message)(Vg_DebugMsg, " memcheck: freelist: vol %lld length %lld\n",
                 VG_(free_queue_volume), VG_(free_queue_length));
+   if (MC_(clo_freelist_discard_vol) > 0)
+      MC_(print_discarded_freelist_stats)();
    VG_(message)(Vg_DebugMsg,
       " memcheck: sanity checks: %d cheap, %d expensive\n",
       n_sanity_cheap, n_sanity_expensive );
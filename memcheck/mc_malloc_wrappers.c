@@ -94,9 +94,21 @@ void delete_MC_Chunk (MC_Chunk* mc);
    This allows a client to allocate and free big blocks
    (e.g. bigger than VG_(clo_freelist_vol)) without losing
    immediately all protection against dangling pointers.
-   position [0] is for big blocks, [1] is for small blocks. */
-static MC_Chunk* freed_list_start[2]  = {NULL, NULL};
-static MC_Chunk* freed_list_end[2]    = {NULL, NULL};
+   position [0] is for big blocks, [1] is for small blocks.
+
+   With --freelist-discard-vol, the big blocks go instead in a third
+   list, position [2], after their pages have been given back to the
+   kernel.  They keep their address range and MC_Chunk, so that
+   accesses to them are still reported with their allocation and free
+   stacks, but cost almost no memory.  This list has its own limit,
+   MC_(clo_freelist_discard_vol), and does not count in
+   VG_(free_queue_volume). */
+static MC_Chunk* freed_list_start[3]  = {NULL, NULL, NULL};
+static MC_Chunk* freed_list_end[3]    = {NULL, NULL, NULL};
+
+static Long discarded_queue_volume = 0;
+static Long discarded_queue_length = 0;
+static Long discarded_bytes        = 0; // given back to the kernel
 
 /* Put a shadow chunk on the freed blocks queue, possibly freeing up
    some of the oldest blocks in the queue at the same time. */
@@ -105,6 +117,22 @@ static void add_to_freed_queue ( MC_Chunk* mc )
    const Bool show = False;
    const int l = (mc->szB >= MC_(clo_freelist_big_blocks) ? 0 : 1);
 
+   if (l == 0 && MC_(clo_freelist_discard_vol) > 0
+       && MC_AllocCustom != mc->allockind
+       && MC_(clo_free_fill) == -1) {
+      discarded_bytes += VG_(cli_discard_pages)( (void*)mc->data, mc->szB );
+      mc->next = NULL;
+      if (freed_list_end[2] == NULL) {
+         freed_list_start[2] = mc;
+      } else {
+         freed_list_end[2]->next = mc;
+      }
+      freed_list_end[2] = mc;
+      discarded_queue_volume += (Long)mc->szB;
+      discarded_queue_length++;
+      return;
+   }
+
    /* Put it at the end of the freed list, unless the block
       would be directly released any way : in this case, we
       put it at the head of the freed list. */
@@ -172,10 +200,39 @@ static void release_oldest_block(void)
    }
 }
 
+/* Release the oldest blocks of the discarded list to bring its volume
+   below MC_(clo_freelist_discard_vol). */
+static void release_oldest_discarded_blocks(void)
+{
+   while (discarded_queue_volume > MC_(clo_freelist_discard_vol)) {
+      MC_Chunk* mc1 = freed_list_start[2];
+
+      tl_assert(mc1 != NULL);
+      discarded_queue_volume -= (Long)mc1->szB;
+      discarded_queue_length--;
+      freed_list_start[2] = mc1->next;
+      if (freed_list_start[2] == NULL)
+         freed_list_end[2] = NULL;
+      mc1->next = NULL; /* just paranoia */
+
+      VG_(cli_free) ( (void*)(mc1->data) );
+      delete_MC_Chunk ( mc1 );
+   }
+}
+
+void MC_(print_discarded_freelist_stats) ( void )
+{
+   VG_(message)(Vg_DebugMsg,
+                " memcheck: discarded freelist: vol %lld length %lld, "
+                "%lld bytes given back to the kernel\n",
+                discarded_queue_volume, discarded_queue_length,
+                discarded_bytes);
+}
+
 MC_Chunk* MC_(get_freed_block_bracketting) (Addr a)
 {
    int i;
-   for (i = 0; i < 2; i++) {
+   for (i = 0; i < 3; i++) {
       MC_Chunk*  mc;
       mc = freed_list_start[i];
       while (mc) {
@@ -210,6 +267,8 @@ MC_Chunk* create_MC_Chunk ( ThreadId tid, Addr p, SizeT szB,
       if the free list volume is exceeded. */
    if (VG_(free_queue_volume) > MC_(clo_freelist_vol))
       release_oldest_block();
+   if (discarded_queue_volume > MC_(clo_freelist_discard_vol))
+      release_oldest_discarded_blocks();
 
    /* Paranoia ... ensure the MC_Chunk is off-limits to the client, so
       the mc->data field isn't visible to the leak checker.  If memory
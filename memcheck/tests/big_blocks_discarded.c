@@ -0,0 +1,35 @@
+#include <stdlib.h>
+#include <string.h>
+/* To be run with --freelist-vol=100000 --freelist-big-blocks=50000
+   --freelist-discard-vol=10000000 */
+static void jumped(void)
+{
+   ;
+}
+int main(int argc, char *argv[])
+{
+   char *big[8];
+   char *small;
+   int i;
+
+   /* Big blocks, much bigger than the free list: they are kept in the
+      queue of discarded blocks. */
+   for (i = 0; i < 8; i++) {
+      big[i] = malloc (1000015);
+      memset (big[i], 0x1, 1000015);
+      free (big[i]);
+   }
+
+   /* Small blocks still go through the normal free list. */
+   small = malloc (10000);
+   free (small);
+   small = malloc (10000);
+   free (small);
+
+   /* All these dangling pointers are still found, with the stack
+      of the free. */
+   if (big[0][10] > 0x0) jumped();
+   if (big[0][500000] > 0x0) jumped();
+   if (big[7][1000014] > 0x0) jumped();
+   return 0;
+}
@@ -0,0 +1,38 @@
+/* Like cdebug.c, but with enough debug info for the linker to compress
+   it: a section is left uncompressed if that would not make it
+   smaller, and zstd has a bigger header than zlib. */
+
+struct vec { int x, y, z; };
+
+static int dot ( struct vec* a, struct vec* b )
+{
+   int r = a->x * b->x;
+   r += a->y * b->y;
+   r += a->z * b->z;
+   return r;
+}
+
+static void scale ( struct vec* a, int k )
+{
+   a->x *= k;
+   a->y *= k;
+   a->z *= k;
+}
+
+static void add ( struct vec* a, struct vec* b )
+{
+   a->x += b->x;
+   a->y += b->y;
+   a->z += b->z;
+}
+
+int main ( void )
+{
+   struct vec a = { 1, 2, 3 };
+   int x;
+   scale(&a, 2);
+   add(&a, &a);
+   if (dot(&a, &a) == 0) return 2;
+   if (x) return 1;
+   return 0;
+}
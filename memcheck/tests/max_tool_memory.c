@@ -0,0 +1,35 @@
+/* Frees a lot of memory with a --max-tool-memory limit low enough for
+   Valgrind to give back memory while the program runs.  The errors
+   found before and after that must be reported as usual: in particular
+   an access to a freed block must still be reported as such. */
+
+#include <stdlib.h>
+#include <string.h>
+
+int main ( void )
+{
+   int   i;
+   int   x = 0;
+   char* p;
+   char* volatile freed;
+
+   freed = malloc(10);
+   free(freed);
+   x += freed[0];
+
+   for (i = 0; i < 1000; i++) {
+      p = malloc(100000);
+      memset(p, i, 100000);
+      free(p);
+   }
+
+   freed = malloc(10);
+   free(freed);
+   x += freed[0];
+
+   p = malloc(10);
+   if (p[0])
+      x++;
+   free(p);
+   return x & 1;
+}
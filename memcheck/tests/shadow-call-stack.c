@@ -0,0 +1,75 @@
+// Check that the stack traces taken with --shadow-call-stack=yes are
+// right after recursion, a longjmp, and in a signal handler.  Each
+// trace has at most 5 frames (the --num-callers value), so that the
+// one taken in the handler stops short of the signal frame and the C
+// library functions beyond it.
+
+#include <setjmp.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../memcheck.h"
+
+static char pool[4096];
+static char* next = pool;
+static jmp_buf jb;
+
+// Blocks are described with client requests so that the stack traces
+// do not depend on how malloc is replaced.
+__attribute__((noinline)) void leak ( int szB )
+{
+   VALGRIND_MALLOCLIKE_BLOCK(next, szB, 0, 0);
+   next += 64;
+}
+
+__attribute__((noinline)) void rec ( int depth, int szB )
+{
+   if (depth == 0)
+      leak(szB);
+   else
+      rec(depth - 1, szB);
+   __asm__ __volatile__("" ::: "memory");
+}
+
+__attribute__((noinline)) void jump ( int depth )
+{
+   if (depth == 0) {
+      leak(2);
+      longjmp(jb, 1);
+   }
+   jump(depth - 1);
+   __asm__ __volatile__("" ::: "memory");
+}
+
+__attribute__((noinline)) void after_jump ( void )
+{
+   leak(3);
+}
+
+static void handler ( int sig )
+{
+   rec(2, 4);
+}
+
+__attribute__((noinline)) void in_signal ( void )
+{
+   raise(SIGUSR1);
+   leak(5);
+}
+
+int main ( void )
+{
+   struct sigaction sa;
+
+   memset(&sa, 0, sizeof sa);
+   sa.sa_handler = handler;
+   sigaction(SIGUSR1, &sa, NULL);
+
+   rec(2, 1);
+   if (!setjmp(jb))
+      jump(2);
+   after_jump();
+   in_signal();
+   rec(1, 6);
+   return 0;
+}
@@ -0,0 +1,74 @@
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pub_core_basics.h"
+
+// Crudely redirect various VG_(foo)() functions to their libc equivalents.
+#define vgPlain_malloc(cc,n)           malloc(n)
+#define vgPlain_free                   free
+#define vgPlain_memset                 memset
+#define vgPlain_memcpy                 memcpy
+
+#include "coregrind/m_debuginfo/tzstd.c"
+
+// The text below, compressed by "zstd -19 --no-check" reading from a
+// pipe, so the frame has a window descriptor and no content size.
+static const char text[] =
+   "Valgrind reads zstd-compressed debug sections.  "
+   "Valgrind reads zlib-compressed debug sections too.  "
+   "Both are decompressed lazily, on first access.\n";
+
+static const UChar frame[] = {
+   0x28, 0xb5, 0x2f, 0xfd, 0x00, 0x68, 0xbd, 0x02, 0x00, 0xe2, 0x45, 0x12,
+   0x12, 0x90, 0xcf, 0x01, 0x98, 0x0c, 0x2d, 0xd6, 0x19, 0x21, 0x83, 0x51,
+   0xff, 0x4d, 0xfe, 0xc7, 0xd8, 0x27, 0x74, 0x60, 0x74, 0x33, 0x42, 0xe6,
+   0xb4, 0x67, 0x53, 0x87, 0xf1, 0xc1, 0xba, 0x76, 0x8d, 0xe3, 0x74, 0x9e,
+   0xe6, 0x8c, 0x46, 0xf2, 0x8f, 0x18, 0xe9, 0x4f, 0x73, 0xff, 0x68, 0x18,
+   0x1b, 0x45, 0xdc, 0x5f, 0xf5, 0x70, 0x7a, 0xe2, 0x6e, 0x9e, 0xf2, 0x45,
+   0x24, 0x12, 0xed, 0xfb, 0x4e, 0x86, 0xe7, 0x13, 0x6c, 0x73, 0x39, 0x53,
+   0x02, 0x03, 0x00, 0x9c, 0x32, 0x02, 0xb0, 0x1d, 0x4c, 0x44, 0xed, 0x01
+};
+
+// A frame header cut short before its window descriptor.
+static const UChar truncated_header[] = { 0x28, 0xb5, 0x2f, 0xfd, 0x00 };
+
+static char out[1024];
+
+// Decompress the first 'len' bytes of 'in' from a block of exactly that
+// size, so that Memcheck reports any read past its end.
+static SizeT decompress(const UChar* in, SizeT len)
+{
+   UChar* buf = malloc(len);
+   SizeT res;
+   assert(buf != NULL);
+   memcpy(buf, in, len);
+   res = tzstd_decompress_mem_to_mem(out, sizeof(out), buf, len);
+   free(buf);
+   return res;
+}
+
+int main(void)
+{
+   SizeT len;
+
+   // The whole frame decompresses to the original text.
+   assert(decompress(frame, sizeof(frame)) == strlen(text));
+   assert(memcmp(out, text, strlen(text)) == 0);
+
+   // Truncated input is rejected without reading beyond it.
+   assert(decompress(truncated_header, sizeof(truncated_header))
+          == TZSTD_DECOMPRESS_MEM_TO_MEM_FAILED);
+   for (len = 1; len < sizeof(frame); len++)
+      assert(decompress(frame, len) == TZSTD_DECOMPRESS_MEM_TO_MEM_FAILED);
+
+   // Output too small for the content is rejected.
+   assert(tzstd_decompress_mem_to_mem(out, strlen(text) - 1,
+                                      frame, sizeof(frame))
+          == TZSTD_DECOMPRESS_MEM_TO_MEM_FAILED);
+
+   printf("ok\n");
+   return 0;
+}
@@ -0,0 +1,31 @@
+/* Takes the same stack trace twice, so that with --unwind=auto the
+   second one uses the outcome of the check made by the first. */
+
+#include "../../../include/valgrind.h"
+
+__attribute__((noinline))
+static void unwind_3 ( int n )
+{
+   VALGRIND_PRINTF_BACKTRACE("trace %d\n", n);
+}
+
+__attribute__((noinline))
+static void unwind_2 ( int n )
+{
+   unwind_3(n);
+}
+
+__attribute__((noinline))
+static void unwind_1 ( int n )
+{
+   unwind_2(n);
+}
+
+int main ( void )
+{
+   int i;
+
+   for (i = 0; i < 2; i++)
+      unwind_1(i);
+   return 0;
+}
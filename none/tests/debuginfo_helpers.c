@@ -0,0 +1,18 @@
+/* The stack trace below goes through 8 compilation units, which gives
+   --debuginfo-helpers=1 a part of the units to read.  The symbols,
+   line numbers and unwinding must be the same as without helpers. */
+
+#include "../../include/valgrind.h"
+
+extern void dih_1(int n);
+
+void dih_end(int n)
+{
+   VALGRIND_PRINTF_BACKTRACE("depth %d\n", n);
+}
+
+int main(void)
+{
+   dih_1(1);
+   return 0;
+}
@@ -0,0 +1,8 @@
+/* Part of the debuginfo_helpers test. */
+
+extern void dih_2(int n);
+
+void dih_1(int n)
+{
+   dih_2(n + 1);
+}
@@ -0,0 +1,8 @@
+/* Part of the debuginfo_helpers test. */
+
+extern void dih_3(int n);
+
+void dih_2(int n)
+{
+   dih_3(n + 1);
+}
@@ -0,0 +1,8 @@
+/* Part of the debuginfo_helpers test. */
+
+extern void dih_4(int n);
+
+void dih_3(int n)
+{
+   dih_4(n + 1);
+}
@@ -0,0 +1,8 @@
+/* Part of the debuginfo_helpers test. */
+
+extern void dih_5(int n);
+
+void dih_4(int n)
+{
+   dih_5(n + 1);
+}
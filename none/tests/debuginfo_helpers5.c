@@ -0,0 +1,8 @@
+/* Part of the debuginfo_helpers test. */
+
+extern void dih_6(int n);
+
+void dih_5(int n)
+{
+   dih_6(n + 1);
+}
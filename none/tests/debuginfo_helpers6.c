@@ -0,0 +1,8 @@
+/* Part of the debuginfo_helpers test. */
+
+extern void dih_7(int n);
+
+void dih_6(int n)
+{
+   dih_7(n + 1);
+}
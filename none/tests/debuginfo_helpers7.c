@@ -0,0 +1,8 @@
+/* Part of the debuginfo_helpers test. */
+
+extern void dih_end(int n);
+
+void dih_7(int n)
+{
+   dih_end(n + 1);
+}
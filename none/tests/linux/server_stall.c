@@ -0,0 +1,62 @@
+/* Connect to a Valgrind --server and send it part of a request, with
+   more fds than it needs.  Then print the pid of a child that keeps
+   the connection open until killed.  The server must keep serving
+   other clients meanwhile. */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+int main(int argc, char **argv)
+{
+   struct sockaddr_un addr;
+   struct msghdr      msg;
+   struct iovec       iov;
+   struct cmsghdr     *cmsg;
+   char               cbuf[CMSG_SPACE(5 * sizeof(int))];
+   int                fds[5];
+   unsigned int       magic = 0x315a4756;   /* VG_ZYGOTE_MAGIC */
+   int                sd, i;
+   pid_t              pid;
+
+   if (argc != 2 || strlen(argv[1]) >= sizeof(addr.sun_path))
+      return 1;
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strcpy(addr.sun_path, argv[1]);
+   sd = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (sd < 0 || connect(sd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+      return 1;
+
+   for (i = 0; i < 5; i++)
+      fds[i] = open("/dev/null", O_RDWR);
+
+   iov.iov_base = &magic;
+   iov.iov_len  = sizeof(magic);
+   memset(&msg, 0, sizeof(msg));
+   msg.msg_iov        = &iov;
+   msg.msg_iovlen     = 1;
+   msg.msg_control    = cbuf;
+   msg.msg_controllen = sizeof(cbuf);
+   cmsg = CMSG_FIRSTHDR(&msg);
+   cmsg->cmsg_level = SOL_SOCKET;
+   cmsg->cmsg_type  = SCM_RIGHTS;
+   cmsg->cmsg_len   = CMSG_LEN(sizeof(fds));
+   memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+   if (sendmsg(sd, &msg, 0) != sizeof(magic))
+      return 1;
+
+   pid = fork();
+   if (pid < 0)
+      return 1;
+   if (pid == 0) {
+      close(1);
+      pause();
+      return 0;
+   }
+   printf("%d\n", (int)pid);
+   return 0;
+}
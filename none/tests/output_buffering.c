@@ -0,0 +1,30 @@
+/* Valgrind's output to a log file is buffered.  Check that it is the
+   same as without buffering, including the output of a forked child
+   writing to the same file. */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "../../include/valgrind.h"
+
+int main(void)
+{
+   pid_t pid;
+   int   i;
+
+   for (i = 0; i < 100; i++)
+      VALGRIND_PRINTF("parent, before fork: %d\n", i);
+
+   pid = fork();
+   if (pid == 0) {
+      for (i = 0; i < 100; i++)
+         VALGRIND_PRINTF("child: %d\n", i);
+      exit(0);
+   }
+   waitpid(pid, NULL, 0);
+
+   for (i = 0; i < 100; i++)
+      VALGRIND_PRINTF("parent, after fork: %d\n", i);
+   return 0;
+}
@@ -5,9 +5,8 @@
    to each other otherwise the memory manager will coalesce them
    into a single one. So they are one page apart.
 
-   NOTE: Valgrind's internal limit VG_N_SEGMENTS must be at least
-   140000 otherwise you get a fatal error similar to this one:
-       "FATAL: VG_N_SEGMENTS is too low."
+   NOTE: Valgrind's segment array has to grow several times to track
+   all of these (it starts out with room for 30000 segments).
 
    Test case passes successfully if the number of segments is
    correctly displayed in elfdump output:
@@ -0,0 +1,33 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+// This test touches a large heap block at pseudo-random places, so
+// that most accesses to the block -- and, under a tool, to its shadow
+// memory -- miss in the TLB.  Comparing the big-footprint and
+// big-footprint_huge runs shows the effect of --huge-pages.
+
+#define FOOTPRINT_MB  512
+#define N_ACCESSES    20000000
+
+int main(void)
+{
+   size_t        n = (size_t)FOOTPRINT_MB << 20;
+   unsigned char* p = malloc(n);
+   unsigned int  x = 1;
+   unsigned long sum = 0;
+   size_t        i;
+
+   if (p == NULL) {
+      perror("malloc");
+      return 1;
+   }
+   for (i = 0; i < n; i += 4096)
+      p[i] = (unsigned char)i;
+   for (i = 0; i < N_ACCESSES; i++) {
+      x = x * 1103515245 + 12345;
+      sum += p[(x >> 2) % n]++;
+   }
+   free(p);
+   printf("%s\n", sum != 0 ? "done" : "odd");
+   return 0;
+}
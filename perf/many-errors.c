@@ -0,0 +1,54 @@
+// Performance test for the error manager: every invalid read below is
+// reported from a different pair of innermost frames, so even once the
+// error manager falls back to comparing only the top two frames of the
+// errors (after 100 of them), the run records 320 * 320 = 102400
+// distinct error contexts.  Searching them linearly for duplicates made
+// recording them quadratic.  Run with --error-limit=no, otherwise
+// Valgrind stops recording errors after the first 1000.
+
+#include <stdlib.h>
+
+// 320 different read instructions, all past the end of p[0] ...
+#define R1(n)    case (n): return p[(n)+1];
+#define R4(n)    R1(n) R1((n)+1) R1((n)+2) R1((n)+3)
+#define R16(n)   R4(n) R4((n)+4) R4((n)+8) R4((n)+12)
+#define R64(n)   R16(n) R16((n)+16) R16((n)+32) R16((n)+48)
+#define R320(n)  R64(n) R64((n)+64) R64((n)+128) R64((n)+192) R64((n)+256)
+
+// ... each called from 320 different call sites.  Using the result
+// differently after each call keeps the compiler from merging them.
+#define C1(n)    case (n): return read_at(j, p) * ((n)+1);
+#define C4(n)    C1(n) C1((n)+1) C1((n)+2) C1((n)+3)
+#define C16(n)   C4(n) C4((n)+4) C4((n)+8) C4((n)+12)
+#define C64(n)   C16(n) C16((n)+16) C16((n)+32) C16((n)+48)
+#define C320(n)  C64(n) C64((n)+64) C64((n)+128) C64((n)+192) C64((n)+256)
+
+__attribute__((noinline))
+static int read_at(int j, volatile char* p)
+{
+   switch (j) {
+      R320(0)
+   }
+   return 0;
+}
+
+__attribute__((noinline))
+static int call_from(int k, int j, volatile char* p)
+{
+   switch (k) {
+      C320(0)
+   }
+   return 0;
+}
+
+int main(void)
+{
+   int k, j, sum = 0;
+   volatile char* p = malloc(1);
+
+   for (k = 0; k < 320; k++)
+      for (j = 0; j < 320; j++)
+         sum += call_from(k, j, p);
+
+   return sum == 12345 ? 1 : 0;
+}
@@ -0,0 +1,41 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// This test does a lot of mmap/munmap calls while keeping many small
+// mappings live at once.  Consecutive mappings alternate their
+// protection so that adjacent ones cannot be merged, which means
+// Valgrind's address space manager has to track one segment per live
+// mapping -- more than the old fixed limit of 30000 segments.
+
+#define N_LIVE   50000
+#define N_MMAPS  1000000
+
+int main(void)
+{
+   long   pagesz = sysconf(_SC_PAGESIZE);
+   char** live   = calloc(N_LIVE, sizeof(char*));
+   int    i, slot;
+
+   for (i = 0; i < N_MMAPS; i++) {
+      slot = i % N_LIVE;
+      if (live[slot] != NULL && munmap(live[slot], pagesz) != 0) {
+         perror("munmap");
+         return 1;
+      }
+      live[slot] = mmap(NULL, pagesz,
+                        (i & 1) ? PROT_READ : PROT_READ|PROT_WRITE,
+                        MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+      if (live[slot] == MAP_FAILED) {
+         perror("mmap");
+         return 1;
+      }
+   }
+
+   for (slot = 0; slot < N_LIVE; slot++)
+      munmap(live[slot], pagesz);
+   free(live);
+   printf("done\n");
+   return 0;
+}